@@ -141,7 +141,7 @@ bool analog_read_all_values()
 void analog_heartbeat(void)
 {
     static uint32_t last_read_ms = 0;
-    if (millis() - last_read_ms > 100) {
+    if (millis() - last_read_ms >= 100) {
         last_read_ms = millis();
         analog_read_all_values();
         if (last_read_ms > 0) {
@@ -0,0 +1,68 @@
+#include "can_ingest.h"
+#include "can_rcv_buffer.h"
+#include "sotscon.h"
+#include <xc.h>
+#include <string.h> // for memcpy
+
+/*
+ * All of the counters live in one struct so that can_ingest_get_stats can copy
+ * them out with interrupts disabled. backlog, backlog_high_water and
+ * frames_dropped are written from the ISR, everything else from the main loop.
+ */
+static volatile can_ingest_stats_t stats;
+
+void init_can_ingest(void)
+{
+    memset((void *) &stats, 0, sizeof(stats));
+}
+
+void can_ingest_push(const can_msg_t *msg)
+{
+    if (rcvb_is_full()) {
+        stats.frames_dropped++;
+        return;
+    }
+
+    rcvb_push_message(msg);
+    stats.backlog++;
+    if (stats.backlog > stats.backlog_high_water) {
+        stats.backlog_high_water = stats.backlog;
+    }
+}
+
+uint8_t can_ingest_run(uint8_t budget)
+{
+    uint8_t processed = 0;
+    can_msg_t msg;
+
+    while (processed < budget && !rcvb_is_empty()) {
+        rcvb_pop_message(&msg);
+        // a single decrement of an 8 bit value is one instruction, so this
+        // can't be torn by the receive interrupt incrementing it
+        stats.backlog--;
+        handle_incoming_can_message(&msg);
+        ++processed;
+    }
+
+    if (processed > 0) {
+        stats.batches++;
+        stats.frames_processed += processed;
+        stats.last_batch_size = processed;
+        if (processed > stats.max_batch_size) {
+            stats.max_batch_size = processed;
+        }
+    }
+
+    return processed;
+}
+
+void can_ingest_get_stats(can_ingest_stats_t *out)
+{
+    // frames_dropped is 16 bits and written from the ISR, so don't let the
+    // ISR run halfway through the copy. Interrupts might already be off, in
+    // which case they stay off
+    uint8_t gie = INTCON0bits.GIE;
+    INTCON0bits.GIE = 0;
+    memcpy(out, (const void *) &stats, sizeof(*out));
+    INTCON0bits.GIE = gie;
+}
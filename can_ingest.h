@@ -0,0 +1,65 @@
+#ifndef CAN_INGEST_H_
+#define CAN_INGEST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "can.h"
+
+/*
+ * This module sits between the CAN driver's receive callback and
+ * handle_incoming_can_message. The callback (ISR context) pushes every
+ * received message into canlib's can_rcv_buffer through can_ingest_push, and
+ * the main loop drains that buffer in batches with can_ingest_run. Along the
+ * way we keep some counters so that we can tell whether the receive buffer is
+ * keeping up with the traffic on the bus.
+ */
+
+/*
+ * The most messages that can_ingest_run will hand to
+ * handle_incoming_can_message in one call, if the caller doesn't have a
+ * better idea. The receive buffer holds 10 messages, so this drains half of a
+ * full buffer per pass through the main loop without starving the radio.
+ */
+#define CAN_INGEST_DEFAULT_BUDGET 5
+
+typedef struct {
+    // number of calls to can_ingest_run that processed at least one message
+    uint32_t batches;
+    // total number of messages handed to handle_incoming_can_message
+    uint32_t frames_processed;
+    // messages that arrived while the receive buffer was full
+    uint16_t frames_dropped;
+    // size of the most recent nonempty batch, and the largest batch ever
+    uint8_t last_batch_size;
+    uint8_t max_batch_size;
+    // messages waiting in the receive buffer right now, and the most that have
+    // ever been waiting at once
+    uint8_t backlog;
+    uint8_t backlog_high_water;
+} can_ingest_stats_t;
+
+/*
+ * Call this function at bootup, after rcvb_init. Resets all counters
+ */
+void init_can_ingest(void);
+
+/*
+ * Call this from the CAN receive callback with every message. If the receive
+ * buffer is full, the message is dropped and counted. Safe to call from an
+ * interrupt context, not safe to call from anywhere else.
+ */
+void can_ingest_push(const can_msg_t *msg);
+
+/*
+ * Pops up to budget messages out of the receive buffer and hands each of them
+ * to handle_incoming_can_message. Returns the number of messages processed.
+ * Don't call this from an interrupt context.
+ */
+uint8_t can_ingest_run(uint8_t budget);
+
+/*
+ * Copies a consistent snapshot of the ingestion counters into stats
+ */
+void can_ingest_get_stats(can_ingest_stats_t *stats);
+
+#endif
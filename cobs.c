@@ -0,0 +1,53 @@
+#include "cobs.h"
+
+uint8_t cobs_encode(const uint8_t *src, uint8_t len, uint8_t *dst)
+{
+    // code_idx is where the code byte for the block we're in goes. It gets
+    // filled in once we know how long the block is
+    uint8_t code_idx = 0;
+    uint8_t out = 1;
+    uint8_t code = 1;
+    uint8_t i;
+    for (i = 0; i < len; ++i) {
+        if (src[i] == 0) {
+            dst[code_idx] = code;
+            code_idx = out++;
+            code = 1;
+        } else {
+            dst[out++] = src[i];
+            if (++code == 0xff) {
+                // a full block, which doesn't imply a zero after it
+                dst[code_idx] = code;
+                code_idx = out++;
+                code = 1;
+            }
+        }
+    }
+    dst[code_idx] = code;
+    return out;
+}
+
+bool cobs_decode(const uint8_t *src, uint8_t len, uint8_t *dst, uint8_t *decoded_len)
+{
+    uint8_t in = 0;
+    uint8_t out = 0;
+    while (in < len) {
+        uint8_t code = src[in++];
+        if (code == 0 || code - 1 > len - in) {
+            return false;
+        }
+        uint8_t i;
+        for (i = 1; i < code; ++i) {
+            if (src[in] == 0) {
+                return false;
+            }
+            dst[out++] = src[in++];
+        }
+        // every block but a full one or the last one stands for a zero
+        if (code != 0xff && in < len) {
+            dst[out++] = 0;
+        }
+    }
+    *decoded_len = out;
+    return true;
+}
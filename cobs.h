@@ -0,0 +1,45 @@
+#ifndef COBS_H_
+#define COBS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Consistent Overhead Byte Stuffing. Encodes a buffer of arbitrary bytes so
+ * that the result has no zero bytes in it, which leaves 0x00 free to mark
+ * the end of each frame on a byte stream. The overhead is one byte, plus one
+ * more for every 254 bytes of input, so for our frames it's always exactly
+ * one byte.
+ *
+ * Neither function adds or expects the 0x00 delimiter, that's up to the
+ * caller.
+ */
+
+/*
+ * The most bytes that cobs_encode can produce from len bytes of input
+ */
+#define COBS_MAX_ENCODED_LEN(len) ((len) + ((len) / 254) + 1)
+
+/*
+ * The most bytes cobs_encode can take, so that what it produces still fits
+ * in a uint8_t length
+ */
+#define COBS_MAX_LEN 253
+
+/*
+ * Encodes len bytes of src into dst, which must have room for
+ * COBS_MAX_ENCODED_LEN(len) bytes. len must be at most COBS_MAX_LEN.
+ * Returns the number of bytes written to dst, none of which are 0x00.
+ */
+uint8_t cobs_encode(const uint8_t *src, uint8_t len, uint8_t *dst);
+
+/*
+ * Decodes len bytes of src (without the delimiter) into dst, which must have
+ * room for len bytes. The decoded length is written to decoded_len. Returns
+ * false if src isn't valid COBS (it has a zero in it, or a code byte that
+ * points past the end), in which case the contents of dst are undefined.
+ * src and dst may be the same buffer.
+ */
+bool cobs_decode(const uint8_t *src, uint8_t len, uint8_t *dst, uint8_t *decoded_len);
+
+#endif
@@ -4,21 +4,47 @@
 #include "can_tx_buffer.h"
 #include "pic18_time.h"
 
-static char
-err_msg_ring_buf[ERROR_MESSAGE_RING_BUFFER_SIZE][ERROR_COMMAND_LENGTH];
+static error_record_t err_msg_ring_buf[ERROR_MESSAGE_RING_BUFFER_SIZE];
 
 static uint8_t err_msg_buf_size = 0;
 static uint8_t err_msg_buf_write = 0;
 static uint8_t err_msg_buf_read = 0;
 
+static error_stats_t stats;
+
+static void count(uint16_t *counter)
+{
+    if (*counter < UINT16_MAX) {
+        ++*counter;
+    }
+}
+
+static bool same_error(const error_t *a, const error_t *b)
+{
+    return a->board_id == b->board_id && a->err_type == b->err_type &&
+           a->byte4 == b->byte4 && a->byte5 == b->byte5 &&
+           a->byte6 == b->byte6 && a->byte7 == b->byte7;
+}
+
+// the waiting error that err is a repeat of, or NULL if it's new
+static error_record_t *find_pending(const error_t *err)
+{
+    uint8_t i;
+    for (i = 0; i < err_msg_buf_size; ++i) {
+        error_record_t *record =
+            &err_msg_ring_buf[(err_msg_buf_read + i) % ERROR_MESSAGE_RING_BUFFER_SIZE];
+        if (same_error(&record->err, err)) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
 void report_error(uint8_t board_id,
                   enum BOARD_STATUS error_type,
                   uint8_t byte4, uint8_t byte5,
                   uint8_t byte6, uint8_t byte7)
 {
-    // Check if the buffer is full
-    if (err_msg_buf_size == ERROR_MESSAGE_RING_BUFFER_SIZE)
-        return;
     error_t err;
     err.board_id = board_id;
     err.err_type = error_type;
@@ -26,12 +52,29 @@ void report_error(uint8_t board_id,
     err.byte5 = byte5;
     err.byte6 = byte6;
     err.byte7 = byte7;
+    count(&stats.reported);
 
-    char *serialized_error = err_msg_ring_buf[err_msg_buf_write];
-    serialize_error(&err, serialized_error);
-    ++err_msg_buf_size;
-    ++err_msg_buf_write;
-    err_msg_buf_write %= ERROR_MESSAGE_RING_BUFFER_SIZE;
+    error_record_t *record = find_pending(&err);
+    if (record != NULL) {
+        if (record->count < UINT8_MAX) {
+            ++record->count;
+        }
+        record->last_ms = millis();
+        count(&stats.coalesced);
+    } else if (err_msg_buf_size == ERROR_MESSAGE_RING_BUFFER_SIZE) {
+        count(&stats.dropped);
+    } else {
+        record = &err_msg_ring_buf[err_msg_buf_write];
+        record->err = err;
+        record->count = 1;
+        record->last_ms = millis();
+        ++err_msg_buf_size;
+        ++err_msg_buf_write;
+        err_msg_buf_write %= ERROR_MESSAGE_RING_BUFFER_SIZE;
+        if (err_msg_buf_size > stats.max_pending) {
+            stats.max_pending = err_msg_buf_size;
+        }
+    }
 
     //if this error was generated by the radio board, we should send the
     //error out over CAN so that logger has a chance to record it
@@ -47,13 +90,12 @@ void report_error(uint8_t board_id,
     }
 }
 
-bool get_next_serialized_error(char *output)
+bool get_next_error(error_record_t *output)
 {
     if (err_msg_buf_size == 0)
         return false;
 
-    char *serialized_error = err_msg_ring_buf[err_msg_buf_read];
-    memcpy(output, serialized_error, ERROR_COMMAND_LENGTH);
+    *output = err_msg_ring_buf[err_msg_buf_read];
 
     ++err_msg_buf_read;
     err_msg_buf_read %= ERROR_MESSAGE_RING_BUFFER_SIZE;
@@ -61,3 +103,17 @@ bool get_next_serialized_error(char *output)
 
     return true;
 }
+
+bool get_next_serialized_error(char *output)
+{
+    error_record_t record;
+    if (!get_next_error(&record))
+        return false;
+
+    return serialize_error(&record.err, output);
+}
+
+void get_error_stats(error_stats_t *output)
+{
+    *output = stats;
+}
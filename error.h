@@ -10,7 +10,7 @@
 // how long the char array you pass to get_next_serialized_error needs to be
 #define ERROR_COMMAND_LENGTH 8
 
-// How many error messages can be buffered at once
+// How many distinct error messages can be buffered at once
 #define ERROR_MESSAGE_RING_BUFFER_SIZE 16
 
 typedef struct {
@@ -22,11 +22,42 @@ typedef struct {
     uint8_t byte7;
 } error_t;
 
+/*
+ * An error waiting to go out, and how many times it's been reported since it
+ * was first buffered. Reports of an error that's already waiting (same board,
+ * type and payload) are merged into it rather than buffered again, so that a
+ * board repeating itself doesn't crowd out everyone else. RLCS gets the count
+ * and how long ago the last report was, see ERROR_REPORT_HEADER
+ */
+typedef struct {
+    error_t err;
+    uint8_t count;      // saturates at UINT8_MAX
+    uint32_t last_ms;   // millis() when it was last reported
+} error_record_t;
+
+typedef struct {
+    uint16_t reported;   // every call to report_error
+    uint16_t coalesced;  // reports merged into an error already waiting
+    uint16_t dropped;    // reports thrown away because the buffer was full
+    uint8_t max_pending; // most distinct errors waiting at once
+} error_stats_t;
+
 void report_error(uint8_t board_id,
                   enum BOARD_STATUS error_type,
                   uint8_t byte4, uint8_t byte5,
                   uint8_t byte6, uint8_t byte7);
 
+/*
+ * Takes the oldest error out of the buffer. Returns false if there isn't one
+ */
+bool get_next_error(error_record_t *output);
+
+/*
+ * Same as get_next_error, but gives just the error, serialized (see
+ * serialize_error) into ERROR_COMMAND_LENGTH characters
+ */
 bool get_next_serialized_error(char *output);
 
+void get_error_stats(error_stats_t *output);
+
 #endif
@@ -14,9 +14,32 @@
 #include "timing_util.h"
 #include "can_tx_buffer.h"
 #include "led_manager.h"
+#include "scheduler.h"
+#include "can_ingest.h"
+#include "perf_stats.h"
+#include "telemetry_history.h"
+#include "radio_mirror.h"
 
 #include <string.h>
 
+/*
+ * How often each of the heartbeat functions gets run by the scheduler, in
+ * milliseconds. These are the periods that each module actually cares about,
+ * they used to all be run every 10ms regardless
+ */
+#define BUS_POWER_PERIOD_MS    10
+#define ANALOG_PERIOD_MS       100
+#define TXB_PERIOD_MS          10
+#define RADIO_PERIOD_MS        10
+#define LED_MANAGER_PERIOD_MS  10
+// sotscon_heartbeat sends the injector command RLCS asks for, and already
+// rate limits itself, so it runs often enough to send it straight away
+#define SOTSCON_PERIOD_MS      10
+#define TIMEOUT_PERIOD_MS      10
+#define PERF_STATS_PERIOD_MS   PERF_STATS_CAN_PERIOD_MS
+#define TELEMETRY_PERIOD_MS    TELEM_RAW_PERIOD_MS
+#define RADIO_MIRROR_PERIOD_MS 10
+
 void can_message_callback(const can_msg_t *msg)
 {
     uint16_t message_type = get_message_type(msg);
@@ -30,13 +53,70 @@ void can_message_callback(const can_msg_t *msg)
         LED_3_OFF();
     }
 
-    rcvb_push_message(msg);
+    can_ingest_push(msg);
 }
 
 //enough space to buffer 10 CAN messages
 uint8_t can_receive_buffer[140];
 uint8_t can_transmit_buffer[140];
 
+/*
+ * There's no sense in sending CAN messages if the bus isn't powered. There's
+ * no one to hear them. So only run the sotscon heartbeat when it is
+ */
+static void sotscon_task(void)
+{
+    if (is_bus_powered()) {
+        sotscon_heartbeat();
+    }
+    // while the bus is powered down, the main loop slows timer0 down and
+    // spends nearly all its time asleep. See wait_for_work
+}
+
+/*
+ * Our own battery voltage doesn't arrive in a CAN message like everything
+ * else in the telemetry history, so sample it here, right before the history
+ * takes its raw sample
+ */
+static void telemetry_task(void)
+{
+    telemetry_record(TELEM_RADIO_BATT_MV, analog_get_vin_mv());
+    telemetry_history_heartbeat();
+}
+
+/*
+ * Puts the CPU into IDLE mode (core stopped, peripherals still clocked) until
+ * the next interrupt, but only if there's nothing for the main loop to do.
+ * Timer0 interrupts every 512us, so we never oversleep a task deadline by
+ * more than that.
+ *
+ * While the bus is unpowered, there's nothing to do except answer RLCS and
+ * keep an eye on the batteries, so timer0 gets slowed down to interrupt every
+ * 32ms instead (see timer0_set_low_power). That cuts the number of times we
+ * wake up by a factor of 64, and a UART byte still wakes us up immediately.
+ * We use IDLE rather than full SLEEP because the UART needs its clock to
+ * receive that byte; waking from SLEEP on a start bit would lose it.
+ *
+ * Interrupts are disabled while we check whether there's work, so that a byte
+ * or CAN message that arrives between the check and the SLEEP instruction
+ * can't leave us asleep with work pending. A pending interrupt still wakes the
+ * core with GIE clear, it just doesn't vector until we set GIE again.
+ */
+static void wait_for_work(void)
+{
+    timer0_set_low_power(!is_bus_powered());
+
+    INTCON0bits.GIE = 0;
+    if (!uart_byte_available() &&
+        rcvb_is_empty() &&
+        scheduler_ms_until_next_deadline() > 0) {
+        CPUDOZEbits.IDLEN = 1;
+        SLEEP();
+        NOP();
+    }
+    INTCON0bits.GIE = 1;
+}
+
 int main()
 {
     //initialization functions
@@ -47,12 +127,28 @@ int main()
     init_adc();
     init_timer0();
     init_interrupts();
+    init_radio_mirror();
     init_uart();
     LED_3_ON();
     init_sotscon();
     rcvb_init(can_receive_buffer, sizeof(can_receive_buffer));
+    init_can_ingest();
     txb_init(can_transmit_buffer, sizeof(can_transmit_buffer), &can_send, &can_send_rdy);
     init_led_manager();
+    init_perf_stats();
+    init_telemetry_history();
+
+    init_scheduler();
+    scheduler_add_task(&sotscon_task, SOTSCON_PERIOD_MS);
+    scheduler_add_task(&sotscon_timeout_heartbeat, TIMEOUT_PERIOD_MS);
+    scheduler_add_task(&bus_power_heartbeat, BUS_POWER_PERIOD_MS);
+    scheduler_add_task(&analog_heartbeat, ANALOG_PERIOD_MS);
+    scheduler_add_task(&txb_heartbeat, TXB_PERIOD_MS);
+    scheduler_add_task(&radio_heartbeat, RADIO_PERIOD_MS);
+    scheduler_add_task(&led_manager_heartbeat, LED_MANAGER_PERIOD_MS);
+    scheduler_add_task(&perf_stats_heartbeat, PERF_STATS_PERIOD_MS);
+    scheduler_add_task(&telemetry_task, TELEMETRY_PERIOD_MS);
+    scheduler_add_task(&radio_mirror_heartbeat, RADIO_MIRROR_PERIOD_MS);
 
     LED_1_OFF();
     LED_2_OFF();
@@ -68,34 +164,33 @@ int main()
 
     //program loop
     while (1) {
+        // time spent asleep in wait_for_work isn't counted
+        uint32_t loop_start_us = micros();
+        uint32_t section_start_us;
+
+        // Take everything the UART has for us, not just one byte, so that a
+        // burst from the radio doesn't have to wait a loop per byte and
+        // overflow the receive buffer. This ends, since we get through bytes
+        // a lot faster than the radio can send them
         if (uart_byte_available()) {
-            radio_handle_input_character(uart_read_byte());
+            section_start_us = micros();
+            do {
+                radio_handle_input_character(uart_read_byte());
+            } while (uart_byte_available());
+            perf_stats_record(PERF_SLOT_RADIO_INPUT, micros() - section_start_us);
         }
 
         // We check for CAN messages regardless of whether the bus is powered.
         // It's possible that the debug board is trying to tell us something,
         // and we should really listen to that
-        if (!rcvb_is_empty()) {
-            can_msg_t msg;
-            rcvb_pop_message(&msg);
-            handle_incoming_can_message(&msg);
-        }
-
-        if (is_bus_powered()) {
-            // There's no sense in sending CAN messages if the bus isn't
-            // powered. There's no one to hear them
-            sotscon_heartbeat();
-        } else {
-            // TODO, what should the radio board do while the bus is powered
-            // down? The ADC stuff I guess?
+        section_start_us = micros();
+        if (can_ingest_run(CAN_INGEST_DEFAULT_BUDGET) > 0) {
+            perf_stats_record(PERF_SLOT_CAN_INGEST, micros() - section_start_us);
         }
 
-        bus_power_heartbeat();
-        analog_heartbeat();
-        txb_heartbeat();
-        radio_heartbeat();
-        led_manager_heartbeat();
-        __delay_ms(10);
+        scheduler_run_due_tasks();
+        perf_stats_record(PERF_SLOT_LOOP, micros() - loop_start_us);
+        wait_for_work();
     }
 
     //unreachable
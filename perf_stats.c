@@ -0,0 +1,115 @@
+#include "perf_stats.h"
+#include "pic18_time.h"
+#include "bus_power.h"
+#include "can_common.h"
+#include "message_types.h"
+#include "can_tx_buffer.h"
+#include <string.h>
+
+static perf_stat_t slots[PERF_NUM_SLOTS];
+
+// the slot that perf_stats_heartbeat will send next
+static uint8_t next_can_slot = 0;
+
+static uint8_t bucket_for(uint32_t elapsed_us)
+{
+    uint8_t bucket = 0;
+    elapsed_us /= PERF_STATS_FIRST_BUCKET_US;
+    while (elapsed_us != 0 && bucket < PERF_STATS_NUM_BUCKETS - 1) {
+        elapsed_us >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+void init_perf_stats(void)
+{
+    memset(slots, 0, sizeof(slots));
+    next_can_slot = 0;
+}
+
+void perf_stats_record(uint8_t slot, uint32_t elapsed_us)
+{
+    if (slot >= PERF_NUM_SLOTS) {
+        return;
+    }
+    perf_stat_t *s = &slots[slot];
+    uint16_t clamped = elapsed_us > UINT16_MAX ? UINT16_MAX : elapsed_us;
+
+    if (s->count == 0 || clamped < s->min_us) {
+        s->min_us = clamped;
+    }
+    if (clamped > s->max_us) {
+        s->max_us = clamped;
+    }
+
+    if (s->count == UINT32_MAX || s->total_us > UINT32_MAX - elapsed_us) {
+        s->count >>= 1;
+        s->total_us >>= 1;
+    }
+    s->count++;
+    s->total_us += elapsed_us;
+
+    uint8_t bucket = bucket_for(elapsed_us);
+    if (s->histogram[bucket] == UINT16_MAX) {
+        uint8_t i;
+        for (i = 0; i < PERF_STATS_NUM_BUCKETS; ++i) {
+            s->histogram[i] >>= 1;
+        }
+    }
+    s->histogram[bucket]++;
+}
+
+bool perf_stats_get(uint8_t slot, perf_stat_t *out)
+{
+    if (slot >= PERF_NUM_SLOTS || slots[slot].count == 0) {
+        return false;
+    }
+    *out = slots[slot];
+    return true;
+}
+
+uint16_t perf_stats_mean_us(const perf_stat_t *stat)
+{
+    if (stat->count == 0) {
+        return 0;
+    }
+    uint32_t mean = stat->total_us / stat->count;
+    return mean > UINT16_MAX ? UINT16_MAX : mean;
+}
+
+void perf_stats_heartbeat(void)
+{
+    // no one to listen if the bus is off
+    if (!is_bus_powered()) {
+        return;
+    }
+
+    // find the next slot that has anything in it
+    uint8_t tries;
+    for (tries = 0; tries < PERF_NUM_SLOTS; ++tries) {
+        uint8_t slot = next_can_slot;
+        next_can_slot = (next_can_slot + 1) % PERF_NUM_SLOTS;
+        if (slots[slot].count == 0) {
+            continue;
+        }
+
+        // same layout as the other canlib messages: 24 bit timestamp first,
+        // then the slot, mean and max
+        uint32_t now = millis();
+        uint16_t mean = perf_stats_mean_us(&slots[slot]);
+        can_msg_t msg;
+        msg.sid = MSG_DEBUG_MSG | BOARD_UNIQUE_ID;
+        msg.data_len = 8;
+        msg.data[0] = (now >> 16) & 0xff;
+        msg.data[1] = (now >> 8) & 0xff;
+        msg.data[2] = now & 0xff;
+        msg.data[3] = slot;
+        msg.data[4] = mean >> 8;
+        msg.data[5] = mean & 0xff;
+        msg.data[6] = slots[slot].max_us >> 8;
+        msg.data[7] = slots[slot].max_us & 0xff;
+        txb_enqueue(&msg);
+        return;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef PERF_STATS_H_
+#define PERF_STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "scheduler.h"
+
+/*
+ * Timing instrumentation. Code that wants to be measured takes micros() before
+ * and after itself and hands the difference to perf_stats_record, which keeps
+ * the min, max and mean, plus a histogram with one bucket per power of two.
+ * The scheduler does this for every task, and main.c does it for each pass
+ * through the main loop and for handling radio and CAN input.
+ *
+ * RLCS can ask for any slot over the radio (see PERF_STATS_REQUEST_HEADER in
+ * serialize.h), and perf_stats_heartbeat sends a summary of one slot at a time
+ * over CAN for the logger.
+ */
+
+// bucket 0 is anything under 32us, each bucket after that covers twice the
+// time, and the last one is everything from 2048us up
+#define PERF_STATS_NUM_BUCKETS 8
+#define PERF_STATS_FIRST_BUCKET_US 32
+
+enum PERF_SLOT {
+    PERF_SLOT_LOOP = 0,      // one pass through the main loop, excluding sleep
+    PERF_SLOT_RADIO_INPUT,   // handling bytes received from the radio
+    PERF_SLOT_CAN_INGEST,    // one batch of received CAN messages
+    PERF_SLOT_FIRST_TASK,    // scheduler task i is PERF_SLOT_FIRST_TASK + i
+    PERF_NUM_SLOTS = PERF_SLOT_FIRST_TASK + SCHEDULER_MAX_TASKS
+};
+
+typedef struct {
+    uint32_t count;
+    uint32_t total_us;
+    uint16_t min_us;
+    uint16_t max_us; // min and max saturate at 65535
+    uint16_t histogram[PERF_STATS_NUM_BUCKETS];
+} perf_stat_t;
+
+/*
+ * How often perf_stats_heartbeat sends a slot's summary out over CAN
+ */
+#define PERF_STATS_CAN_PERIOD_MS 1000
+
+/*
+ * Call this function at bootup. Clears every slot
+ */
+void init_perf_stats(void);
+
+/*
+ * Adds one measurement of elapsed_us to slot. When count or total get close
+ * to overflowing, both are halved, which keeps the mean correct. Histogram
+ * buckets are halved together for the same reason
+ */
+void perf_stats_record(uint8_t slot, uint32_t elapsed_us);
+
+/*
+ * Copies the stats for slot into out. Returns false if slot doesn't exist or
+ * has never had anything recorded
+ */
+bool perf_stats_get(uint8_t slot, perf_stat_t *out);
+
+/*
+ * Returns the mean of everything recorded in stat, in microseconds
+ */
+uint16_t perf_stats_mean_us(const perf_stat_t *stat);
+
+/*
+ * Sends the summary (mean and max) of the next slot with anything in it as a
+ * MSG_DEBUG_MSG. Call every PERF_STATS_CAN_PERIOD_MS
+ */
+void perf_stats_heartbeat(void);
+
+#endif
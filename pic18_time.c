@@ -7,8 +7,16 @@
 
 static uint32_t millis_counter = 0;
 
-//max value for this counter is (125-1)+64, so we can use 8 bits
-static uint8_t internal_count = 0;
+//max value for this counter is (125-1)+(64 << LOW_POWER_PRESCALE_SHIFT), so
+//it needs 16 bits now that the timer can be slowed down
+static uint16_t internal_count = 0;
+
+//timer0's prescaler is 1:(1 << prescale_shift). 0 normally, and
+//LOW_POWER_PRESCALE_SHIFT while we're in low power mode
+static uint8_t prescale_shift = 0;
+
+//micros() never returns less than it did last time. See the comment on micros
+static uint32_t last_micros = 0;
 
 uint32_t millis(void)
 {
@@ -53,11 +61,54 @@ uint32_t micros(void)
     //will reduce the number of missing microseconds by a factor of 256
     T0CON0bits.EN = 0;
     uint8_t timer_val = TMR0L;
-    uint8_t internal_val = internal_count;
+    uint16_t internal_val = internal_count;
     uint32_t millis_val = millis_counter;
     T0CON0bits.EN = 1;
 
-    return millis_val * 1000 + timer_val + ((uint32_t) internal_val) * 4;
+    uint32_t now;
+    if (prescale_shift == 0) {
+        now = millis_val * 1000 + timer_val + ((uint32_t) internal_val) * 4;
+    } else {
+        //in low power mode, TMR0L is worth up to 255 << prescale_shift
+        //internal counts, which would wreck monotonicity if we added it in
+        //like above. So we only count whole overflows, and the resolution
+        //is however long the timer takes to overflow. Each internal count
+        //is 8us, and internal_count stays under 125
+        now = millis_val * 1000 + ((uint32_t) internal_val) * 8;
+    }
+
+    //switching between the two formulas above can make the count jump
+    //backwards a little, so hold it until it catches up
+    if ((int32_t) (now - last_micros) < 0) {
+        return last_micros;
+    }
+    last_micros = now;
+    return now;
+}
+
+void timer0_set_low_power(bool low_power)
+{
+    uint8_t new_shift = low_power ? LOW_POWER_PRESCALE_SHIFT : 0;
+    if (new_shift == prescale_shift) {
+        return;
+    }
+
+    //fold whatever TMR0L has counted so far into internal_count, so the time
+    //since the last overflow isn't lost. Each TMR0L count is 2us times the
+    //prescaler, each internal count is 8us
+    uint8_t gie = INTCON0bits.GIE;
+    INTCON0bits.GIE = 0;
+    T0CON0bits.EN = 0;
+    internal_count += ((uint16_t) TMR0L << prescale_shift) / 4;
+    while (internal_count > MILLIS_REMAINDER_CAP) {
+        internal_count -= MILLIS_REMAINDER_CAP;
+        millis_counter++;
+    }
+    TMR0L = 0;
+    prescale_shift = new_shift;
+    T0CON1bits.CKPS = new_shift;
+    T0CON0bits.EN = 1;
+    INTCON0bits.GIE = gie;
 }
 
 
@@ -74,8 +125,9 @@ uint32_t micros(void)
 void timer0_handle_interrupt()
 {
     millis_counter += MILLIS_INCREMENT;
-    internal_count += MILLIS_REMAINDER;
-    if (internal_count > MILLIS_REMAINDER_CAP) {
+    //with the prescaler on, each overflow is worth that many more counts
+    internal_count += MILLIS_REMAINDER << prescale_shift;
+    while (internal_count > MILLIS_REMAINDER_CAP) {
         internal_count -= MILLIS_REMAINDER_CAP;
         millis_counter++;
     }
@@ -1,8 +1,17 @@
 #ifndef PIC18_TIME_H
 #define PIC18_TIME_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * Prescaler used by timer0 in low power mode, as a power of two. Normally the
+ * timer overflows (and wakes the CPU) every 512us. With a 1:64 prescaler it
+ * only does that every 32.768ms, which is plenty when all we're doing is
+ * waiting for RLCS to talk to us.
+ */
+#define LOW_POWER_PRESCALE_SHIFT 6
+
 /*
  * Returns the number of milliseconds that have happened since the
  * microcontroller woke up.
@@ -14,6 +23,15 @@ uint32_t millis(void);
  */
 uint32_t micros(void);
 
+/*
+ * Slows timer0 down (low_power true) or puts it back to normal speed. While
+ * it's slowed down, millis() and micros() only move forward once every
+ * 32.768ms, so only do this when nothing needs better timing than that.
+ * millis() stays correct across the switch. Calling this with the mode that
+ * we're already in does nothing, so it's fine to call every loop
+ */
+void timer0_set_low_power(bool low_power);
+
 /*
  * Interrupt handler for timer 0 interrupt. Do not call from application code
  */
@@ -1,9 +1,14 @@
 #include "radio_handler.h"
 #include "serialize.h"
+#include "radio_parser.h"
+#include "radio_tx.h"
 #include "sotscon.h"
-#include "uart.h"
 #include "pic18_time.h" // for millis()
 #include "bus_power.h"
+#include "perf_stats.h"
+#include "telemetry_history.h"
+#include "can_ingest.h"
+#include "radio_mirror.h"
 #include <string.h> // for memcpy
 
 static enum VALVE_STATE inj_valve_state = VALVE_UNK;
@@ -12,6 +17,63 @@ static enum VALVE_STATE vent_valve_state = VALVE_OPEN;
 
 static uint32_t last_contact_millis = 0;
 
+// the delta state frames we've sent lately (see STATE_DELTA_HEADER), so that
+// the next one can be relative to whichever of them RLCS says it has. A
+// keyframe goes out every STATE_DELTA_KEYFRAME_INTERVAL frames regardless
+#define STATE_DELTA_HISTORY 4
+#define STATE_DELTA_KEYFRAME_INTERVAL 16
+static system_state sent_states[STATE_DELTA_HISTORY];
+static uint8_t sent_seqs[STATE_DELTA_HISTORY];
+static uint8_t num_sent_states = 0;
+static uint8_t next_sent_slot = 0;
+static uint8_t next_delta_seq = 0;
+static uint8_t deltas_since_keyframe = 0;
+
+// set while RLCS is polling with BUNDLE_REQUEST_HEADER, in which case errors
+// and GPS positions go out in bundles instead of in frames of their own
+static bool bundle_polls = false;
+
+// set while RLCS is subscribed (see SUBSCRIBE_HEADER) to how often it wants a
+// bundle, 0 otherwise. pushed_state and pushed_seq are what was in the last
+// bundle we sent by ourselves, which the next one is relative to
+static uint32_t push_period_ms = 0;
+static uint32_t time_last_push = 0;
+static system_state pushed_state;
+static uint8_t pushed_seq = STATE_DELTA_NO_SNAPSHOT;
+
+// the newest acknowledged state command we've applied (see
+// SEQ_COMMAND_HEADER), and whether the last command of any kind asked for the
+// bus to be powered, which acknowledgements repeat back
+static uint8_t last_command_seq = COMMAND_SEQ_NONE;
+static bool bus_power_commanded = false;
+
+// GPS positions go out this often, one way or the other
+#define GPS_PERIOD_MS 30000
+static uint32_t time_last_gps_coords_sent = 0;
+
+// the version of the radio protocol RLCS last asked for
+static enum RADIO_PROTOCOL_VERSION protocol_version = RADIO_PROTOCOL_DEFAULT;
+
+enum RADIO_PROTOCOL_VERSION radio_protocol_version(void)
+{
+    return protocol_version;
+}
+
+// everything that comes in as ASCII goes through here, see radio_input_types
+static radio_parser_t input_parser;
+static bool input_parser_ready = false;
+
+void radio_fec_counts(uint16_t *corrected, uint16_t *uncorrectable)
+{
+    *corrected = input_parser.stats.fec_corrected;
+    *uncorrectable = input_parser.stats.fec_uncorrectable;
+}
+
+void radio_input_stats(radio_parser_stats_t *stats)
+{
+    *stats = input_parser.stats;
+}
+
 enum VALVE_STATE radio_get_expected_inj_valve_state(void)
 {
     return inj_valve_state;
@@ -28,118 +90,649 @@ enum VALVE_STATE radio_get_expected_vent_valve_state(void)
     return vent_valve_state;
 }
 
-void radio_handle_input_character(uint8_t c)
+/*
+ * Queues the first body_len characters of frame, plus the frame check that
+ * whatever built it put after them, to go out in class cls (see radio_tx.h).
+ * In RADIO_PROTOCOL_V3 that's converted to a binary frame first
+ */
+static void radio_send_frame(enum RADIO_TX_CLASS cls, char *frame, uint8_t body_len)
+{
+    if (protocol_version == RADIO_PROTOCOL_V3) {
+        uint8_t binary[BINARY_FRAME_MAX_LEN];
+        uint8_t len = frame_to_binary(frame, body_len, binary);
+        if (len > 0) {
+            radio_tx_send(cls, binary, len);
+        }
+    } else {
+        radio_tx_send(cls, (uint8_t *) frame, body_len + frame_check_len(protocol_version));
+    }
+}
+
+/*
+ * Fills in state with what we'll tell RLCS about the rocket
+ */
+static void get_current_state(system_state *state)
+{
+    state->tank_pressure = current_tank_pressure();
+    state->num_boards_connected = current_num_boards_connected();
+    state->injector_valve_state = current_inj_valve_position();
+    // Just tell them that vent is whatever they want it to be. This
+    // prevents tower box from flooding us with messages to change our
+    // state, thus saving battery power
+    state->vent_valve_state = vent_valve_state;
+    state->bus_is_powered = is_bus_powered();
+    state->any_errors_detected = any_errors_active();
+    state->bus_battery_voltage_mv = current_inj_batt_mv();
+    state->vent_battery_voltage_mv = 0;
+
+    // Clamp battery voltages to 14 bits
+    if (state->bus_battery_voltage_mv > 0x3FFF)
+        state->bus_battery_voltage_mv = 0x3FFF;
+    if (state->vent_battery_voltage_mv > 0x3FFF)
+        state->vent_battery_voltage_mv = 0x3FFF;
+}
+
+static void send_state(void)
+{
+    bundle_polls = false;
+    //we need to serialize our current state and send it over the radio
+    char state_to_send[STATE_COMMAND_LEN];
+    system_state current_state;
+    get_current_state(&current_state);
+
+    create_state_command(state_to_send, &current_state, protocol_version);
+    radio_send_frame(RADIO_TX_SAFETY, state_to_send, STATE_COMMAND_BODY_LEN);
+    // we've received a valid something from RLCS, so reset
+    // safe state timer
+    last_contact_millis = millis();
+}
+
+/*
+ * The state the next delta state should be relative to, given that RLCS last
+ * got the one with sequence number acked_seq. NULL for a keyframe
+ */
+static const system_state *delta_base(uint8_t acked_seq)
+{
+    const system_state *base = NULL;
+    uint8_t i;
+    if (deltas_since_keyframe < STATE_DELTA_KEYFRAME_INTERVAL) {
+        for (i = 0; i < num_sent_states; ++i) {
+            if (sent_seqs[i] == acked_seq) {
+                base = &sent_states[i];
+                break;
+            }
+        }
+    }
+    deltas_since_keyframe = base == NULL ? 0 : deltas_since_keyframe + 1;
+    return base;
+}
+
+// remembers a delta state we just sent, as next_delta_seq, and moves on to
+// the next sequence number. Not contact with RLCS by itself, since we might
+// have sent it unasked
+static void delta_sent(const system_state *current_state)
+{
+    // the oldest one we have makes way for this one
+    sent_states[next_sent_slot] = *current_state;
+    sent_seqs[next_sent_slot] = next_delta_seq;
+    next_sent_slot = (next_sent_slot + 1) % STATE_DELTA_HISTORY;
+    if (num_sent_states < STATE_DELTA_HISTORY) {
+        num_sent_states++;
+    }
+    next_delta_seq = (next_delta_seq + 1) % STATE_DELTA_NO_SNAPSHOT;
+}
+
+/*
+ * Sends our current state as a delta state frame, relative to the one with
+ * sequence number acked_seq if we still have it
+ */
+static void send_state_delta(uint8_t acked_seq)
+{
+    const system_state *base = delta_base(acked_seq);
+    system_state current_state;
+    get_current_state(&current_state);
+
+    char delta[STATE_DELTA_MAX_LEN];
+    uint8_t len = create_state_delta(&current_state, next_delta_seq, base, acked_seq,
+                                     delta, protocol_version);
+    if (len > 0) {
+        radio_send_frame(RADIO_TX_SAFETY, delta, len);
+    }
+    delta_sent(&current_state);
+}
+
+/*
+ * Takes the oldest waiting error out of the buffer as an error report.
+ * Returns false if there isn't one
+ */
+static bool get_next_error_report(error_report_t *report)
+{
+    error_record_t record;
+    if (!get_next_error(&record)) {
+        return false;
+    }
+    uint32_t age_s = (millis() - record.last_ms) / 1000;
+    report->err = record.err;
+    report->count = record.count < ERROR_REPEAT_MAX ? record.count : ERROR_REPEAT_MAX;
+    report->age_s = age_s < ERROR_REPEAT_MAX ? age_s : ERROR_REPEAT_MAX;
+    return true;
+}
+
+/*
+ * Sends a bundle: current_state as a delta state like send_state_delta, plus
+ * as many waiting errors as fit, and our GPS position if it's due
+ */
+static void send_bundle(uint8_t acked_seq, const system_state *current_state)
 {
-    static char message[STATE_COMMAND_LEN] = {0};
-    static uint8_t chars_received = 0;
+    bundle_records_t records;
+    records.has_gps = false;
+    records.num_errors = 0;
+    if (millis() - time_last_gps_coords_sent > GPS_PERIOD_MS) {
+        gps_position_t *gps = &records.gps;
+        current_gps_position(&gps->lat_deg, &gps->lat_min, &gps->lat_dmin, &gps->lat_dir,
+                             &gps->lon_deg, &gps->lon_min, &gps->lon_dmin, &gps->lon_dir);
+        records.has_gps = true;
+        time_last_gps_coords_sent = millis();
+    }
+    while (records.num_errors + (records.has_gps ? 1 : 0) < BUNDLE_MAX_RECORDS &&
+           get_next_error_report(&records.errors[records.num_errors])) {
+        records.num_errors++;
+    }
+
+    const system_state *base = delta_base(acked_seq);
+    char bundle[BUNDLE_MAX_LEN];
+    uint8_t len = create_bundle(current_state, next_delta_seq, base, acked_seq,
+                                &records, bundle, protocol_version);
+    if (len == 0 && records.has_gps) {
+        // the only thing that can be wrong is the GPS position, same as in
+        // radio_heartbeat
+        report_error(BOARD_UNIQUE_ID, E_CODING_FUCKUP, 0, 0, 0, 0);
+        records.has_gps = false;
+        len = create_bundle(current_state, next_delta_seq, base, acked_seq,
+                            &records, bundle, protocol_version);
+    }
+    if (len > 0) {
+        radio_send_frame(RADIO_TX_SAFETY, bundle, len);
+    }
+    delta_sent(current_state);
+}
 
-    if (c == STATE_REQUEST_HEADER) {
-        //we need to serialize our current state and send it over the radio
-        char state_to_send[STATE_COMMAND_LEN];
+/*
+ * Sends current_state in a bundle by ourselves, because RLCS is subscribed
+ */
+static void push_bundle(uint8_t acked_seq, const system_state *current_state)
+{
+    pushed_state = *current_state;
+    pushed_seq = next_delta_seq;
+    send_bundle(acked_seq, current_state);
+    time_last_push = millis();
+}
+
+/*
+ * Whether anything's changed between a and b that RLCS should hear about
+ * straight away, rather than at the next push
+ */
+static bool significant_change(const system_state *a, const system_state *b)
+{
+    return a->injector_valve_state != b->injector_valve_state ||
+           a->vent_valve_state != b->vent_valve_state ||
+           a->bus_is_powered != b->bus_is_powered ||
+           a->any_errors_detected != b->any_errors_detected;
+}
+
+/*
+ * Handles a subscribe from RLCS, for a bundle every period units of
+ * PUSH_PERIOD_UNIT_MS (or none, if period is 0) starting with one relative
+ * to acked_seq
+ */
+static void handle_subscribe(uint8_t period, uint8_t acked_seq)
+{
+    push_period_ms = (uint32_t) period * PUSH_PERIOD_UNIT_MS;
+    if (push_period_ms != 0) {
         system_state current_state;
+        get_current_state(&current_state);
+        push_bundle(acked_seq, &current_state);
+    }
+    last_contact_millis = millis();
+}
+
+/*
+ * Fills in one page of board stats (see enum BOARD_STATS_PAGE). Returns false
+ * for pages we don't have
+ */
+static bool get_board_stats(uint8_t page, board_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (page == BOARD_STATS_CAN_INGEST) {
+        can_ingest_stats_t ingest;
+        can_ingest_get_stats(&ingest);
+        stats->counters[0] = ingest.frames_processed;
+        stats->counters[1] = ingest.batches;
+        stats->counters[2] = ingest.frames_dropped;
+        stats->counters[3] = ingest.max_batch_size;
+        stats->counters[4] = ingest.backlog;
+        stats->counters[5] = ingest.backlog_high_water;
+        return true;
+    }
+    if (page >= BOARD_STATS_RADIO_TX_SAFETY && page <= BOARD_STATS_RADIO_TX_DEBUG) {
+        radio_tx_stats_t tx;
+        radio_tx_get_stats((enum RADIO_TX_CLASS) (page - BOARD_STATS_RADIO_TX_SAFETY), &tx);
+        stats->counters[0] = tx.frames_sent;
+        stats->counters[1] = tx.frames_dropped;
+        stats->counters[2] = tx.depth;
+        stats->counters[3] = tx.max_depth;
+        stats->counters[4] = tx.frames_sent ? tx.total_latency_ms / tx.frames_sent : 0;
+        stats->counters[5] = tx.max_latency_ms;
+        return true;
+    }
+    if (page == BOARD_STATS_ERRORS) {
+        error_stats_t errors;
+        get_error_stats(&errors);
+        stats->counters[0] = errors.reported;
+        stats->counters[1] = errors.coalesced;
+        stats->counters[2] = errors.dropped;
+        stats->counters[3] = errors.max_pending;
+        return true;
+    }
+    if (page == BOARD_STATS_RADIO_MIRROR) {
+        radio_mirror_stats_t mirror;
+        radio_mirror_get_stats(&mirror);
+        stats->counters[0] = radio_mirror_enabled();
+        stats->counters[1] = mirror.bytes_mirrored;
+        stats->counters[2] = mirror.bytes_dropped;
+        stats->counters[3] = mirror.bytes_discarded;
+        stats->counters[4] = mirror.messages_sent;
+        stats->counters[5] = mirror.partial_flushes;
+        return true;
+    }
+    if (page == BOARD_STATS_RADIO_INPUT) {
+        stats->counters[0] = input_parser.stats.fec_corrected;
+        stats->counters[1] = input_parser.stats.fec_uncorrectable;
+        stats->counters[2] = input_parser.stats.frames_ok;
+        stats->counters[3] = input_parser.stats.bad_checks;
+        stats->counters[4] = input_parser.stats.truncated;
+        stats->counters[5] = input_parser.stats.resyncs;
+        return true;
+    }
+    return false;
+}
+
+// Sends RLCS one page of board stats, if it's a page we have
+static void send_board_stats(uint8_t page)
+{
+    board_stats_t stats;
+    char stats_msg[BOARD_STATS_MSG_LEN];
+    if (get_board_stats(page, &stats) &&
+        create_board_stats_message(page, &stats, stats_msg, protocol_version)) {
+        radio_send_frame(RADIO_TX_DEBUG, stats_msg, BOARD_STATS_MSG_BODY_LEN);
+    }
+}
 
-        current_state.tank_pressure = current_tank_pressure();
-        current_state.num_boards_connected = current_num_boards_connected();
-        current_state.injector_valve_state = current_inj_valve_position();
-        // Just tell them that vent is whatever they want it to be. This
-        // prevents tower box from flooding us with messages to change our
-        // state, thus saving battery power
-        current_state.vent_valve_state = vent_valve_state;
-        current_state.bus_is_powered = is_bus_powered();
-        current_state.any_errors_detected = any_errors_active();
-        current_state.bus_battery_voltage_mv = current_inj_batt_mv();
-        current_state.vent_battery_voltage_mv = 0;
-
-        // Clamp battery voltages to 14 bits
-        if (current_state.bus_battery_voltage_mv > 0x3FFF)
-            current_state.bus_battery_voltage_mv = 0x3FFF;
-        if (current_state.vent_battery_voltage_mv > 0x3FFF)
-            current_state.vent_battery_voltage_mv = 0x3FFF;
-
-
-        create_state_command(state_to_send, &current_state);
-        uart_transmit_buffer((uint8_t *) state_to_send, STATE_COMMAND_LEN - 1);
-        // we've received a valid something from RLCS, so reset
-        // safe state timer
+/*
+ * Answers a one character query from RLCS. header says what kind of query it
+ * was, which says which slot or quantity it wants (or for a delta state
+ * poll, which frame RLCS last got). Queries for things we don't have any
+ * data on are ignored
+ */
+static void radio_answer_query(char header, uint8_t which)
+{
+    if (header == STATE_DELTA_REQUEST_HEADER) {
+        bundle_polls = false;
+        send_state_delta(which);
         last_contact_millis = millis();
-    } else if (c == STATE_COMMAND_HEADER) {
-        chars_received = 1;
-        message[0] = STATE_COMMAND_HEADER;
-    } else if (chars_received == STATE_COMMAND_LEN - 2) {
-        // Only STATE_COMMAND_LEN - 1 characters are actually transmitted
-        // in each message (the null terminator is left out).
-        // This means that this character is the checksum.
-
-        // The checksum only includes the serialized state bytes.
-        // As such, we shouldn't include the { in it.
-        message[chars_received] = '\0';
-        char actual_checksum = checksum(message + 1);
-        if (actual_checksum == c) {
-            // The message was correctly received
-            char serialized[SERIALIZED_OUTPUT_LEN];
-            memcpy(serialized, message + 1, SERIALIZED_OUTPUT_LEN - 1);
-            serialized[SERIALIZED_OUTPUT_LEN - 1] = 0;
-            system_state state;
-            deserialize_state(&state, serialized);
-            inj_valve_state = state.injector_valve_state;
-            vent_valve_state = state.vent_valve_state;
-            /* control whether the bus is powered */
-            if (state.bus_is_powered) {
-                trigger_bus_powerup();
-            } else {
-                trigger_bus_shutdown();
-            }
+    } else if (header == BUNDLE_REQUEST_HEADER) {
+        bundle_polls = true;
+        system_state current_state;
+        get_current_state(&current_state);
+        send_bundle(which, &current_state);
+        last_contact_millis = millis();
+    } else if (header == PERF_STATS_REQUEST_HEADER) {
+        perf_stat_t stat;
+        char perf_msg[PERF_STATS_MSG_LEN];
+        if (perf_stats_get(which, &stat) &&
+            create_perf_stats_message(which, &stat, perf_msg, protocol_version)) {
+            radio_send_frame(RADIO_TX_DEBUG, perf_msg, PERF_STATS_MSG_BODY_LEN);
+        }
+    } else if (header == TELEMETRY_REQUEST_HEADER) {
+        telem_summary_t summary;
+        char telem_msg[TELEMETRY_SUMMARY_MSG_LEN];
+        if (telemetry_get_summary(which, &summary) &&
+            create_telemetry_summary_message(which, &summary, telem_msg, protocol_version)) {
+            radio_send_frame(RADIO_TX_DEBUG, telem_msg, TELEMETRY_SUMMARY_MSG_BODY_LEN);
+        }
+    } else if (header == BOARD_STATS_REQUEST_HEADER) {
+        send_board_stats(which);
+    }
+}
 
-            last_contact_millis = millis();
-        } else {
-            // Discard this message
-            chars_received = 0;
+/*
+ * Turns the radio mirror off for 0 and on for 1 (see RADIO_MIRROR_HEADER),
+ * and tells RLCS whether it's on
+ */
+static void handle_radio_mirror(uint8_t which)
+{
+    if (which <= 1) {
+        radio_mirror_set_enabled(which == 1);
+    }
+    send_board_stats(BOARD_STATS_RADIO_MIRROR);
+}
+
+/*
+ * Does what RLCS told us to in a state command
+ */
+static void apply_state_command(const system_state *state)
+{
+    inj_valve_state = state->injector_valve_state;
+    vent_valve_state = state->vent_valve_state;
+    /* control whether the bus is powered */
+    bus_power_commanded = state->bus_is_powered;
+    if (state->bus_is_powered) {
+        trigger_bus_powerup();
+    } else {
+        trigger_bus_shutdown();
+    }
+}
+
+/*
+ * Takes a state command whose frame check, if it had one, has already been
+ * checked
+ */
+static void handle_state_command(const char *cmd)
+{
+    system_state state;
+    // a command with a character that isn't base64 in it is garbage, even
+    // if the frame check happened to match
+    if (!deserialize_state(&state, cmd + 1)) {
+        return;
+    }
+    apply_state_command(&state);
+
+    last_contact_millis = millis();
+}
+
+/*
+ * Whether acknowledged command seq is newer than last_command_seq, see
+ * SEQ_COMMAND_HEADER
+ */
+static bool command_seq_is_new(uint8_t seq)
+{
+    if (last_command_seq == COMMAND_SEQ_NONE) {
+        return true;
+    }
+    uint8_t ahead = (seq + COMMAND_SEQ_NONE - last_command_seq) % COMMAND_SEQ_NONE;
+    return ahead != 0 && ahead <= COMMAND_SEQ_WINDOW;
+}
+
+/*
+ * Takes an acknowledged state command and answers it
+ */
+static void handle_seq_command(const char *cmd)
+{
+    command_ack_t ack;
+    system_state state;
+    ack.seq = COMMAND_SEQ_NONE;
+    bool valid = expand_seq_command(&ack.seq, &state, cmd, protocol_version);
+    // without a sequence number there's nothing to answer
+    if (ack.seq >= COMMAND_SEQ_NONE) {
+        return;
+    }
+    ack.accepted = false;
+    if (valid && command_seq_is_new(ack.seq)) {
+        apply_state_command(&state);
+        last_command_seq = ack.seq;
+        ack.accepted = true;
+    } else if (valid && ack.seq == last_command_seq) {
+        // the acknowledgement for this one must have got lost
+        ack.accepted = true;
+    }
+    ack.last_seq = last_command_seq;
+    ack.injector_valve_state = inj_valve_state;
+    ack.vent_valve_state = vent_valve_state;
+    ack.bus_is_powered = bus_power_commanded;
+
+    char reply[COMMAND_ACK_LEN];
+    if (create_command_ack(&ack, reply, protocol_version)) {
+        radio_send_frame(RADIO_TX_SAFETY, reply, COMMAND_ACK_BODY_LEN);
+    }
+
+    last_contact_millis = millis();
+}
+
+static void handle_version_select(uint8_t requested)
+{
+    if (radio_protocol_supported(requested) && requested != protocol_version) {
+        // anything still waiting to go out is in the old version, and would
+        // go out after the reply
+        radio_tx_flush();
+        protocol_version = requested;
+    }
+
+    // tell RLCS which version we ended up with
+    char reply[VERSION_REPLY_MAX_LEN];
+    uint8_t len = create_version_reply(protocol_version, reply);
+    radio_tx_send(RADIO_TX_SAFETY, (uint8_t *) reply, len);
+
+    last_contact_millis = millis();
+}
+
+/*
+ * Handles a frame that came in as binary, once binary_to_frame has checked
+ * it and turned it back into characters. Binary frames have the same
+ * headers and bodies as the ASCII ones. Queries can come in either way, but
+ * version selects are always ASCII
+ */
+static void handle_binary_frame(char *frame, uint8_t len)
+{
+    if (frame[0] == STATE_REQUEST_HEADER) {
+        send_state();
+    } else if ((frame[0] == PERF_STATS_REQUEST_HEADER ||
+                frame[0] == TELEMETRY_REQUEST_HEADER ||
+                frame[0] == BOARD_STATS_REQUEST_HEADER ||
+                frame[0] == STATE_DELTA_REQUEST_HEADER ||
+                frame[0] == BUNDLE_REQUEST_HEADER) && len >= 2) {
+        uint8_t which = base64_to_binary(frame[1]);
+        if (which != BASE64_INVALID) {
+            radio_answer_query(frame[0], which);
+        }
+    } else if (frame[0] == SUBSCRIBE_HEADER && len >= SUBSCRIBE_BODY_LEN) {
+        uint8_t period, acked_seq;
+        if (expand_subscribe(&period, &acked_seq, frame, protocol_version)) {
+            handle_subscribe(period, acked_seq);
+        }
+    } else if (frame[0] == RADIO_MIRROR_HEADER && len >= RADIO_MIRROR_BODY_LEN) {
+        uint8_t which;
+        if (expand_radio_mirror(&which, frame, protocol_version)) {
+            handle_radio_mirror(which);
         }
+    } else if (frame[0] == STATE_COMMAND_HEADER && len >= STATE_COMMAND_BODY_LEN) {
+        handle_state_command(frame);
+    } else if (frame[0] == SEQ_COMMAND_HEADER && len >= SEQ_COMMAND_BODY_LEN) {
+        handle_seq_command(frame);
+    }
+}
+
+/*
+ * The frames RLCS sends us in ASCII. Queries are a header and then one base64
+ * character saying which slot, quantity or sequence number RLCS is asking
+ * about, and have no frame check
+ */
+static const radio_frame_type_t radio_input_types[] = {
+    { STATE_COMMAND_HEADER, STATE_COMMAND_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION_AFTER_HEADER },
+    { SEQ_COMMAND_HEADER, SEQ_COMMAND_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { STATE_REQUEST_HEADER, 1, 0, NULL, PARSER_CHECK_NONE },
+    { STATE_DELTA_REQUEST_HEADER, 2, 0, NULL, PARSER_CHECK_NONE },
+    { BUNDLE_REQUEST_HEADER, 2, 0, NULL, PARSER_CHECK_NONE },
+    { PERF_STATS_REQUEST_HEADER, 2, 0, NULL, PARSER_CHECK_NONE },
+    { TELEMETRY_REQUEST_HEADER, 2, 0, NULL, PARSER_CHECK_NONE },
+    { BOARD_STATS_REQUEST_HEADER, 2, 0, NULL, PARSER_CHECK_NONE },
+    { SUBSCRIBE_HEADER, SUBSCRIBE_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { RADIO_MIRROR_HEADER, RADIO_MIRROR_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { VERSION_SELECT_HEADER, VERSION_SELECT_BODY_LEN, 0, NULL, PARSER_CHECK_V1 },
+};
+
+/*
+ * Handles a frame that came in as ASCII, once input_parser has checked it
+ */
+static void handle_ascii_frame(char *frame, uint8_t len)
+{
+    if (frame[0] == VERSION_SELECT_HEADER) {
+        handle_version_select(base64_to_binary(frame[1]));
     } else {
-        // This character is in the middle of a message.
-        // Check that we've received the starting character first.
-        if (chars_received > 0) {
-            message[chars_received] = c;
-            ++chars_received;
+        // everything else looks just the same as it does in binary
+        handle_binary_frame(frame, len);
+    }
+}
+
+static radio_parser_t *get_input_parser(void)
+{
+    if (!input_parser_ready) {
+        init_radio_parser(&input_parser, radio_input_types,
+                          sizeof(radio_input_types) / sizeof(radio_input_types[0]),
+                          &handle_ascii_frame);
+        input_parser_ready = true;
+    }
+    return &input_parser;
+}
+
+/*
+ * Takes a character of input in RADIO_PROTOCOL_V3. Bytes are saved up until
+ * the 0x00 on the end of a binary frame. The first byte of a COBS encoded
+ * frame is the distance to its first zero, and none of our frames are long
+ * enough for that to reach any of the headers below, so a query or version
+ * select at the start of a frame must be ASCII. Those are still taken in
+ * ASCII, since a one character query would be five bytes in binary
+ */
+#if BINARY_FRAME_RAW_LEN(RADIO_FRAME_MAX_BODY_LEN) + 1 >= TELEMETRY_REQUEST_HEADER || \
+    TELEMETRY_REQUEST_HEADER > PERF_STATS_REQUEST_HEADER || \
+    TELEMETRY_REQUEST_HEADER > BOARD_STATS_REQUEST_HEADER || \
+    TELEMETRY_REQUEST_HEADER > RADIO_MIRROR_HEADER || \
+    TELEMETRY_REQUEST_HEADER > STATE_REQUEST_HEADER || \
+    TELEMETRY_REQUEST_HEADER > VERSION_SELECT_HEADER || \
+    TELEMETRY_REQUEST_HEADER > STATE_DELTA_REQUEST_HEADER || \
+    TELEMETRY_REQUEST_HEADER > BUNDLE_REQUEST_HEADER || \
+    TELEMETRY_REQUEST_HEADER > STATE_COMMAND_HEADER || \
+    TELEMETRY_REQUEST_HEADER > SUBSCRIBE_HEADER || \
+    TELEMETRY_REQUEST_HEADER > SEQ_COMMAND_HEADER
+#error "a binary frame could start with an ASCII query header"
+#endif
+static void radio_handle_binary_character(uint8_t c)
+{
+    static uint8_t frame[BINARY_FRAME_MAX_LEN];
+    static uint8_t bytes_received = 0;
+    // set when a frame's too long for us, we ignore everything up to the next
+    // 0x00 when that happens
+    static bool overflowed = false;
+    radio_parser_t *parser = get_input_parser();
+
+    if (radio_parser_in_frame(parser) ||
+        (bytes_received == 0 && !overflowed && radio_parser_is_header(parser, c))) {
+        // (state commands are turned away by the parser, since there's no
+        // ASCII frame check in this version)
+        radio_parser_feed(parser, c, protocol_version);
+    } else if (c == 0) {
+        char body[RADIO_FRAME_MAX_BODY_LEN + 1];
+        uint8_t len = 0;
+        if (!overflowed && bytes_received > 0) {
+            len = binary_to_frame(frame, bytes_received, body);
+        }
+        bytes_received = 0;
+        overflowed = false;
+        if (len > 0) {
+            handle_binary_frame(body, len);
         }
-        // Otherwise, simply discard the character.
+    } else if (bytes_received == sizeof(frame)) {
+        overflowed = true;
+        bytes_received = 0;
+    } else if (!overflowed) {
+        frame[bytes_received++] = c;
+    }
+}
+
+void radio_handle_input_character(uint8_t c)
+{
+    if (protocol_version == RADIO_PROTOCOL_V3) {
+        radio_handle_binary_character(c);
+    } else {
+        radio_parser_feed(get_input_parser(), c, protocol_version);
     }
 }
 
 void radio_heartbeat(void)
 {
-    //if we have an error message ready to send, and it's been longer than 1
-    //second since we last sent an error message, then send that error message.
-    static uint32_t time_last_error_msg_sent = 0;
-    if (millis() - time_last_error_msg_sent > 1000) {
-        //the +2 is to add a error_command_header and a checksum
-        char error_msg_to_send[ERROR_COMMAND_LENGTH + 2];
-        if (get_next_serialized_error(error_msg_to_send + 1)) {
-            error_msg_to_send[0] = ERROR_COMMAND_HEADER;
-
-            //make sure doesn't read past here
-            error_msg_to_send[ERROR_COMMAND_LENGTH] = '\0';
-            error_msg_to_send[ERROR_COMMAND_LENGTH] = checksum(error_msg_to_send);
-            error_msg_to_send[ERROR_COMMAND_LENGTH + 1] = '\0';
-            uart_transmit_buffer((uint8_t *) error_msg_to_send, ERROR_COMMAND_LENGTH + 1);
-            time_last_error_msg_sent = millis();
+    bool records_in_bundles = bundle_polls || push_period_ms != 0;
+
+    radio_tx_service();
+
+    //if we have an error message ready to send, and errors haven't used up
+    //their share of the link, then send that error message. With bundle polls
+    //or a subscription, they go out in the next bundle instead. Only
+    //RADIO_PROTOCOL_V1 gets them without their repeat count
+    if (!records_in_bundles && radio_tx_ready(RADIO_TX_ERROR)) {
+        if (protocol_version == RADIO_PROTOCOL_V1) {
+            //room for the error_command_header, the serialized error and its
+            //null terminator, which the frame check then overwrites
+            char error_msg_to_send[ERROR_MSG_BODY_LEN + FRAME_CHECK_MAX_LEN];
+            if (get_next_serialized_error(error_msg_to_send + 1)) {
+                error_msg_to_send[0] = ERROR_COMMAND_HEADER;
+                append_frame_check(error_msg_to_send, ERROR_MSG_BODY_LEN, protocol_version);
+                radio_send_frame(RADIO_TX_ERROR, error_msg_to_send, ERROR_MSG_BODY_LEN);
+            }
+        } else {
+            error_report_t report;
+            char report_msg[ERROR_REPORT_LEN];
+            if (get_next_error_report(&report) &&
+                create_error_report(&report, report_msg, protocol_version)) {
+                radio_send_frame(RADIO_TX_ERROR, report_msg, ERROR_REPORT_BODY_LEN);
+            }
         }
     }
 
-    //send GPS coordinates over radio every 30 seconds
-    static uint32_t time_last_gps_coords_sent = 0;
-    if (millis() - time_last_gps_coords_sent > 30000) {
+    //send GPS coordinates over radio every 30 seconds, if they aren't going
+    //out in bundles
+    if (!records_in_bundles && millis() - time_last_gps_coords_sent > GPS_PERIOD_MS &&
+        radio_tx_ready(RADIO_TX_GPS)) {
         uint8_t lat_deg, lat_min, lat_dmin, lat_dir;
         uint8_t lon_deg, lon_min, lon_dmin, lon_dir;
         current_gps_position(&lat_deg, &lat_min, &lat_dmin, &lat_dir,
                              &lon_deg, &lon_min, &lon_dmin, &lon_dir);
-        uint8_t buffer[GPS_MSG_LEN];
+        char buffer[GPS_MSG_LEN];
         if (create_gps_message(lat_deg, lat_min, lat_dmin, lat_dir, lon_deg, lon_min,
-                               lon_dmin, lon_dir, buffer)) {
-            uart_transmit_buffer(buffer, GPS_MSG_LEN);
+                               lon_dmin, lon_dir, buffer, protocol_version)) {
+            radio_send_frame(RADIO_TX_GPS, buffer, GPS_MSG_BODY_LEN);
         } else {
             report_error(BOARD_UNIQUE_ID, E_CODING_FUCKUP, 0, 0, 0, 0);
         }
         time_last_gps_coords_sent = millis();
     }
+
+    // If RLCS has been quiet for long enough that we've gone to safe state,
+    // that might be because a ground station that doesn't know about
+    // protocol versions has taken over. Go back to the default so that it
+    // can understand us. Newer ground stations just select again
+    if (protocol_version != RADIO_PROTOCOL_DEFAULT &&
+        millis() - last_contact_millis >= TIME_NO_CONTACT_BEFORE_SAFE_STATE) {
+        radio_tx_flush();
+        protocol_version = RADIO_PROTOCOL_DEFAULT;
+    }
+    // and don't hold errors back for bundle polls that might never come, or
+    // keep pushing to a ground station that isn't listening
+    if (records_in_bundles &&
+        millis() - last_contact_millis >= TIME_NO_CONTACT_BEFORE_SAFE_STATE) {
+        bundle_polls = false;
+        push_period_ms = 0;
+    }
+    // whoever we hear from next might be starting their command sequence
+    // numbers over, so take the next one whatever it is
+    if (millis() - last_contact_millis >= TIME_NO_CONTACT_BEFORE_SAFE_STATE) {
+        last_command_seq = COMMAND_SEQ_NONE;
+    }
+
+    if (push_period_ms != 0) {
+        system_state current_state;
+        get_current_state(&current_state);
+        if (millis() - time_last_push >= push_period_ms ||
+            significant_change(&current_state, &pushed_state)) {
+            push_bundle(pushed_seq, &current_state);
+        }
+    }
 }
@@ -2,6 +2,8 @@
 #define RADIO_HANDLER_H_
 
 #include "message_types.h"
+#include "serialize.h"
+#include "radio_parser.h"
 #include <stdint.h>
 
 /*
@@ -37,8 +39,33 @@ enum VALVE_STATE radio_get_expected_inj_valve_state(void);
  */
 enum VALVE_STATE radio_get_expected_vent_valve_state(void);
 
+/*
+ * Takes a byte that came in over the radio. Call with every byte, as soon as
+ * it's available
+ */
 void radio_handle_input_character(uint8_t c);
 
+/*
+ * Returns the radio protocol version (see enum RADIO_PROTOCOL_VERSION) that
+ * RLCS last selected. This goes back to RADIO_PROTOCOL_DEFAULT if we don't
+ * hear from RLCS for TIME_NO_CONTACT_BEFORE_SAFE_STATE
+ */
+enum RADIO_PROTOCOL_VERSION radio_protocol_version(void);
+
+/*
+ * How many state commands from RLCS the forward error correction in
+ * RADIO_PROTOCOL_V4 has fixed, and how many had too much wrong with them to
+ * fix, since boot. Both stop at 0xFFFF
+ */
+void radio_fec_counts(uint16_t *corrected, uint16_t *uncorrectable);
+
+/*
+ * Copies the statistics of the parser that ASCII input from RLCS goes
+ * through (see radio_parser.h) into stats. Those cover everything that
+ * comes in, other than binary frames in RADIO_PROTOCOL_V3
+ */
+void radio_input_stats(radio_parser_stats_t *stats);
+
 /*
  * Checks if we need to send an error message over UART. Call every loop
  * through the application code
@@ -0,0 +1,132 @@
+#include "radio_mirror.h"
+#include "bus_power.h"
+#include "pic18_time.h" // for millis()
+#include "message_types.h"
+#include "can.h"
+#include "can_tx_buffer.h"
+
+#if (RADIO_MIRROR_BUFFER_LEN & (RADIO_MIRROR_BUFFER_LEN - 1)) != 0
+#error RADIO_MIRROR_BUFFER_LEN must be a power of two
+#endif
+#if RADIO_MIRROR_BUFFER_LEN > 255
+#error RADIO_MIRROR_BUFFER_LEN must fit the uint8_t indices
+#endif
+
+// a CAN message's worth
+#define CHUNK_LEN 8
+
+static bool enabled = true;
+
+// bytes waiting to be sent, the oldest at tail
+static uint8_t buffer[RADIO_MIRROR_BUFFER_LEN];
+static uint8_t head = 0;
+static uint8_t tail = 0;
+static uint8_t count = 0;
+
+// when the heartbeat first saw the partial chunk that's waiting, if
+// partial_waiting is set
+static bool partial_waiting = false;
+static uint32_t partial_seen_ms = 0;
+
+static radio_mirror_stats_t stats;
+
+void init_radio_mirror(void)
+{
+    enabled = true;
+    head = 0;
+    tail = 0;
+    count = 0;
+    partial_waiting = false;
+    stats = (radio_mirror_stats_t) {0};
+}
+
+void radio_mirror_set_enabled(bool enable)
+{
+    enabled = enable;
+}
+
+bool radio_mirror_enabled(void)
+{
+    return enabled;
+}
+
+void radio_mirror_append(uint8_t byte)
+{
+    if (!enabled) {
+        return;
+    }
+    if (count == RADIO_MIRROR_BUFFER_LEN) {
+        if (stats.bytes_dropped != UINT32_MAX) {
+            stats.bytes_dropped++;
+        }
+        return;
+    }
+    buffer[head] = byte;
+    head = (head + 1) & (RADIO_MIRROR_BUFFER_LEN - 1);
+    count++;
+}
+
+static void add_saturating(uint32_t *counter, uint8_t n)
+{
+    *counter = (*counter > UINT32_MAX - n) ? UINT32_MAX : *counter + n;
+}
+
+// sends the oldest len bytes in one message, returns false if there's no
+// room for it in the CAN transmit buffer
+static bool send_chunk(uint8_t len)
+{
+    can_msg_t msg;
+    // not build_printf_can_message, that stops at the first 0x00, and in
+    // binary framing every frame ends in one
+    msg.sid = MSG_DEBUG_PRINTF | BOARD_UNIQUE_ID;
+    msg.data_len = len;
+    uint8_t i;
+    uint8_t at = tail;
+    for (i = 0; i < len; ++i) {
+        msg.data[i] = buffer[at];
+        at = (at + 1) & (RADIO_MIRROR_BUFFER_LEN - 1);
+    }
+    if (!txb_enqueue(&msg)) {
+        return false;
+    }
+    tail = at;
+    count -= len;
+    add_saturating(&stats.bytes_mirrored, len);
+    add_saturating(&stats.messages_sent, 1);
+    return true;
+}
+
+void radio_mirror_heartbeat(void)
+{
+    if (!enabled || !is_bus_powered()) {
+        add_saturating(&stats.bytes_discarded, count);
+        tail = head;
+        count = 0;
+        partial_waiting = false;
+        return;
+    }
+
+    while (count >= CHUNK_LEN) {
+        if (!send_chunk(CHUNK_LEN)) {
+            return;
+        }
+        // time whatever is left over from here
+        partial_waiting = false;
+    }
+
+    if (count == 0) {
+        partial_waiting = false;
+    } else if (!partial_waiting) {
+        partial_waiting = true;
+        partial_seen_ms = millis();
+    } else if (millis() - partial_seen_ms >= RADIO_MIRROR_FLUSH_MS &&
+               send_chunk(count)) {
+        add_saturating(&stats.partial_flushes, 1);
+        partial_waiting = false;
+    }
+}
+
+void radio_mirror_get_stats(radio_mirror_stats_t *out)
+{
+    *out = stats;
+}
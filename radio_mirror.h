@@ -0,0 +1,73 @@
+#ifndef RADIO_MIRROR_H_
+#define RADIO_MIRROR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Copies everything we send over the radio onto the CAN bus as well, in
+ * MSG_DEBUG_PRINTF messages, so that the logger and the debug board can see
+ * what RLCS was told.
+ *
+ * uart_transmit_byte hands each byte to radio_mirror_append, which does
+ * nothing but store it. radio_mirror_heartbeat does the rest from the
+ * scheduler: it sends every full 8 byte chunk that's waiting, and sends
+ * whatever's left over once it's been waiting RADIO_MIRROR_FLUSH_MS, so a
+ * short frame at the end of a burst doesn't sit there until the next one.
+ *
+ * Nothing is sent while the bus is unpowered, since there's no one to hear
+ * it, and what's waiting is thrown away instead. If the CAN transmit buffer
+ * is full, bytes wait for the next heartbeat, and only bytes that arrive
+ * while RADIO_MIRROR_BUFFER_LEN are already waiting get dropped.
+ *
+ * RLCS turns mirroring on and off with a frame made by create_radio_mirror,
+ * over the radio or in MSG_DEBUG_RADIO_CMDs, and reads the stats as board
+ * stats.
+ */
+
+// how many bytes can wait to be mirrored. A power of two, so that wrapping
+// around is a mask
+#define RADIO_MIRROR_BUFFER_LEN 64
+
+// the longest a partial chunk waits before it's sent anyway. Measured from
+// the first heartbeat that sees it, so it can be up to one heartbeat longer
+#define RADIO_MIRROR_FLUSH_MS 100
+
+// all of these saturate. They're 32 bits, since at radio rates a 16 bit byte
+// count fills up in minutes
+typedef struct {
+    uint32_t bytes_mirrored;   // made it into a CAN message
+    uint32_t bytes_dropped;    // arrived with the buffer full
+    uint32_t bytes_discarded;  // thrown away while the bus was off or mirroring was
+    uint32_t messages_sent;
+    uint32_t partial_flushes;  // messages sent with less than 8 bytes in them
+} radio_mirror_stats_t;
+
+/*
+ * Empties the buffer, clears the stats and turns mirroring on
+ */
+void init_radio_mirror(void);
+
+/*
+ * Turns mirroring on or off. While it's off, radio_mirror_append ignores
+ * what it's given, and whatever was already waiting is thrown away at the
+ * next heartbeat
+ */
+void radio_mirror_set_enabled(bool enabled);
+bool radio_mirror_enabled(void);
+
+/*
+ * Queues one byte that's just been sent over the radio. Called from
+ * uart_transmit_byte, so it's kept to a single store. Not thread safe, call
+ * it from the main loop only
+ */
+void radio_mirror_append(uint8_t byte);
+
+/*
+ * Sends what's waiting over CAN, see above. Call this every 10ms or so
+ */
+void radio_mirror_heartbeat(void);
+
+void radio_mirror_get_stats(radio_mirror_stats_t *stats);
+
+#endif
@@ -0,0 +1,215 @@
+#include "radio_parser.h"
+#include <stddef.h> // for NULL
+#include <string.h> // for memset, memcmp
+
+void init_radio_parser(radio_parser_t *parser, const radio_frame_type_t *types,
+                       uint8_t num_types, radio_frame_handler_t handler)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->types = types;
+    parser->num_types = num_types;
+    parser->handler = handler;
+}
+
+static const radio_frame_type_t *find_type(const radio_parser_t *parser, uint8_t c)
+{
+    uint8_t i;
+    for (i = 0; i < parser->num_types; ++i) {
+        if ((uint8_t) parser->types[i].header == c) {
+            return &parser->types[i];
+        }
+    }
+    return NULL;
+}
+
+bool radio_parser_is_header(const radio_parser_t *parser, uint8_t c)
+{
+    return find_type(parser, c) != NULL;
+}
+
+bool radio_parser_in_frame(const radio_parser_t *parser)
+{
+    return parser->type != NULL;
+}
+
+void radio_parser_reset(radio_parser_t *parser)
+{
+    parser->type = NULL;
+    parser->len = 0;
+    parser->expected = 0;
+    parser->check = FRAME_CHECK_INIT;
+}
+
+static void count(uint16_t *stat)
+{
+    if (*stat < UINT16_MAX) {
+        (*stat)++;
+    }
+}
+
+// the version whose frame check is on frames of type, when received in version
+static enum RADIO_PROTOCOL_VERSION check_version(const radio_frame_type_t *type,
+                                                 enum RADIO_PROTOCOL_VERSION version)
+{
+    return type->check == PARSER_CHECK_V1 ? RADIO_PROTOCOL_V1 : version;
+}
+
+static uint8_t check_len(const radio_frame_type_t *type,
+                         enum RADIO_PROTOCOL_VERSION version)
+{
+    return type->check == PARSER_CHECK_NONE ? 0 :
+        frame_check_len(check_version(type, version));
+}
+
+// Whether frames checked in version have their frame check folded in as the
+// bytes arrive. Not RADIO_PROTOCOL_V4's, since FEC might have to fix the
+// body before the CRC-12 over it means anything
+static bool check_as_fed(enum RADIO_PROTOCOL_VERSION version)
+{
+    return version == RADIO_PROTOCOL_V1 || version == RADIO_PROTOCOL_V2;
+}
+
+// Folds the byte that was just appended into the running frame check, if the
+// frame check covers it
+static void fold_byte(radio_parser_t *parser, uint8_t c,
+                      enum RADIO_PROTOCOL_VERSION version)
+{
+    const radio_frame_type_t *type = parser->type;
+    enum RADIO_PROTOCOL_VERSION check = check_version(type, version);
+    if (type->check == PARSER_CHECK_NONE || !check_as_fed(check)) {
+        return;
+    }
+    if (parser->len == 1 && type->check == PARSER_CHECK_VERSION_AFTER_HEADER) {
+        return;
+    }
+    // the prefix is always part of the body, so until we know how long the
+    // frame is, everything is
+    if (parser->expected != 0 &&
+        parser->len > parser->expected - check_len(type, version)) {
+        return;
+    }
+    parser->check = frame_check_update(parser->check, c, check);
+}
+
+// A whole frame's here. Checks it, and hands it on if it's good
+static void finish_frame(radio_parser_t *parser, enum RADIO_PROTOCOL_VERSION version)
+{
+    const radio_frame_type_t *type = parser->type;
+    uint8_t body_len = parser->len - check_len(type, version);
+    bool ok = true;
+
+    if (type->check != PARSER_CHECK_NONE) {
+        enum RADIO_PROTOCOL_VERSION check = check_version(type, version);
+        if (check_as_fed(check)) {
+            // the body's already been folded in, so it's just the frame
+            // check characters left to compare
+            char expected[FRAME_CHECK_MAX_LEN];
+            uint8_t len = encode_frame_check(parser->check, expected, check);
+            ok = memcmp(expected, parser->frame + body_len, len) == 0;
+        } else {
+            // fec_correct_frame knows about state commands' frame check not
+            // covering the header, frame_check_ok doesn't
+            enum FEC_RESULT fec = fec_correct_frame(parser->frame, body_len, check);
+            if (type->check == PARSER_CHECK_VERSION_AFTER_HEADER) {
+                ok = frame_check_ok(parser->frame + 1, body_len - 1, check);
+            } else {
+                ok = frame_check_ok(parser->frame, body_len, check);
+            }
+            if (fec == FEC_CORRECTED && ok) {
+                count(&parser->stats.fec_corrected);
+            } else if (fec == FEC_UNCORRECTABLE) {
+                count(&parser->stats.fec_uncorrectable);
+            }
+        }
+    }
+
+    radio_parser_reset(parser);
+    if (ok) {
+        count(&parser->stats.frames_ok);
+        parser->handler(parser->frame, body_len);
+    } else {
+        count(&parser->stats.bad_checks);
+    }
+}
+
+// Works out how long the frame is, frame check included, once there's
+// enough of it to tell. 0 if we don't know yet, or if it makes no sense
+static uint8_t expected_len(const radio_parser_t *parser,
+                            enum RADIO_PROTOCOL_VERSION version)
+{
+    const radio_frame_type_t *type = parser->type;
+    uint8_t body_len = type->body_len;
+    if (body_len == 0) {
+        if (parser->len < type->prefix_len) {
+            return 0;
+        }
+        body_len = type->variable_body_len(parser->frame);
+        if (body_len == 0) {
+            return 0;
+        }
+    }
+    return body_len + check_len(type, version);
+}
+
+void radio_parser_feed(radio_parser_t *parser, uint8_t c,
+                       enum RADIO_PROTOCOL_VERSION version)
+{
+    const radio_frame_type_t *type = find_type(parser, c);
+    if (type != NULL) {
+        if (parser->type != NULL) {
+            count(&parser->stats.truncated);
+        }
+        radio_parser_reset(parser);
+        parser->discarding = false;
+        // frames that need an ASCII frame check can't come in ASCII in
+        // versions that don't have one
+        if ((type->check == PARSER_CHECK_VERSION ||
+             type->check == PARSER_CHECK_VERSION_AFTER_HEADER) &&
+            frame_check_len(version) == 0) {
+            type = NULL;
+        }
+    }
+
+    if (type == NULL && parser->type == NULL) {
+        // not part of any frame we know about
+        if (!parser->discarding) {
+            parser->discarding = true;
+            count(&parser->stats.resyncs);
+        }
+        count(&parser->stats.bytes_discarded);
+        return;
+    }
+
+    if (type != NULL) {
+        parser->type = type;
+    } else if (parser->len == sizeof(parser->frame)) {
+        // a prefix that's too long for us
+        radio_parser_reset(parser);
+        count(&parser->stats.bad_checks);
+        return;
+    }
+    // anything else is appended, even if it isn't base64, since FEC might be
+    // able to fix it
+    parser->frame[parser->len++] = (char) c;
+
+    if (parser->expected == 0) {
+        parser->expected = expected_len(parser, version);
+        if (parser->expected == 0 && parser->type->body_len == 0 &&
+            parser->len >= parser->type->prefix_len) {
+            // the prefix makes no sense, so neither does the rest of it
+            radio_parser_reset(parser);
+            count(&parser->stats.bad_checks);
+            return;
+        }
+        if (parser->expected > sizeof(parser->frame)) {
+            // a frame type that's too long for us
+            radio_parser_reset(parser);
+            count(&parser->stats.bad_checks);
+            return;
+        }
+    }
+    fold_byte(parser, c, version);
+    if (parser->len == parser->expected) {
+        finish_frame(parser, version);
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef RADIO_PARSER_H_
+#define RADIO_PARSER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "serialize.h"
+
+/*
+ * Streaming parser for ASCII radio frames. Bytes go in one at a time as they
+ * come off the UART, and whole frames come out, checked, through a callback.
+ *
+ * Which frames it knows about, and how long each one is, comes from a table
+ * of radio_frame_type_t, one entry per header character. Every header is
+ * outside the base64 alphabet that frame bodies and frame checks are made of,
+ * so a header byte can never be part of a frame. Whenever one arrives, the
+ * parser drops whatever it was in the middle of and starts on the new frame
+ * straight away. Bytes that aren't part of any frame are thrown away until
+ * the next header. So a dropped byte, a header corrupted into something
+ * else, or a frame type we don't know about only ever costs the frames it
+ * touched.
+ *
+ * Everything the parser needs to know lives in a radio_parser_t, so there can
+ * be more than one of them.
+ */
+
+// The longest frame, frame check included, that any table can describe
+#define RADIO_PARSER_MAX_LEN (RADIO_FRAME_MAX_BODY_LEN + FRAME_CHECK_MAX_LEN)
+
+enum RADIO_PARSER_CHECK {
+    // one character queries and the like, which have no frame check
+    PARSER_CHECK_NONE,
+    // the frame check of whatever version the parser's being fed in. These
+    // aren't accepted in versions without an ASCII frame check
+    PARSER_CHECK_VERSION,
+    // the same, but the frame check doesn't cover the header (state commands)
+    PARSER_CHECK_VERSION_AFTER_HEADER,
+    // always a RADIO_PROTOCOL_V1 frame check (version selects)
+    PARSER_CHECK_V1,
+};
+
+typedef struct {
+    char header;
+    // length of the frame without its frame check, header included. 0 if
+    // that depends on what's in the frame, in which case variable_body_len
+    // works it out from the first prefix_len characters, and returns 0 if
+    // they don't make sense
+    uint8_t body_len;
+    uint8_t prefix_len;
+    uint8_t (*variable_body_len)(const char *prefix);
+    enum RADIO_PARSER_CHECK check;
+} radio_frame_type_t;
+
+/*
+ * Called with every frame that passes its frame check (after forward error
+ * correction in versions that have it). body_len doesn't include the frame
+ * check
+ */
+typedef void (*radio_frame_handler_t)(char *frame, uint8_t body_len);
+
+typedef struct {
+    uint16_t frames_ok;
+    uint16_t bad_checks;        // complete frames whose frame check was wrong
+    uint16_t truncated;         // frames cut short by another header
+    uint16_t resyncs;           // runs of bytes thrown away between frames
+    uint16_t bytes_discarded;
+    uint16_t fec_corrected;     // frames that FEC had to fix
+    uint16_t fec_uncorrectable;
+} radio_parser_stats_t;
+
+typedef struct {
+    const radio_frame_type_t *types;
+    uint8_t num_types;
+    radio_frame_handler_t handler;
+    radio_parser_stats_t stats;
+
+    // the frame we're in the middle of, if type isn't NULL
+    const radio_frame_type_t *type;
+    char frame[RADIO_PARSER_MAX_LEN];
+    uint8_t len;
+    // how long the frame is, frame check included. 0 until we know
+    uint8_t expected;
+    // the frame check of the body so far, in versions where it's worked out
+    // as the bytes arrive rather than once the whole frame is here
+    uint16_t check;
+    // whether the last byte was thrown away, so that a run of them counts as
+    // one resync
+    bool discarding;
+} radio_parser_t;
+
+/*
+ * Sets up parser to recognize the num_types frames in types (which it keeps
+ * a pointer to, rather than copying) and hand them to handler. Clears the
+ * stats
+ */
+void init_radio_parser(radio_parser_t *parser, const radio_frame_type_t *types,
+                       uint8_t num_types, radio_frame_handler_t handler);
+
+/*
+ * Feeds the parser one byte, received in version. If that finishes a frame
+ * with a good frame check, the handler is called before this returns
+ */
+void radio_parser_feed(radio_parser_t *parser, uint8_t c,
+                       enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Whether c is the header of one of parser's frame types
+ */
+bool radio_parser_is_header(const radio_parser_t *parser, uint8_t c);
+
+/*
+ * Whether the parser is part way through a frame
+ */
+bool radio_parser_in_frame(const radio_parser_t *parser);
+
+/*
+ * Forgets any frame the parser is part way through, without counting it as
+ * truncated
+ */
+void radio_parser_reset(radio_parser_t *parser);
+
+#endif
@@ -0,0 +1,168 @@
+#include "radio_tx.h"
+#include "uart.h"
+#include "pic18_time.h" // for millis()
+#include <string.h> // for memcpy
+
+// How far ahead of the UART we let ourselves get, in bytes. About one
+// radio_heartbeat's worth, so that the UART doesn't sit idle between calls
+// to radio_tx_service, while anything new never has much to wait behind
+#define RADIO_TX_LOOKAHEAD_MS 15
+#define RADIO_TX_LOOKAHEAD_BYTES (RADIO_TX_BYTES_PER_S * RADIO_TX_LOOKAHEAD_MS / 1000 + 1)
+
+/*
+ * Each class's share of the link. rate is in bytes a second (0 for no
+ * limit), and burst is how many bytes it can save up, which has to be at
+ * least a whole frame
+ */
+typedef struct {
+    uint16_t rate;
+    uint16_t burst;
+} radio_tx_budget_t;
+
+static const radio_tx_budget_t budgets[RADIO_TX_NUM_CLASSES] = {
+    [RADIO_TX_SAFETY] = { 0, 0 },
+    [RADIO_TX_ERROR] = { RADIO_TX_BYTES_PER_S / 4, 4 * RADIO_TX_MAX_FRAME_LEN },
+    [RADIO_TX_GPS] = { RADIO_TX_BYTES_PER_S / 20, RADIO_TX_MAX_FRAME_LEN },
+    [RADIO_TX_DEBUG] = { RADIO_TX_BYTES_PER_S / 10, 2 * RADIO_TX_MAX_FRAME_LEN },
+};
+
+#if RADIO_TX_LOOKAHEAD_BYTES + RADIO_TX_MAX_FRAME_LEN >= UART_TX_BUFFER_LEN
+#error "the UART transmit buffer can't hold what radio_tx_service gives it"
+#endif
+
+typedef struct {
+    uint8_t len;
+    uint32_t queued_ms;
+    uint8_t data[RADIO_TX_MAX_FRAME_LEN];
+} radio_tx_frame_t;
+
+typedef struct {
+    radio_tx_frame_t frames[RADIO_TX_QUEUE_DEPTH];
+    uint8_t head;
+    // tokens are in thousandths of a byte, so that they can be topped up
+    // every millisecond without rounding away
+    uint32_t tokens;
+    radio_tx_stats_t stats;
+} radio_tx_queue_t;
+
+static radio_tx_queue_t queues[RADIO_TX_NUM_CLASSES];
+static bool buckets_full = false;
+static uint32_t last_refill_ms = 0;
+
+static void refill_buckets(void)
+{
+    uint32_t now = millis();
+    uint32_t elapsed = now - last_refill_ms;
+    uint8_t cls;
+    // they all start out full, and anything over a minute fills them anyway
+    if (!buckets_full || elapsed > 60000) {
+        elapsed = 60000;
+        buckets_full = true;
+    }
+    last_refill_ms = now;
+    for (cls = 0; cls < RADIO_TX_NUM_CLASSES; ++cls) {
+        uint32_t cap = (uint32_t) budgets[cls].burst * 1000;
+        queues[cls].tokens += elapsed * budgets[cls].rate;
+        if (queues[cls].tokens > cap) {
+            queues[cls].tokens = cap;
+        }
+    }
+}
+
+// whether cls can afford to send len bytes right now
+static bool affordable(uint8_t cls, uint8_t len)
+{
+    return budgets[cls].rate == 0 || queues[cls].tokens >= (uint32_t) len * 1000;
+}
+
+bool radio_tx_send(enum RADIO_TX_CLASS cls, const uint8_t *frame, uint8_t len)
+{
+    if (cls >= RADIO_TX_NUM_CLASSES || len == 0 || len > RADIO_TX_MAX_FRAME_LEN) {
+        return false;
+    }
+    radio_tx_queue_t *q = &queues[cls];
+    if (q->stats.depth == RADIO_TX_QUEUE_DEPTH) {
+        if (q->stats.frames_dropped < UINT16_MAX) {
+            q->stats.frames_dropped++;
+        }
+        return false;
+    }
+    radio_tx_frame_t *slot = &q->frames[(q->head + q->stats.depth) % RADIO_TX_QUEUE_DEPTH];
+    memcpy(slot->data, frame, len);
+    slot->len = len;
+    slot->queued_ms = millis();
+    q->stats.depth++;
+    if (q->stats.depth > q->stats.max_depth) {
+        q->stats.max_depth = q->stats.depth;
+    }
+    radio_tx_service();
+    return true;
+}
+
+bool radio_tx_ready(enum RADIO_TX_CLASS cls)
+{
+    if (cls >= RADIO_TX_NUM_CLASSES) {
+        return false;
+    }
+    refill_buckets();
+    return queues[cls].stats.depth < RADIO_TX_QUEUE_DEPTH &&
+           affordable(cls, RADIO_TX_MAX_FRAME_LEN);
+}
+
+void radio_tx_service(void)
+{
+    refill_buckets();
+    while (uart_transmit_pending() < RADIO_TX_LOOKAHEAD_BYTES) {
+        // the highest priority class with a frame it can afford
+        uint8_t cls;
+        radio_tx_queue_t *q = NULL;
+        for (cls = 0; cls < RADIO_TX_NUM_CLASSES; ++cls) {
+            if (queues[cls].stats.depth > 0 &&
+                affordable(cls, queues[cls].frames[queues[cls].head].len)) {
+                q = &queues[cls];
+                break;
+            }
+        }
+        if (q == NULL) {
+            return;
+        }
+
+        radio_tx_frame_t *frame = &q->frames[q->head];
+        uart_transmit_buffer(frame->data, frame->len);
+        if (budgets[cls].rate != 0) {
+            q->tokens -= (uint32_t) frame->len * 1000;
+        }
+        q->head = (q->head + 1) % RADIO_TX_QUEUE_DEPTH;
+        q->stats.depth--;
+
+        uint32_t latency = millis() - frame->queued_ms;
+        if (latency > UINT16_MAX) {
+            latency = UINT16_MAX;
+        }
+        if (latency > q->stats.max_latency_ms) {
+            q->stats.max_latency_ms = (uint16_t) latency;
+        }
+        if (q->stats.frames_sent < UINT16_MAX) {
+            q->stats.frames_sent++;
+            q->stats.total_latency_ms += latency;
+        }
+        q->stats.bytes_sent += frame->len;
+    }
+}
+
+void radio_tx_flush(void)
+{
+    uint8_t cls;
+    for (cls = 0; cls < RADIO_TX_NUM_CLASSES; ++cls) {
+        radio_tx_stats_t *stats = &queues[cls].stats;
+        stats->frames_dropped += stats->depth;
+        stats->depth = 0;
+    }
+}
+
+void radio_tx_get_stats(enum RADIO_TX_CLASS cls, radio_tx_stats_t *stats)
+{
+    if (cls < RADIO_TX_NUM_CLASSES) {
+        *stats = queues[cls].stats;
+    }
+}
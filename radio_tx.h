@@ -0,0 +1,90 @@
+#ifndef RADIO_TX_H_
+#define RADIO_TX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "serialize.h"
+
+/*
+ * Radio transmit scheduler. Everything the radio board sends goes through
+ * here rather than straight into the UART, in one of a few priority classes.
+ * Frames wait in a small queue per class, and only go to the UART once it's
+ * nearly done with what it already has, so there's never more than a frame
+ * or so ahead of anything new. When the link is free, the highest priority
+ * class with a frame waiting goes first, so a state reply waits for at most
+ * the one frame that's already going out, however many errors are queued up
+ * behind it.
+ *
+ * Every class but RADIO_TX_SAFETY also has a token bucket, which limits it
+ * to a share of the link's airtime (worked out from RADIO_TX_BAUD) with some
+ * room for bursts. A class that's used up its share waits, and lower
+ * priority classes get a turn in the meantime.
+ */
+
+enum RADIO_TX_CLASS {
+    RADIO_TX_SAFETY = 0,    // state and version replies, anything RLCS is waiting on
+    RADIO_TX_ERROR,         // error frames
+    RADIO_TX_GPS,           // GPS positions
+    RADIO_TX_DEBUG,         // perf stats and telemetry summaries
+    RADIO_TX_NUM_CLASSES
+};
+
+// Baud rate of the radio link, and how many bytes a second that is with 8N1
+// framing (10 bits a byte)
+#ifndef RADIO_TX_BAUD
+#define RADIO_TX_BAUD 9600
+#endif
+#define RADIO_TX_BYTES_PER_S (RADIO_TX_BAUD / 10)
+
+// How many frames each class can have waiting
+#define RADIO_TX_QUEUE_DEPTH 2
+
+// The longest frame that can be queued, ASCII or binary
+#define RADIO_TX_MAX_FRAME_LEN                                                  \
+    (RADIO_FRAME_MAX_BODY_LEN + FRAME_CHECK_MAX_LEN > BINARY_FRAME_MAX_LEN ?    \
+     RADIO_FRAME_MAX_BODY_LEN + FRAME_CHECK_MAX_LEN : BINARY_FRAME_MAX_LEN)
+
+typedef struct {
+    uint16_t frames_sent;
+    uint16_t frames_dropped;    // frames that were queued while the queue was full
+    uint32_t bytes_sent;
+    uint8_t depth;              // frames waiting right now
+    uint8_t max_depth;
+    // from radio_tx_send to the frame going to the UART
+    uint16_t max_latency_ms;
+    uint32_t total_latency_ms;  // divide by frames_sent for the mean
+} radio_tx_stats_t;
+
+/*
+ * Queues len bytes of frame to be sent in class cls, and sends it straight
+ * away if the link is free. Returns false if the class's queue is full, in
+ * which case the frame is dropped
+ */
+bool radio_tx_send(enum RADIO_TX_CLASS cls, const uint8_t *frame, uint8_t len);
+
+/*
+ * Whether a frame queued in cls now would go out soon: there's room in the
+ * queue, and the class hasn't used up its share of the link. Worth checking
+ * before taking something out of a buffer of its own just to queue it
+ */
+bool radio_tx_ready(enum RADIO_TX_CLASS cls);
+
+/*
+ * Hands the next frames to the UART, if it's ready for them. Call often (every
+ * radio_heartbeat at least), since nothing goes out between calls other than
+ * from radio_tx_send
+ */
+void radio_tx_service(void);
+
+/*
+ * Throws away every frame that's waiting, counting them as dropped. For when
+ * they're no use any more, like after switching protocol versions
+ */
+void radio_tx_flush(void);
+
+/*
+ * Copies the stats for class cls into stats
+ */
+void radio_tx_get_stats(enum RADIO_TX_CLASS cls, radio_tx_stats_t *stats);
+
+#endif
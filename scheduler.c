@@ -0,0 +1,77 @@
+#include "scheduler.h"
+#include "pic18_time.h"
+#include "perf_stats.h"
+#include <stddef.h> // for NULL
+
+static struct {
+    scheduler_task_t run;
+    uint16_t period_ms;
+    uint32_t next_deadline_ms;
+} tasks[SCHEDULER_MAX_TASKS];
+
+static uint8_t num_tasks = 0;
+
+/*
+ * Returns true if deadline is at or before now. Done with a signed difference
+ * so that it keeps working when millis() wraps around after 49 days
+ */
+static bool deadline_passed(uint32_t deadline, uint32_t now)
+{
+    return (int32_t) (now - deadline) >= 0;
+}
+
+void init_scheduler(void)
+{
+    num_tasks = 0;
+}
+
+bool scheduler_add_task(scheduler_task_t task, uint16_t period_ms)
+{
+    if (task == NULL || num_tasks == SCHEDULER_MAX_TASKS) {
+        return false;
+    }
+    tasks[num_tasks].run = task;
+    tasks[num_tasks].period_ms = period_ms;
+    tasks[num_tasks].next_deadline_ms = millis();
+    ++num_tasks;
+    return true;
+}
+
+void scheduler_run_due_tasks(void)
+{
+    uint8_t i;
+    for (i = 0; i < num_tasks; ++i) {
+        uint32_t now = millis();
+        if (!deadline_passed(tasks[i].next_deadline_ms, now)) {
+            continue;
+        }
+
+        uint32_t start_us = micros();
+        tasks[i].run();
+        perf_stats_record(PERF_SLOT_FIRST_TASK + i, micros() - start_us);
+
+        tasks[i].next_deadline_ms += tasks[i].period_ms;
+        //if we're still behind after that, we missed at least one whole
+        //period. Don't try to catch up, just start counting from now
+        if (deadline_passed(tasks[i].next_deadline_ms, now)) {
+            tasks[i].next_deadline_ms = now + tasks[i].period_ms;
+        }
+    }
+}
+
+uint32_t scheduler_ms_until_next_deadline(void)
+{
+    uint32_t now = millis();
+    uint32_t earliest = UINT32_MAX;
+    uint8_t i;
+    for (i = 0; i < num_tasks; ++i) {
+        if (deadline_passed(tasks[i].next_deadline_ms, now)) {
+            return 0;
+        }
+        uint32_t remaining = tasks[i].next_deadline_ms - now;
+        if (remaining < earliest) {
+            earliest = remaining;
+        }
+    }
+    return earliest;
+}
@@ -0,0 +1,51 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A small cooperative scheduler. Application code registers its periodic
+ * heartbeat functions with scheduler_add_task, and the main loop calls
+ * scheduler_run_due_tasks every time it wakes up. Each task has its own next
+ * deadline (in millis() time), so a task only runs once its period has
+ * elapsed, and the main loop can sleep until the earliest deadline instead of
+ * spinning on a fixed delay.
+ *
+ * None of this touches any registers, so it builds on the host against a fake
+ * millis() for testing.
+ */
+
+// How many tasks can be registered. Bump this if you add a heartbeat
+#define SCHEDULER_MAX_TASKS 10
+
+typedef void (*scheduler_task_t)(void);
+
+/*
+ * Call this function at bootup, before adding any tasks. Clears the task table
+ */
+void init_scheduler(void);
+
+/*
+ * Registers task to be run every period_ms milliseconds. The task is due
+ * immediately, so it will run on the next call to scheduler_run_due_tasks.
+ * Tasks are run in the order that they were added. Returns false if the task
+ * table is full or task is NULL
+ */
+bool scheduler_add_task(scheduler_task_t task, uint16_t period_ms);
+
+/*
+ * Runs every task whose deadline has passed, and moves its deadline forward by
+ * one period. If a task has fallen more than a whole period behind (because
+ * something else hogged the CPU), it is rescheduled one period from now
+ * rather than being run several times in a row to catch up.
+ */
+void scheduler_run_due_tasks(void);
+
+/*
+ * Returns the number of milliseconds until the earliest task deadline, or 0
+ * if a task is already due. If there are no tasks, returns UINT32_MAX.
+ */
+uint32_t scheduler_ms_until_next_deadline(void);
+
+#endif
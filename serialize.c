@@ -2,38 +2,336 @@
 #include <string.h>
 #include <stddef.h> // for NULL
 
+/*
+ * Both directions of the modified base64 alphabet are plain table lookups.
+ * Every character we send or receive over the radio goes through one of these
+ * tables, so they're kept in program memory rather than recomputed with a
+ * chain of comparisons each time
+ */
+static const char base64_encode_table[64] = {
+    'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+    'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
+    'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+    'w', 'x', 'y', 'z', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '&', '/',
+};
+
+// XX marks characters that aren't in the alphabet
+#define XX BASE64_INVALID
+static const uint8_t base64_decode_table[256] = {
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, // 0x00
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, // 0x10
+    XX, XX, XX, XX, XX, XX, 62, XX, XX, XX, XX, XX, XX, XX, XX, 63, // 0x20
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, XX, XX, XX, XX, XX, XX, // 0x30
+    XX,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, // 0x40
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, XX, XX, XX, XX, XX, // 0x50
+    XX, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, // 0x60
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, XX, XX, XX, XX, XX, // 0x70
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, // 0x80
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, // 0x90
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, // 0xA0
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, // 0xB0
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, // 0xC0
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, // 0xD0
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, // 0xE0
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, // 0xF0
+};
+#undef XX
+
 char binary_to_base64(uint8_t binary)
 {
-    if (binary <= 25)
-        return binary + 'A';
-    if (binary <= 51)
-        return (binary - 26) + 'a';
-    if (binary <= 61)
-        return (binary - 52) + '0';
-    if (binary == 62)
-        return '&';
-    if (binary == 63)
-        return '/';
-    // ***TODO***: return an error in all other cases
-    return 0;
+    if (binary > 63) {
+        return 0;
+    }
+    return base64_encode_table[binary];
 }
 
 uint8_t base64_to_binary(char base64)
 {
-    if ('A' <= base64 && base64 <= 'Z')
-        return base64 - 'A';
-    if ('a' <= base64 && base64 <= 'z')
-        return base64 - 'a' + 26;
-    if ('0' <= base64 && base64 <= '9')
-        return base64 - '0' + 52;
-    if (base64 == '&')
-        return 62;
-    if (base64 == '/')
-        return 63;
-    // ***TODO***: return an error in all other cases
-    return 255;
+    return base64_decode_table[(uint8_t) base64];
+}
+
+void encode_bits(const uint8_t *bits, char *str, uint8_t len)
+{
+    uint8_t i;
+    for (i = 0; i < len; ++i) {
+        str[i] = base64_encode_table[bits[i] & 0x3f];
+    }
+}
+
+bool decode_bits(const char *str, uint8_t *bits, uint8_t len)
+{
+    uint8_t i;
+    for (i = 0; i < len; ++i) {
+        // stop at the first bad character, so that a short (null
+        // terminated) string never gets read past its end
+        uint8_t sextet = base64_decode_table[(uint8_t) str[i]];
+        if (sextet == BASE64_INVALID) {
+            return false;
+        }
+        bits[i] = sextet;
+    }
+    return true;
 }
 
+/*
+ * The bit packing engine. Everything below works on arrays of sextets (6 bit
+ * values, one per base64 character), most significant bit first.
+ */
+
+/*
+ * Writes the bottom width bits of value into sextets, starting bit_pos bits
+ * into the stream, and advances bit_pos. Works a sextet at a time rather than
+ * a bit at a time. sextets must be zeroed beforehand
+ */
+static void pack_bits(uint8_t *sextets, uint16_t *bit_pos, uint32_t value, uint8_t width)
+{
+    while (width > 0) {
+        uint8_t space = 6 - (*bit_pos % 6);
+        uint8_t take = width < space ? width : space;
+        uint8_t chunk = (value >> (width - take)) & ((1u << take) - 1);
+        sextets[*bit_pos / 6] |= chunk << (space - take);
+        *bit_pos += take;
+        width -= take;
+    }
+}
+
+/*
+ * Reads width bits out of sextets, starting bit_pos bits into the stream, and
+ * advances bit_pos. If is_signed, the top bit read is a sign bit
+ */
+static uint32_t unpack_bits(const uint8_t *sextets, uint16_t *bit_pos, uint8_t width,
+                            bool is_signed)
+{
+    uint32_t value = 0;
+    uint8_t remaining = width;
+    while (remaining > 0) {
+        uint8_t space = 6 - (*bit_pos % 6);
+        uint8_t take = remaining < space ? remaining : space;
+        uint8_t chunk = (sextets[*bit_pos / 6] >> (space - take)) & ((1u << take) - 1);
+        value = (value << take) | chunk;
+        *bit_pos += take;
+        remaining -= take;
+    }
+    if (is_signed && (value & ((uint32_t) 1 << (width - 1)))) {
+        value |= ~(((uint32_t) 1 << (width - 1)) - 1);
+    }
+    return value;
+}
+
+/*
+ * These generate the pack and unpack functions for a frame schema (see the
+ * comment on STATE_FIELDS in serialize.h):
+ *
+ *   static void pack_<frame>(const type *src, uint8_t *sextets);
+ *   static void unpack_<frame>(type *dst, const uint8_t *sextets);
+ *
+ * Each one is a straight line of calls to pack_bits/unpack_bits, one per
+ * field, with the widths as constants. Frames that only ever go one way only
+ * get the half they need.
+ */
+#define PACK_FIELD(name, width, signedness) \
+    pack_bits(sextets, &bit_pos, (uint32_t) src->name, width);
+#define UNPACK_FIELD(name, width, signedness) \
+    dst->name = unpack_bits(sextets, &bit_pos, width, signedness);
+
+#define DEFINE_FRAME_PACK(frame, type, FIELDS)                          \
+    static void pack_##frame(const type *src, uint8_t *sextets)         \
+    {                                                                   \
+        uint16_t bit_pos = 0;                                           \
+        memset(sextets, 0, SCHEMA_CHARS(FIELDS));                       \
+        FIELDS(PACK_FIELD)                                              \
+    }
+#define DEFINE_FRAME_UNPACK(frame, type, FIELDS)                        \
+    static void unpack_##frame(type *dst, const uint8_t *sextets)       \
+    {                                                                   \
+        uint16_t bit_pos = 0;                                           \
+        FIELDS(UNPACK_FIELD)                                            \
+    }
+#define DEFINE_FRAME_CODEC(frame, type, FIELDS)                         \
+    DEFINE_FRAME_PACK(frame, type, FIELDS)                              \
+    DEFINE_FRAME_UNPACK(frame, type, FIELDS)
+
+/*
+ * The same again for schemas that also go inside a bundle, where they don't
+ * start at the beginning of the bitstream:
+ *
+ *   static void pack_<record>_record(const type *src, uint8_t *sextets,
+ *                                    uint16_t *pos);
+ *   static void unpack_<record>_record(type *dst, const uint8_t *sextets,
+ *                                      uint16_t *pos);
+ *
+ * which start pos bits in, and advance pos past the record.
+ */
+#define DEFINE_RECORD_CODEC(record, type, FIELDS)                               \
+    static void pack_##record##_record(const type *src, uint8_t *sextets,       \
+                                       uint16_t *pos)                           \
+    {                                                                           \
+        uint16_t bit_pos = *pos;                                                \
+        FIELDS(PACK_FIELD)                                                      \
+        *pos = bit_pos;                                                         \
+    }                                                                           \
+    static void unpack_##record##_record(type *dst, const uint8_t *sextets,     \
+                                         uint16_t *pos)                         \
+    {                                                                           \
+        uint16_t bit_pos = *pos;                                                \
+        FIELDS(UNPACK_FIELD)                                                    \
+        *pos = bit_pos;                                                         \
+    }
+
+/*
+ * Frames whose wire fields don't map straight onto a public struct get a
+ * private one here, and the public functions fill it in
+ */
+
+// lat_north and lon_east are 1 for 'N' and 'E', 0 for 'S' and 'W'
+typedef struct {
+    uint8_t lat_deg, lat_min, lat_dmin;
+    uint8_t lon_deg, lon_min, lon_dmin;
+    bool lat_north, lon_east;
+} gps_frame_t;
+
+#define GPS_FIELDS(X)                   \
+    X(lat_deg,   8, FIELD_UNSIGNED)     \
+    X(lat_min,   8, FIELD_UNSIGNED)     \
+    X(lat_dmin,  8, FIELD_UNSIGNED)     \
+    X(lon_deg,   8, FIELD_UNSIGNED)     \
+    X(lon_min,   8, FIELD_UNSIGNED)     \
+    X(lon_dmin,  8, FIELD_UNSIGNED)     \
+    X(lat_north, 1, FIELD_UNSIGNED)     \
+    X(lon_east,  1, FIELD_UNSIGNED)
+
+// see create_perf_stats_message in serialize.h
+typedef struct {
+    uint8_t slot;
+    uint32_t count;
+    uint16_t min_us, mean_us, max_us;
+    uint8_t shares[PERF_STATS_NUM_BUCKETS];
+} perf_frame_t;
+
+#define PERF_FIELDS(X)                  \
+    X(slot,      6,  FIELD_UNSIGNED)    \
+    X(count,     24, FIELD_UNSIGNED)    \
+    X(min_us,    16, FIELD_UNSIGNED)    \
+    X(mean_us,   16, FIELD_UNSIGNED)    \
+    X(max_us,    16, FIELD_UNSIGNED)    \
+    X(shares[0], 8,  FIELD_UNSIGNED)    \
+    X(shares[1], 8,  FIELD_UNSIGNED)    \
+    X(shares[2], 8,  FIELD_UNSIGNED)    \
+    X(shares[3], 8,  FIELD_UNSIGNED)    \
+    X(shares[4], 8,  FIELD_UNSIGNED)    \
+    X(shares[5], 8,  FIELD_UNSIGNED)    \
+    X(shares[6], 8,  FIELD_UNSIGNED)    \
+    X(shares[7], 8,  FIELD_UNSIGNED)
+
+typedef struct {
+    uint8_t quantity;
+    telem_summary_t summary;
+} telemetry_frame_t;
+
+#define TELEMETRY_FIELDS(X)                             \
+    X(quantity,                 6,  FIELD_UNSIGNED)     \
+    X(summary.latest,           16, FIELD_UNSIGNED)     \
+    X(summary.rate_per_min,     16, FIELD_SIGNED)       \
+    X(summary.min,              16, FIELD_UNSIGNED)     \
+    X(summary.max,              16, FIELD_UNSIGNED)     \
+    X(summary.bucket_means[0],  16, FIELD_UNSIGNED)     \
+    X(summary.bucket_means[1],  16, FIELD_UNSIGNED)     \
+    X(summary.bucket_means[2],  16, FIELD_UNSIGNED)     \
+    X(summary.bucket_means[3],  16, FIELD_UNSIGNED)     \
+    X(summary.bucket_means[4],  16, FIELD_UNSIGNED)     \
+    X(summary.bucket_means[5],  16, FIELD_UNSIGNED)     \
+    X(summary.bucket_means[6],  16, FIELD_UNSIGNED)     \
+    X(summary.bucket_means[7],  16, FIELD_UNSIGNED)
+
+// see create_board_stats_message in serialize.h
+typedef struct {
+    uint8_t page;
+    board_stats_t stats;
+} board_stats_frame_t;
+
+#define BOARD_STATS_FIELDS(X)                           \
+    X(page,                     6,  FIELD_UNSIGNED)     \
+    X(stats.counters[0],        24, FIELD_UNSIGNED)     \
+    X(stats.counters[1],        24, FIELD_UNSIGNED)     \
+    X(stats.counters[2],        24, FIELD_UNSIGNED)     \
+    X(stats.counters[3],        24, FIELD_UNSIGNED)     \
+    X(stats.counters[4],        24, FIELD_UNSIGNED)     \
+    X(stats.counters[5],        24, FIELD_UNSIGNED)
+
+// see SEQ_COMMAND_HEADER in serialize.h
+#define COMMAND_ACK_FIELDS(X)                           \
+    X(seq,                      6,  FIELD_UNSIGNED)     \
+    X(last_seq,                 6,  FIELD_UNSIGNED)     \
+    X(accepted,                 1,  FIELD_UNSIGNED)     \
+    X(injector_valve_state,     2,  FIELD_UNSIGNED)     \
+    X(vent_valve_state,         2,  FIELD_UNSIGNED)     \
+    X(bus_is_powered,           1,  FIELD_UNSIGNED)
+
+/*
+ * Make sure that the frame lengths in the headers still match the schemas.
+ * If one of these fires, you changed a schema, so update the length (and
+ * RLCS)
+ */
+#if SCHEMA_CHARS(STATE_FIELDS) != SERIALIZED_OUTPUT_LEN - 1
+#error "STATE_FIELDS doesn't match SERIALIZED_OUTPUT_LEN"
+#endif
+#if SCHEMA_CHARS(ERROR_FIELDS) != ERROR_COMMAND_LENGTH - 1
+#error "ERROR_FIELDS doesn't match ERROR_COMMAND_LENGTH"
+#endif
+#if SCHEMA_CHARS(GPS_FIELDS) != GPS_MSG_BODY_LEN - 1
+#error "GPS_FIELDS doesn't match GPS_MSG_BODY_LEN"
+#endif
+#if SCHEMA_CHARS(PERF_FIELDS) != PERF_STATS_MSG_BODY_LEN - 1
+#error "PERF_FIELDS doesn't match PERF_STATS_MSG_BODY_LEN"
+#endif
+#if SCHEMA_CHARS(TELEMETRY_FIELDS) != TELEMETRY_SUMMARY_MSG_BODY_LEN - 1
+#error "TELEMETRY_FIELDS doesn't match TELEMETRY_SUMMARY_MSG_BODY_LEN"
+#endif
+#if SCHEMA_CHARS(BOARD_STATS_FIELDS) != BOARD_STATS_MSG_BODY_LEN - 1
+#error "BOARD_STATS_FIELDS doesn't match BOARD_STATS_MSG_BODY_LEN"
+#endif
+#if BOARD_STATS_NUM_COUNTERS != 6
+#error "BOARD_STATS_FIELDS lists 6 counters"
+#endif
+#if BOARD_STATS_MSG_BODY_LEN > RADIO_FRAME_MAX_BODY_LEN
+#error "board stats messages are longer than RADIO_FRAME_MAX_BODY_LEN"
+#endif
+#if SCHEMA_CHARS(COMMAND_ACK_FIELDS) != COMMAND_ACK_BODY_LEN - 1
+#error "COMMAND_ACK_FIELDS doesn't match COMMAND_ACK_BODY_LEN"
+#endif
+#if STATE_DELTA_MAX_BODY_LEN > RADIO_FRAME_MAX_BODY_LEN
+#error "delta state frames are longer than RADIO_FRAME_MAX_BODY_LEN"
+#endif
+#if SCHEMA_BITS(GPS_FIELDS) > ERROR_REPORT_BITS
+#error "BUNDLE_MAX_BODY_LEN assumes that error reports are the longest"
+#endif
+#if (1 << (SCHEMA_BITS(ERROR_REPEAT_FIELDS) / 2)) - 1 != ERROR_REPEAT_MAX
+#error "ERROR_REPEAT_MAX doesn't match ERROR_REPEAT_FIELDS"
+#endif
+#if TELEMETRY_SUMMARY_MSG_BODY_LEN > RADIO_FRAME_MAX_BODY_LEN
+#error "telemetry summaries are longer than RADIO_FRAME_MAX_BODY_LEN"
+#endif
+#if BUNDLE_MAX_RECORDS > 3
+#error "the error count in a bundle is only 2 bits"
+#endif
+#if SCHEMA_FIELDS(STATE_FIELDS) > 8
+#error "the changed field bitmap of delta state frames doesn't fit in a uint8_t"
+#endif
+#if PERF_STATS_NUM_BUCKETS != 8 || TELEM_SUMMARY_BUCKETS != 8
+#error "PERF_FIELDS and TELEMETRY_FIELDS list 8 buckets each"
+#endif
+
+DEFINE_FRAME_CODEC(state, system_state, STATE_FIELDS)
+DEFINE_FRAME_CODEC(error, error_t, ERROR_FIELDS)
+DEFINE_FRAME_CODEC(gps, gps_frame_t, GPS_FIELDS)
+DEFINE_FRAME_PACK(perf, perf_frame_t, PERF_FIELDS)
+DEFINE_FRAME_CODEC(telemetry, telemetry_frame_t, TELEMETRY_FIELDS)
+DEFINE_FRAME_CODEC(board_stats, board_stats_frame_t, BOARD_STATS_FIELDS)
+DEFINE_FRAME_CODEC(command_ack, command_ack_t, COMMAND_ACK_FIELDS)
+DEFINE_RECORD_CODEC(error, error_t, ERROR_FIELDS)
+DEFINE_RECORD_CODEC(error_repeat, error_report_t, ERROR_REPEAT_FIELDS)
+DEFINE_RECORD_CODEC(gps, gps_frame_t, GPS_FIELDS)
+
 bool serialize_state(const system_state *state, char *str)
 {
     if (state == NULL)
@@ -41,58 +339,10 @@ bool serialize_state(const system_state *state, char *str)
     if (str == NULL)
         return false;
 
-    uint8_t raw = 0;
-    // Bits 5-2 represent the number of boards connected
-    raw |= (state->num_boards_connected & 0b00001111) << 2;
-    // Bits 1-0 represent injector valve state
-    raw |= (state->injector_valve_state & 0x3);
-    str[0] = binary_to_base64(raw);
-
-    raw = 0;
-    // Bits 5-4 represent vent valve state
-    raw |= ((state->vent_valve_state & 0x3) << 4);
-    // Bits 3-0 are the top bits 9-6 of the tank pressure
-    raw |= ((state->tank_pressure >> 6) & 0xf);
-    str[1] = binary_to_base64(raw);
-
-    // Use all the bits of this next one to hold bits 5-0 of tank pressure
-    raw = (state->tank_pressure & 0x3f);
-    str[2] = binary_to_base64(raw);
-
-    raw = 0;
-    // Bit 5 represents whether the bus is should be powered
-    if (state->bus_is_powered)
-        raw |= 0b00100000;
-    // Bit 4 represents whether errors have been detected
-    if (state->any_errors_detected)
-        raw |= 0b00010000;
-    // Bits 3-0 are the top bits 13-10 of the bus battery voltage
-    raw |= (state->bus_battery_voltage_mv >> 10) & 0xf;
-    str[3] = binary_to_base64(raw);
-
-    raw = 0;
-    // Bits 5-0 hold bits 9-4 of the bus battery voltage
-    raw = (state->bus_battery_voltage_mv >> 4) & 0x3f ;
-    str[4] = binary_to_base64(raw);
-
-    raw = 0;
-    // Bits 5-2 hold bits 3-0 of the bus battery voltage
-    raw = (state->bus_battery_voltage_mv & 0xf) << 2;
-    // Bits 1-0 hold bits 13-12 of the vent battery voltage
-    raw |= (state->vent_battery_voltage_mv >> 12) & 0x3;
-    str[5] = binary_to_base64(raw);
-
-    raw = 0;
-    // Bits 5-0 hold bits 11-6 of the vent battery voltage
-    raw = (state->vent_battery_voltage_mv >> 6) & 0x3f;
-    str[6] = binary_to_base64(raw);
-
-    raw = 0;
-    // Bits 5-0 hold bits 5-0 of the vent battery voltage
-    raw = (state->vent_battery_voltage_mv & 0x3f);
-    str[7] = binary_to_base64(raw);
-
-    str[8] = '\0';
+    uint8_t sextets[SCHEMA_CHARS(STATE_FIELDS)];
+    pack_state(state, sextets);
+    encode_bits(sextets, str, sizeof(sextets));
+    str[SERIALIZED_OUTPUT_LEN - 1] = '\0';
 
     return true;
 }
@@ -104,48 +354,10 @@ bool deserialize_state(system_state *state, const char *str)
     if (str == NULL)
         return false;
 
-    uint8_t raw = base64_to_binary(str[0]);
-
-    // Bits 5-2 represent the number of boards connected
-    state->num_boards_connected = (raw & 0b00111100) >> 2;
-    // Bits 1-0 represent injector valve state
-    state->injector_valve_state = raw & 0x3;
-
-    raw = base64_to_binary(str[1]);
-
-    // Bits 5-4 represent vent valve state
-    state->vent_valve_state = ((raw & 0x30) >> 4);
-    // Bit 3-0 are bits 9-6 of tank pressure
-    state->tank_pressure = ((uint16_t) (raw & 0xf)) << 6;
-
-    raw = base64_to_binary(str[2]);
-    state->tank_pressure |= (raw & 0x3f);
-
-    raw = base64_to_binary(str[3]);
-    // Bit 5 represents whether the bus should be powered
-    state->bus_is_powered = raw & 0x20;
-    // Bit 4 represents whether any errors are active
-    state->any_errors_detected = raw & 0x10;
-    // Bits 3-0 represent the top 13-10 bits of the bus battery voltage
-    state->bus_battery_voltage_mv = (uint16_t) (raw & 0xf) << 10;
-
-    raw = base64_to_binary(str[4]);
-    // Bits 5-0 represent bits 9-4 of the bus battery voltage
-    state->bus_battery_voltage_mv |= (raw & 0x3f) << 4;
-
-    raw = base64_to_binary(str[5]);
-    // Bits 5-2 represent bits 3-0 of the bus battery voltage
-    state->bus_battery_voltage_mv |= (raw & 0x3c) >> 2;
-    // Bits 1-0 represent bits 13-12 of the vent battery voltage
-    state->vent_battery_voltage_mv = (uint16_t) (raw & 0x3) << 12;
-
-    raw = base64_to_binary(str[6]);
-    // Bits 5-0 represent bits 11-6 of the vent battery voltage
-    state->vent_battery_voltage_mv |= (raw & 0x3f) << 6;
-
-    raw = base64_to_binary(str[7]);
-    // Bits 5-0 represent bits 5-0 of the vent battery voltage
-    state->vent_battery_voltage_mv |= raw & 0x3f;
+    uint8_t sextets[SCHEMA_CHARS(STATE_FIELDS)];
+    if (!decode_bits(str, sextets, sizeof(sextets)))
+        return false;
+    unpack_state(state, sextets);
 
     return true;
 }
@@ -157,37 +369,10 @@ bool serialize_error(const error_t *err, char *str)
     if (str == NULL)
         return false;
 
-    // A temporary variable to store the values to be Base64-encoded
-    uint8_t temp = 0;
-
-    // The board ID is is given 4 bits
-    temp = (err->board_id & 0b00001111) << 2;
-    // The error type is given 6 bits
-    temp |= (err->err_type & 0b00110000) >> 4;
-    str[0] = binary_to_base64(temp);
-
-    temp = (err->err_type & 0b00001111) << 2;
-    temp |= (err->byte4 & 0b11000000) >> 6;
-    str[1] = binary_to_base64(temp);
-
-    temp = (err->byte4 & 0b00111111);
-    str[2] = binary_to_base64(temp);
-
-    temp = (err->byte5 & 0b11111100) >> 2;
-    str[3] = binary_to_base64(temp);
-
-    temp = (err->byte5 & 0b00000011) << 4;
-    temp |= (err->byte6 & 0b11110000) >> 4;
-    str[4] = binary_to_base64(temp);
-
-    temp = (err->byte6 & 0b00001111) << 2;
-    temp |= (err->byte7 & 0b11000000) >> 6;
-    str[5] = binary_to_base64(temp);
-
-    temp = (err->byte7 & 0b00111111);
-    str[6] = binary_to_base64(temp);
-
-    str[7] = 0;
+    uint8_t sextets[SCHEMA_CHARS(ERROR_FIELDS)];
+    pack_error(err, sextets);
+    encode_bits(sextets, str, sizeof(sextets));
+    str[ERROR_COMMAND_LENGTH - 1] = '\0';
 
     return true;
 }
@@ -199,34 +384,45 @@ bool deserialize_error(error_t *err, const char *str)
     if (str == NULL)
         return false;
 
-    // A temporary variable to store decoded values
-    uint8_t temp = 0;
-
-    temp = base64_to_binary(str[0]);
-    err->board_id = (temp & 0b00111100) >> 2;
-    err->err_type = (temp & 0b00000011) << 4;
-
-    temp = base64_to_binary(str[1]);
-    err->err_type |= (temp & 0b00111100) >> 2;
-    err->byte4 = (temp & 0b00000011) << 6;
-
-    temp = base64_to_binary(str[2]);
-    err->byte4 |= (temp & 0b00111111);
+    uint8_t sextets[SCHEMA_CHARS(ERROR_FIELDS)];
+    if (!decode_bits(str, sextets, sizeof(sextets)))
+        return false;
+    unpack_error(err, sextets);
 
-    temp = base64_to_binary(str[3]);
-    err->byte5 = (temp & 0b00111111) << 2;
+    return true;
+}
 
-    temp = base64_to_binary(str[4]);
-    err->byte5 |= (temp & 0b00110000) >> 4;
-    err->byte6 = (temp & 0b00001111) << 4;
+bool create_error_report(const error_report_t *report, char *str,
+                         enum RADIO_PROTOCOL_VERSION version)
+{
+    if (report == NULL || str == NULL)
+        return false;
 
-    temp = base64_to_binary(str[5]);
-    err->byte6 |= (temp & 0b00111100) >> 2;
-    err->byte7 = (temp & 0b00000011) << 6;
+    uint8_t sextets[ERROR_REPORT_BODY_LEN - 1];
+    uint16_t bit_pos = 0;
+    memset(sextets, 0, sizeof(sextets));
+    pack_error_record(&report->err, sextets, &bit_pos);
+    pack_error_repeat_record(report, sextets, &bit_pos);
+    str[0] = ERROR_REPORT_HEADER;
+    encode_bits(sextets, str + 1, sizeof(sextets));
+    append_frame_check(str, ERROR_REPORT_BODY_LEN, version);
+    return true;
+}
 
-    temp = base64_to_binary(str[6]);
-    err->byte7 |= (temp & 0b00111111);
+bool expand_error_report(error_report_t *report, const char *str,
+                         enum RADIO_PROTOCOL_VERSION version)
+{
+    if (report == NULL || str == NULL || str[0] != ERROR_REPORT_HEADER ||
+        !frame_check_ok(str, ERROR_REPORT_BODY_LEN, version)) {
+        return false;
+    }
 
+    uint8_t sextets[ERROR_REPORT_BODY_LEN - 1];
+    if (!decode_bits(str + 1, sextets, sizeof(sextets)))
+        return false;
+    uint16_t bit_pos = 0;
+    unpack_error_record(&report->err, sextets, &bit_pos);
+    unpack_error_repeat_record(report, sextets, &bit_pos);
     return true;
 }
 
@@ -238,7 +434,8 @@ bool create_gps_message(uint8_t latitude_deg,
                         uint8_t longitude_min,
                         uint8_t longitude_dmin,
                         uint8_t longitude_dir,
-                        char *str)
+                        char *str,
+                        enum RADIO_PROTOCOL_VERSION version)
 {
     if (str == NULL ||
         (latitude_dir != 'N' && latitude_dir != 'S') ||
@@ -246,31 +443,23 @@ bool create_gps_message(uint8_t latitude_deg,
         return false;
     }
 
-    str[0] = GPS_MSG_HEADER;
-
-    str[1] = binary_to_base64((latitude_deg >> 2) & 0x3f);
-    str[2] = binary_to_base64(((latitude_deg << 4) & 0x30) |
-                              ((latitude_min >> 4) & 0xf));
-
-    str[3] = binary_to_base64(((latitude_min << 2) & 0x3c) |
-                              ((latitude_dmin >> 6) & 0x3));
-
-    str[4] = binary_to_base64(latitude_dmin & 0x3f);
-    str[5] = binary_to_base64((longitude_deg >> 2) & 0x3f);
-    str[6] = binary_to_base64(((longitude_deg << 4) & 0x30) |
-                              ((longitude_min >> 4) & 0xf));
+    gps_frame_t frame = {
+        .lat_deg = latitude_deg,
+        .lat_min = latitude_min,
+        .lat_dmin = latitude_dmin,
+        .lon_deg = longitude_deg,
+        .lon_min = longitude_min,
+        .lon_dmin = longitude_dmin,
+        .lat_north = (latitude_dir == 'N'),
+        .lon_east = (longitude_dir == 'E'),
+    };
+    uint8_t sextets[SCHEMA_CHARS(GPS_FIELDS)];
+    pack_gps(&frame, sextets);
 
-    str[7] = binary_to_base64(((longitude_min << 2) & 0x3c) |
-                              ((longitude_dmin >> 6) & 0x3));
-
-    str[8] = binary_to_base64(longitude_dmin & 0x3f);
-    str[9] = binary_to_base64((latitude_dir == 'N' ? 0x20 : 0) |
-                              (longitude_dir == 'E' ? 0x10 : 0));
+    str[0] = GPS_MSG_HEADER;
+    encode_bits(sextets, str + 1, sizeof(sextets));
 
-    // calculate checksum
-    str[GPS_MSG_LEN - 1] = '\0';
-    char cs = checksum(str);
-    str[GPS_MSG_LEN - 1] = cs;
+    append_frame_check(str, GPS_MSG_BODY_LEN, version);
 
     return true;
 }
@@ -283,67 +472,195 @@ bool expand_gps_message(uint8_t *latitude_deg,
                         uint8_t *longitude_min,
                         uint8_t *longitude_dmin,
                         uint8_t *longitude_dir,
-                        char *str)
+                        const char *str,
+                        enum RADIO_PROTOCOL_VERSION version)
 {
     if (str == NULL || str[0] != GPS_MSG_HEADER) {
         return false;
     }
 
-    char actual_checksum = str[GPS_MSG_LEN - 1];
-    str[GPS_MSG_LEN - 1] = '\0';
-    char expected_checksum = checksum(str);
-    if (expected_checksum != actual_checksum) {
+    if (!frame_check_ok(str, GPS_MSG_BODY_LEN, version)) {
+        return false;
+    }
+
+    gps_frame_t frame;
+    uint8_t sextets[SCHEMA_CHARS(GPS_FIELDS)];
+    if (!decode_bits(str + 1, sextets, sizeof(sextets))) {
         return false;
     }
+    unpack_gps(&frame, sextets);
 
-    // 6 bits per char. So with 6 bytes, it's gonna take 8 characters
-    *latitude_deg   = (base64_to_binary(str[1]) << 2) & 0xfc;
-    *latitude_deg  |= (base64_to_binary(str[2]) >> 4) & 0x3;
+    *latitude_deg   = frame.lat_deg;
+    *latitude_min   = frame.lat_min;
+    *latitude_dmin  = frame.lat_dmin;
+    *longitude_deg  = frame.lon_deg;
+    *longitude_min  = frame.lon_min;
+    *longitude_dmin = frame.lon_dmin;
+    *latitude_dir   = frame.lat_north ? 'N' : 'S';
+    *longitude_dir  = frame.lon_east ? 'E' : 'W';
 
-    *latitude_min   = (base64_to_binary(str[2]) << 4) & 0xf0;
-    *latitude_min  |= (base64_to_binary(str[3]) >> 2) & 0xf;
+    return true;
+}
 
-    *latitude_dmin  = (base64_to_binary(str[3]) << 6) & 0xc0;
-    *latitude_dmin |= (base64_to_binary(str[4]))      & 0x3f;
+bool create_perf_stats_message(uint8_t slot, const perf_stat_t *stat, char *str,
+                               enum RADIO_PROTOCOL_VERSION version)
+{
+    if (stat == NULL || str == NULL || slot > 0x3f) {
+        return false;
+    }
 
-    *longitude_deg   = (base64_to_binary(str[5]) << 2) & 0xfc;
-    *longitude_deg  |= (base64_to_binary(str[6]) >> 4) & 0x3;
+    perf_frame_t frame;
+    frame.slot = slot;
+    frame.count = stat->count > 0xffffff ? 0xffffff : stat->count;
+    frame.min_us = stat->min_us;
+    frame.mean_us = perf_stats_mean_us(stat);
+    frame.max_us = stat->max_us;
+
+    // the buckets get halved separately from count, so normalize against
+    // their own total rather than count
+    uint32_t hist_total = 0;
+    uint8_t i;
+    for (i = 0; i < PERF_STATS_NUM_BUCKETS; ++i) {
+        hist_total += stat->histogram[i];
+    }
+    for (i = 0; i < PERF_STATS_NUM_BUCKETS; ++i) {
+        frame.shares[i] = 0;
+        if (hist_total != 0) {
+            frame.shares[i] = ((uint32_t) stat->histogram[i] * 255) / hist_total;
+        }
+    }
 
-    *longitude_min   = (base64_to_binary(str[6]) << 4) & 0xf0;
-    *longitude_min  |= (base64_to_binary(str[7]) >> 2) & 0xf;
+    uint8_t sextets[SCHEMA_CHARS(PERF_FIELDS)];
+    pack_perf(&frame, sextets);
 
-    *longitude_dmin  = (base64_to_binary(str[7]) << 6) & 0xc0;
-    *longitude_dmin |= (base64_to_binary(str[8]))      & 0x3f;
+    str[0] = PERF_STATS_REQUEST_HEADER;
+    encode_bits(sextets, str + 1, sizeof(sextets));
 
-    // last char has lat_dir (1=='N', 0=='S') and lon_dir (1=='E', 0==W)
-    *latitude_dir  = (base64_to_binary(str[9]) & 0x20) ? 'N' : 'S';
-    *longitude_dir = (base64_to_binary(str[9]) & 0x10) ? 'E' : 'W';
+    append_frame_check(str, PERF_STATS_MSG_BODY_LEN, version);
 
     return true;
 }
 
-bool compare_system_states(const system_state *s, const system_state *p)
+bool create_telemetry_summary_message(uint8_t quantity,
+                                      const telem_summary_t *summary,
+                                      char *str,
+                                      enum RADIO_PROTOCOL_VERSION version)
 {
-    if (s == NULL)
+    if (summary == NULL || str == NULL || quantity > 0x3f) {
         return false;
-    if (p == NULL)
+    }
+
+    telemetry_frame_t frame;
+    frame.quantity = quantity;
+    frame.summary = *summary;
+    uint8_t sextets[SCHEMA_CHARS(TELEMETRY_FIELDS)];
+    pack_telemetry(&frame, sextets);
+
+    str[0] = TELEMETRY_REQUEST_HEADER;
+    encode_bits(sextets, str + 1, sizeof(sextets));
+
+    append_frame_check(str, TELEMETRY_SUMMARY_MSG_BODY_LEN, version);
+
+    return true;
+}
+
+bool expand_telemetry_summary_message(uint8_t *quantity,
+                                      telem_summary_t *summary,
+                                      const char *str,
+                                      enum RADIO_PROTOCOL_VERSION version)
+{
+    if (quantity == NULL || summary == NULL || str == NULL ||
+        str[0] != TELEMETRY_REQUEST_HEADER) {
+        return false;
+    }
+
+    if (!frame_check_ok(str, TELEMETRY_SUMMARY_MSG_BODY_LEN, version)) {
         return false;
+    }
 
-    if (s->num_boards_connected != p->num_boards_connected)
+    telemetry_frame_t frame;
+    uint8_t sextets[SCHEMA_CHARS(TELEMETRY_FIELDS)];
+    if (!decode_bits(str + 1, sextets, sizeof(sextets))) {
         return false;
-    if (s->injector_valve_state != p->injector_valve_state)
+    }
+    unpack_telemetry(&frame, sextets);
+    *quantity = frame.quantity;
+    *summary = frame.summary;
+
+    return true;
+}
+
+bool create_board_stats_message(uint8_t page, const board_stats_t *stats, char *str,
+                                enum RADIO_PROTOCOL_VERSION version)
+{
+    if (stats == NULL || str == NULL || page > 0x3f) {
         return false;
-    if (s->vent_valve_state != p->vent_valve_state)
+    }
+
+    board_stats_frame_t frame;
+    frame.page = page;
+    uint8_t i;
+    for (i = 0; i < BOARD_STATS_NUM_COUNTERS; ++i) {
+        frame.stats.counters[i] = stats->counters[i] > BOARD_STATS_COUNTER_MAX ?
+                                  BOARD_STATS_COUNTER_MAX : stats->counters[i];
+    }
+    uint8_t sextets[SCHEMA_CHARS(BOARD_STATS_FIELDS)];
+    pack_board_stats(&frame, sextets);
+
+    str[0] = BOARD_STATS_REQUEST_HEADER;
+    encode_bits(sextets, str + 1, sizeof(sextets));
+
+    append_frame_check(str, BOARD_STATS_MSG_BODY_LEN, version);
+
+    return true;
+}
+
+bool expand_board_stats_message(uint8_t *page, board_stats_t *stats, const char *str,
+                                enum RADIO_PROTOCOL_VERSION version)
+{
+    if (page == NULL || stats == NULL || str == NULL ||
+        str[0] != BOARD_STATS_REQUEST_HEADER) {
         return false;
-    if (s->bus_is_powered != p->bus_is_powered)
+    }
+
+    if (!frame_check_ok(str, BOARD_STATS_MSG_BODY_LEN, version)) {
         return false;
-    if (s->any_errors_detected != p->any_errors_detected)
+    }
+
+    board_stats_frame_t frame;
+    uint8_t sextets[SCHEMA_CHARS(BOARD_STATS_FIELDS)];
+    if (!decode_bits(str + 1, sextets, sizeof(sextets))) {
         return false;
+    }
+    unpack_board_stats(&frame, sextets);
+    *page = frame.page;
+    *stats = frame.stats;
 
     return true;
 }
 
-bool create_state_command(char *cmd, const system_state *state)
+/*
+ * Generated from STATE_FIELDS, so every field that goes over the radio gets
+ * compared, and new fields get compared without anyone having to remember
+ */
+#define COMPARE_FIELD(name, width, signedness) \
+    if (s->name != p->name)                   \
+        return false;
+
+bool compare_system_states(const system_state *s, const system_state *p)
+{
+    if (s == NULL)
+        return false;
+    if (p == NULL)
+        return false;
+
+    STATE_FIELDS(COMPARE_FIELD)
+
+    return true;
+}
+
+bool create_state_command(char *cmd, const system_state *state,
+                          enum RADIO_PROTOCOL_VERSION version)
 {
     if (cmd == NULL)
         return false;
@@ -359,31 +676,806 @@ bool create_state_command(char *cmd, const system_state *state)
 
     // Message start indicator
     cmd[0] = STATE_COMMAND_HEADER;
-    // Checksum
-    cmd[STATE_COMMAND_LEN - 2] = '\0';
-    cmd[STATE_COMMAND_LEN - 2] = checksum(serialized);
+    // Frame check. This only covers the serialized state, not the header
+    uint8_t check_len = append_frame_check(cmd + 1, SERIALIZED_OUTPUT_LEN - 1, version);
     // Null terminator
-    cmd[STATE_COMMAND_LEN - 1] = 0;
+    cmd[STATE_COMMAND_BODY_LEN + check_len] = 0;
 
     return true;
 }
 
+bool expand_state_command(system_state *state, const char *cmd,
+                          enum RADIO_PROTOCOL_VERSION version)
+{
+    if (state == NULL || cmd == NULL || cmd[0] != STATE_COMMAND_HEADER)
+        return false;
+    if (!frame_check_ok(cmd + 1, SERIALIZED_OUTPUT_LEN - 1, version))
+        return false;
+    return deserialize_state(state, cmd + 1);
+}
+
+bool create_seq_command(char *cmd, uint8_t seq, const system_state *state,
+                        enum RADIO_PROTOCOL_VERSION version)
+{
+    if (cmd == NULL || state == NULL || seq >= COMMAND_SEQ_NONE)
+        return false;
+
+    char serialized[SERIALIZED_OUTPUT_LEN];
+    if (!serialize_state(state, serialized))
+        return false;
+
+    cmd[0] = SEQ_COMMAND_HEADER;
+    cmd[1] = binary_to_base64(seq);
+    memcpy(cmd + 2, serialized, SERIALIZED_OUTPUT_LEN - 1);
+    // unlike a state command, the frame check covers the header too
+    append_frame_check(cmd, SEQ_COMMAND_BODY_LEN, version);
+
+    return true;
+}
+
+bool expand_seq_command(uint8_t *seq, system_state *state, const char *cmd,
+                        enum RADIO_PROTOCOL_VERSION version)
+{
+    if (seq == NULL || state == NULL || cmd == NULL || cmd[0] != SEQ_COMMAND_HEADER)
+        return false;
+    if (!frame_check_ok(cmd, SEQ_COMMAND_BODY_LEN, version))
+        return false;
+    *seq = base64_to_binary(cmd[1]);
+    if (*seq >= COMMAND_SEQ_NONE)
+        return false;
+    return deserialize_state(state, cmd + 2);
+}
+
+bool create_command_ack(const command_ack_t *ack, char *str,
+                        enum RADIO_PROTOCOL_VERSION version)
+{
+    if (ack == NULL || str == NULL)
+        return false;
+
+    uint8_t sextets[SCHEMA_CHARS(COMMAND_ACK_FIELDS)];
+    pack_command_ack(ack, sextets);
+
+    str[0] = COMMAND_ACK_HEADER;
+    encode_bits(sextets, str + 1, sizeof(sextets));
+    append_frame_check(str, COMMAND_ACK_BODY_LEN, version);
+
+    return true;
+}
+
+bool expand_command_ack(command_ack_t *ack, const char *str,
+                        enum RADIO_PROTOCOL_VERSION version)
+{
+    if (ack == NULL || str == NULL || str[0] != COMMAND_ACK_HEADER)
+        return false;
+    if (!frame_check_ok(str, COMMAND_ACK_BODY_LEN, version))
+        return false;
+
+    uint8_t sextets[SCHEMA_CHARS(COMMAND_ACK_FIELDS)];
+    if (!decode_bits(str + 1, sextets, sizeof(sextets)))
+        return false;
+    unpack_command_ack(ack, sextets);
+
+    return true;
+}
+
+bool create_subscribe(char *str, uint8_t period, uint8_t acked_seq,
+                      enum RADIO_PROTOCOL_VERSION version)
+{
+    if (str == NULL || period > 0x3f || acked_seq > 0x3f)
+        return false;
+
+    str[0] = SUBSCRIBE_HEADER;
+    str[1] = binary_to_base64(period);
+    str[2] = binary_to_base64(acked_seq);
+    append_frame_check(str, SUBSCRIBE_BODY_LEN, version);
+
+    return true;
+}
+
+bool expand_subscribe(uint8_t *period, uint8_t *acked_seq, const char *str,
+                      enum RADIO_PROTOCOL_VERSION version)
+{
+    if (period == NULL || acked_seq == NULL || str == NULL ||
+        str[0] != SUBSCRIBE_HEADER)
+        return false;
+    if (!frame_check_ok(str, SUBSCRIBE_BODY_LEN, version))
+        return false;
+
+    uint8_t p = base64_to_binary(str[1]);
+    uint8_t a = base64_to_binary(str[2]);
+    if (p == BASE64_INVALID || a == BASE64_INVALID)
+        return false;
+    *period = p;
+    *acked_seq = a;
+
+    return true;
+}
+
+bool create_radio_mirror(char *str, uint8_t which, enum RADIO_PROTOCOL_VERSION version)
+{
+    if (str == NULL || which > 0x3f)
+        return false;
+
+    str[0] = RADIO_MIRROR_HEADER;
+    str[1] = binary_to_base64(which);
+    append_frame_check(str, RADIO_MIRROR_BODY_LEN, version);
+
+    return true;
+}
+
+bool expand_radio_mirror(uint8_t *which, const char *str,
+                         enum RADIO_PROTOCOL_VERSION version)
+{
+    if (which == NULL || str == NULL || str[0] != RADIO_MIRROR_HEADER)
+        return false;
+    if (!frame_check_ok(str, RADIO_MIRROR_BODY_LEN, version))
+        return false;
+
+    uint8_t w = base64_to_binary(str[1]);
+    if (w == BASE64_INVALID)
+        return false;
+    *which = w;
+
+    return true;
+}
+
+/*
+ * The delta state frame codec. Like the generated ones above, but each field
+ * only goes in if its bit in changed is set. The bit for the first field in
+ * STATE_FIELDS is the top one
+ */
+#define STATE_DELTA_ALL_CHANGED ((uint8_t) ((1u << SCHEMA_FIELDS(STATE_FIELDS)) - 1))
+#define STATE_DELTA_FIRST_FIELD ((uint8_t) (1u << (SCHEMA_FIELDS(STATE_FIELDS) - 1)))
+
+#define FIND_CHANGED_FIELD(name, width, signedness)     \
+    if (base == NULL || state->name != base->name) {    \
+        changed |= mask;                                \
+    }                                                   \
+    mask >>= 1;
+#define PACK_CHANGED_FIELD(name, width, signedness)                     \
+    if (changed & mask) {                                               \
+        pack_bits(sextets, &bit_pos, (uint32_t) state->name, width);    \
+    }                                                                   \
+    mask >>= 1;
+#define UNPACK_CHANGED_FIELD(name, width, signedness)                   \
+    if (changed & mask) {                                               \
+        dst.name = unpack_bits(sextets, &bit_pos, width, signedness);   \
+    }                                                                   \
+    mask >>= 1;
+#define CHANGED_FIELD_BITS(name, width, signedness)     \
+    if (changed & mask) {                               \
+        bits += width;                                  \
+    }                                                   \
+    mask >>= 1;
+
+/*
+ * Delta states on their own and inside bundles. These start pos bits into
+ * sextets, and advance pos past the delta state
+ */
+static void pack_state_delta(const system_state *state, uint8_t seq,
+                             const system_state *base, uint8_t base_seq,
+                             uint8_t *sextets, uint16_t *pos)
+{
+    if (base == NULL) {
+        base_seq = seq;
+    }
+
+    uint8_t changed = 0;
+    uint8_t mask = STATE_DELTA_FIRST_FIELD;
+    STATE_FIELDS(FIND_CHANGED_FIELD)
+
+    uint16_t bit_pos = *pos;
+    pack_bits(sextets, &bit_pos, seq, 6);
+    pack_bits(sextets, &bit_pos, base_seq, 6);
+    pack_bits(sextets, &bit_pos, changed, SCHEMA_FIELDS(STATE_FIELDS));
+    mask = STATE_DELTA_FIRST_FIELD;
+    STATE_FIELDS(PACK_CHANGED_FIELD)
+    *pos = bit_pos;
+}
+
+// how many bits the delta state takes, prefix included. Only needs the prefix
+static uint16_t state_delta_bits(const uint8_t *sextets, uint16_t pos)
+{
+    uint16_t bit_pos = pos + 12;
+    uint8_t changed = unpack_bits(sextets, &bit_pos, SCHEMA_FIELDS(STATE_FIELDS), false);
+    uint8_t mask = STATE_DELTA_FIRST_FIELD;
+    uint16_t bits = STATE_DELTA_PREFIX_BITS;
+    STATE_FIELDS(CHANGED_FIELD_BITS)
+    return bits;
+}
+
+/*
+ * If the delta state can be applied to state, which came from frame *seq,
+ * applies it and updates *seq. Returns whether it did. pos is advanced past
+ * it either way
+ */
+static bool unpack_state_delta(system_state *state, uint8_t *seq,
+                               const uint8_t *sextets, uint16_t *pos)
+{
+    uint16_t bit_pos = *pos;
+    *pos += state_delta_bits(sextets, bit_pos);
+
+    uint8_t new_seq = unpack_bits(sextets, &bit_pos, 6, false);
+    uint8_t base_seq = unpack_bits(sextets, &bit_pos, 6, false);
+    uint8_t changed = unpack_bits(sextets, &bit_pos, SCHEMA_FIELDS(STATE_FIELDS), false);
+    if (new_seq == STATE_DELTA_NO_SNAPSHOT) {
+        return false;
+    }
+    if (base_seq == new_seq) {
+        if (changed != STATE_DELTA_ALL_CHANGED) {
+            return false;
+        }
+    } else if (base_seq != *seq || base_seq == STATE_DELTA_NO_SNAPSHOT) {
+        return false;
+    }
+
+    system_state dst = *state;
+    uint8_t mask = STATE_DELTA_FIRST_FIELD;
+    STATE_FIELDS(UNPACK_CHANGED_FIELD)
+    *state = dst;
+    *seq = new_seq;
+    return true;
+}
+
+uint8_t create_state_delta(const system_state *state, uint8_t seq,
+                           const system_state *base, uint8_t base_seq,
+                           char *str, enum RADIO_PROTOCOL_VERSION version)
+{
+    if (state == NULL || str == NULL || seq >= STATE_DELTA_NO_SNAPSHOT ||
+        (base != NULL && base_seq >= STATE_DELTA_NO_SNAPSHOT)) {
+        return 0;
+    }
+
+    uint8_t sextets[STATE_DELTA_MAX_BODY_LEN - 1];
+    uint16_t bit_pos = 0;
+    memset(sextets, 0, sizeof(sextets));
+    pack_state_delta(state, seq, base, base_seq, sextets, &bit_pos);
+
+    uint8_t len = 1 + (bit_pos + 5) / 6;
+    str[0] = STATE_DELTA_HEADER;
+    encode_bits(sextets, str + 1, len - 1);
+    append_frame_check(str, len, version);
+    return len;
+}
+
+uint8_t state_delta_body_len(const char *str)
+{
+    uint8_t sextets[STATE_DELTA_PREFIX_LEN - 1];
+    if (str == NULL || str[0] != STATE_DELTA_HEADER ||
+        !decode_bits(str + 1, sextets, sizeof(sextets))) {
+        return 0;
+    }
+    return 1 + (state_delta_bits(sextets, 0) + 5) / 6;
+}
+
+bool expand_state_delta(system_state *state, uint8_t *seq, const char *str,
+                        enum RADIO_PROTOCOL_VERSION version)
+{
+    if (state == NULL || seq == NULL)
+        return false;
+    uint8_t len = state_delta_body_len(str);
+    uint8_t sextets[STATE_DELTA_MAX_BODY_LEN - 1];
+    if (len == 0 || !frame_check_ok(str, len, version) ||
+        !decode_bits(str + 1, sextets, len - 1)) {
+        return false;
+    }
+
+    uint16_t bit_pos = 0;
+    return unpack_state_delta(state, seq, sextets, &bit_pos);
+}
+
+uint8_t create_bundle(const system_state *state, uint8_t seq,
+                      const system_state *base, uint8_t base_seq,
+                      const bundle_records_t *records, char *str,
+                      enum RADIO_PROTOCOL_VERSION version)
+{
+    if (state == NULL || records == NULL || str == NULL ||
+        seq >= STATE_DELTA_NO_SNAPSHOT ||
+        (base != NULL && base_seq >= STATE_DELTA_NO_SNAPSHOT) ||
+        records->num_errors + (records->has_gps ? 1 : 0) > BUNDLE_MAX_RECORDS) {
+        return 0;
+    }
+    const gps_position_t *gps = &records->gps;
+    if (records->has_gps &&
+        ((gps->lat_dir != 'N' && gps->lat_dir != 'S') ||
+         (gps->lon_dir != 'E' && gps->lon_dir != 'W'))) {
+        return 0;
+    }
+
+    uint8_t sextets[BUNDLE_MAX_BODY_LEN - 1];
+    uint16_t bit_pos = 0;
+    memset(sextets, 0, sizeof(sextets));
+    pack_bits(sextets, &bit_pos, records->num_errors, 2);
+    pack_bits(sextets, &bit_pos, records->has_gps, 1);
+    pack_state_delta(state, seq, base, base_seq, sextets, &bit_pos);
+    if (records->has_gps) {
+        gps_frame_t frame = {
+            .lat_deg = gps->lat_deg,
+            .lat_min = gps->lat_min,
+            .lat_dmin = gps->lat_dmin,
+            .lon_deg = gps->lon_deg,
+            .lon_min = gps->lon_min,
+            .lon_dmin = gps->lon_dmin,
+            .lat_north = (gps->lat_dir == 'N'),
+            .lon_east = (gps->lon_dir == 'E'),
+        };
+        pack_gps_record(&frame, sextets, &bit_pos);
+    }
+    uint8_t i;
+    for (i = 0; i < records->num_errors; ++i) {
+        pack_error_record(&records->errors[i].err, sextets, &bit_pos);
+        pack_error_repeat_record(&records->errors[i], sextets, &bit_pos);
+    }
+
+    uint8_t len = 1 + (bit_pos + 5) / 6;
+    str[0] = BUNDLE_HEADER;
+    encode_bits(sextets, str + 1, len - 1);
+    append_frame_check(str, len, version);
+    return len;
+}
+
+uint8_t bundle_body_len(const char *str)
+{
+    uint8_t sextets[BUNDLE_PREFIX_LEN - 1];
+    if (str == NULL || str[0] != BUNDLE_HEADER ||
+        !decode_bits(str + 1, sextets, sizeof(sextets))) {
+        return 0;
+    }
+    uint16_t bit_pos = 0;
+    uint8_t num_errors = unpack_bits(sextets, &bit_pos, 2, false);
+    bool has_gps = unpack_bits(sextets, &bit_pos, 1, false);
+    if (num_errors + (has_gps ? 1 : 0) > BUNDLE_MAX_RECORDS) {
+        return 0;
+    }
+    uint16_t bits = 3 + state_delta_bits(sextets, bit_pos) +
+                    (has_gps ? SCHEMA_BITS(GPS_FIELDS) : 0) +
+                    num_errors * ERROR_REPORT_BITS;
+    return 1 + (bits + 5) / 6;
+}
+
+bool expand_bundle(system_state *state, uint8_t *seq, bool *state_applied,
+                   bundle_records_t *records, const char *str,
+                   enum RADIO_PROTOCOL_VERSION version)
+{
+    if (state == NULL || seq == NULL || state_applied == NULL || records == NULL)
+        return false;
+    uint8_t len = bundle_body_len(str);
+    uint8_t sextets[BUNDLE_MAX_BODY_LEN - 1];
+    if (len == 0 || !frame_check_ok(str, len, version) ||
+        !decode_bits(str + 1, sextets, len - 1)) {
+        return false;
+    }
+
+    uint16_t bit_pos = 0;
+    records->num_errors = unpack_bits(sextets, &bit_pos, 2, false);
+    records->has_gps = unpack_bits(sextets, &bit_pos, 1, false);
+    *state_applied = unpack_state_delta(state, seq, sextets, &bit_pos);
+    if (records->has_gps) {
+        gps_frame_t frame;
+        unpack_gps_record(&frame, sextets, &bit_pos);
+        records->gps.lat_deg = frame.lat_deg;
+        records->gps.lat_min = frame.lat_min;
+        records->gps.lat_dmin = frame.lat_dmin;
+        records->gps.lat_dir = frame.lat_north ? 'N' : 'S';
+        records->gps.lon_deg = frame.lon_deg;
+        records->gps.lon_min = frame.lon_min;
+        records->gps.lon_dmin = frame.lon_dmin;
+        records->gps.lon_dir = frame.lon_east ? 'E' : 'W';
+    }
+    uint8_t i;
+    for (i = 0; i < records->num_errors; ++i) {
+        unpack_error_record(&records->errors[i].err, sextets, &bit_pos);
+        unpack_error_repeat_record(&records->errors[i], sextets, &bit_pos);
+    }
+    return true;
+}
+
+bool create_version_select(uint8_t version, char *str)
+{
+    if (str == NULL || version > 0x3f)
+        return false;
+    str[0] = VERSION_SELECT_HEADER;
+    str[1] = binary_to_base64(version);
+    append_frame_check(str, VERSION_SELECT_BODY_LEN, RADIO_PROTOCOL_V1);
+    return true;
+}
+
+enum RADIO_PROTOCOL_VERSION version_reply_frame_check(enum RADIO_PROTOCOL_VERSION version)
+{
+    return version == RADIO_PROTOCOL_V3 ? RADIO_PROTOCOL_V1 : version;
+}
+
+uint8_t create_version_reply(enum RADIO_PROTOCOL_VERSION version, char *str)
+{
+    if (str == NULL)
+        return 0;
+    uint8_t len = 0;
+    if (version == RADIO_PROTOCOL_V3) {
+        str[len++] = 0;
+    }
+    char *reply = str + len;
+    reply[0] = VERSION_SELECT_HEADER;
+    reply[1] = binary_to_base64(version);
+    len += VERSION_SELECT_BODY_LEN;
+    len += append_frame_check(reply, VERSION_SELECT_BODY_LEN, version_reply_frame_check(version));
+    return len;
+}
+
+/*
+ * What each byte adds to the version 1 checksum. The checksum of a frame is
+ * the sum of these, mod 64. Each entry weighs the bits of the index, counting
+ * from bit 0: every even placed bit that's set adds 3, and every odd placed
+ * bit that's set adds 2
+ */
+static const uint8_t luhn_table[256] = {
+     0,  3,  2,  5,  3,  6,  5,  8,  2,  5,  4,  7,  5,  8,  7, 10,
+     3,  6,  5,  8,  6,  9,  8, 11,  5,  8,  7, 10,  8, 11, 10, 13,
+     2,  5,  4,  7,  5,  8,  7, 10,  4,  7,  6,  9,  7, 10,  9, 12,
+     5,  8,  7, 10,  8, 11, 10, 13,  7, 10,  9, 12, 10, 13, 12, 15,
+     3,  6,  5,  8,  6,  9,  8, 11,  5,  8,  7, 10,  8, 11, 10, 13,
+     6,  9,  8, 11,  9, 12, 11, 14,  8, 11, 10, 13, 11, 14, 13, 16,
+     5,  8,  7, 10,  8, 11, 10, 13,  7, 10,  9, 12, 10, 13, 12, 15,
+     8, 11, 10, 13, 11, 14, 13, 16, 10, 13, 12, 15, 13, 16, 15, 18,
+     2,  5,  4,  7,  5,  8,  7, 10,  4,  7,  6,  9,  7, 10,  9, 12,
+     5,  8,  7, 10,  8, 11, 10, 13,  7, 10,  9, 12, 10, 13, 12, 15,
+     4,  7,  6,  9,  7, 10,  9, 12,  6,  9,  8, 11,  9, 12, 11, 14,
+     7, 10,  9, 12, 10, 13, 12, 15,  9, 12, 11, 14, 12, 15, 14, 17,
+     5,  8,  7, 10,  8, 11, 10, 13,  7, 10,  9, 12, 10, 13, 12, 15,
+     8, 11, 10, 13, 11, 14, 13, 16, 10, 13, 12, 15, 13, 16, 15, 18,
+     7, 10,  9, 12, 10, 13, 12, 15,  9, 12, 11, 14, 12, 15, 14, 17,
+    10, 13, 12, 15, 13, 16, 15, 18, 12, 15, 14, 17, 15, 18, 17, 20,
+};
+
+/*
+ * CRC-12 with polynomial x^12 + x^11 + x^3 + x^2 + x + 1 (0x80F), most
+ * significant bit first, no reflection or final xor. Each entry is the CRC
+ * register after clocking one byte, index, through an empty register. See
+ * crc12_update for how it's used
+ */
+static const uint16_t crc12_table[256] = {
+    0x000, 0x80F, 0x811, 0x01E, 0x82D, 0x022, 0x03C, 0x833,
+    0x855, 0x05A, 0x044, 0x84B, 0x078, 0x877, 0x869, 0x066,
+    0x8A5, 0x0AA, 0x0B4, 0x8BB, 0x088, 0x887, 0x899, 0x096,
+    0x0F0, 0x8FF, 0x8E1, 0x0EE, 0x8DD, 0x0D2, 0x0CC, 0x8C3,
+    0x945, 0x14A, 0x154, 0x95B, 0x168, 0x967, 0x979, 0x176,
+    0x110, 0x91F, 0x901, 0x10E, 0x93D, 0x132, 0x12C, 0x923,
+    0x1E0, 0x9EF, 0x9F1, 0x1FE, 0x9CD, 0x1C2, 0x1DC, 0x9D3,
+    0x9B5, 0x1BA, 0x1A4, 0x9AB, 0x198, 0x997, 0x989, 0x186,
+    0xA85, 0x28A, 0x294, 0xA9B, 0x2A8, 0xAA7, 0xAB9, 0x2B6,
+    0x2D0, 0xADF, 0xAC1, 0x2CE, 0xAFD, 0x2F2, 0x2EC, 0xAE3,
+    0x220, 0xA2F, 0xA31, 0x23E, 0xA0D, 0x202, 0x21C, 0xA13,
+    0xA75, 0x27A, 0x264, 0xA6B, 0x258, 0xA57, 0xA49, 0x246,
+    0x3C0, 0xBCF, 0xBD1, 0x3DE, 0xBED, 0x3E2, 0x3FC, 0xBF3,
+    0xB95, 0x39A, 0x384, 0xB8B, 0x3B8, 0xBB7, 0xBA9, 0x3A6,
+    0xB65, 0x36A, 0x374, 0xB7B, 0x348, 0xB47, 0xB59, 0x356,
+    0x330, 0xB3F, 0xB21, 0x32E, 0xB1D, 0x312, 0x30C, 0xB03,
+    0xD05, 0x50A, 0x514, 0xD1B, 0x528, 0xD27, 0xD39, 0x536,
+    0x550, 0xD5F, 0xD41, 0x54E, 0xD7D, 0x572, 0x56C, 0xD63,
+    0x5A0, 0xDAF, 0xDB1, 0x5BE, 0xD8D, 0x582, 0x59C, 0xD93,
+    0xDF5, 0x5FA, 0x5E4, 0xDEB, 0x5D8, 0xDD7, 0xDC9, 0x5C6,
+    0x440, 0xC4F, 0xC51, 0x45E, 0xC6D, 0x462, 0x47C, 0xC73,
+    0xC15, 0x41A, 0x404, 0xC0B, 0x438, 0xC37, 0xC29, 0x426,
+    0xCE5, 0x4EA, 0x4F4, 0xCFB, 0x4C8, 0xCC7, 0xCD9, 0x4D6,
+    0x4B0, 0xCBF, 0xCA1, 0x4AE, 0xC9D, 0x492, 0x48C, 0xC83,
+    0x780, 0xF8F, 0xF91, 0x79E, 0xFAD, 0x7A2, 0x7BC, 0xFB3,
+    0xFD5, 0x7DA, 0x7C4, 0xFCB, 0x7F8, 0xFF7, 0xFE9, 0x7E6,
+    0xF25, 0x72A, 0x734, 0xF3B, 0x708, 0xF07, 0xF19, 0x716,
+    0x770, 0xF7F, 0xF61, 0x76E, 0xF5D, 0x752, 0x74C, 0xF43,
+    0xEC5, 0x6CA, 0x6D4, 0xEDB, 0x6E8, 0xEE7, 0xEF9, 0x6F6,
+    0x690, 0xE9F, 0xE81, 0x68E, 0xEBD, 0x6B2, 0x6AC, 0xEA3,
+    0x660, 0xE6F, 0xE71, 0x67E, 0xE4D, 0x642, 0x65C, 0xE53,
+    0xE35, 0x63A, 0x624, 0xE2B, 0x618, 0xE17, 0xE09, 0x606,
+};
+
+uint16_t crc12_update(uint16_t crc, uint8_t byte)
+{
+    uint8_t idx = (uint8_t) ((crc >> 4) ^ byte);
+    return ((crc << 8) ^ crc12_table[idx]) & 0xfff;
+}
+
 char checksum(char *cmd)
 {
     uint8_t total = 0;
     uint8_t idx = 0;
     while (cmd[idx] != 0) {
-        uint8_t curr = (uint8_t) cmd[idx];
-        uint8_t odd_sum = 0;
-        uint8_t even_sum = 0;
-        for (uint8_t i = 0; i < 4; ++i) {
-            odd_sum += 0b00000010 & curr;
-            even_sum += 0b00000001 & curr;
-            curr = curr >> 2;
-        }
-        total += odd_sum + 3 * even_sum;
+        total += luhn_table[(uint8_t) cmd[idx]];
         ++idx;
     }
     total %= 64;
     return binary_to_base64(total);
 }
+
+bool radio_protocol_supported(uint8_t version)
+{
+    return version == RADIO_PROTOCOL_V1 ||
+           version == RADIO_PROTOCOL_V2 ||
+           version == RADIO_PROTOCOL_V3 ||
+           version == RADIO_PROTOCOL_V4;
+}
+
+uint8_t frame_check_len(enum RADIO_PROTOCOL_VERSION version)
+{
+    if (version == RADIO_PROTOCOL_V3) {
+        return 0;
+    }
+    if (version == RADIO_PROTOCOL_V4) {
+        return 2 + FEC_PARITY_LEN;
+    }
+    return version == RADIO_PROTOCOL_V2 ? 2 : 1;
+}
+
+uint16_t frame_check_update(uint16_t check, uint8_t byte,
+                            enum RADIO_PROTOCOL_VERSION version)
+{
+    if (version == RADIO_PROTOCOL_V2 || version == RADIO_PROTOCOL_V4) {
+        return crc12_update(check, byte);
+    }
+    return (check + luhn_table[byte]) & 0x3f;
+}
+
+/*
+ * GF(64) arithmetic for the RADIO_PROTOCOL_V4 Reed-Solomon code, with
+ * x^6 + x + 1 as the field polynomial and alpha = x. gf64_exp[i] is alpha^i,
+ * and it's twice as long as it needs to be so that adding two logs never
+ * needs a mod. gf64_log[0] is meaningless
+ */
+static const uint8_t gf64_exp[126] = {
+     1,  2,  4,  8, 16, 32,  3,  6, 12, 24, 48, 35,  5, 10, 20, 40,
+    19, 38, 15, 30, 60, 59, 53, 41, 17, 34,  7, 14, 28, 56, 51, 37,
+     9, 18, 36, 11, 22, 44, 27, 54, 47, 29, 58, 55, 45, 25, 50, 39,
+    13, 26, 52, 43, 21, 42, 23, 46, 31, 62, 63, 61, 57, 49, 33,  1,
+     2,  4,  8, 16, 32,  3,  6, 12, 24, 48, 35,  5, 10, 20, 40, 19,
+    38, 15, 30, 60, 59, 53, 41, 17, 34,  7, 14, 28, 56, 51, 37,  9,
+    18, 36, 11, 22, 44, 27, 54, 47, 29, 58, 55, 45, 25, 50, 39, 13,
+    26, 52, 43, 21, 42, 23, 46, 31, 62, 63, 61, 57, 49, 33,
+};
+static const uint8_t gf64_log[64] = {
+     0,  0,  1,  6,  2, 12,  7, 26,  3, 32, 13, 35,  8, 48, 27, 18,
+     4, 24, 33, 16, 14, 52, 36, 54,  9, 45, 49, 38, 28, 41, 19, 56,
+     5, 62, 25, 11, 34, 31, 17, 47, 15, 23, 53, 51, 37, 44, 55, 40,
+    10, 61, 46, 30, 50, 22, 39, 43, 29, 60, 42, 21, 20, 59, 57, 58,
+};
+
+static uint8_t gf64_mul(uint8_t a, uint8_t b)
+{
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return gf64_exp[gf64_log[a] + gf64_log[b]];
+}
+
+// the generator polynomial is (x - 1)(x - alpha) = x^2 + 3x + 2
+#define FEC_GEN_1 3
+#define FEC_GEN_0 2
+
+static uint8_t fec_symbol(char c)
+{
+    uint8_t sextet = base64_decode_table[(uint8_t) c];
+    return sextet == BASE64_INVALID ? 0 : sextet;
+}
+
+/*
+ * Writes the FEC_PARITY_LEN parity characters for the first len characters
+ * of frame right after them. The first character is the highest power of x
+ */
+static void fec_append_parity(char *frame, uint8_t len)
+{
+    uint8_t hi = 0, lo = 0;
+    uint8_t i;
+    for (i = 0; i < len; ++i) {
+        uint8_t feedback = fec_symbol(frame[i]) ^ hi;
+        hi = lo ^ gf64_mul(feedback, FEC_GEN_1);
+        lo = gf64_mul(feedback, FEC_GEN_0);
+    }
+    frame[len] = base64_encode_table[hi];
+    frame[len + 1] = base64_encode_table[lo];
+}
+
+// the code word evaluated at 1 and at alpha
+static void fec_syndromes(const char *frame, uint8_t n, uint8_t *s0, uint8_t *s1)
+{
+    *s0 = 0;
+    *s1 = 0;
+    uint8_t i;
+    for (i = 0; i < n; ++i) {
+        uint8_t symbol = fec_symbol(frame[i]);
+        *s0 ^= symbol;
+        *s1 = gf64_mul(*s1, 2) ^ symbol;
+    }
+}
+
+static bool fec_syndromes_zero(const char *frame, uint8_t n)
+{
+    uint8_t s0, s1;
+    fec_syndromes(frame, n, &s0, &s1);
+    return s0 == 0 && s1 == 0;
+}
+
+uint8_t encode_frame_check(uint16_t check, char *str,
+                           enum RADIO_PROTOCOL_VERSION version)
+{
+    if (version == RADIO_PROTOCOL_V3) {
+        return 0;
+    }
+    if (version == RADIO_PROTOCOL_V2 || version == RADIO_PROTOCOL_V4) {
+        str[0] = base64_encode_table[(check >> 6) & 0x3f];
+        str[1] = base64_encode_table[check & 0x3f];
+        return 2;
+    }
+    str[0] = base64_encode_table[check & 0x3f];
+    return 1;
+}
+
+uint8_t append_frame_check(char *frame, uint8_t len,
+                           enum RADIO_PROTOCOL_VERSION version)
+{
+    uint16_t check = FRAME_CHECK_INIT;
+    uint8_t i;
+    for (i = 0; i < len; ++i) {
+        check = frame_check_update(check, (uint8_t) frame[i], version);
+    }
+    uint8_t check_len = encode_frame_check(check, frame + len, version);
+    if (version == RADIO_PROTOCOL_V4) {
+        fec_append_parity(frame, len + check_len);
+        check_len += FEC_PARITY_LEN;
+    }
+    return check_len;
+}
+
+bool frame_check_ok(const char *frame, uint8_t len,
+                    enum RADIO_PROTOCOL_VERSION version)
+{
+    char expected[FRAME_CHECK_MAX_LEN];
+    uint16_t check = FRAME_CHECK_INIT;
+    uint8_t i;
+    for (i = 0; i < len; ++i) {
+        check = frame_check_update(check, (uint8_t) frame[i], version);
+    }
+    uint8_t check_len = encode_frame_check(check, expected, version);
+    if (version == RADIO_PROTOCOL_V4) {
+        // the CRC-12 covers the body byte for byte, but the parity
+        // characters are only checked as symbols, and 0 is 'A' or anything
+        // that isn't base64
+        const char *parity = frame + len + check_len;
+        if (!fec_syndromes_zero(frame, len + check_len + FEC_PARITY_LEN) ||
+            base64_decode_table[(uint8_t) parity[0]] == BASE64_INVALID ||
+            base64_decode_table[(uint8_t) parity[1]] == BASE64_INVALID) {
+            return false;
+        }
+    }
+    return memcmp(expected, frame + len, check_len) == 0;
+}
+
+enum FEC_RESULT fec_correct_frame(char *frame, uint8_t body_len,
+                                  enum RADIO_PROTOCOL_VERSION version)
+{
+    if (version != RADIO_PROTOCOL_V4 || frame == NULL || body_len == 0) {
+        return FEC_CLEAN;
+    }
+    const char *start = frame;
+    // same as create_state_command, the frame check of a state command
+    // doesn't cover the header
+    if (frame[0] == STATE_COMMAND_HEADER) {
+        frame++;
+        body_len--;
+    }
+
+    uint8_t n = body_len + frame_check_len(version);
+    uint8_t s0, s1, pos;
+    fec_syndromes(frame, n, &s0, &s1);
+    if (s0 == 0 && s1 == 0) {
+        // a character that was 'A' (symbol 0) and got turned into something
+        // that isn't base64 doesn't show up in the syndromes. The header is
+        // the only thing that's allowed not to be base64
+        for (pos = (frame == start) ? 1 : 0; pos < n; ++pos) {
+            if (base64_decode_table[(uint8_t) frame[pos]] == BASE64_INVALID) {
+                break;
+            }
+        }
+        if (pos == n) {
+            return FEC_CLEAN;
+        }
+    } else if (s0 == 0 || s1 == 0) {
+        return FEC_UNCORRECTABLE;
+    } else {
+        // one error of size s0, at the character whose power of alpha is
+        // s1 / s0
+        uint8_t power = (gf64_log[s1] + 63 - gf64_log[s0]) % 63;
+        if (power >= n) {
+            return FEC_UNCORRECTABLE;
+        }
+        pos = n - 1 - power;
+    }
+    char original = frame[pos];
+    frame[pos] = base64_encode_table[fec_symbol(original) ^ s0];
+    if (!frame_check_ok(frame, body_len, version)) {
+        frame[pos] = original;
+        return FEC_UNCORRECTABLE;
+    }
+    return FEC_CORRECTED;
+}
+
+#define BINARY_FRAME_MAX_RAW_LEN BINARY_FRAME_RAW_LEN(RADIO_FRAME_MAX_BODY_LEN)
+
+#if BINARY_FRAME_MAX_RAW_LEN > COBS_MAX_LEN
+#error "binary frames are too long to COBS encode"
+#endif
+
+uint8_t frame_to_binary(const char *frame, uint8_t body_len, uint8_t *out)
+{
+    if (frame == NULL || out == NULL || body_len == 0 ||
+        body_len > RADIO_FRAME_MAX_BODY_LEN) {
+        return 0;
+    }
+
+    uint8_t raw[BINARY_FRAME_MAX_RAW_LEN];
+    uint8_t raw_len = 0;
+    raw[raw_len++] = (uint8_t) frame[0];
+
+    // bits waiting to go out are at the bottom of pending. Anything above
+    // those is left over from earlier and gets shifted out of the way
+    uint16_t pending = 0;
+    uint8_t pending_bits = 0;
+    uint8_t i;
+    for (i = 1; i < body_len; ++i) {
+        uint8_t sextet = base64_decode_table[(uint8_t) frame[i]];
+        if (sextet == BASE64_INVALID) {
+            return 0;
+        }
+        pending = (pending << 6) | sextet;
+        pending_bits += 6;
+        if (pending_bits >= 8) {
+            pending_bits -= 8;
+            raw[raw_len++] = (uint8_t) (pending >> pending_bits);
+        }
+    }
+    if (pending_bits > 0) {
+        raw[raw_len++] = (uint8_t) (pending << (8 - pending_bits));
+    }
+
+    uint16_t crc = FRAME_CHECK_INIT;
+    for (i = 0; i < raw_len; ++i) {
+        crc = crc12_update(crc, raw[i]);
+    }
+    raw[raw_len++] = (uint8_t) (crc >> 8);
+    raw[raw_len++] = (uint8_t) crc;
+
+    uint8_t out_len = cobs_encode(raw, raw_len, out);
+    out[out_len++] = 0;
+    return out_len;
+}
+
+uint8_t binary_to_frame(const uint8_t *in, uint8_t len, char *frame)
+{
+    uint8_t raw[COBS_MAX_ENCODED_LEN(BINARY_FRAME_MAX_RAW_LEN)];
+    uint8_t raw_len;
+    if (in == NULL || frame == NULL || len > sizeof(raw) ||
+        !cobs_decode(in, len, raw, &raw_len) ||
+        raw_len < 3 || raw_len > BINARY_FRAME_MAX_RAW_LEN) {
+        return 0;
+    }
+
+    raw_len -= 2;
+    uint16_t crc = FRAME_CHECK_INIT;
+    uint8_t i;
+    for (i = 0; i < raw_len; ++i) {
+        crc = crc12_update(crc, raw[i]);
+    }
+    if (raw[raw_len] != (uint8_t) (crc >> 8) || raw[raw_len + 1] != (uint8_t) crc) {
+        return 0;
+    }
+
+    uint8_t frame_len = 0;
+    frame[frame_len++] = (char) raw[0];
+    uint16_t pending = 0;
+    uint8_t pending_bits = 0;
+    for (i = 1; i < raw_len; ++i) {
+        pending = (pending << 8) | raw[i];
+        pending_bits += 8;
+        while (pending_bits >= 6) {
+            pending_bits -= 6;
+            frame[frame_len++] = base64_encode_table[(pending >> pending_bits) & 0x3f];
+        }
+    }
+    return frame_len;
+}
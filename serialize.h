@@ -5,6 +5,9 @@
 #include <stdint.h>
 #include "error.h"
 #include "message_types.h"
+#include "perf_stats.h"
+#include "telemetry_history.h"
+#include "cobs.h"
 
 /*
  * This macro defines how long (in bytes) a string must be in order to
@@ -13,13 +16,55 @@
  * characters in it
  */
 #define SERIALIZED_OUTPUT_LEN 9
+
+/*
+ * Radio protocol versions. All that changes between them so far is the frame
+ * check at the end of every frame:
+ *
+ *   RADIO_PROTOCOL_V1  one base64 character, a modified Luhn checksum (see
+ *                      checksum() below). It misses a lot of the multi bit
+ *                      corruption the XBee link produces
+ *   RADIO_PROTOCOL_V2  two base64 characters, a CRC-12 (see crc12_update)
+ *   RADIO_PROTOCOL_V3  binary framing. Frames are built just like they are
+ *                      for the others, but without an ASCII frame check
+ *                      (frame_check_len is 0), and then frame_to_binary
+ *                      packs them into bytes and adds a CRC-12 before they
+ *                      go out. One character queries can still be sent in
+ *                      ASCII between binary frames
+ *   RADIO_PROTOCOL_V4  four base64 characters, RADIO_PROTOCOL_V2's CRC-12
+ *                      followed by two Reed-Solomon parity characters, which
+ *                      let the receiver fix any one wrong character (see
+ *                      fec_correct_frame). For marginal links
+ *
+ * In the ASCII versions, the frame check covers the same characters of each
+ * frame whichever version is in use. The radio board speaks
+ * RADIO_PROTOCOL_DEFAULT until RLCS asks for something else with a version
+ * select (see VERSION_SELECT_HEADER), so ground stations that don't know
+ * about versions keep working.
+ */
+enum RADIO_PROTOCOL_VERSION {
+    RADIO_PROTOCOL_V1 = 1,
+    RADIO_PROTOCOL_V2 = 2,
+    RADIO_PROTOCOL_V3 = 3,
+    RADIO_PROTOCOL_V4 = 4,
+};
+#define RADIO_PROTOCOL_DEFAULT RADIO_PROTOCOL_V1
+#define RADIO_PROTOCOL_LATEST RADIO_PROTOCOL_V4
+// the longest frame check any version uses, for sizing buffers
+#define FRAME_CHECK_MAX_LEN 4
+// how many of RADIO_PROTOCOL_V4's frame check characters are parity
+#define FEC_PARITY_LEN 2
+
 /*
  * Length of a state command. A state command is a block of characters
- * that can be sent over the radio. It's mostly the serialized state output
- * with a couple of additional bytes for STATE_COMMAND header and for a
- * CRC or hamming code
+ * that can be sent over the radio. It's the STATE_COMMAND_HEADER followed by
+ * the serialized state output (STATE_COMMAND_BODY_LEN characters in all),
+ * then the frame check, which only covers the serialized state.
+ * STATE_COMMAND_LEN is big enough for any version's frame check and a null
+ * terminator
  */
-#define STATE_COMMAND_LEN (SERIALIZED_OUTPUT_LEN + 2)
+#define STATE_COMMAND_BODY_LEN SERIALIZED_OUTPUT_LEN
+#define STATE_COMMAND_LEN (STATE_COMMAND_BODY_LEN + FRAME_CHECK_MAX_LEN + 1)
 /*
  * This character indicates the beginning of a state command.
  */
@@ -29,13 +74,115 @@
  */
 #define STATE_REQUEST_HEADER '}'
 /*
- * This character indicates the beginning of a error message
+ * This character indicates the beginning of a error message. It's followed
+ * by a serialized error (see serialize_error), and the frame check covers
+ * both of them
  */
 #define ERROR_COMMAND_HEADER '!'
+#define ERROR_MSG_BODY_LEN ERROR_COMMAND_LENGTH
+/*
+ * That's only in RADIO_PROTOCOL_V1. From RADIO_PROTOCOL_V2 on, errors go out
+ * after this character instead, as an error report (see error_report_t and
+ * create_error_report), which also says how often the error was repeated
+ */
+#define ERROR_REPORT_HEADER ';'
+#define ERROR_REPORT_BODY_LEN (1 + (ERROR_REPORT_BITS + 5) / 6)
+#define ERROR_REPORT_LEN (ERROR_REPORT_BODY_LEN + FRAME_CHECK_MAX_LEN)
+/*
+ * This character starts a version select, which RLCS sends to pick the radio
+ * protocol version. It's followed by the version it wants (one base64
+ * character) and a RADIO_PROTOCOL_V1 frame check of both, whatever version
+ * is currently in use, so that it can always be understood. The radio board
+ * answers with a version select of its own (see create_version_reply), with
+ * the version it's now using. That's the requested version if it's
+ * supported, otherwise the one it was already using.
+ *
+ * Version selects are ASCII even in RADIO_PROTOCOL_V3. Whoever sends one
+ * while the other end might be in the middle of a binary frame puts a 0x00
+ * in front of it to end that frame, and since a binary frame can never start
+ * with VERSION_SELECT_HEADER, a receiver that sees one at the start of a
+ * frame knows it's ASCII. So either end can always get the other back to a
+ * version it knows
+ */
+#define VERSION_SELECT_HEADER '^'
+#define VERSION_SELECT_BODY_LEN 2
+#define VERSION_SELECT_LEN (VERSION_SELECT_BODY_LEN + FRAME_CHECK_MAX_LEN)
+#define VERSION_REPLY_MAX_LEN (VERSION_SELECT_LEN + 1)
+
+/*
+ * Radio frames are described by field schemas: X-macro lists of
+ * X(name, width, signedness). Fields are packed in the order listed, most
+ * significant bit first, into a bitstream that gets sent six bits per
+ * character (see binary_to_base64). serialize.c generates the pack and unpack
+ * code for each frame from its schema at compile time, so there's nothing to
+ * interpret at runtime, and it checks the frame lengths in this file against
+ * the schemas.
+ *
+ * Values wider than their field are truncated to the bottom width bits.
+ * FIELD_SIGNED fields are two's complement, and are sign extended when they
+ * are unpacked.
+ *
+ * To add a field to a frame, add it to the frame's struct and add one line to
+ * its schema (and update RLCS to match, and the frame length if it grows).
+ */
+#define FIELD_UNSIGNED 0
+#define FIELD_SIGNED 1
+
+#define SCHEMA_FIELD_BITS(name, width, signedness) + (width)
+#define SCHEMA_BITS(FIELDS) (0 FIELDS(SCHEMA_FIELD_BITS))
+#define SCHEMA_FIELD_COUNT(name, width, signedness) + 1
+#define SCHEMA_FIELDS(FIELDS) (0 FIELDS(SCHEMA_FIELD_COUNT))
+#define SCHEMA_CHARS(FIELDS) ((SCHEMA_BITS(FIELDS) + 5) / 6)
+
+/*
+ * The state that goes both ways: the radio board's view of the rocket in
+ * answer to a STATE_REQUEST_HEADER, and RLCS's orders in a state command
+ */
+#define STATE_FIELDS(X)                             \
+    X(num_boards_connected,    4,  FIELD_UNSIGNED)  \
+    X(injector_valve_state,    2,  FIELD_UNSIGNED)  \
+    X(vent_valve_state,        2,  FIELD_UNSIGNED)  \
+    X(tank_pressure,           10, FIELD_UNSIGNED)  \
+    X(bus_is_powered,          1,  FIELD_UNSIGNED)  \
+    X(any_errors_detected,     1,  FIELD_UNSIGNED)  \
+    X(bus_battery_voltage_mv,  14, FIELD_UNSIGNED)  \
+    X(vent_battery_voltage_mv, 14, FIELD_UNSIGNED)
+
+/*
+ * An error_t (see error.h), sent after an ERROR_COMMAND_HEADER
+ */
+#define ERROR_FIELDS(X)                             \
+    X(board_id,                4,  FIELD_UNSIGNED)  \
+    X(err_type,                6,  FIELD_UNSIGNED)  \
+    X(byte4,                   8,  FIELD_UNSIGNED)  \
+    X(byte5,                   8,  FIELD_UNSIGNED)  \
+    X(byte6,                   8,  FIELD_UNSIGNED)  \
+    X(byte7,                   8,  FIELD_UNSIGNED)
+
+/*
+ * What an error report adds to an error: how many times it was reported
+ * while it waited to go out, and how many seconds before it went out it was
+ * last reported. Both saturate at ERROR_REPEAT_MAX
+ */
+#define ERROR_REPEAT_FIELDS(X)                      \
+    X(count,                   6,  FIELD_UNSIGNED)  \
+    X(age_s,                   6,  FIELD_UNSIGNED)
+#define ERROR_REPEAT_MAX 63
+#define ERROR_REPORT_BITS (SCHEMA_BITS(ERROR_FIELDS) + SCHEMA_BITS(ERROR_REPEAT_FIELDS))
+
+/*
+ * An error as RLCS gets it in an ERROR_REPORT_HEADER frame or a bundle
+ */
+typedef struct {
+    error_t err;
+    uint8_t count;
+    uint8_t age_s;
+} error_report_t;
 
 /*
  * This type contains all of the information that needs to be shared between
- * the operator on the ground and the CAN system in the rocket.
+ * the operator on the ground and the CAN system in the rocket. The order of
+ * the fields here doesn't matter, STATE_FIELDS decides how they're sent.
  */
 typedef struct {
     uint16_t tank_pressure;
@@ -48,21 +195,181 @@ typedef struct {
     uint16_t vent_battery_voltage_mv;
 } system_state;
 
+/*
+ * Delta state frames. Instead of STATE_REQUEST_HEADER, RLCS can poll with a
+ * STATE_DELTA_REQUEST_HEADER followed by the sequence number (one base64
+ * character) of the last delta frame it got, or STATE_DELTA_NO_SNAPSHOT if it
+ * doesn't have one. The radio board answers with a STATE_DELTA_HEADER frame:
+ *
+ *   seq       6 bits   this frame's sequence number, 0 to
+ *                      STATE_DELTA_NO_SNAPSHOT - 1
+ *   base_seq  6 bits   the frame this one is relative to, or seq itself for
+ *                      a keyframe, which has every field in it
+ *   changed   one bit per field in STATE_FIELDS, in order, set for the
+ *             fields that are in this frame
+ *   ...       the changed fields, packed as they are in STATE_FIELDS
+ *
+ * followed by the frame check of the whole thing, header included. Fields
+ * that aren't in the frame are the same as they were in frame base_seq. The
+ * radio board remembers the last few frames it sent, and sends a keyframe if
+ * it doesn't have the one RLCS asked about, and every so often regardless.
+ *
+ * The length of a delta frame depends on which fields are in it, see
+ * state_delta_body_len.
+ */
+#define STATE_DELTA_REQUEST_HEADER ']'
+#define STATE_DELTA_HEADER '['
+#define STATE_DELTA_NO_SNAPSHOT 63
+#define STATE_DELTA_PREFIX_BITS (6 + 6 + SCHEMA_FIELDS(STATE_FIELDS))
+// enough characters, header included, to work out how long the frame is
+#define STATE_DELTA_PREFIX_LEN (1 + (STATE_DELTA_PREFIX_BITS + 5) / 6)
+#define STATE_DELTA_MAX_BODY_LEN \
+    (1 + (STATE_DELTA_PREFIX_BITS + SCHEMA_BITS(STATE_FIELDS) + 5) / 6)
+#define STATE_DELTA_MAX_LEN (STATE_DELTA_MAX_BODY_LEN + FRAME_CHECK_MAX_LEN)
+
+/*
+ * Bundles. RLCS can also poll with a BUNDLE_REQUEST_HEADER, followed by a
+ * delta state sequence number just like a STATE_DELTA_REQUEST_HEADER. The
+ * radio board answers with one BUNDLE_HEADER frame holding a delta state and
+ * whatever else it has waiting to go out: errors, and a GPS position when
+ * one's due. That's instead of sending each of those in its own frame, with
+ * its own header and frame check, and instead of only one error a second.
+ * While RLCS polls this way, errors and GPS positions only go out in bundles.
+ *
+ *   num_errors  2 bits   how many error records there are
+ *   has_gps     1 bit    whether there's a GPS record
+ *   ...         a delta state, laid out as it is after a STATE_DELTA_HEADER
+ *   GPS record  packed as it is after a GPS_MSG_HEADER, if has_gps
+ *   errors      packed as they are after an ERROR_REPORT_HEADER
+ *
+ * followed by the frame check of the whole thing, header included. There are
+ * at most BUNDLE_MAX_RECORDS records besides the state, GPS included. Like a
+ * delta state frame, its length depends on what's in it, see
+ * bundle_body_len. Bundles are newer than any ground station that only
+ * speaks RADIO_PROTOCOL_V1, so their errors are error reports in every
+ * version.
+ */
+#define BUNDLE_REQUEST_HEADER ')'
+#define BUNDLE_HEADER '('
+#define BUNDLE_MAX_RECORDS 3
+#define BUNDLE_PREFIX_BITS (2 + 1 + STATE_DELTA_PREFIX_BITS)
+#define BUNDLE_PREFIX_LEN (1 + (BUNDLE_PREFIX_BITS + 5) / 6)
+// an error report is a little longer than a GPS record, which serialize.c
+// checks, so the longest bundle is all errors
+#define BUNDLE_MAX_BODY_LEN                                     \
+    (1 + (BUNDLE_PREFIX_BITS + SCHEMA_BITS(STATE_FIELDS) +      \
+          BUNDLE_MAX_RECORDS * ERROR_REPORT_BITS + 5) / 6)
+#define BUNDLE_MAX_LEN (BUNDLE_MAX_BODY_LEN + FRAME_CHECK_MAX_LEN)
+
+/*
+ * Push mode. Instead of polling, RLCS can subscribe with a SUBSCRIBE_HEADER,
+ * then the period it wants states at in units of PUSH_PERIOD_UNIT_MS (one
+ * base64 character, 0 to unsubscribe), then a delta state sequence number
+ * just like the one after a BUNDLE_REQUEST_HEADER. The radio board answers
+ * with a bundle straight away, and from then on sends one by itself every
+ * period, each relative to the one before, plus one as soon as either valve,
+ * bus power or the error flag changes. A subscribe is also how RLCS asks to
+ * catch up after missing a bundle: the next one is relative to the sequence
+ * number it gives. Like bundle polls, errors and GPS positions only go out in
+ * bundles while subscribed. A subscribe lasts until it's cancelled, so
+ * unlike a query it ends with the frame check of the whole thing, header
+ * included.
+ *
+ * Bundles the radio board sends by itself don't count as contact with RLCS,
+ * so a subscription lapses if RLCS goes quiet for long enough that the radio
+ * board goes to safe state.
+ */
+#define SUBSCRIBE_HEADER '*'
+#define SUBSCRIBE_BODY_LEN 3
+#define SUBSCRIBE_LEN (SUBSCRIBE_BODY_LEN + FRAME_CHECK_MAX_LEN)
+#define PUSH_PERIOD_UNIT_MS 100
+
+/*
+ * Acknowledged state commands. Instead of a STATE_COMMAND_HEADER, RLCS can
+ * send a SEQ_COMMAND_HEADER, then a sequence number (one base64 character, 0
+ * to COMMAND_SEQ_NONE - 1), then the serialized state, then the frame check
+ * of the whole thing, header included. The radio board answers every one
+ * whose frame check is good with a COMMAND_ACK_HEADER frame:
+ *
+ *   seq        6 bits  the command this answers
+ *   last_seq   6 bits  the newest command the radio board has applied, or
+ *                      COMMAND_SEQ_NONE if it hasn't applied any since boot
+ *                      (or since it last went to safe state)
+ *   accepted   1 bit   whether the command is applied now
+ *   injector_valve_state, vent_valve_state, bus_is_powered
+ *              5 bits  as in STATE_FIELDS, what the radio board is now
+ *                      following, whatever became of this command
+ *
+ * followed by the frame check of the whole thing, header included.
+ *
+ * A command is applied if it's newer than last_seq, which means it's at
+ * most COMMAND_SEQ_WINDOW ahead of it (counting round from
+ * COMMAND_SEQ_NONE - 1 to 0). One that is last_seq is a resend of a command
+ * already applied, and is accepted without being applied again. Anything
+ * else is older than what's been applied, and is turned away, so that
+ * resending a command that got lost can never undo a newer one. That lets
+ * RLCS send a new command without waiting for the last one to be
+ * acknowledged, and only resend the newest one if its acknowledgement
+ * doesn't come. If RLCS starts again from a sequence number the radio board
+ * thinks is old, last_seq in the rejection says where to carry on from.
+ *
+ * Plain state commands still work, and don't change last_seq.
+ */
+#define SEQ_COMMAND_HEADER '<'
+#define SEQ_COMMAND_BODY_LEN (2 + SERIALIZED_OUTPUT_LEN - 1)
+#define SEQ_COMMAND_LEN (SEQ_COMMAND_BODY_LEN + FRAME_CHECK_MAX_LEN)
+#define COMMAND_ACK_HEADER '>'
+#define COMMAND_ACK_BODY_LEN 4
+#define COMMAND_ACK_LEN (COMMAND_ACK_BODY_LEN + FRAME_CHECK_MAX_LEN)
+#define COMMAND_SEQ_NONE 63
+#define COMMAND_SEQ_WINDOW 31
+
+typedef struct {
+    uint8_t seq;
+    uint8_t last_seq;
+    bool accepted;
+    enum VALVE_STATE injector_valve_state;
+    enum VALVE_STATE vent_valve_state;
+    bool bus_is_powered;
+} command_ack_t;
+
 /*
  * This function converts a binary value from 0 to 63 inclusive into a
  * printable charcter using a modified version of Base64. The + character is
  * not used, and is replaced by the & character, due to the XBEE interpreting
- * the + character as a special character.
+ * the + character as a special character. Returns 0 (not a printable
+ * character) if binary is bigger than 63.
  */
 char binary_to_base64(uint8_t binary);
 
+/*
+ * Returned by base64_to_binary for any character that isn't part of the
+ * modified Base64 alphabet
+ */
+#define BASE64_INVALID 0xFF
+
 /*
  * This function converts a value from a modified version of Base64 into a raw
  * binary value. See the description of the function binary_to_base64() for a
  * description of the modified Base64 encoding and the reason for its use.
+ * Returns BASE64_INVALID if base64 isn't a legal character.
  */
 uint8_t base64_to_binary(char base64);
 
+/*
+ * Bulk versions of the two functions above. bits is a buffer of len bytes,
+ * each of which holds 6 bits (the bottom 6, the top two are ignored by
+ * encode_bits and are always 0 out of decode_bits), and str is len
+ * characters of modified Base64. Neither adds or expects a null terminator.
+ *
+ * decode_bits returns false as soon as it finds a character that isn't in
+ * the alphabet, in which case the contents of bits are undefined. Every
+ * deserialize and expand function below uses it, and rejects the whole frame
+ * rather than decoding garbage.
+ */
+void encode_bits(const uint8_t *bits, char *str, uint8_t len);
+bool decode_bits(const char *str, uint8_t *bits, uint8_t len);
+
 /*
  * This function takes a system_state and serializes it into ASCII text that
  * can be sent over the radio. It will return true if it was able to
@@ -85,15 +392,43 @@ bool deserialize_state(system_state *state, const char *str);
 bool serialize_error(const error_t *err, char *str);
 
 /*
- *
+ * Converts a string generated by serialize_error back into an error_t.
+ * Returns true on success
  */
 bool deserialize_error(error_t *err, const char *str);
 
-#define GPS_MSG_LEN 11
+/*
+ * Writes an error report into str, which must be at least ERROR_REPORT_LEN
+ * bytes long: the ERROR_REPORT_HEADER, the report, and the frame check for
+ * version. Does not null terminate str
+ */
+bool create_error_report(const error_report_t *report, char *str,
+                         enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Unpacks the error report in str, received in version. Returns false, and
+ * leaves report alone, if the frame is bad
+ */
+bool expand_error_report(error_report_t *report, const char *str,
+                         enum RADIO_PROTOCOL_VERSION version);
+
+#define GPS_MSG_BODY_LEN 10
+#define GPS_MSG_LEN (GPS_MSG_BODY_LEN + FRAME_CHECK_MAX_LEN)
 #define GPS_MSG_HEADER '$'
+
+/*
+ * A GPS position, as create_gps_message takes it. lat_dir is 'N' or 'S', and
+ * lon_dir is 'E' or 'W'
+ */
+typedef struct {
+    uint8_t lat_deg, lat_min, lat_dmin, lat_dir;
+    uint8_t lon_deg, lon_min, lon_dmin, lon_dir;
+} gps_position_t;
 /*
- * Packs the latitude and longitude into str. str must be a buffer
- * at least GPS_MSG_LEN bytes long. Returns true on success.
+ * Packs the latitude and longitude into str, followed by the frame check for
+ * version. str must be a buffer at least GPS_MSG_LEN bytes long, and
+ * GPS_MSG_BODY_LEN + frame_check_len(version) of it gets used. Returns true
+ * on success.
  *
  * Example of what it might put in str: "$IBIyah4vgY"
  * Note that this function does not null terminate str
@@ -106,11 +441,12 @@ bool create_gps_message(uint8_t latitude_deg,
                         uint8_t longitude_min,
                         uint8_t longitude_dmin,
                         uint8_t longitude_dir,
-                        char *str);
+                        char *str,
+                        enum RADIO_PROTOCOL_VERSION version);
 
 /*
- * Unpacks str into latitude and longitude values. str must be a buffer
- * at least GPS_MSG_LEN bytes long. Returns true on success.
+ * Unpacks str into latitude and longitude values. str must hold a whole GPS
+ * message in version. Returns false if the header or frame check are wrong.
  */
 bool expand_gps_message(uint8_t *latitude_deg,
                         uint8_t *latitude_min,
@@ -120,28 +456,468 @@ bool expand_gps_message(uint8_t *latitude_deg,
                         uint8_t *longitude_min,
                         uint8_t *longitude_dmin,
                         uint8_t *longitude_dir,
-                        char *str);
+                        const char *str,
+                        enum RADIO_PROTOCOL_VERSION version);
+
+#define PERF_STATS_MSG_BODY_LEN 25
+#define PERF_STATS_MSG_LEN (PERF_STATS_MSG_BODY_LEN + FRAME_CHECK_MAX_LEN)
+/*
+ * This character means "hey radio board, send your timing stats". It is
+ * followed by one base64 character, the perf stats slot (see enum PERF_SLOT)
+ * that RLCS wants to see. The radio board replies with a perf stats message,
+ * which starts with the same character
+ */
+#define PERF_STATS_REQUEST_HEADER '%'
+/*
+ * Packs the timing stats for one slot into str. str must be a buffer at least
+ * PERF_STATS_MSG_LEN bytes long. Returns true on success. After the header,
+ * the message is a bitstream (most significant bit first, 6 bits per
+ * character) of:
+ *
+ *   slot       6 bits
+ *   count     24 bits, saturating
+ *   min_us    16 bits
+ *   mean_us   16 bits
+ *   max_us    16 bits
+ *   histogram  8 bits for each of the PERF_STATS_NUM_BUCKETS buckets. Each
+ *              one is that bucket's share of all the samples, scaled so that
+ *              255 means all of them
+ *
+ * followed by two bits of padding and a frame check for version of
+ * everything before it. Note that this function does not null terminate str
+ */
+bool create_perf_stats_message(uint8_t slot, const perf_stat_t *stat, char *str,
+                               enum RADIO_PROTOCOL_VERSION version);
+
+#define TELEMETRY_SUMMARY_MSG_BODY_LEN 34
+#define TELEMETRY_SUMMARY_MSG_LEN (TELEMETRY_SUMMARY_MSG_BODY_LEN + FRAME_CHECK_MAX_LEN)
+/*
+ * This character means "hey radio board, send the recent history of one
+ * quantity". It is followed by one base64 character, the quantity (see enum
+ * TELEM_QUANTITY). The radio board replies with a telemetry summary message,
+ * which starts with the same character
+ */
+#define TELEMETRY_REQUEST_HEADER '#'
+/*
+ * Packs a telemetry summary into str. str must be a buffer at least
+ * TELEMETRY_SUMMARY_MSG_LEN bytes long. Returns true on success. After the
+ * header, the message is a bitstream (most significant bit first, 6 bits per
+ * character) of:
+ *
+ *   quantity      6 bits
+ *   latest       16 bits
+ *   rate_per_min 16 bits, two's complement
+ *   min          16 bits
+ *   max          16 bits
+ *   bucket means 16 bits each, TELEM_SUMMARY_BUCKETS of them, newest first
+ *
+ * followed by a frame check for version of everything before it. Note that
+ * this function does not null terminate str
+ */
+bool create_telemetry_summary_message(uint8_t quantity,
+                                      const telem_summary_t *summary,
+                                      char *str,
+                                      enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Unpacks a message made by create_telemetry_summary_message. Returns false
+ * if the header or frame check are wrong
+ */
+bool expand_telemetry_summary_message(uint8_t *quantity,
+                                      telem_summary_t *summary,
+                                      const char *str,
+                                      enum RADIO_PROTOCOL_VERSION version);
+
+#define BOARD_STATS_MSG_BODY_LEN 26
+#define BOARD_STATS_MSG_LEN (BOARD_STATS_MSG_BODY_LEN + FRAME_CHECK_MAX_LEN)
+/*
+ * This character means "hey radio board, tell me how you're keeping up". It
+ * is followed by one base64 character, the page RLCS wants to see (see enum
+ * BOARD_STATS_PAGE). The radio board replies with a board stats message,
+ * which starts with the same character.
+ *
+ * Every page is BOARD_STATS_NUM_COUNTERS counters, each saturating at
+ * BOARD_STATS_COUNTER_MAX, out of one of the firmware's stats structs. What
+ * each one means is listed with its page, and counters a page doesn't use
+ * are 0. Pages we don't have are ignored
+ */
+#define BOARD_STATS_REQUEST_HEADER '?'
+#define BOARD_STATS_NUM_COUNTERS 6
+#define BOARD_STATS_COUNTER_MAX 0xFFFFFFul
+
+enum BOARD_STATS_PAGE {
+    /*
+     * can_ingest_stats_t, whether the CAN receive buffer is keeping up:
+     *   frames_processed, batches, frames_dropped, max_batch_size, backlog,
+     *   backlog_high_water
+     */
+    BOARD_STATS_CAN_INGEST = 0,
+    /*
+     * radio_tx_stats_t, one page per enum RADIO_TX_CLASS in the same order,
+     * whether the radio's keeping up with what each class sends:
+     *   frames_sent, frames_dropped, depth, max_depth, mean latency in ms,
+     *   max_latency_ms
+     */
+    BOARD_STATS_RADIO_TX_SAFETY,
+    BOARD_STATS_RADIO_TX_ERROR,
+    BOARD_STATS_RADIO_TX_GPS,
+    BOARD_STATS_RADIO_TX_DEBUG,
+    /*
+     * error_stats_t, how many errors there really were, since the error
+     * frames only carry one of each that got merged together:
+     *   reported, coalesced, dropped, max_pending
+     */
+    BOARD_STATS_ERRORS,
+    /*
+     * radio_mirror_stats_t, and whether the radio is being mirrored on CAN
+     * (see RADIO_MIRROR_HEADER):
+     *   enabled, bytes_mirrored, bytes_dropped, bytes_discarded,
+     *   messages_sent, partial_flushes
+     */
+    BOARD_STATS_RADIO_MIRROR,
+    /*
+     * radio_parser_stats_t of what RLCS sends us in ASCII, how well the
+     * uplink's holding up:
+     *   fec_corrected, fec_uncorrectable, frames_ok, bad_checks, truncated,
+     *   resyncs
+     */
+    BOARD_STATS_RADIO_INPUT,
+    BOARD_STATS_NUM_PAGES
+};
+
+typedef struct {
+    uint32_t counters[BOARD_STATS_NUM_COUNTERS];
+} board_stats_t;
+
+/*
+ * Packs one page of board stats into str. str must be a buffer at least
+ * BOARD_STATS_MSG_LEN bytes long. Returns true on success. After the
+ * header, the message is a bitstream (most significant bit first, 6 bits per
+ * character) of:
+ *
+ *   page        6 bits
+ *   counters   24 bits each, BOARD_STATS_NUM_COUNTERS of them
+ *
+ * followed by a frame check for version of everything before it. Note that
+ * this function does not null terminate str
+ */
+bool create_board_stats_message(uint8_t page, const board_stats_t *stats, char *str,
+                                enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Unpacks a message made by create_board_stats_message. Returns false if the
+ * header or frame check are wrong
+ */
+bool expand_board_stats_message(uint8_t *page, board_stats_t *stats, const char *str,
+                                enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * This character means "hey radio board, stop (or start) copying what you
+ * send me onto the CAN bus". It is followed by one base64 character, 0 for
+ * off and 1 for on, and anything else leaves it as it is. Since it changes
+ * what the radio board does until it's told otherwise, it ends with the frame
+ * check of the whole thing, header included, like a subscribe. The radio
+ * board replies with the BOARD_STATS_RADIO_MIRROR page of board stats, so
+ * RLCS can see that it took
+ */
+#define RADIO_MIRROR_HEADER '~'
+#define RADIO_MIRROR_BODY_LEN 2
+#define RADIO_MIRROR_LEN (RADIO_MIRROR_BODY_LEN + FRAME_CHECK_MAX_LEN)
+
+/*
+ * Writes a RADIO_MIRROR_HEADER frame into str, which must be at least
+ * RADIO_MIRROR_LEN bytes long, with the frame check for version. Returns
+ * false if which doesn't fit in a base64 character. Does not null terminate
+ * str
+ */
+bool create_radio_mirror(char *str, uint8_t which, enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Unpacks a frame made by create_radio_mirror. Returns false if the header or
+ * frame check are wrong
+ */
+bool expand_radio_mirror(uint8_t *which, const char *str,
+                         enum RADIO_PROTOCOL_VERSION version);
 
 /*
  * Returns true if the two system states passed to it are equal (returns
  * false if either of them are NULL). Note that in C you're not just allowed
  * to do (*s == *p), you have to individually compare each element in the
- * struct, due to data representation reasons
+ * struct, due to data representation reasons. Every field in STATE_FIELDS is
+ * compared
  */
 bool compare_system_states(const system_state *s, const system_state *p);
 
 /*
  * This function creates a state command that can be sent over the radio
- * byte by byte. Returns false if it couldn't do so, for some reason
+ * byte by byte, with the frame check for version, and null terminates it.
+ * cmd must be at least STATE_COMMAND_LEN bytes long. Returns false if it
+ * couldn't do so, for some reason
+ */
+bool create_state_command(char *cmd, const system_state *state,
+                          enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Checks the frame check on a state command received in version, and
+ * deserializes it into state. Returns false if the header or frame check are
+ * wrong, or if the state can't be deserialized
+ */
+bool expand_state_command(system_state *state, const char *cmd,
+                          enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Writes an acknowledged state command (see SEQ_COMMAND_HEADER) with
+ * sequence number seq into cmd, which must be at least SEQ_COMMAND_LEN bytes
+ * long, with the frame check for version. Returns false if seq is out of
+ * range. Does not null terminate cmd
+ */
+bool create_seq_command(char *cmd, uint8_t seq, const system_state *state,
+                        enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Unpacks a frame made by create_seq_command, received in version. Returns
+ * false, and leaves *seq alone, if the frame check of the whole frame, header
+ * included, is wrong. Otherwise *seq gets the sequence number, and this
+ * returns false if that's out of range or the state can't be deserialized
+ */
+bool expand_seq_command(uint8_t *seq, system_state *state, const char *cmd,
+                        enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Writes ack into str as a COMMAND_ACK_HEADER frame, with the frame check
+ * for version. str must be at least COMMAND_ACK_LEN bytes long. Does not null
+ * terminate str
+ */
+bool create_command_ack(const command_ack_t *ack, char *str,
+                        enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Unpacks a frame made by create_command_ack. Returns false if the header or
+ * frame check are wrong
+ */
+bool expand_command_ack(command_ack_t *ack, const char *str,
+                        enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Writes a subscribe (see SUBSCRIBE_HEADER) for a bundle every period units
+ * of PUSH_PERIOD_UNIT_MS, relative to delta state acked_seq, into str, which
+ * must be at least SUBSCRIBE_LEN bytes long, with the frame check for
+ * version. Returns false if period or acked_seq don't fit in a base64
+ * character. Does not null terminate str
+ */
+bool create_subscribe(char *str, uint8_t period, uint8_t acked_seq,
+                      enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Unpacks a frame made by create_subscribe. Returns false if the header or
+ * frame check are wrong
+ */
+bool expand_subscribe(uint8_t *period, uint8_t *acked_seq, const char *str,
+                      enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Writes a delta state frame with sequence number seq into str, which must
+ * be at least STATE_DELTA_MAX_LEN bytes long, with the frame check for
+ * version. It has the fields of state that differ from base, which was sent
+ * as base_seq. If base is NULL, it's a keyframe. Returns the length of the
+ * frame without its frame check, or 0 if seq or base_seq are out of range.
+ * Does not null terminate str
+ */
+uint8_t create_state_delta(const system_state *state, uint8_t seq,
+                           const system_state *base, uint8_t base_seq,
+                           char *str, enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Returns the length of the delta state frame in str, without its frame
+ * check, given only its first STATE_DELTA_PREFIX_LEN characters. Returns 0
+ * if those don't make sense
+ */
+uint8_t state_delta_body_len(const char *str);
+
+/*
+ * Applies the delta state frame in str, received in version, to state. On
+ * the way in, *seq is the sequence number of the frame that state came from
+ * (STATE_DELTA_NO_SNAPSHOT if none), and on the way out, the one it's come
+ * from now. Returns false, and leaves both alone, if the frame is bad, or if
+ * it's relative to a frame other than *seq
+ */
+bool expand_state_delta(system_state *state, uint8_t *seq, const char *str,
+                        enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * What's in a bundle besides the state, see BUNDLE_HEADER
+ */
+typedef struct {
+    bool has_gps;
+    gps_position_t gps;
+    uint8_t num_errors;
+    error_report_t errors[BUNDLE_MAX_RECORDS];
+} bundle_records_t;
+
+/*
+ * Writes a bundle into str, which must be at least BUNDLE_MAX_LEN bytes
+ * long, with the frame check for version. The state part is as
+ * create_state_delta, and records is everything else that goes in it.
+ * Returns the length of the frame without its frame check, or 0 if there
+ * are too many records, or anything's out of range. Does not null terminate
+ * str
  */
-bool create_state_command(char *cmd, const system_state *state);
+uint8_t create_bundle(const system_state *state, uint8_t seq,
+                      const system_state *base, uint8_t base_seq,
+                      const bundle_records_t *records, char *str,
+                      enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Returns the length of the bundle in str, without its frame check, given
+ * only its first BUNDLE_PREFIX_LEN characters. Returns 0 if those don't make
+ * sense
+ */
+uint8_t bundle_body_len(const char *str);
+
+/*
+ * Unpacks the bundle in str, received in version. The records always come
+ * out, but the state is applied to state and *seq as expand_state_delta
+ * would, and only if it can be. *state_applied says whether it was. Returns
+ * false, and leaves everything alone, if the frame is bad
+ */
+bool expand_bundle(system_state *state, uint8_t *seq, bool *state_applied,
+                   bundle_records_t *records, const char *str,
+                   enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Writes a version select asking for version into str, which must be at
+ * least VERSION_SELECT_LEN bytes long. The frame check is always
+ * RADIO_PROTOCOL_V1's, so VERSION_SELECT_BODY_LEN + 1 characters get used.
+ * Does not null terminate str
+ */
+bool create_version_select(uint8_t version, char *str);
+
+/*
+ * The version whose frame check is on the radio board's answer to a version
+ * select, when it announces version. That's version itself, except for
+ * RADIO_PROTOCOL_V3, which has no ASCII frame check, so RADIO_PROTOCOL_V1's
+ * is used instead
+ */
+enum RADIO_PROTOCOL_VERSION version_reply_frame_check(enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Writes the radio board's answer to a version select into str, which must
+ * be at least VERSION_REPLY_MAX_LEN bytes long, and returns how many bytes
+ * to send. An answer announcing RADIO_PROTOCOL_V3 has a 0x00 in front of it,
+ * since the other end might already be listening for binary frames
+ */
+uint8_t create_version_reply(enum RADIO_PROTOCOL_VERSION version, char *str);
 
 /*
  * This function computes the checksum of a NULL-terminated message using a
  * modified version of the Luhn algorithm. The checksum is equal to the sum of
  * the odd-placed digits plus three times the sum of the even-placed digits,
- * modulo 64. The function returns the Base-64 encoding of the checksum.
+ * modulo 64. The function returns the Base-64 encoding of the checksum. This
+ * is the RADIO_PROTOCOL_V1 frame check.
  */
 char checksum(char *cmd);
 
+/*
+ * Folds one more byte into a CRC-12 (the RADIO_PROTOCOL_V2 frame check).
+ * Start with FRAME_CHECK_INIT. Only the bottom 12 bits are used
+ */
+uint16_t crc12_update(uint16_t crc, uint8_t byte);
+
+/*
+ * Returns true if version is one that we know how to speak
+ */
+bool radio_protocol_supported(uint8_t version);
+
+/*
+ * The number of characters the frame check takes up in version
+ */
+uint8_t frame_check_len(enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Incremental frame check, so that a receiver can fold in bytes as they
+ * arrive rather than buffering a whole frame first. Start from
+ * FRAME_CHECK_INIT, call frame_check_update with each byte that the frame
+ * check covers, and then encode_frame_check writes the frame check
+ * characters to str and returns how many it wrote (frame_check_len(version)).
+ * The exception is RADIO_PROTOCOL_V4, where this only does the CRC-12, since
+ * the parity characters after it depend on the whole frame.
+ */
+#define FRAME_CHECK_INIT 0
+uint16_t frame_check_update(uint16_t check, uint8_t byte,
+                            enum RADIO_PROTOCOL_VERSION version);
+uint8_t encode_frame_check(uint16_t check, char *str,
+                           enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Computes the frame check of the first len bytes of frame and writes it
+ * right after them, at frame + len. Returns the number of characters written
+ * (0 for RADIO_PROTOCOL_V3, which always passes frame_check_ok, since the
+ * check happens in binary_to_frame instead)
+ */
+uint8_t append_frame_check(char *frame, uint8_t len,
+                           enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Returns true if the frame check right after the first len bytes of frame
+ * matches them
+ */
+bool frame_check_ok(const char *frame, uint8_t len,
+                    enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * Forward error correction. In RADIO_PROTOCOL_V4, the base64 characters that
+ * the frame check covers and the frame check itself are a Reed-Solomon code
+ * word over GF(64) (x^6 + x + 1, generator roots 1 and alpha), one symbol per
+ * character. Anything that isn't base64 counts as 0, so headers are covered
+ * without being base64, and a character that got turned into something that
+ * isn't base64 can be fixed. Two parity symbols can fix any one wrong
+ * symbol. The CRC-12 is checked afterwards, to catch the frames that had
+ * more wrong with them than that and got "fixed" into something else.
+ */
+enum FEC_RESULT {
+    FEC_CLEAN,          // nothing needed fixing (or this version has no FEC)
+    FEC_CORRECTED,      // one character was fixed, and the frame check passes
+    FEC_UNCORRECTABLE,  // too much wrong to fix, the frame's left alone
+};
+
+/*
+ * Fixes what it can of the frame in frame, which is body_len characters
+ * long plus its frame check in version. Knows which characters the frame
+ * check of each kind of frame covers. In versions without FEC this does
+ * nothing, and returns FEC_CLEAN, so frame_check_ok still has the final say
+ */
+enum FEC_RESULT fec_correct_frame(char *frame, uint8_t body_len,
+                                  enum RADIO_PROTOCOL_VERSION version);
+
+/*
+ * The longest frame body (everything but the frame check) of any frame, and
+ * how long it can get in binary. A binary frame is the header character as a
+ * type byte, then the base64 characters of the body packed 8 bits to a byte
+ * (the last byte padded with zeroes), then the CRC-12 of all of that in two
+ * bytes, most significant first. That gets COBS encoded, and followed by a
+ * 0x00 to mark the end of the frame.
+ */
+#define RADIO_FRAME_MAX_BODY_LEN BUNDLE_MAX_BODY_LEN
+#define BINARY_FRAME_RAW_LEN(body_len) (1 + (((body_len) - 1) * 6 + 7) / 8 + 2)
+#define BINARY_FRAME_MAX_LEN (COBS_MAX_ENCODED_LEN(BINARY_FRAME_RAW_LEN(RADIO_FRAME_MAX_BODY_LEN)) + 1)
+
+/*
+ * Converts the first body_len characters of frame (a frame built for
+ * RADIO_PROTOCOL_V3, so there's no frame check on it) into a binary frame in
+ * out, which must be at least BINARY_FRAME_MAX_LEN bytes long. Returns the
+ * number of bytes to send, including the 0x00 on the end, or 0 if body_len
+ * is too long or the body isn't all base64.
+ */
+uint8_t frame_to_binary(const char *frame, uint8_t body_len, uint8_t *out);
+
+/*
+ * The other direction. in is len bytes of binary frame, without the 0x00 on
+ * the end. If the COBS encoding and CRC are good, this writes the frame body
+ * back out as characters to frame, which must be at least
+ * RADIO_FRAME_MAX_BODY_LEN + 1 bytes long, and returns how many. Returns 0 if
+ * the frame is bad. The body might have one more base64 character than
+ * the frame had, which is just padding and is always 'A'
+ */
+uint8_t binary_to_frame(const uint8_t *in, uint8_t len, char *frame);
+
 #endif
@@ -0,0 +1,8 @@
+#ifndef SIM_PIC18F26K83_H_
+#define SIM_PIC18F26K83_H_
+
+// everything the firmware needs from the device header lives in the virtual
+// register file
+#include "xc.h"
+
+#endif
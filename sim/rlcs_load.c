@@ -0,0 +1,675 @@
+/*
+ * rlcs_load: a stand-in for RLCS (or the tower box) that runs on the host
+ * and talks to the firmware over a real byte stream, using the same
+ * serialize.c codecs the firmware does, so that what goes over the link is
+ * exactly what the radio would carry. It puts the link under a configurable
+ * load of polls and valve commands, optionally corrupting and dropping bytes
+ * each way, and reports round trip latency, frame loss and throughput.
+ *
+ * By default it starts ./radio_sim's bridge scenario itself and talks to it
+ * over a socketpair. With -D it opens a device instead, a pty that radio_sim
+ * -u is on, or a serial port with a real board on the other end of it.
+ * Either way it runs in real time, so a run takes as long as -t says.
+ *
+ * This is a load generator rather than a test, so nothing here passes or
+ * fails. sim_ground.c is the model the scenarios check against.
+ */
+
+#include "serialize.h"
+#include "radio_parser.h"
+#include "perf_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// serialize.c only needs this for perf stats messages, which we never build
+uint16_t perf_stats_mean_us(const perf_stat_t *stat) { return 0; }
+
+// acknowledged commands are sent again if the ack hasn't come after this
+// long, and every so often anyway, as sim_ground does
+#define ACK_TIMEOUT_MS 200
+#define COMMAND_REFRESH_MS 5000
+
+/* Options */
+
+static uint32_t duration_s = 60;
+static uint16_t poll_period_ms = 500;
+static enum { POLL_STATE, POLL_DELTA, POLL_BUNDLE } poll_kind = POLL_BUNDLE;
+static uint32_t toggle_period_ms = 10000;
+static uint32_t repeat_period_ms = 1000;
+static bool acked_commands = false;
+static enum RADIO_PROTOCOL_VERSION wanted_version = RADIO_PROTOCOL_V3;
+static uint32_t flip_one_in = 0;
+static uint32_t drop_one_in = 0;
+static const char *device = NULL;
+static const char *sim_path = "./radio_sim";
+
+/* Results */
+
+typedef struct {
+    uint32_t *samples_us;
+    uint32_t count;
+    uint32_t size;
+} latencies_t;
+
+static struct {
+    uint32_t bytes_up, bytes_down;
+    uint32_t frames_up, frames_down;
+    uint32_t bad_frames;
+    uint32_t bits_flipped, bytes_dropped;
+
+    uint32_t polls_sent, polls_answered, polls_lost;
+    latencies_t poll_rtt;
+
+    uint32_t commands_sent, command_resends;
+    uint32_t commands_acked, commands_rejected;
+    latencies_t command_ack;
+    uint32_t toggles, toggles_confirmed;
+    latencies_t command_confirm;
+
+    uint32_t version_selects, version_replies;
+    uint32_t errors_received, gps_received;
+} results;
+
+static void latency_add(latencies_t *l, uint64_t us)
+{
+    if (l->count == l->size) {
+        l->size = l->size ? 2 * l->size : 256;
+        l->samples_us = realloc(l->samples_us, l->size * sizeof(*l->samples_us));
+        if (!l->samples_us) {
+            perror("rlcs_load");
+            exit(1);
+        }
+    }
+    l->samples_us[l->count++] = us;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void latency_print(const char *name, latencies_t *l)
+{
+    if (l->count == 0) {
+        printf("%-28s none\n", name);
+        return;
+    }
+    qsort(l->samples_us, l->count, sizeof(*l->samples_us), &compare_u32);
+    uint64_t sum = 0;
+    uint32_t i;
+    for (i = 0; i < l->count; ++i) {
+        sum += l->samples_us[i];
+    }
+    printf("%-28s %u: min %.1f mean %.1f p50 %.1f p99 %.1f max %.1f ms\n", name,
+           l->count, l->samples_us[0] / 1000.0, sum / l->count / 1000.0,
+           l->samples_us[l->count / 2] / 1000.0, l->samples_us[l->count * 99 / 100] / 1000.0,
+           l->samples_us[l->count - 1] / 1000.0);
+}
+
+/* The link */
+
+static int link_fd = -1;
+static pid_t sim_pid = 0;
+static struct timespec start;
+
+static uint64_t now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) (now.tv_sec - start.tv_sec) * 1000000 +
+           (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+static uint32_t now_ms(void)
+{
+    return now_us() / 1000;
+}
+
+static bool open_device(const char *path)
+{
+    link_fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (link_fd < 0) {
+        fprintf(stderr, "rlcs_load: can't open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct termios tio;
+    if (tcgetattr(link_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetspeed(&tio, B9600);
+        tcsetattr(link_fd, TCSANOW, &tio);
+    }
+    return true;
+}
+
+// runs the bridge scenario with the other end of a socketpair as its link
+static bool start_sim(void)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        perror("rlcs_load: socketpair");
+        return false;
+    }
+    sim_pid = fork();
+    if (sim_pid < 0) {
+        perror("rlcs_load: fork");
+        return false;
+    }
+    if (sim_pid == 0) {
+        char seconds[16];
+        // a little longer than us, so that it's still there when we finish
+        snprintf(seconds, sizeof(seconds), "%u", duration_s + 5);
+        close(fds[0]);
+        if (dup2(fds[1], 3) < 0) {
+            perror("rlcs_load: dup2");
+            _exit(1);
+        }
+        if (fds[1] != 3) {
+            close(fds[1]);
+        }
+        execl(sim_path, sim_path, "-u", "fd:3", "-t", seconds, "bridge", (char *) NULL);
+        fprintf(stderr, "rlcs_load: can't run %s: %s\n", sim_path, strerror(errno));
+        _exit(1);
+    }
+    close(fds[1]);
+    link_fd = fds[0];
+    fcntl(link_fd, F_SETFL, fcntl(link_fd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+// radio noise, the same each way. The generator is a fixed xorshift so that
+// runs are repeatable
+static uint32_t noise_state = 2463534242u;
+
+static uint32_t noise_random(void)
+{
+    noise_state ^= noise_state << 13;
+    noise_state ^= noise_state >> 17;
+    noise_state ^= noise_state << 5;
+    return noise_state;
+}
+
+// returns false if the byte should be dropped, having maybe flipped a bit
+static bool add_noise(uint8_t *byte)
+{
+    if (drop_one_in && noise_random() % drop_one_in == 0) {
+        results.bytes_dropped++;
+        return false;
+    }
+    if (flip_one_in && noise_random() % flip_one_in == 0) {
+        *byte ^= 1 << (noise_random() % 8);
+        results.bits_flipped++;
+    }
+    return true;
+}
+
+static void send_bytes(const char *bytes, size_t len)
+{
+    uint8_t out[BINARY_FRAME_MAX_LEN + FRAME_CHECK_MAX_LEN + 2];
+    size_t n = 0;
+    while (len--) {
+        uint8_t byte = (uint8_t) *bytes++;
+        if (add_noise(&byte) && n < sizeof(out)) {
+            out[n++] = byte;
+        }
+    }
+    results.bytes_up += n;
+
+    size_t done = 0;
+    while (done < n) {
+        ssize_t w = write(link_fd, out + done, n - done);
+        if (w > 0) {
+            done += w;
+        } else if (w < 0 && (errno == EAGAIN || errno == EINTR)) {
+            struct pollfd p = { link_fd, POLLOUT, 0 };
+            poll(&p, 1, 10);
+        } else {
+            fprintf(stderr, "rlcs_load: link closed\n");
+            exit(1);
+        }
+    }
+}
+
+/* The protocol, as RLCS speaks it. See sim_ground.c, which this follows */
+
+static enum RADIO_PROTOCOL_VERSION tx_version = RADIO_PROTOCOL_DEFAULT;
+static enum RADIO_PROTOCOL_VERSION rx_version = RADIO_PROTOCOL_DEFAULT;
+
+static bool poll_outstanding = false;
+static uint64_t poll_sent_us = 0;
+static system_state delta_state;
+static uint8_t delta_seq = STATE_DELTA_NO_SNAPSHOT;
+
+static system_state command;
+static uint8_t command_seq = 0;
+static bool command_acked = false;
+static uint64_t command_first_sent_us = 0;
+static uint32_t next_command_ms = 0;
+static bool awaiting_confirmation = false;
+static uint64_t toggled_us = 0;
+
+static radio_parser_t parser;
+static char binary_body[RADIO_FRAME_MAX_BODY_LEN + 1];
+static uint8_t binary_frame[BINARY_FRAME_MAX_LEN];
+static uint8_t binary_frame_len = 0;
+
+static void send_frame(const char *frame, uint8_t len)
+{
+    if (tx_version == RADIO_PROTOCOL_V3) {
+        uint8_t binary[BINARY_FRAME_MAX_LEN];
+        len = frame_to_binary(frame, len, binary);
+        send_bytes((const char *) binary, len);
+    } else {
+        send_bytes(frame, len);
+    }
+    results.frames_up++;
+}
+
+static void send_version_select(void)
+{
+    // the 0x00 ends any binary frame the board thinks it's in the middle of
+    char select[VERSION_SELECT_LEN + 1] = {0};
+    create_version_select(wanted_version, select + 1);
+    send_bytes(select, 1 + VERSION_SELECT_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V1));
+    results.frames_up++;
+    results.version_selects++;
+    tx_version = wanted_version;
+}
+
+static void send_poll(void)
+{
+    if (poll_outstanding) {
+        results.polls_lost++;
+        // the board might have been reset, or gone back to the default
+        // version after not hearing from us. Start again from scratch
+        delta_seq = STATE_DELTA_NO_SNAPSHOT;
+        if (wanted_version != RADIO_PROTOCOL_DEFAULT) {
+            rx_version = RADIO_PROTOCOL_DEFAULT;
+            send_version_select();
+        }
+    }
+    if (poll_kind == POLL_STATE) {
+        char poll = STATE_REQUEST_HEADER;
+        send_bytes(&poll, 1);
+    } else {
+        char poll[2] = { poll_kind == POLL_BUNDLE ? BUNDLE_REQUEST_HEADER :
+                                                    STATE_DELTA_REQUEST_HEADER,
+                         binary_to_base64(delta_seq) };
+        send_bytes(poll, sizeof(poll));
+    }
+    results.frames_up++;
+    results.polls_sent++;
+    poll_outstanding = true;
+    poll_sent_us = now_us();
+}
+
+static void send_command(void)
+{
+    if (acked_commands) {
+        char cmd[SEQ_COMMAND_LEN];
+        create_seq_command(cmd, command_seq, &command, tx_version);
+        send_frame(cmd, SEQ_COMMAND_BODY_LEN + frame_check_len(tx_version));
+    } else {
+        char cmd[STATE_COMMAND_LEN];
+        create_state_command(cmd, &command, tx_version);
+        send_frame(cmd, STATE_COMMAND_BODY_LEN + frame_check_len(tx_version));
+    }
+    results.commands_sent++;
+}
+
+static void toggle_injector(void)
+{
+    command.injector_valve_state = command.injector_valve_state == VALVE_OPEN ?
+                                   VALVE_CLOSED : VALVE_OPEN;
+    results.toggles++;
+    awaiting_confirmation = true;
+    toggled_us = now_us();
+    if (acked_commands) {
+        command_seq = (command_seq + 1) % COMMAND_SEQ_NONE;
+        command_acked = false;
+        command_first_sent_us = toggled_us;
+    }
+    send_command();
+}
+
+static void command_ack_received(const command_ack_t *ack)
+{
+    if (ack->seq != command_seq || command_acked) {
+        return;
+    }
+    if (ack->accepted) {
+        command_acked = true;
+        results.commands_acked++;
+        latency_add(&results.command_ack, now_us() - command_first_sent_us);
+        next_command_ms = now_ms() + COMMAND_REFRESH_MS;
+        return;
+    }
+    results.commands_rejected++;
+    if (ack->last_seq != COMMAND_SEQ_NONE) {
+        command_seq = (ack->last_seq + 1) % COMMAND_SEQ_NONE;
+    }
+    results.command_resends++;
+    send_command();
+    next_command_ms = now_ms() + ACK_TIMEOUT_MS;
+}
+
+static void state_received(const system_state *state)
+{
+    if (poll_outstanding) {
+        results.polls_answered++;
+        latency_add(&results.poll_rtt, now_us() - poll_sent_us);
+        poll_outstanding = false;
+    }
+    if (awaiting_confirmation &&
+        state->injector_valve_state == command.injector_valve_state) {
+        awaiting_confirmation = false;
+        results.toggles_confirmed++;
+        latency_add(&results.command_confirm, now_us() - toggled_us);
+    }
+}
+
+static void handle_frame(char *frame, uint8_t len)
+{
+    results.frames_down++;
+    switch (frame[0]) {
+        case STATE_COMMAND_HEADER: {
+            system_state state;
+            if (!expand_state_command(&state, frame, rx_version)) {
+                break;
+            }
+            state_received(&state);
+            return;
+        }
+        case STATE_DELTA_HEADER:
+            if (!expand_state_delta(&delta_state, &delta_seq, frame, rx_version)) {
+                break;
+            }
+            state_received(&delta_state);
+            return;
+        case BUNDLE_HEADER: {
+            bundle_records_t records;
+            bool state_applied;
+            if (!expand_bundle(&delta_state, &delta_seq, &state_applied, &records,
+                               frame, rx_version)) {
+                break;
+            }
+            if (state_applied) {
+                state_received(&delta_state);
+            }
+            results.gps_received += records.has_gps;
+            results.errors_received += records.num_errors;
+            return;
+        }
+        case ERROR_COMMAND_HEADER: {
+            error_t err;
+            if (!frame_check_ok(frame, ERROR_MSG_BODY_LEN, rx_version) ||
+                !deserialize_error(&err, frame + 1)) {
+                break;
+            }
+            results.errors_received++;
+            return;
+        }
+        case ERROR_REPORT_HEADER: {
+            error_report_t report;
+            if (!expand_error_report(&report, frame, rx_version)) {
+                break;
+            }
+            results.errors_received++;
+            return;
+        }
+        case COMMAND_ACK_HEADER: {
+            command_ack_t ack;
+            if (!expand_command_ack(&ack, frame, rx_version)) {
+                break;
+            }
+            command_ack_received(&ack);
+            return;
+        }
+        case GPS_MSG_HEADER:
+            results.gps_received++;
+            return;
+        case VERSION_SELECT_HEADER: {
+            uint8_t announced = base64_to_binary(frame[1]);
+            if (!radio_protocol_supported(announced) ||
+                !frame_check_ok(frame, VERSION_SELECT_BODY_LEN,
+                                version_reply_frame_check(announced))) {
+                break;
+            }
+            tx_version = announced;
+            rx_version = announced;
+            results.version_replies++;
+            return;
+        }
+        default:
+            return;
+    }
+    results.bad_frames++;
+}
+
+// a version reply's frame check depends on the version it announces
+static uint8_t version_reply_len(const char *prefix)
+{
+    uint8_t announced = base64_to_binary(prefix[1]);
+    return VERSION_SELECT_BODY_LEN +
+        frame_check_len(radio_protocol_supported(announced) ?
+                        version_reply_frame_check(announced) :
+                        RADIO_PROTOCOL_DEFAULT);
+}
+
+static const radio_frame_type_t frame_types[] = {
+    { STATE_COMMAND_HEADER, STATE_COMMAND_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION_AFTER_HEADER },
+    { STATE_DELTA_HEADER, 0, STATE_DELTA_PREFIX_LEN, &state_delta_body_len, PARSER_CHECK_VERSION },
+    { BUNDLE_HEADER, 0, BUNDLE_PREFIX_LEN, &bundle_body_len, PARSER_CHECK_VERSION },
+    { ERROR_COMMAND_HEADER, ERROR_MSG_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { ERROR_REPORT_HEADER, ERROR_REPORT_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { GPS_MSG_HEADER, GPS_MSG_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { COMMAND_ACK_HEADER, COMMAND_ACK_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { TELEMETRY_REQUEST_HEADER, TELEMETRY_SUMMARY_MSG_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { PERF_STATS_REQUEST_HEADER, PERF_STATS_MSG_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { VERSION_SELECT_HEADER, 0, 2, &version_reply_len, PARSER_CHECK_NONE },
+};
+
+static void receive_binary(uint8_t byte)
+{
+    if (byte != 0) {
+        if (binary_frame_len == sizeof(binary_frame)) {
+            results.bad_frames++;
+            binary_frame_len = 0;
+        }
+        binary_frame[binary_frame_len++] = byte;
+        return;
+    }
+    if (binary_frame_len == 0) {
+        return;
+    }
+    uint8_t len = binary_to_frame(binary_frame, binary_frame_len, binary_body);
+    binary_frame_len = 0;
+    if (len == 0) {
+        results.bad_frames++;
+        return;
+    }
+    handle_frame(binary_body, len);
+}
+
+static void receive(uint8_t byte)
+{
+    if (!add_noise(&byte)) {
+        return;
+    }
+    // in binary, the only ASCII is a version select at the start of a frame
+    if (rx_version == RADIO_PROTOCOL_V3 && !radio_parser_in_frame(&parser) &&
+        !(byte == VERSION_SELECT_HEADER && binary_frame_len == 0)) {
+        receive_binary(byte);
+        return;
+    }
+    radio_parser_feed(&parser, byte, rx_version);
+}
+
+/* Running it */
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n\n"
+            "  -t seconds  how long to run (%u)\n"
+            "  -p ms       poll period, 0 for none (%u)\n"
+            "  -k kind     poll with state, delta or bundle requests (bundle)\n"
+            "  -c ms       toggle the injector valve this often, 0 for never (%u)\n"
+            "  -r ms       repeat plain commands this often (%u)\n"
+            "  -a          send acknowledged commands instead of repeating them\n"
+            "  -v version  protocol version to select, 1 to %u (%u)\n"
+            "  -n N        flip a bit in one byte in N, each way\n"
+            "  -d N        drop one byte in N, each way\n"
+            "  -D device   talk to a pty or serial port instead of starting the sim\n"
+            "  -S path     the sim to start (%s)\n",
+            argv0, duration_s, poll_period_ms, toggle_period_ms, repeat_period_ms,
+            RADIO_PROTOCOL_LATEST, wanted_version, sim_path);
+    exit(2);
+}
+
+static void parse_options(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "t:p:k:c:r:av:n:d:D:S:")) != -1) {
+        switch (opt) {
+            case 't': duration_s = strtoul(optarg, NULL, 10); break;
+            case 'p': poll_period_ms = strtoul(optarg, NULL, 10); break;
+            case 'c': toggle_period_ms = strtoul(optarg, NULL, 10); break;
+            case 'r': repeat_period_ms = strtoul(optarg, NULL, 10); break;
+            case 'a': acked_commands = true; break;
+            case 'n': flip_one_in = strtoul(optarg, NULL, 10); break;
+            case 'd': drop_one_in = strtoul(optarg, NULL, 10); break;
+            case 'D': device = optarg; break;
+            case 'S': sim_path = optarg; break;
+            case 'k':
+                if (strcmp(optarg, "state") == 0) {
+                    poll_kind = POLL_STATE;
+                } else if (strcmp(optarg, "delta") == 0) {
+                    poll_kind = POLL_DELTA;
+                } else if (strcmp(optarg, "bundle") == 0) {
+                    poll_kind = POLL_BUNDLE;
+                } else {
+                    usage(argv[0]);
+                }
+                break;
+            case 'v':
+                wanted_version = strtoul(optarg, NULL, 10);
+                if (!radio_protocol_supported(wanted_version)) {
+                    usage(argv[0]);
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc || duration_s == 0 || repeat_period_ms == 0) {
+        usage(argv[0]);
+    }
+}
+
+static void print_report(uint32_t elapsed_ms)
+{
+    double seconds = elapsed_ms / 1000.0;
+    printf("\n--- rlcs_load: %.1f s in RADIO_PROTOCOL_V%u, %s commands ---\n",
+           seconds, rx_version, acked_commands ? "acknowledged" : "repeated");
+    printf("link: %u bytes up (%.1f B/s), %u bytes down (%.1f B/s)\n",
+           results.bytes_up, results.bytes_up / seconds,
+           results.bytes_down, results.bytes_down / seconds);
+    printf("frames: %u up, %u down, %u down bad\n",
+           results.frames_up, results.frames_down, results.bad_frames);
+    printf("noise: %u bits flipped, %u bytes dropped\n",
+           results.bits_flipped, results.bytes_dropped);
+    printf("parser: %u frames ok, %u bad checks, %u truncated, %u resyncs, "
+           "%u FEC corrected, %u uncorrectable\n",
+           parser.stats.frames_ok, parser.stats.bad_checks, parser.stats.truncated,
+           parser.stats.resyncs, parser.stats.fec_corrected, parser.stats.fec_uncorrectable);
+    printf("version selects: %u sent, %u answered\n",
+           results.version_selects, results.version_replies);
+    printf("polls: %u sent, %u answered, %u lost (%.2f%%)\n",
+           results.polls_sent, results.polls_answered, results.polls_lost,
+           results.polls_sent ? 100.0 * results.polls_lost / results.polls_sent : 0);
+    printf("commands: %u sent, %u resent, %u acknowledged, %u rejected\n",
+           results.commands_sent, results.command_resends,
+           results.commands_acked, results.commands_rejected);
+    printf("injector toggles: %u, %u confirmed by a state\n",
+           results.toggles, results.toggles_confirmed);
+    printf("errors received: %u, gps: %u\n", results.errors_received, results.gps_received);
+    latency_print("poll to state", &results.poll_rtt);
+    latency_print("command to ack", &results.command_ack);
+    latency_print("toggle to confirmation", &results.command_confirm);
+}
+
+int main(int argc, char **argv)
+{
+    parse_options(argc, argv);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (device ? !open_device(device) : !start_sim()) {
+        return 1;
+    }
+    init_radio_parser(&parser, frame_types, sizeof(frame_types) / sizeof(frame_types[0]),
+                      &handle_frame);
+
+    command.injector_valve_state = VALVE_CLOSED;
+    command.vent_valve_state = VALVE_CLOSED;
+    command.bus_is_powered = true;
+
+    uint32_t end_ms = duration_s * 1000;
+    uint32_t next_poll_ms = 0;
+    uint32_t next_toggle_ms = toggle_period_ms;
+    if (wanted_version != RADIO_PROTOCOL_DEFAULT) {
+        send_version_select();
+    }
+
+    uint32_t now;
+    while ((now = now_ms()) < end_ms) {
+        if (poll_period_ms && (int32_t) (now - next_poll_ms) >= 0) {
+            send_poll();
+            next_poll_ms = now + poll_period_ms;
+        }
+        if (toggle_period_ms && (int32_t) (now - next_toggle_ms) >= 0) {
+            toggle_injector();
+            next_toggle_ms = now + toggle_period_ms;
+            next_command_ms = now + (acked_commands ? ACK_TIMEOUT_MS : repeat_period_ms);
+        } else if ((int32_t) (now - next_command_ms) >= 0) {
+            if (acked_commands && !command_acked) {
+                results.command_resends++;
+            }
+            send_command();
+            next_command_ms = now + (!acked_commands ? repeat_period_ms :
+                                     command_acked ? COMMAND_REFRESH_MS : ACK_TIMEOUT_MS);
+        }
+
+        struct pollfd p = { link_fd, POLLIN, 0 };
+        if (poll(&p, 1, 1) > 0) {
+            uint8_t bytes[256];
+            ssize_t n = read(link_fd, bytes, sizeof(bytes));
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+                fprintf(stderr, "rlcs_load: link closed\n");
+                break;
+            }
+            ssize_t i;
+            for (i = 0; i < n; ++i) {
+                results.bytes_down++;
+                receive(bytes[i]);
+            }
+        }
+    }
+    uint32_t elapsed_ms = now_ms();
+
+    // hanging up ends the bridge scenario, which prints its own report first
+    close(link_fd);
+    if (sim_pid > 0) {
+        waitpid(sim_pid, NULL, 0);
+    }
+    print_report(elapsed_ms);
+    return 0;
+}
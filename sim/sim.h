@@ -0,0 +1,130 @@
+#ifndef SIM_H_
+#define SIM_H_
+
+/*
+ * Host simulator for the radio board firmware. The real firmware modules
+ * (everything except config.c and canlib's pic18f26k83_can.c) are linked
+ * against a virtual register file (xc.h in this directory) and virtual
+ * timer0, ADC, UART and CAN peripherals. Simulated time only moves forward
+ * when the firmware goes to sleep waiting for an interrupt, so hours of
+ * flight-day operation run in seconds.
+ *
+ * Around the firmware sit the models in sim_boards.c (the other boards on the
+ * CAN bus) and sim_ground.c (RLCS on the other end of the XBee link), and the
+ * scripted scenarios in sim_scenarios.c that drive them.
+ *
+ * Note that the firmware's own code runs in zero simulated time, so every
+ * latency that the simulator reports is made of peripheral and link time
+ * (UART bytes, CAN frames, timer ticks, task periods) only.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "can.h"
+
+/* Simulated time */
+
+// microseconds since the simulated board was powered on
+uint64_t sim_now_us(void);
+uint32_t sim_now_ms(void);
+
+/*
+ * Registers a function to be called once per simulated millisecond. This is
+ * how the board, ground and scenario models get to run. Returns false if
+ * there are too many hooks already.
+ */
+bool sim_add_ms_hook(void (*hook)(uint32_t now_ms));
+
+/*
+ * Stops the simulation once simulated time reaches end_ms. The report is
+ * printed and the process exits from inside the firmware's main loop.
+ */
+void sim_set_end_ms(uint32_t end_ms);
+
+/* Virtual UART, the XBee side of it */
+
+#define SIM_UART_BYTE_US 1040 // 10 bits at 9615 baud (U1BRG = 77)
+
+// queue bytes to arrive at the board's UART RX pin, back to back
+void sim_uart_ground_send(const uint8_t *bytes, size_t len);
+// called with every byte that the board finishes transmitting
+void sim_uart_set_tx_listener(void (*listener)(uint8_t byte));
+// true if there are no bytes still waiting to go up to the board
+bool sim_uart_ground_idle(void);
+// how many bytes are still waiting to go up to the board
+size_t sim_uart_ground_queued(void);
+
+/* Virtual ADC */
+
+// set what the ADC reads on an analog channel (raw 12 bit counts)
+void sim_adc_set_channel(uint8_t channel, uint16_t counts);
+
+/* Virtual CAN bus, see sim_can.c */
+
+#define SIM_CAN_BITRATE 100000
+
+// put a frame from one of the simulated boards onto the bus
+void sim_can_board_send(const can_msg_t *msg);
+// called with every frame that the radio board puts onto the bus
+void sim_can_set_listener(void (*listener)(const can_msg_t *msg));
+// true while the radio board is supplying power to the bus
+bool sim_bus_powered(void);
+
+// driven by sim_core.c, these advance the CAN bus model
+uint64_t sim_can_next_event_us(void);
+void sim_can_update(uint64_t now_us);
+bool sim_can_interrupt_pending(void);
+
+/* Statistics */
+
+typedef struct {
+    uint32_t count;
+    uint64_t sum;
+    uint32_t min;
+    uint32_t max;
+} sim_stat_t;
+
+void sim_stat_add(sim_stat_t *stat, uint32_t value);
+void sim_stat_print(const char *name, const sim_stat_t *stat, const char *unit);
+
+typedef struct {
+    uint32_t wakeups;        // times SLEEP returned
+    uint32_t isr_calls;
+    uint32_t uart_tx_bytes;
+    uint32_t uart_rx_bytes;
+    uint32_t uart_rx_overruns;
+    uint32_t can_frames_to_board;
+    uint32_t can_frames_from_board;
+    uint32_t can_frames_lost;     // hardware receive buffers full
+    uint32_t can_frames_unheard;  // radio board sent while the bus was off
+    uint64_t can_bus_busy_us;
+} sim_counters_t;
+
+extern sim_counters_t sim_counters;
+
+/* Scenario checks */
+
+// record a pass/fail check, printed in the final report
+void sim_check(bool passed, const char *description);
+
+/* Scenario plumbing, see sim_scenarios.c */
+
+typedef struct {
+    const char *name;
+    const char *description;
+    uint32_t default_duration_s;
+    void (*setup)(void);
+    void (*tick)(uint32_t now_ms);
+    void (*finish)(void);
+    // set for scenarios that only make sense with a link on -u, which
+    // `make run` leaves out
+    bool needs_link;
+} sim_scenario_t;
+
+extern const sim_scenario_t sim_scenarios[];
+extern const size_t sim_num_scenarios;
+
+void sim_init(const sim_scenario_t *scenario);
+
+#endif
@@ -0,0 +1,292 @@
+#include "sim.h"
+#include "sim_boards.h"
+#include "can_common.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_PERIODIC 6
+#define ERROR_REPEATS 3
+
+typedef struct {
+    uint16_t type;
+    uint8_t sensor_id; // only used for MSG_SENSOR_ANALOG
+    uint16_t period_ms;
+    uint32_t next_ms;
+} periodic_msg_t;
+
+typedef struct {
+    const char *name;
+    uint8_t unique_id;
+    bool alive;
+    bool powered;
+    uint32_t powered_at_ms;
+    enum BOARD_STATUS pending_error;
+    uint8_t error_repeats;
+    periodic_msg_t periodic[MAX_PERIODIC];
+} board_t;
+
+sim_boards_stats_t sim_boards_stats;
+
+static board_t boards[SIM_NUM_BOARDS] = {
+    { "injector", SIM_ID_INJECTOR, true, false, 0, E_NOMINAL, 0, {
+        { MSG_GENERAL_BOARD_STATUS, 0, 500, 0 },
+        { MSG_INJ_VALVE_STATUS, 0, 500, 0 },
+        { MSG_SENSOR_ANALOG, SENSOR_INJ_BATT, 1000, 0 },
+    } },
+    { "sensor", SIM_ID_SENSOR, true, false, 0, E_NOMINAL, 0, {
+        { MSG_GENERAL_BOARD_STATUS, 0, 500, 0 },
+        { MSG_SENSOR_ANALOG, SENSOR_PRESSURE_OX, 100, 0 },
+    } },
+    { "logger", SIM_ID_LOGGER, true, false, 0, E_NOMINAL, 0, {
+        { MSG_GENERAL_BOARD_STATUS, 0, 500, 0 },
+    } },
+    { "gps", SIM_ID_GPS, true, false, 0, E_NOMINAL, 0, {
+        { MSG_GENERAL_BOARD_STATUS, 0, 500, 0 },
+        { MSG_GPS_TIMESTAMP, 0, 1000, 0 },
+        { MSG_GPS_LATITUDE, 0, 1000, 0 },
+        { MSG_GPS_LONGITUDE, 0, 1000, 0 },
+        { MSG_GPS_ALTITUDE, 0, 1000, 0 },
+        { MSG_GPS_INFO, 0, 1000, 0 },
+    } },
+    { "imu", SIM_ID_IMU, true, false, 0, E_NOMINAL, 0, {
+        { MSG_GENERAL_BOARD_STATUS, 0, 500, 0 },
+        { MSG_SENSOR_ACC, 0, 50, 0 },
+        { MSG_SENSOR_GYRO, 0, 50, 0 },
+        { MSG_SENSOR_MAG, 0, 50, 0 },
+    } },
+};
+
+static enum VALVE_STATE inj_valve = VALVE_CLOSED;
+static enum VALVE_STATE inj_target = VALVE_CLOSED;
+static uint32_t inj_actuate_at_ms = 0;
+static uint16_t tank_pressure = 0;
+
+static board_t *find_board(uint8_t unique_id)
+{
+    uint8_t i;
+    for (i = 0; i < SIM_NUM_BOARDS; ++i) {
+        if (boards[i].unique_id == unique_id) {
+            return &boards[i];
+        }
+    }
+    return NULL;
+}
+
+static bool board_running(const board_t *b, uint32_t now_ms)
+{
+    return b->alive && b->powered && now_ms - b->powered_at_ms >= SIM_BOARD_BOOT_MS;
+}
+
+/*
+ * Fill in a message the way the real board would. Timestamps are the first
+ * bytes of every message, the layouts of the rest match what sotscon.c reads
+ */
+static void build_message(board_t *b, const periodic_msg_t *p, uint32_t now_ms,
+                          can_msg_t *msg)
+{
+    memset(msg, 0, sizeof(*msg));
+    msg->sid = p->type | b->unique_id;
+    msg->data_len = 8;
+    msg->data[0] = (now_ms >> 16) & 0xff;
+    msg->data[1] = (now_ms >> 8) & 0xff;
+    msg->data[2] = now_ms & 0xff;
+
+    switch (p->type) {
+        case MSG_GENERAL_BOARD_STATUS:
+            if (b->error_repeats > 0) {
+                b->error_repeats--;
+                msg->data[3] = b->pending_error;
+                msg->data[4] = b->unique_id;
+            } else {
+                msg->data[3] = E_NOMINAL;
+            }
+            break;
+        case MSG_INJ_VALVE_STATUS:
+            msg->data[3] = inj_valve;
+            msg->data[4] = inj_target;
+            msg->data_len = 5;
+            break;
+        case MSG_SENSOR_ANALOG: {
+            uint16_t value = p->sensor_id == SENSOR_PRESSURE_OX ? tank_pressure : 12100;
+            msg->data[2] = p->sensor_id;
+            msg->data[3] = value >> 8;
+            msg->data[4] = value & 0xff;
+            msg->data_len = 5;
+            break;
+        }
+        case MSG_GPS_LATITUDE:
+            msg->data[3] = 48;  // degrees
+            msg->data[4] = 29;  // minutes
+            msg->data[5] = 73;  // decimal minutes
+            msg->data[6] = 'N';
+            msg->data_len = 7;
+            break;
+        case MSG_GPS_LONGITUDE:
+            msg->data[3] = 81;
+            msg->data[4] = 17;
+            msg->data[5] = 52;
+            msg->data[6] = 'W';
+            msg->data_len = 7;
+            break;
+        case MSG_GPS_ALTITUDE:
+            msg->data[3] = 0x01; // 300.5 m
+            msg->data[4] = 0x2c;
+            msg->data[5] = 5;
+            msg->data[6] = 'M';
+            msg->data_len = 7;
+            break;
+        case MSG_GPS_TIMESTAMP:
+            msg->data[3] = (now_ms / 3600000) % 24;
+            msg->data[4] = (now_ms / 60000) % 60;
+            msg->data[5] = (now_ms / 1000) % 60;
+            msg->data[6] = (now_ms / 10) % 100;
+            msg->data_len = 7;
+            break;
+        case MSG_SENSOR_ACC:
+        case MSG_SENSOR_GYRO:
+        case MSG_SENSOR_MAG: {
+            // some noise around a fixed reading on each axis: positive on x,
+            // either side of zero on y, and negative on z, like gravity on
+            // an axis pointing down
+            int16_t axes[3] = {
+                0x1000 + (int16_t) (now_ms & 0x0f),
+                (int16_t) ((now_ms >> 4) & 0x0f) - 8,
+                -0x3000 - (int16_t) ((now_ms >> 8) & 0x0f),
+            };
+            uint8_t axis;
+            for (axis = 0; axis < 3; ++axis) {
+                msg->data[2 + 2 * axis] = (uint16_t) axes[axis] >> 8;
+                msg->data[3 + 2 * axis] = (uint16_t) axes[axis] & 0xff;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void send_valve_status(uint32_t now_ms)
+{
+    board_t *b = find_board(SIM_ID_INJECTOR);
+    if (board_running(b, now_ms)) {
+        can_msg_t msg;
+        build_message(b, &b->periodic[1], now_ms, &msg);
+        sim_can_board_send(&msg);
+        sim_boards_stats.frames_sent++;
+    }
+}
+
+static void boards_listener(const can_msg_t *msg)
+{
+    uint32_t now_ms = sim_now_ms();
+    uint16_t type = get_message_type(msg);
+    if (type == MSG_INJ_VALVE_CMD) {
+        sim_boards_stats.inj_valve_cmds++;
+        if (!board_running(find_board(SIM_ID_INJECTOR), now_ms)) {
+            return;
+        }
+        enum VALVE_STATE requested = msg->data[3];
+        if (requested != inj_target && (requested == VALVE_OPEN || requested == VALVE_CLOSED)) {
+            inj_target = requested;
+            inj_actuate_at_ms = now_ms + SIM_VALVE_ACTUATION_MS;
+        }
+    } else if (type == MSG_GENERAL_CMD) {
+        sim_boards_stats.bus_down_warnings++;
+    }
+}
+
+static void boards_tick(uint32_t now_ms)
+{
+    bool bus = sim_bus_powered();
+    uint8_t i, j;
+    for (i = 0; i < SIM_NUM_BOARDS; ++i) {
+        board_t *b = &boards[i];
+        if (bus && !b->powered) {
+            b->powered_at_ms = now_ms;
+            for (j = 0; j < MAX_PERIODIC; ++j) {
+                // stagger the first messages a little, boards don't all boot
+                // in the same millisecond
+                b->periodic[j].next_ms = now_ms + SIM_BOARD_BOOT_MS + i * 7 + j;
+            }
+        }
+        b->powered = bus;
+        if (!board_running(b, now_ms)) {
+            continue;
+        }
+        for (j = 0; j < MAX_PERIODIC; ++j) {
+            periodic_msg_t *p = &b->periodic[j];
+            if (p->period_ms == 0 || (int32_t) (now_ms - p->next_ms) < 0) {
+                continue;
+            }
+            can_msg_t msg;
+            build_message(b, p, now_ms, &msg);
+            sim_can_board_send(&msg);
+            sim_boards_stats.frames_sent++;
+            p->next_ms += p->period_ms;
+        }
+    }
+
+    if (inj_valve != inj_target && (int32_t) (now_ms - inj_actuate_at_ms) >= 0) {
+        inj_valve = inj_target;
+        sim_boards_stats.inj_actuations++;
+        send_valve_status(now_ms);
+    }
+}
+
+void sim_boards_init(void)
+{
+    sim_can_set_listener(&boards_listener);
+    sim_add_ms_hook(&boards_tick);
+}
+
+void sim_board_set_alive(uint8_t unique_id, bool alive)
+{
+    board_t *b = find_board(unique_id);
+    if (b) {
+        if (alive && !b->alive) {
+            // reboots as though it just got power
+            b->powered = false;
+        }
+        b->alive = alive;
+    }
+}
+
+void sim_board_report_error(uint8_t unique_id, enum BOARD_STATUS error_code)
+{
+    board_t *b = find_board(unique_id);
+    if (b) {
+        b->pending_error = error_code;
+        b->error_repeats = ERROR_REPEATS;
+    }
+}
+
+void sim_boards_set_imu_period_ms(uint16_t period_ms)
+{
+    board_t *b = find_board(SIM_ID_IMU);
+    uint8_t j;
+    for (j = 1; j < 4; ++j) {
+        b->periodic[j].period_ms = period_ms;
+        b->periodic[j].next_ms = sim_now_ms();
+    }
+}
+
+void sim_boards_set_tank_pressure(uint16_t pressure)
+{
+    tank_pressure = pressure;
+}
+
+uint8_t sim_boards_num_running(void)
+{
+    uint8_t i, count = 0;
+    for (i = 0; i < SIM_NUM_BOARDS; ++i) {
+        if (board_running(&boards[i], sim_now_ms())) {
+            count++;
+        }
+    }
+    return count;
+}
+
+enum VALVE_STATE sim_boards_inj_valve(void)
+{
+    return inj_valve;
+}
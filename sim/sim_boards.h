@@ -0,0 +1,60 @@
+#ifndef SIM_BOARDS_H_
+#define SIM_BOARDS_H_
+
+/*
+ * Models of the other boards on the CAN bus. Each board boots a little while
+ * after the radio board powers the bus, then sends its messages periodically
+ * until it's killed or the bus goes down. The injector board also listens for
+ * MSG_INJ_VALVE_CMD and moves its (virtual) valve.
+ *
+ * Unique IDs here are arbitrary. They only need to be different from each
+ * other and from the radio board, and no more than sotscon's
+ * MAX_BOARD_UNIQUE_ID.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "message_types.h"
+
+#define SIM_ID_INJECTOR 0x02
+#define SIM_ID_SENSOR   0x04
+#define SIM_ID_LOGGER   0x06
+#define SIM_ID_GPS      0x0A
+#define SIM_ID_IMU      0x0C
+
+#define SIM_NUM_BOARDS 5
+
+// how long a board takes from bus power to its first message
+#define SIM_BOARD_BOOT_MS 200
+// how long the injector valve takes to move once commanded
+#define SIM_VALVE_ACTUATION_MS 250
+
+void sim_boards_init(void);
+
+// a dead board sends nothing, even if the bus is powered
+void sim_board_set_alive(uint8_t unique_id, bool alive);
+
+// have a board report error_code in its next few status messages
+void sim_board_report_error(uint8_t unique_id, enum BOARD_STATUS error_code);
+
+// how often the IMU sends each of acc, gyro and mag, 0 to stop
+void sim_boards_set_imu_period_ms(uint16_t period_ms);
+
+// what the sensor board reads for oxidizer tank pressure
+void sim_boards_set_tank_pressure(uint16_t pressure);
+
+// number of boards that are alive and have booted
+uint8_t sim_boards_num_running(void);
+
+enum VALVE_STATE sim_boards_inj_valve(void);
+
+typedef struct {
+    uint32_t frames_sent;
+    uint32_t inj_valve_cmds;
+    uint32_t inj_actuations;
+    uint32_t bus_down_warnings;
+} sim_boards_stats_t;
+
+extern sim_boards_stats_t sim_boards_stats;
+
+#endif
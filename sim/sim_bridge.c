@@ -0,0 +1,124 @@
+#include "sim.h"
+#include "sim_bridge.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Bytes from the link are only read while fewer than this many are still
+// waiting to go up to the board. Anything sending faster than the UART can
+// take is held up in the link rather than piling up in the simulator
+#define BRIDGE_MAX_QUEUED 256
+
+static int link_fd = -1;
+static bool hung_up = false;
+
+// the real time and simulated time when the bridge started, which the two
+// are kept in step from
+static struct timespec start_wall;
+static uint32_t start_ms = 0;
+static bool started = false;
+
+static uint64_t wall_us_since_start(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) (now.tv_sec - start_wall.tv_sec) * 1000000 +
+           (now.tv_nsec - start_wall.tv_nsec) / 1000;
+}
+
+static void hang_up(void)
+{
+    if (!hung_up) {
+        hung_up = true;
+        fprintf(stderr, "sim: link closed at %u ms, stopping\n", sim_now_ms());
+        sim_set_end_ms(sim_now_ms() + 1);
+    }
+}
+
+static void bridge_tx(uint8_t byte)
+{
+    if (hung_up) {
+        return;
+    }
+    while (write(link_fd, &byte, 1) < 0) {
+        if (errno != EAGAIN && errno != EINTR) {
+            hang_up();
+            return;
+        }
+        usleep(100);
+    }
+}
+
+static void bridge_tick(uint32_t now_ms)
+{
+    if (!started) {
+        clock_gettime(CLOCK_MONOTONIC, &start_wall);
+        start_ms = now_ms;
+        started = true;
+    }
+
+    // don't get ahead of real time
+    uint64_t sim_us = (uint64_t) (now_ms - start_ms) * 1000;
+    uint64_t wall_us = wall_us_since_start();
+    if (sim_us > wall_us) {
+        usleep(sim_us - wall_us);
+    }
+
+    if (hung_up) {
+        return;
+    }
+    while (sim_uart_ground_queued() < BRIDGE_MAX_QUEUED) {
+        uint8_t bytes[64];
+        size_t room = BRIDGE_MAX_QUEUED - sim_uart_ground_queued();
+        ssize_t n = read(link_fd, bytes, room < sizeof(bytes) ? room : sizeof(bytes));
+        if (n > 0) {
+            sim_uart_ground_send(bytes, n);
+        } else {
+            if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                hang_up();
+            }
+            break;
+        }
+    }
+}
+
+bool sim_bridge_open(const char *where)
+{
+    if (strncmp(where, "fd:", 3) == 0) {
+        link_fd = atoi(where + 3);
+    } else {
+        link_fd = open(where, O_RDWR | O_NOCTTY);
+        if (link_fd < 0) {
+            fprintf(stderr, "sim: can't open %s: %s\n", where, strerror(errno));
+            return false;
+        }
+    }
+    // a pty or serial port has to pass bytes through untouched
+    struct termios tio;
+    if (tcgetattr(link_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(link_fd, TCSANOW, &tio);
+    }
+    int flags = fcntl(link_fd, F_GETFL);
+    if (flags < 0 || fcntl(link_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        fprintf(stderr, "sim: can't use %s: %s\n", where, strerror(errno));
+        link_fd = -1;
+        return false;
+    }
+
+    // this replaces sim_ground's listener, and the ground model is left with
+    // nothing to do since no scenario has told it to poll or command
+    sim_uart_set_tx_listener(&bridge_tx);
+    sim_add_ms_hook(&bridge_tick);
+    return true;
+}
+
+bool sim_bridge_active(void)
+{
+    return link_fd >= 0;
+}
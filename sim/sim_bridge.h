@@ -0,0 +1,28 @@
+#ifndef SIM_BRIDGE_H_
+#define SIM_BRIDGE_H_
+
+/*
+ * Connects the board's end of the XBee link to something outside the
+ * simulator, like rlcs_load or a real ground station on a pty, instead of
+ * the RLCS model in sim_ground.c. Everything the board transmits is written
+ * to the link as it finishes going out, and everything read from the link
+ * is queued to arrive at the board's UART. While the bridge is open,
+ * simulated time is held back to real time, so that whatever's on the other
+ * end sees the board answer as quickly as the real one would. The
+ * simulation ends when the other end hangs up.
+ */
+
+#include <stdbool.h>
+
+/*
+ * Opens the link. where is either the path of a device to open (a pty, say)
+ * or "fd:N" for a file descriptor that's already open, like one end of a
+ * socketpair that rlcs_load passed down. Call before the scenario's setup.
+ * Returns false, having said why on stderr, if it can't be opened
+ */
+bool sim_bridge_open(const char *where);
+
+// true once sim_bridge_open has succeeded
+bool sim_bridge_active(void);
+
+#endif
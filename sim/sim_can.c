@@ -0,0 +1,160 @@
+/*
+ * Virtual CAN bus, and a stand-in for canlib's pic18f26k83_can.c driver.
+ *
+ * Every frame, whether it comes from the radio board or one of the simulated
+ * boards, waits its turn for the one shared bus and occupies it for a frame
+ * time at SIM_CAN_BITRATE. Frames from the simulated boards are then dropped
+ * into a two deep receive buffer (like the ECAN module's RXB0 and RXB1) and
+ * the firmware gets an interrupt. If both hardware buffers are full when a
+ * frame finishes, it's lost, just like on the real board.
+ */
+#include "sim.h"
+#include "xc.h"
+#include "pic18f26k83_can.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BUS_QUEUE_LEN 256
+#define HW_RX_BUFFERS 2
+
+typedef struct {
+    can_msg_t msg;
+    bool from_radio_board;
+} bus_frame_t;
+
+static bus_frame_t bus_queue[BUS_QUEUE_LEN];
+static size_t bus_head = 0, bus_count = 0;
+static bool bus_busy = false;
+static uint64_t bus_done_us = 0;
+static bool radio_board_frame_queued = false;
+
+static can_msg_t hw_rx[HW_RX_BUFFERS];
+static uint8_t hw_rx_count = 0;
+
+static void (*receive_callback)(const can_msg_t *msg) = NULL;
+static void (*listener)(const can_msg_t *msg) = NULL;
+
+/*
+ * Frame time for a standard frame: 47 bits of overhead plus the data, plus
+ * about 20% for bit stuffing
+ */
+static uint32_t frame_time_us(const can_msg_t *msg)
+{
+    uint32_t bits = (47 + 8 * (uint32_t) msg->data_len) * 6 / 5;
+    return bits * 1000000 / SIM_CAN_BITRATE;
+}
+
+static void bus_enqueue(const can_msg_t *msg, bool from_radio_board)
+{
+    if (bus_count == BUS_QUEUE_LEN) {
+        fprintf(stderr, "sim: CAN bus queue overflowed\n");
+        return;
+    }
+    bus_frame_t *f = &bus_queue[(bus_head + bus_count) % BUS_QUEUE_LEN];
+    f->msg = *msg;
+    f->from_radio_board = from_radio_board;
+    bus_count++;
+}
+
+bool sim_bus_powered(void)
+{
+    // 12V enable, see power_bus() in bus_power.c
+    return LATA2;
+}
+
+void sim_can_board_send(const can_msg_t *msg)
+{
+    bus_enqueue(msg, false);
+}
+
+void sim_can_set_listener(void (*l)(const can_msg_t *msg))
+{
+    listener = l;
+}
+
+uint64_t sim_can_next_event_us(void)
+{
+    if (bus_busy) {
+        return bus_done_us;
+    }
+    // a frame is waiting and the bus is free, it can start right now
+    return bus_count ? 0 : UINT64_MAX;
+}
+
+void sim_can_update(uint64_t now_us)
+{
+    while (true) {
+        if (bus_busy) {
+            if (now_us < bus_done_us) {
+                return;
+            }
+            bus_frame_t *f = &bus_queue[bus_head];
+            bus_head = (bus_head + 1) % BUS_QUEUE_LEN;
+            bus_count--;
+            bus_busy = false;
+
+            if (f->from_radio_board) {
+                radio_board_frame_queued = false;
+                if (!sim_bus_powered()) {
+                    // nobody to acknowledge it
+                    sim_counters.can_frames_unheard++;
+                } else {
+                    sim_counters.can_frames_from_board++;
+                    if (listener) {
+                        listener(&f->msg);
+                    }
+                }
+            } else if (receive_callback) {
+                if (hw_rx_count == HW_RX_BUFFERS) {
+                    sim_counters.can_frames_lost++;
+                } else {
+                    hw_rx[hw_rx_count++] = f->msg;
+                    sim_counters.can_frames_to_board++;
+                }
+            }
+        }
+        if (bus_count == 0) {
+            return;
+        }
+        uint32_t t = frame_time_us(&bus_queue[bus_head].msg);
+        bus_busy = true;
+        bus_done_us = now_us + t;
+        sim_counters.can_bus_busy_us += t;
+    }
+}
+
+bool sim_can_interrupt_pending(void)
+{
+    PIR5 = hw_rx_count ? 1 : 0;
+    return PIR5 != 0;
+}
+
+/* The driver interface that the firmware links against */
+
+void can_init(const can_timing_t *timing, void (*callback)(const can_msg_t *message))
+{
+    (void) timing;
+    receive_callback = callback;
+}
+
+void can_send(const can_msg_t *message)
+{
+    radio_board_frame_queued = true;
+    bus_enqueue(message, true);
+}
+
+bool can_send_rdy(void)
+{
+    // one transmit buffer, like the driver uses
+    return !radio_board_frame_queued;
+}
+
+void can_handle_interrupt(void)
+{
+    uint8_t i;
+    for (i = 0; i < hw_rx_count; ++i) {
+        receive_callback(&hw_rx[i]);
+    }
+    hw_rx_count = 0;
+    PIR5 = 0;
+}
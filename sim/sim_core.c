@@ -0,0 +1,392 @@
+#include "sim.h"
+#include "xc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * The virtual register file, see xc.h
+ */
+sim_registers_t sim_regs;
+
+sim_counters_t sim_counters;
+
+// the firmware's interrupt service routine, from interrupts.c
+void isr(void);
+
+static uint64_t now_us = 0;
+static uint64_t end_us = UINT64_MAX;
+static const sim_scenario_t *scenario = NULL;
+
+#define MAX_MS_HOOKS 8
+static void (*ms_hooks[MAX_MS_HOOKS])(uint32_t now_ms);
+static uint8_t num_ms_hooks = 0;
+static uint64_t next_ms_us = 0;
+
+static uint32_t checks_run = 0;
+static uint32_t checks_failed = 0;
+
+/* Timer0 model. Clocked from MFINTOSC (500kHz) through the prescaler */
+static uint64_t t0_last_update_us = 0;
+static uint32_t t0_residual_us = 0;
+
+static uint32_t t0_tick_us(void)
+{
+    return 2u << T0CON1bits.CKPS;
+}
+
+static void timer0_update(uint64_t t)
+{
+    if (!T0CON0bits.EN) {
+        t0_last_update_us = t;
+        t0_residual_us = 0;
+        return;
+    }
+    uint64_t elapsed = t - t0_last_update_us + t0_residual_us;
+    uint32_t tick = t0_tick_us();
+    uint64_t ticks = elapsed / tick;
+    t0_residual_us = elapsed % tick;
+    t0_last_update_us = t;
+
+    uint64_t count = TMR0L + ticks;
+    if (count >= 256) {
+        PIR3bits.TMR0IF = 1;
+    }
+    TMR0L = count % 256;
+}
+
+static uint64_t timer0_next_event(void)
+{
+    if (!T0CON0bits.EN) {
+        return UINT64_MAX;
+    }
+    return t0_last_update_us + (uint64_t) (256 - TMR0L) * t0_tick_us() - t0_residual_us;
+}
+
+/* ADC model. Conversions take a fixed time and read a per-channel value */
+#define ADC_CONVERSION_US 20
+static uint16_t adc_channels[64];
+static bool adc_busy = false;
+static uint64_t adc_done_us = 0;
+
+void sim_adc_set_channel(uint8_t channel, uint16_t counts)
+{
+    adc_channels[channel % 64] = counts;
+}
+
+static void adc_update(uint64_t t)
+{
+    if (adc_busy && t >= adc_done_us) {
+        uint16_t value = adc_channels[ADPCH % 64];
+        ADRESL = value & 0xff;
+        ADRESH = value >> 8;
+        ADCON0bits.GO = 0;
+        PIR1bits.ADIF = 1;
+        adc_busy = false;
+    }
+    if (!adc_busy && ADCON0bits.GO && ADCON0bits.ON) {
+        adc_busy = true;
+        adc_done_us = t + ADC_CONVERSION_US;
+    }
+}
+
+/*
+ * UART model. The transmit side has a one byte holding register (U1TXB) and
+ * a shift register. Clearing TXEN pauses the shift register part way
+ * through a byte, which is what the real module appears to do. The receive
+ * side has a one byte U1RXB, if the firmware doesn't read it before the next
+ * byte finishes arriving, that byte is lost.
+ */
+static void (*uart_tx_listener)(uint8_t byte) = NULL;
+static bool uart_shifting = false;
+static uint8_t uart_shift_byte;
+static uint32_t uart_shift_remaining_us;
+static uint64_t uart_shift_last_us;
+
+#define UART_RX_QUEUE_LEN 4096
+static uint8_t uart_rx_queue[UART_RX_QUEUE_LEN];
+static size_t uart_rx_head = 0, uart_rx_count = 0;
+static uint64_t uart_rx_next_us = UINT64_MAX;
+
+void sim_uart_set_tx_listener(void (*listener)(uint8_t byte))
+{
+    uart_tx_listener = listener;
+}
+
+void sim_uart_ground_send(const uint8_t *bytes, size_t len)
+{
+    while (len--) {
+        if (uart_rx_count == UART_RX_QUEUE_LEN) {
+            fprintf(stderr, "sim: ground to board queue overflowed\n");
+            return;
+        }
+        uart_rx_queue[(uart_rx_head + uart_rx_count) % UART_RX_QUEUE_LEN] = *bytes++;
+        if (uart_rx_count++ == 0) {
+            uart_rx_next_us = now_us + SIM_UART_BYTE_US;
+        }
+    }
+}
+
+bool sim_uart_ground_idle(void)
+{
+    return uart_rx_count == 0;
+}
+
+size_t sim_uart_ground_queued(void)
+{
+    return uart_rx_count;
+}
+
+static bool uart_tx_running(void)
+{
+    return U1CON1bits.ON && U1CON0bits.TXEN;
+}
+
+static void uart_update(uint64_t t)
+{
+    // transmit side
+    if (uart_shifting && uart_tx_running()) {
+        uint32_t elapsed = t - uart_shift_last_us;
+        if (elapsed >= uart_shift_remaining_us) {
+            uart_shifting = false;
+            sim_counters.uart_tx_bytes++;
+            if (uart_tx_listener) {
+                uart_tx_listener(uart_shift_byte);
+            }
+        } else {
+            uart_shift_remaining_us -= elapsed;
+        }
+    }
+    uart_shift_last_us = t;
+    if (!uart_shifting && uart_tx_running() && U1TXB != SIM_U1TXB_EMPTY) {
+        uart_shifting = true;
+        uart_shift_byte = (uint8_t) U1TXB;
+        uart_shift_remaining_us = SIM_UART_BYTE_US;
+        U1TXB = SIM_U1TXB_EMPTY;
+    }
+    PIR3bits.U1TXIF = uart_tx_running() && U1TXB == SIM_U1TXB_EMPTY;
+
+    // receive side
+    if (uart_rx_count > 0 && t >= uart_rx_next_us) {
+        uint8_t byte = uart_rx_queue[uart_rx_head];
+        uart_rx_head = (uart_rx_head + 1) % UART_RX_QUEUE_LEN;
+        uart_rx_count--;
+        uart_rx_next_us = uart_rx_count ? uart_rx_next_us + SIM_UART_BYTE_US : UINT64_MAX;
+
+        if (U1CON1bits.ON && U1CON0bits.RXEN) {
+            if (PIR3bits.U1RXIF) {
+                sim_counters.uart_rx_overruns++;
+            } else {
+                U1RXB = byte;
+                PIR3bits.U1RXIF = 1;
+                sim_counters.uart_rx_bytes++;
+            }
+        }
+    }
+}
+
+static uint64_t uart_next_event(void)
+{
+    uint64_t next = uart_rx_next_us;
+    if (uart_shifting && uart_tx_running()) {
+        uint64_t done = uart_shift_last_us + uart_shift_remaining_us;
+        if (done < next) {
+            next = done;
+        }
+    }
+    return next;
+}
+
+/* Interrupts */
+
+static bool interrupt_pending(void)
+{
+    return (PIE1bits.ADIE && PIR1bits.ADIF) ||
+           sim_can_interrupt_pending() ||
+           (PIE3bits.TMR0IE && PIR3bits.TMR0IF) ||
+           (PIE3bits.U1RXIE && PIR3bits.U1RXIF) ||
+           (PIE3bits.U1TXIE && PIR3bits.U1TXIF) ||
+           (PIE3bits.U1EIE && PIR3bits.U1EIF);
+}
+
+/*
+ * Bring every peripheral up to time t. Also picks up anything the firmware
+ * started since the last update (a written U1TXB, a set GO bit)
+ */
+static void update_peripherals(uint64_t t)
+{
+    timer0_update(t);
+    adc_update(t);
+    uart_update(t);
+    sim_can_update(t);
+}
+
+/*
+ * Calls the ISR until nothing is pending. The ISR only handles one source per
+ * call, just like the real thing, so we keep calling it. Returns true if it
+ * was called at all
+ */
+static bool dispatch_interrupts(void)
+{
+    bool dispatched = false;
+    uint16_t guard = 0;
+    update_peripherals(now_us);
+    while (interrupt_pending()) {
+        isr();
+        sim_counters.isr_calls++;
+        dispatched = true;
+        update_peripherals(now_us);
+        if (++guard == 1000) {
+            fprintf(stderr, "sim: interrupt storm at %llu us\n",
+                    (unsigned long long) now_us);
+            exit(2);
+        }
+    }
+    return dispatched;
+}
+
+static void finish(void)
+{
+    if (scenario && scenario->finish) {
+        scenario->finish();
+    }
+
+    printf("\n--- simulation report: %s ---\n", scenario ? scenario->name : "none");
+    double sim_s = now_us / 1e6;
+    double wall_s = (double) clock() / CLOCKS_PER_SEC;
+    printf("simulated %.1f s in %.2f s of CPU time (%.0fx real time)\n",
+           sim_s, wall_s, wall_s > 0 ? sim_s / wall_s : 0.0);
+    printf("main loop wakeups: %u (%.1f per second)\n",
+           sim_counters.wakeups, sim_counters.wakeups / sim_s);
+    printf("interrupts: %u\n", sim_counters.isr_calls);
+    printf("uart: %u bytes sent (%.1f B/s), %u bytes received, %u overruns\n",
+           sim_counters.uart_tx_bytes, sim_counters.uart_tx_bytes / sim_s,
+           sim_counters.uart_rx_bytes, sim_counters.uart_rx_overruns);
+    printf("can: %u frames to radio board (%.1f/s), %u frames from it, "
+           "%u lost in hardware, %u sent while the bus was off, bus %.1f%% busy\n",
+           sim_counters.can_frames_to_board, sim_counters.can_frames_to_board / sim_s,
+           sim_counters.can_frames_from_board, sim_counters.can_frames_lost,
+           sim_counters.can_frames_unheard,
+           100.0 * sim_counters.can_bus_busy_us / now_us);
+    printf("checks: %u run, %u failed\n", checks_run, checks_failed);
+    exit(checks_failed ? 1 : 0);
+}
+
+/*
+ * Move time forward to the next thing that's going to happen, and make it
+ * happen.
+ */
+static void advance(void)
+{
+    uint64_t next = next_ms_us;
+    uint64_t candidate;
+    if ((candidate = timer0_next_event()) < next) next = candidate;
+    if ((candidate = uart_next_event()) < next) next = candidate;
+    if ((candidate = sim_can_next_event_us()) < next) next = candidate;
+    if (adc_busy && adc_done_us < next) next = adc_done_us;
+    if (next < now_us) next = now_us;
+
+    now_us = next;
+    update_peripherals(now_us);
+
+    if (now_us >= next_ms_us) {
+        next_ms_us += 1000;
+        uint8_t i;
+        for (i = 0; i < num_ms_hooks; ++i) {
+            ms_hooks[i](sim_now_ms());
+        }
+        if (now_us >= end_us) {
+            finish();
+        }
+    }
+}
+
+void sim_sleep(void)
+{
+    if (!dispatch_interrupts()) {
+        do {
+            advance();
+        } while (!dispatch_interrupts());
+    }
+    sim_counters.wakeups++;
+}
+
+void sim_delay_us(uint32_t us)
+{
+    uint64_t until = now_us + us;
+    while (now_us < until) {
+        advance();
+        if (INTCON0bits.GIE) {
+            dispatch_interrupts();
+        }
+    }
+}
+
+uint64_t sim_now_us(void)
+{
+    return now_us;
+}
+
+uint32_t sim_now_ms(void)
+{
+    return now_us / 1000;
+}
+
+bool sim_add_ms_hook(void (*hook)(uint32_t now_ms))
+{
+    if (num_ms_hooks == MAX_MS_HOOKS) {
+        return false;
+    }
+    ms_hooks[num_ms_hooks++] = hook;
+    return true;
+}
+
+void sim_set_end_ms(uint32_t end_ms)
+{
+    end_us = (uint64_t) end_ms * 1000;
+}
+
+void sim_check(bool passed, const char *description)
+{
+    checks_run++;
+    if (passed) {
+        printf("\x1B[32mCheck Passed:\x1B[0m %s\n", description);
+    } else {
+        printf("\x1B[31mCheck Failed:\x1B[0m %s\n", description);
+        checks_failed++;
+    }
+}
+
+void sim_stat_add(sim_stat_t *stat, uint32_t value)
+{
+    if (stat->count == 0 || value < stat->min) stat->min = value;
+    if (stat->count == 0 || value > stat->max) stat->max = value;
+    stat->count++;
+    stat->sum += value;
+}
+
+void sim_stat_print(const char *name, const sim_stat_t *stat, const char *unit)
+{
+    if (stat->count == 0) {
+        printf("%s: no samples\n", name);
+        return;
+    }
+    printf("%s: n=%u min=%u%s mean=%llu%s max=%u%s\n", name, stat->count,
+           stat->min, unit, (unsigned long long) (stat->sum / stat->count), unit,
+           stat->max, unit);
+}
+
+void sim_init(const sim_scenario_t *s)
+{
+    scenario = s;
+
+    // the firmware waits on these during init, and the hardware sets them
+    OSCCON2 = 0x70;
+    OSCCON3bits.ORDY = 1;
+    FVRCONbits.RDY = 1;
+    U1TXB = SIM_U1TXB_EMPTY;
+
+    if (scenario && scenario->tick) {
+        sim_add_ms_hook(scenario->tick);
+    }
+}
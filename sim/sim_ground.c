@@ -0,0 +1,605 @@
+#include "sim_ground.h"
+#include <stdio.h>
+#include <string.h>
+
+sim_ground_stats_t sim_ground_stats;
+
+static uint16_t poll_period_ms = 0;
+static uint32_t next_poll_ms = 0;
+static bool poll_outstanding = false;
+static uint64_t poll_sent_us = 0;
+
+static system_state command;
+static uint16_t command_repeat_ms = 0;
+static uint32_t next_command_ms = 0;
+
+// with acknowledged commands, the sequence number of the newest one, and
+// whether it's been acknowledged yet. Older ones are never sent again, since
+// this one replaces them
+static bool acked_commands = false;
+static uint8_t command_seq = 0;
+static bool command_acked = false;
+static uint64_t command_first_sent_us = 0;
+
+static bool silent = false;
+
+static system_state last_state;
+static uint32_t last_state_ms = 0;
+
+// with delta or bundle polls, the state and sequence number of the last
+// delta state we got, which the next one is relative to
+static enum SIM_POLL_KIND poll_kind = SIM_POLL_STATE;
+static system_state delta_state;
+static uint8_t delta_seq = STATE_DELTA_NO_SNAPSHOT;
+// with SIM_POLL_PUSH, whether we've subscribed
+static bool subscribed = false;
+
+// The board handles a version select before anything we send after it, so
+// we can send in the new version straight away. What it sends us is in the
+// old version until its answer arrives though
+static enum RADIO_PROTOCOL_VERSION tx_version = RADIO_PROTOCOL_DEFAULT;
+static enum RADIO_PROTOCOL_VERSION rx_version = RADIO_PROTOCOL_DEFAULT;
+static enum RADIO_PROTOCOL_VERSION wanted_version = RADIO_PROTOCOL_DEFAULT;
+
+static telem_summary_t last_telemetry;
+static uint8_t last_telemetry_quantity = 0xFF;
+
+static board_stats_t board_stats[BOARD_STATS_NUM_PAGES];
+static bool board_stats_received[BOARD_STATS_NUM_PAGES];
+
+// receive side frame assembly. ASCII frames go through parser, binary ones
+// are put together in binary_frame until they're complete, and then turned
+// back into characters in binary_body
+static radio_parser_t parser;
+static char binary_body[RADIO_FRAME_MAX_BODY_LEN + 1];
+static uint8_t binary_frame[BINARY_FRAME_MAX_LEN];
+static uint8_t binary_frame_len = 0;
+
+// radio noise. One byte in noise_one_in gets a bit flipped, each way. The
+// generator is a fixed xorshift so that runs are repeatable
+static uint32_t noise_one_in = 0;
+static uint32_t noise_state = 2463534242u;
+
+static uint32_t noise_random(void)
+{
+    noise_state ^= noise_state << 13;
+    noise_state ^= noise_state >> 17;
+    noise_state ^= noise_state << 5;
+    return noise_state;
+}
+
+static uint8_t add_noise(uint8_t byte)
+{
+    if (noise_one_in && noise_random() % noise_one_in == 0) {
+        byte ^= 1 << (noise_random() % 8);
+        sim_ground_stats.bytes_corrupted++;
+    }
+    return byte;
+}
+
+static void send_bytes(const char *bytes, size_t len)
+{
+    if (silent) {
+        return;
+    }
+    while (len--) {
+        uint8_t byte = add_noise((uint8_t) *bytes++);
+        sim_uart_ground_send(&byte, 1);
+    }
+}
+
+// sends len characters of frame, frame check included, in tx_version
+static void send_frame(const char *frame, uint8_t len)
+{
+    if (tx_version == RADIO_PROTOCOL_V3) {
+        uint8_t binary[BINARY_FRAME_MAX_LEN];
+        len = frame_to_binary(frame, len, binary);
+        send_bytes((const char *) binary, len);
+    } else {
+        send_bytes(frame, len);
+    }
+}
+
+static void send_version_select(void)
+{
+    // the 0x00 ends any binary frame the board thinks it's in the middle of
+    char select[VERSION_SELECT_LEN + 1] = {0};
+    create_version_select(wanted_version, select + 1);
+    send_bytes(select, 1 + VERSION_SELECT_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V1));
+    tx_version = wanted_version;
+}
+
+// a poll went unanswered, or pushes stopped coming
+static void board_went_quiet(void)
+{
+    sim_ground_stats.unanswered_polls++;
+    // the board might have been reset, and reused the sequence number
+    // we have. Ask for a keyframe to be safe
+    delta_seq = STATE_DELTA_NO_SNAPSHOT;
+    // The board goes back to the default version if it doesn't hear
+    // from us for a while, in which case we can't understand each
+    // other any more. Start again from the default
+    if (wanted_version != RADIO_PROTOCOL_DEFAULT) {
+        rx_version = RADIO_PROTOCOL_DEFAULT;
+        send_version_select();
+    }
+}
+
+static void send_subscribe(void)
+{
+    char subscribe[SUBSCRIBE_LEN];
+    create_subscribe(subscribe, poll_period_ms / PUSH_PERIOD_UNIT_MS, delta_seq, tx_version);
+    send_frame(subscribe, SUBSCRIBE_BODY_LEN + frame_check_len(tx_version));
+    subscribed = !silent;
+    sim_ground_stats.subscribes_sent++;
+}
+
+// with SIM_POLL_PUSH, called every poll period instead of polling. If
+// pushes have stopped for a couple of periods, subscribe again
+static void check_subscription(void)
+{
+    if (subscribed && sim_now_ms() - last_state_ms <= 2 * poll_period_ms) {
+        return;
+    }
+    if (subscribed) {
+        board_went_quiet();
+    }
+    send_subscribe();
+}
+
+static void send_poll(void)
+{
+    if (poll_outstanding) {
+        board_went_quiet();
+    }
+    // queries are still ASCII in binary, see radio_handle_binary_character
+    if (poll_kind != SIM_POLL_STATE) {
+        char poll[2] = { poll_kind == SIM_POLL_BUNDLE ? BUNDLE_REQUEST_HEADER :
+                                                        STATE_DELTA_REQUEST_HEADER,
+                         binary_to_base64(delta_seq) };
+        send_bytes(poll, sizeof(poll));
+    } else {
+        char poll = STATE_REQUEST_HEADER;
+        send_bytes(&poll, 1);
+    }
+    poll_outstanding = !silent;
+    poll_sent_us = sim_now_us();
+    sim_ground_stats.polls_sent++;
+}
+
+static void send_command(void)
+{
+    if (acked_commands) {
+        char cmd[SEQ_COMMAND_LEN];
+        create_seq_command(cmd, command_seq, &command, tx_version);
+        send_frame(cmd, SEQ_COMMAND_BODY_LEN + frame_check_len(tx_version));
+    } else {
+        char cmd[STATE_COMMAND_LEN];
+        create_state_command(cmd, &command, tx_version);
+        send_frame(cmd, STATE_COMMAND_BODY_LEN + frame_check_len(tx_version));
+    }
+    sim_ground_stats.commands_sent++;
+}
+
+static void command_ack_received(const command_ack_t *ack)
+{
+    if (ack->seq != command_seq || command_acked) {
+        // about a command we've already moved on from
+        return;
+    }
+    if (ack->accepted) {
+        command_acked = true;
+        sim_ground_stats.commands_acked++;
+        sim_stat_add(&sim_ground_stats.command_ack_latency_us,
+                     sim_now_us() - command_first_sent_us);
+        next_command_ms = sim_now_ms() + SIM_COMMAND_REFRESH_MS;
+        return;
+    }
+    sim_ground_stats.commands_rejected++;
+    // the board has applied newer commands than this one, from before we
+    // were restarted, say. Carry on from there
+    if (ack->last_seq != COMMAND_SEQ_NONE) {
+        command_seq = (ack->last_seq + 1) % COMMAND_SEQ_NONE;
+    }
+    sim_ground_stats.command_resends++;
+    send_command();
+    next_command_ms = sim_now_ms() + SIM_COMMAND_ACK_TIMEOUT_MS;
+}
+
+static void state_received(void)
+{
+    last_state_ms = sim_now_ms();
+    sim_ground_stats.states_received++;
+    if (poll_outstanding) {
+        sim_stat_add(&sim_ground_stats.poll_latency_us,
+                     sim_now_us() - poll_sent_us);
+        poll_outstanding = false;
+    }
+}
+
+static void error_received(const error_report_t *report)
+{
+    sim_ground_stats.errors_received++;
+    sim_ground_stats.error_repeats += report->count;
+    sim_ground_stats.errors_by_type[report->err.err_type % 64]++;
+}
+
+/*
+ * Handles a frame from the board. If it came in ASCII, the parser has
+ * already checked its frame check (and fixed what FEC could)
+ */
+static void handle_frame(char *frame, uint8_t len)
+{
+    switch (frame[0]) {
+        case STATE_COMMAND_HEADER: {
+            if (!expand_state_command(&last_state, frame, rx_version)) {
+                sim_ground_stats.bad_frames++;
+                return;
+            }
+            state_received();
+            break;
+        }
+        case STATE_DELTA_HEADER: {
+            if (!expand_state_delta(&delta_state, &delta_seq, frame, rx_version)) {
+                sim_ground_stats.bad_frames++;
+                return;
+            }
+            last_state = delta_state;
+            state_received();
+            sim_ground_stats.delta_states_received++;
+            break;
+        }
+        case BUNDLE_HEADER: {
+            bundle_records_t records;
+            bool state_applied;
+            if (!expand_bundle(&delta_state, &delta_seq, &state_applied, &records,
+                               frame, rx_version)) {
+                sim_ground_stats.bad_frames++;
+                return;
+            }
+            sim_ground_stats.bundles_received++;
+            if (state_applied) {
+                last_state = delta_state;
+                state_received();
+                sim_ground_stats.delta_states_received++;
+            } else if (poll_kind == SIM_POLL_PUSH) {
+                // we missed the one it's relative to, so ask to catch up
+                send_subscribe();
+            }
+            if (records.has_gps) {
+                sim_ground_stats.gps_received++;
+            }
+            uint8_t i;
+            for (i = 0; i < records.num_errors; ++i) {
+                error_received(&records.errors[i]);
+            }
+            break;
+        }
+        case ERROR_COMMAND_HEADER: {
+            // RADIO_PROTOCOL_V1 doesn't say how often it was repeated
+            error_report_t report = { .count = 1, .age_s = 0 };
+            if (!frame_check_ok(frame, ERROR_MSG_BODY_LEN, rx_version) ||
+                !deserialize_error(&report.err, frame + 1)) {
+                sim_ground_stats.bad_frames++;
+                return;
+            }
+            error_received(&report);
+            break;
+        }
+        case ERROR_REPORT_HEADER: {
+            error_report_t report;
+            if (!expand_error_report(&report, frame, rx_version)) {
+                sim_ground_stats.bad_frames++;
+                return;
+            }
+            error_received(&report);
+            break;
+        }
+        case COMMAND_ACK_HEADER: {
+            command_ack_t ack;
+            if (!expand_command_ack(&ack, frame, rx_version)) {
+                sim_ground_stats.bad_frames++;
+                return;
+            }
+            command_ack_received(&ack);
+            break;
+        }
+        case GPS_MSG_HEADER: {
+            uint8_t lat_deg, lat_min, lat_dmin, lat_dir;
+            uint8_t lon_deg, lon_min, lon_dmin, lon_dir;
+            if (!expand_gps_message(&lat_deg, &lat_min, &lat_dmin, &lat_dir,
+                                    &lon_deg, &lon_min, &lon_dmin, &lon_dir,
+                                    frame, rx_version)) {
+                sim_ground_stats.bad_frames++;
+                return;
+            }
+            sim_ground_stats.gps_received++;
+            break;
+        }
+        case TELEMETRY_REQUEST_HEADER: {
+            if (!expand_telemetry_summary_message(&last_telemetry_quantity,
+                                                  &last_telemetry, frame, rx_version)) {
+                sim_ground_stats.bad_frames++;
+                return;
+            }
+            sim_ground_stats.telemetry_received++;
+            break;
+        }
+        case BOARD_STATS_REQUEST_HEADER: {
+            uint8_t page;
+            board_stats_t stats;
+            if (!expand_board_stats_message(&page, &stats, frame, rx_version) ||
+                page >= BOARD_STATS_NUM_PAGES) {
+                sim_ground_stats.bad_frames++;
+                return;
+            }
+            board_stats[page] = stats;
+            board_stats_received[page] = true;
+            break;
+        }
+        case VERSION_SELECT_HEADER: {
+            uint8_t announced = base64_to_binary(frame[1]);
+            if (!radio_protocol_supported(announced) ||
+                !frame_check_ok(frame, VERSION_SELECT_BODY_LEN,
+                                version_reply_frame_check(announced))) {
+                sim_ground_stats.bad_frames++;
+                return;
+            }
+            tx_version = announced;
+            rx_version = announced;
+            sim_ground_stats.version_selects_confirmed++;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// a version reply's frame check depends on the version it announces
+static uint8_t version_reply_len(const char *prefix)
+{
+    uint8_t announced = base64_to_binary(prefix[1]);
+    return VERSION_SELECT_BODY_LEN +
+        frame_check_len(radio_protocol_supported(announced) ?
+                        version_reply_frame_check(announced) :
+                        RADIO_PROTOCOL_DEFAULT);
+}
+
+// everything the board sends us in ASCII. Version replies are checked by
+// handle_frame, so their frame check is part of what the parser hands over
+static const radio_frame_type_t ground_frame_types[] = {
+    { STATE_COMMAND_HEADER, STATE_COMMAND_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION_AFTER_HEADER },
+    { STATE_DELTA_HEADER, 0, STATE_DELTA_PREFIX_LEN, &state_delta_body_len, PARSER_CHECK_VERSION },
+    { BUNDLE_HEADER, 0, BUNDLE_PREFIX_LEN, &bundle_body_len, PARSER_CHECK_VERSION },
+    { ERROR_COMMAND_HEADER, ERROR_MSG_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { ERROR_REPORT_HEADER, ERROR_REPORT_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { GPS_MSG_HEADER, GPS_MSG_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { COMMAND_ACK_HEADER, COMMAND_ACK_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { TELEMETRY_REQUEST_HEADER, TELEMETRY_SUMMARY_MSG_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { PERF_STATS_REQUEST_HEADER, PERF_STATS_MSG_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { BOARD_STATS_REQUEST_HEADER, BOARD_STATS_MSG_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION },
+    { VERSION_SELECT_HEADER, 0, 2, &version_reply_len, PARSER_CHECK_NONE },
+};
+
+static void ground_receive_binary(uint8_t byte)
+{
+    if (byte != 0) {
+        if (binary_frame_len == sizeof(binary_frame)) {
+            sim_ground_stats.bad_frames++;
+            binary_frame_len = 0;
+        }
+        binary_frame[binary_frame_len++] = byte;
+        return;
+    }
+    if (binary_frame_len == 0) {
+        return;
+    }
+    uint8_t len = binary_to_frame(binary_frame, binary_frame_len, binary_body);
+    binary_frame_len = 0;
+    if (len == 0) {
+        sim_ground_stats.bad_frames++;
+        return;
+    }
+    handle_frame(binary_body, len);
+}
+
+static void ground_receive(uint8_t byte)
+{
+    if (silent) {
+        return;
+    }
+    byte = add_noise(byte);
+    // in binary, the only ASCII is a version select at the start of a frame
+    if (rx_version == RADIO_PROTOCOL_V3 && !radio_parser_in_frame(&parser) &&
+        !(byte == VERSION_SELECT_HEADER && binary_frame_len == 0)) {
+        ground_receive_binary(byte);
+        return;
+    }
+    radio_parser_feed(&parser, byte, rx_version);
+}
+
+static void ground_tick(uint32_t now_ms)
+{
+    if (poll_period_ms && (int32_t) (now_ms - next_poll_ms) >= 0) {
+        if (poll_kind == SIM_POLL_PUSH) {
+            check_subscription();
+        } else {
+            send_poll();
+        }
+        next_poll_ms = now_ms + poll_period_ms;
+    }
+    if (acked_commands && command_repeat_ms &&
+        (int32_t) (now_ms - next_command_ms) >= 0) {
+        if (!command_acked) {
+            sim_ground_stats.command_resends++;
+        }
+        send_command();
+        next_command_ms = now_ms + (command_acked ? SIM_COMMAND_REFRESH_MS :
+                                                    SIM_COMMAND_ACK_TIMEOUT_MS);
+    } else if (command_repeat_ms && (int32_t) (now_ms - next_command_ms) >= 0) {
+        send_command();
+        next_command_ms = now_ms + command_repeat_ms;
+    }
+}
+
+void sim_ground_init(void)
+{
+    init_radio_parser(&parser, ground_frame_types,
+                      sizeof(ground_frame_types) / sizeof(ground_frame_types[0]),
+                      &handle_frame);
+    sim_uart_set_tx_listener(&ground_receive);
+    sim_add_ms_hook(&ground_tick);
+    memset(&command, 0, sizeof(command));
+    command.injector_valve_state = VALVE_CLOSED;
+    command.vent_valve_state = VALVE_CLOSED;
+    command.bus_is_powered = true;
+}
+
+void sim_ground_set_poll_period_ms(uint16_t period_ms)
+{
+    poll_period_ms = period_ms;
+    next_poll_ms = sim_now_ms();
+}
+
+void sim_ground_send_command(enum VALVE_STATE inj, enum VALVE_STATE vent,
+                             bool bus_powered, uint16_t repeat_ms)
+{
+    command.injector_valve_state = inj;
+    command.vent_valve_state = vent;
+    command.bus_is_powered = bus_powered;
+    command_repeat_ms = repeat_ms;
+    if (acked_commands) {
+        command_seq = (command_seq + 1) % COMMAND_SEQ_NONE;
+        command_acked = false;
+        command_first_sent_us = sim_now_us();
+        send_command();
+        next_command_ms = sim_now_ms() + SIM_COMMAND_ACK_TIMEOUT_MS;
+        return;
+    }
+    send_command();
+    next_command_ms = sim_now_ms() + repeat_ms;
+}
+
+void sim_ground_set_acked_commands(bool acked)
+{
+    acked_commands = acked;
+}
+
+void sim_ground_select_protocol(enum RADIO_PROTOCOL_VERSION v)
+{
+    wanted_version = v;
+    send_version_select();
+}
+
+enum RADIO_PROTOCOL_VERSION sim_ground_protocol(void)
+{
+    return rx_version;
+}
+
+void sim_ground_set_noise(uint32_t one_in)
+{
+    noise_one_in = one_in;
+}
+
+void sim_ground_set_poll_kind(enum SIM_POLL_KIND kind)
+{
+    poll_kind = kind;
+}
+
+void sim_ground_request_telemetry(uint8_t quantity)
+{
+    char request[2] = { TELEMETRY_REQUEST_HEADER, binary_to_base64(quantity) };
+    send_bytes(request, sizeof(request));
+}
+
+const telem_summary_t *sim_ground_last_telemetry(uint8_t *quantity)
+{
+    *quantity = last_telemetry_quantity;
+    return &last_telemetry;
+}
+
+void sim_ground_request_board_stats(uint8_t page)
+{
+    char request[2] = { BOARD_STATS_REQUEST_HEADER, binary_to_base64(page) };
+    send_bytes(request, sizeof(request));
+}
+
+void sim_ground_set_radio_mirror(bool enabled)
+{
+    char request[RADIO_MIRROR_LEN];
+    create_radio_mirror(request, enabled ? 1 : 0, tx_version);
+    send_frame(request, RADIO_MIRROR_BODY_LEN + frame_check_len(tx_version));
+}
+
+bool sim_ground_board_stats(uint8_t page, board_stats_t *stats)
+{
+    if (page >= BOARD_STATS_NUM_PAGES || !board_stats_received[page]) {
+        return false;
+    }
+    *stats = board_stats[page];
+    return true;
+}
+
+void sim_ground_set_silent(bool s)
+{
+    silent = s;
+    poll_outstanding = false;
+    subscribed = false;
+    radio_parser_reset(&parser);
+    binary_frame_len = 0;
+}
+
+const radio_parser_stats_t *sim_ground_parser_stats(void)
+{
+    return &parser.stats;
+}
+
+const system_state *sim_ground_last_state(void)
+{
+    return &last_state;
+}
+
+uint32_t sim_ground_last_state_ms(void)
+{
+    return last_state_ms;
+}
+
+void sim_ground_print_report(void)
+{
+    printf("ground: %u polls, %u subscribes, %u unanswered, %u commands sent; received %u states "
+           "(%u as deltas), %u bundles, %u errors (%u reports), %u gps, %u telemetry, "
+           "%u bad frames; "
+           "protocol v%u, %u version selects confirmed\n",
+           sim_ground_stats.polls_sent, sim_ground_stats.subscribes_sent,
+           sim_ground_stats.unanswered_polls,
+           sim_ground_stats.commands_sent, sim_ground_stats.states_received,
+           sim_ground_stats.delta_states_received, sim_ground_stats.bundles_received,
+           sim_ground_stats.errors_received, sim_ground_stats.error_repeats,
+           sim_ground_stats.gps_received, sim_ground_stats.telemetry_received,
+           sim_ground_stats.bad_frames, rx_version,
+           sim_ground_stats.version_selects_confirmed);
+    printf("ground parser: %u frames ok, %u bad checks, %u truncated, "
+           "%u resyncs (%u bytes discarded)\n",
+           parser.stats.frames_ok, parser.stats.bad_checks, parser.stats.truncated,
+           parser.stats.resyncs, parser.stats.bytes_discarded);
+    if (noise_one_in) {
+        printf("noise: %u bytes corrupted; FEC fixed %u frames, %u uncorrectable\n",
+               sim_ground_stats.bytes_corrupted, parser.stats.fec_corrected,
+               parser.stats.fec_uncorrectable);
+    }
+    sim_stat_print("poll to state latency", &sim_ground_stats.poll_latency_us, "us");
+    if (acked_commands) {
+        printf("acknowledged commands: %u acknowledged, %u rejected, %u resent\n",
+               sim_ground_stats.commands_acked, sim_ground_stats.commands_rejected,
+               sim_ground_stats.command_resends);
+        sim_stat_print("command to acknowledgement", &sim_ground_stats.command_ack_latency_us,
+                       "us");
+    }
+    uint8_t i;
+    for (i = 0; i < 64; ++i) {
+        if (sim_ground_stats.errors_by_type[i]) {
+            printf("  error type 0x%02x received %u times\n", i,
+                   sim_ground_stats.errors_by_type[i]);
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef SIM_GROUND_H_
+#define SIM_GROUND_H_
+
+/*
+ * Model of RLCS on the far end of the XBee link. It polls for state, sends
+ * state commands, and decodes everything the radio board sends back using the
+ * same serialize.c code that the firmware uses.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "serialize.h"
+#include "radio_parser.h"
+#include "sim.h"
+
+void sim_ground_init(void);
+
+// send a STATE_REQUEST_HEADER every period_ms, 0 to stop polling
+void sim_ground_set_poll_period_ms(uint16_t period_ms);
+
+// send a state command now, and then every repeat_ms (0 to only send once).
+// RLCS keeps resending the current command, so that's the default
+void sim_ground_send_command(enum VALVE_STATE inj, enum VALVE_STATE vent,
+                             bool bus_powered, uint16_t repeat_ms);
+
+// send commands as acknowledged state commands (SEQ_COMMAND_HEADER) instead.
+// Each one is sent once, and only sent again if its acknowledgement doesn't
+// come within SIM_COMMAND_ACK_TIMEOUT_MS, or every SIM_COMMAND_REFRESH_MS
+// in case the board has been reset, rather than every repeat_ms
+#define SIM_COMMAND_ACK_TIMEOUT_MS 200
+#define SIM_COMMAND_REFRESH_MS 5000
+void sim_ground_set_acked_commands(bool acked);
+
+// ask the board to switch to protocol version v. sim_ground_protocol is the
+// version we're actually speaking, which changes once the board confirms.
+// If polls start going unanswered, we assume the board went back to the
+// default version and ask again
+void sim_ground_select_protocol(enum RADIO_PROTOCOL_VERSION v);
+enum RADIO_PROTOCOL_VERSION sim_ground_protocol(void);
+
+// flip a bit in one byte in one_in, at random, in both directions. 0 for a
+// clean link
+void sim_ground_set_noise(uint32_t one_in);
+
+// what to poll with. Delta polls (STATE_DELTA_REQUEST_HEADER) get only the
+// fields that changed since the last poll, and bundle polls
+// (BUNDLE_REQUEST_HEADER) get that plus any errors and GPS positions the
+// board has waiting, all in one frame. With SIM_POLL_PUSH, RLCS doesn't poll
+// at all, it subscribes (SUBSCRIBE_HEADER) for a bundle every poll period,
+// and only subscribes again if it misses one
+enum SIM_POLL_KIND {
+    SIM_POLL_STATE,
+    SIM_POLL_DELTA,
+    SIM_POLL_BUNDLE,
+    SIM_POLL_PUSH,
+};
+void sim_ground_set_poll_kind(enum SIM_POLL_KIND kind);
+
+// ask for a telemetry summary of quantity (enum TELEM_QUANTITY). The reply
+// lands in sim_ground_last_telemetry, which also says which quantity it was
+void sim_ground_request_telemetry(uint8_t quantity);
+const telem_summary_t *sim_ground_last_telemetry(uint8_t *quantity);
+
+// ask for a page of board stats (enum BOARD_STATS_PAGE). Once a reply for
+// that page has arrived, sim_ground_board_stats copies out the latest one
+// and returns true
+void sim_ground_request_board_stats(uint8_t page);
+bool sim_ground_board_stats(uint8_t page, board_stats_t *stats);
+
+// turn the board's radio mirror on or off. Its reply is the
+// BOARD_STATS_RADIO_MIRROR page, for sim_ground_board_stats
+void sim_ground_set_radio_mirror(bool enabled);
+
+// a silent ground station neither sends nor hears anything, like when the
+// radio link drops out
+void sim_ground_set_silent(bool silent);
+
+// the last state that the board reported, and when it arrived (0 if never)
+const system_state *sim_ground_last_state(void);
+uint32_t sim_ground_last_state_ms(void);
+
+// what became of the ASCII frames from the board, see radio_parser.h
+const radio_parser_stats_t *sim_ground_parser_stats(void);
+
+typedef struct {
+    uint32_t polls_sent;
+    uint32_t subscribes_sent;
+    uint32_t commands_sent;
+    uint32_t commands_acked;
+    uint32_t commands_rejected;
+    uint32_t command_resends;
+    uint32_t states_received;
+    uint32_t delta_states_received;
+    uint32_t bundles_received;
+    uint32_t errors_received;
+    uint32_t error_repeats;  // every report they stand for, by their counts
+    uint32_t gps_received;
+    uint32_t telemetry_received;
+    uint32_t bad_frames;
+    uint32_t version_selects_confirmed;
+    uint32_t bytes_corrupted;
+    uint32_t unanswered_polls;
+    uint32_t errors_by_type[64];
+    sim_stat_t poll_latency_us;
+    sim_stat_t command_ack_latency_us; // from first sent to acknowledged
+} sim_ground_stats_t;
+
+extern sim_ground_stats_t sim_ground_stats;
+
+void sim_ground_print_report(void);
+
+#endif
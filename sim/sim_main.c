@@ -0,0 +1,90 @@
+#include "sim.h"
+#include "sim_boards.h"
+#include "sim_ground.h"
+#include "sim_bridge.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// main() from the firmware's main.c, renamed by the Makefile
+int firmware_main(void);
+
+static void usage(const char *argv0)
+{
+    size_t i;
+    fprintf(stderr, "usage: %s [-t seconds] [-u link] scenario\n"
+            "       %s -l\n\n"
+            "  -l       list the scenarios that run on their own, for make run\n"
+            "  -u link  put the XBee link on a pty or serial device, or fd:N for an\n"
+            "           open file descriptor, in real time. See sim_bridge.h\n\n"
+            "scenarios:\n", argv0, argv0);
+    for (i = 0; i < sim_num_scenarios; ++i) {
+        fprintf(stderr, "  %-16s %s (%u s)\n", sim_scenarios[i].name,
+                sim_scenarios[i].description, sim_scenarios[i].default_duration_s);
+    }
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const sim_scenario_t *scenario = NULL;
+    const char *link = NULL;
+    uint32_t duration_s = 0;
+    int i;
+    size_t j;
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            duration_s = strtoul(argv[++i], NULL, 10);
+            continue;
+        }
+        if (strcmp(argv[i], "-l") == 0) {
+            for (j = 0; j < sim_num_scenarios; ++j) {
+                if (!sim_scenarios[j].needs_link) {
+                    printf("%s\n", sim_scenarios[j].name);
+                }
+            }
+            return 0;
+        }
+        if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) {
+            link = argv[++i];
+            continue;
+        }
+        for (j = 0; j < sim_num_scenarios; ++j) {
+            if (strcmp(argv[i], sim_scenarios[j].name) == 0) {
+                scenario = &sim_scenarios[j];
+            }
+        }
+        if (scenario == NULL) {
+            usage(argv[0]);
+        }
+    }
+    if (scenario == NULL) {
+        usage(argv[0]);
+    }
+    if (duration_s == 0) {
+        duration_s = scenario->default_duration_s;
+    }
+
+    printf("running %s for %u simulated seconds\n", scenario->name, duration_s);
+    sim_boards_init();
+    sim_ground_init();
+    sim_init(scenario);
+    if (link && !sim_bridge_open(link)) {
+        return 1;
+    }
+
+    // a healthy 12V battery, see analog.c for the scaling
+    sim_adc_set_channel(ANALOG_CH_BATT_VOLTAGE, 12000 / 4);
+    sim_adc_set_channel(ANALOG_CH_BATT_CURRENT, 120 * 15);
+    sim_adc_set_channel(ANALOG_CH_BUS_CURRENT, 80 * 15);
+    sim_set_end_ms(duration_s * 1000);
+    if (scenario->setup) {
+        scenario->setup();
+    }
+
+    // never returns, the simulation exits once it reaches the end time
+    firmware_main();
+    return 0;
+}
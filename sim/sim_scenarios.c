@@ -0,0 +1,761 @@
+/*
+ * Scripted scenarios. Each one sets up the ground station and boards, pokes
+ * at them from its tick function as simulated time passes, and checks what
+ * happened in its finish function. Checks look at the system from the
+ * outside wherever possible (what RLCS received, what the injector board was
+ * told to do), rather than at firmware internals.
+ */
+#include "sim.h"
+#include "sim_boards.h"
+#include "sim_ground.h"
+#include "sim_bridge.h"
+#include "radio_handler.h"
+#include "radio_tx.h"
+#include "radio_mirror.h"
+#include "error.h"
+#include "bus_power.h"
+#include "can_ingest.h"
+#include "sotscon.h"
+#include "pic18_time.h"
+#include "telemetry_history.h"
+#include <stdio.h>
+#include <stdlib.h> // for labs
+#include <string.h> // for memset
+
+#define POLL_PERIOD_MS 500
+#define COMMAND_REPEAT_MS 1000
+
+/*
+ * Protocol version RLCS uses when the link is clean. The parity symbols in
+ * RADIO_PROTOCOL_V4 only pay for themselves once bytes start getting lost,
+ * which is what noisy_link is for
+ */
+#define CLEAN_LINK_PROTOCOL RADIO_PROTOCOL_V3
+
+static void setup_with_protocol(enum RADIO_PROTOCOL_VERSION version)
+{
+    sim_ground_select_protocol(version);
+    sim_ground_set_poll_period_ms(POLL_PERIOD_MS);
+    sim_ground_set_poll_kind(SIM_POLL_BUNDLE);
+    sim_ground_send_command(VALVE_CLOSED, VALVE_CLOSED, true, COMMAND_REPEAT_MS);
+    sim_boards_set_tank_pressure(420);
+}
+
+static void common_setup(void)
+{
+    setup_with_protocol(CLEAN_LINK_PROTOCOL);
+}
+
+static void common_report(void)
+{
+    can_ingest_stats_t ingest;
+    can_ingest_get_stats(&ingest);
+
+    sim_ground_print_report();
+    printf("boards: %u frames sent, %u injector commands heard, %u actuations\n",
+           sim_boards_stats.frames_sent, sim_boards_stats.inj_valve_cmds,
+           sim_boards_stats.inj_actuations);
+    printf("firmware can ingest: %u frames in %u batches, largest batch %u, "
+           "backlog high water %u, %u dropped\n",
+           ingest.frames_processed, ingest.batches, ingest.max_batch_size,
+           ingest.backlog_high_water, ingest.frames_dropped);
+    printf("firmware messages received by type:");
+    uint16_t type;
+    for (type = 0; type < 0x800; type += 0x20) {
+        if (sotscon_message_count(type)) {
+            printf(" 0x%03x=%u", type, sotscon_message_count(type));
+        }
+    }
+    printf("\n");
+
+    error_stats_t errors;
+    get_error_stats(&errors);
+    printf("firmware errors: %u reported, %u merged into ones waiting, %u dropped, "
+           "%u waiting at most\n",
+           errors.reported, errors.coalesced, errors.dropped, errors.max_pending);
+
+    static const char *const class_names[RADIO_TX_NUM_CLASSES] = {
+        "safety", "error", "gps", "debug"
+    };
+    uint8_t cls;
+    for (cls = 0; cls < RADIO_TX_NUM_CLASSES; ++cls) {
+        radio_tx_stats_t tx;
+        radio_tx_get_stats(cls, &tx);
+        printf("firmware radio tx %s: %u frames, %u bytes, %u dropped, "
+               "queued max %u deep, waited mean %u max %u ms\n",
+               class_names[cls], tx.frames_sent, tx.bytes_sent, tx.frames_dropped,
+               tx.max_depth, tx.frames_sent ? tx.total_latency_ms / tx.frames_sent : 0,
+               tx.max_latency_ms);
+    }
+
+    radio_mirror_stats_t mirror;
+    radio_mirror_get_stats(&mirror);
+    printf("firmware radio mirror: %u bytes in %u CAN messages (%u partial), "
+           "%u dropped, %u discarded\n",
+           mirror.bytes_mirrored, mirror.messages_sent, mirror.partial_flushes,
+           mirror.bytes_dropped, mirror.bytes_discarded);
+}
+
+static bool polls_mostly_answered(void)
+{
+    return sim_ground_stats.states_received * 100 >= sim_ground_stats.polls_sent * 98;
+}
+
+/*
+ * Valve command bookkeeping shared by the scenarios that toggle the injector.
+ * Measures from the moment RLCS starts sending the command, to the injector
+ * valve actually moving, and to RLCS seeing the new state in a poll response
+ */
+static enum VALVE_STATE commanded_inj = VALVE_CLOSED;
+static uint64_t command_sent_us = 0;
+static bool awaiting_actuation = false, awaiting_confirmation = false;
+static uint32_t commands_toggled = 0;
+static sim_stat_t actuation_latency_ms, confirmation_latency_ms;
+
+static void toggle_injector(void)
+{
+    commanded_inj = (commanded_inj == VALVE_OPEN) ? VALVE_CLOSED : VALVE_OPEN;
+    sim_ground_send_command(commanded_inj, VALVE_CLOSED, true, COMMAND_REPEAT_MS);
+    command_sent_us = sim_now_us();
+    awaiting_actuation = awaiting_confirmation = true;
+    commands_toggled++;
+}
+
+static void track_injector(void)
+{
+    uint32_t elapsed_ms = (sim_now_us() - command_sent_us) / 1000;
+    if (awaiting_actuation && sim_boards_inj_valve() == commanded_inj) {
+        sim_stat_add(&actuation_latency_ms, elapsed_ms);
+        awaiting_actuation = false;
+    }
+    if (awaiting_confirmation &&
+        sim_ground_last_state()->injector_valve_state == commanded_inj &&
+        sim_ground_last_state_ms() * 1000ull > command_sent_us) {
+        sim_stat_add(&confirmation_latency_ms, elapsed_ms);
+        awaiting_confirmation = false;
+    }
+}
+
+/* powerup: boot, power the bus, make sure RLCS sees every board */
+
+static uint32_t all_boards_seen_ms = 0;
+
+// RLCS asks how CAN ingestion and the radio are keeping up this long in
+#define INGEST_STATS_AT_MS 50000
+#define RADIO_TX_STATS_AT_MS 50100
+// and turns the radio mirror off for a while in between
+#define MIRROR_OFF_AT_MS 30000
+#define MIRROR_ON_AT_MS 40000
+static board_stats_t mirror_off_reply;
+static bool mirror_off_replied = false;
+static uint16_t mirror_messages_off = 0, mirror_messages_on = 0;
+
+static void powerup_tick(uint32_t now_ms)
+{
+    if (now_ms == INGEST_STATS_AT_MS) {
+        sim_ground_request_board_stats(BOARD_STATS_CAN_INGEST);
+    }
+    if (now_ms == RADIO_TX_STATS_AT_MS) {
+        sim_ground_request_board_stats(BOARD_STATS_RADIO_TX_SAFETY);
+    }
+    radio_mirror_stats_t mirror;
+    if (now_ms == MIRROR_OFF_AT_MS) {
+        sim_ground_set_radio_mirror(false);
+    } else if (now_ms == MIRROR_OFF_AT_MS + 1000) {
+        mirror_off_replied = sim_ground_board_stats(BOARD_STATS_RADIO_MIRROR,
+                                                    &mirror_off_reply);
+        radio_mirror_get_stats(&mirror);
+        mirror_messages_off = mirror.messages_sent;
+    } else if (now_ms == MIRROR_ON_AT_MS) {
+        radio_mirror_get_stats(&mirror);
+        mirror_messages_on = mirror.messages_sent;
+        sim_ground_set_radio_mirror(true);
+    }
+    if (all_boards_seen_ms == 0 && sim_ground_last_state_ms() != 0 &&
+        sim_ground_last_state()->num_boards_connected == SIM_NUM_BOARDS) {
+        all_boards_seen_ms = now_ms;
+    }
+}
+
+static void powerup_finish(void)
+{
+    common_report();
+    printf("RLCS saw all %u boards after %u ms\n", SIM_NUM_BOARDS, all_boards_seen_ms);
+    sim_check(all_boards_seen_ms != 0 && all_boards_seen_ms < 2000,
+              "RLCS sees every board within 2 s of bootup");
+    sim_check(sim_ground_last_state()->bus_is_powered, "bus reported powered");
+    sim_check(sim_ground_last_state()->num_boards_connected == SIM_NUM_BOARDS,
+              "every board still connected at the end");
+    sim_check(polls_mostly_answered(), "at least 98% of polls answered");
+    sim_check(sim_counters.can_frames_lost == 0, "no CAN frames lost in hardware");
+    sim_check(sim_ground_protocol() == CLEAN_LINK_PROTOCOL &&
+              radio_protocol_version() == CLEAN_LINK_PROTOCOL,
+              "RLCS and the board agree on the clean link protocol version");
+    sim_check(sim_ground_stats.bad_frames == 0 &&
+              sim_ground_parser_stats()->bad_checks == 0 &&
+              sim_ground_parser_stats()->truncated == 0, "no bad frames on a clean link");
+    sim_check(sim_ground_stats.delta_states_received == sim_ground_stats.states_received &&
+              sim_ground_stats.bundles_received == sim_ground_stats.states_received,
+              "every state arrived as a delta state in a bundle");
+
+    board_stats_t reported;
+    can_ingest_stats_t ingest;
+    can_ingest_get_stats(&ingest);
+    sim_check(sim_ground_board_stats(BOARD_STATS_CAN_INGEST, &reported) &&
+              reported.counters[0] > ingest.frames_processed / 2 &&
+              reported.counters[0] <= ingest.frames_processed &&
+              reported.counters[2] == ingest.frames_dropped &&
+              reported.counters[5] <= ingest.backlog_high_water &&
+              reported.counters[5] > 0,
+              "RLCS can ask how CAN ingestion is keeping up");
+
+    radio_tx_stats_t tx;
+    radio_tx_get_stats(RADIO_TX_SAFETY, &tx);
+    sim_check(sim_ground_board_stats(BOARD_STATS_RADIO_TX_SAFETY, &reported) &&
+              reported.counters[0] > tx.frames_sent / 2 &&
+              reported.counters[0] <= tx.frames_sent &&
+              reported.counters[1] == tx.frames_dropped &&
+              reported.counters[3] <= tx.max_depth &&
+              reported.counters[5] <= tx.max_latency_ms,
+              "RLCS can ask how the radio is keeping up with safety frames");
+
+    radio_mirror_stats_t mirror;
+    radio_mirror_get_stats(&mirror);
+    sim_check(mirror_off_replied && mirror_off_reply.counters[0] == 0 &&
+              mirror_messages_on == mirror_messages_off &&
+              sim_ground_board_stats(BOARD_STATS_RADIO_MIRROR, &reported) &&
+              reported.counters[0] == 1 && radio_mirror_enabled() &&
+              mirror.messages_sent > mirror_messages_on,
+              "RLCS can turn the radio mirror off and back on");
+
+    // there's no way to get these to the ground yet, so look inside
+    imu_reading_t acc;
+    gps_altitude_t altitude;
+    gps_time_t time;
+    sim_check(current_imu_reading(IMU_ACC, &acc) &&
+              acc.average[0] >= 0x1000 && acc.average[0] <= 0x100f &&
+              acc.average[2] >= -0x300f && acc.average[2] <= -0x3000 &&
+              acc.last[2] >= -0x300f && acc.last[2] <= -0x3000 &&
+              sim_now_ms() - acc.last_received_ms <= 50,
+              "IMU readings and averages decoded");
+    // y swings either side of zero, which only averages out if the samples
+    // are taken as signed
+    sim_check(acc.average[1] >= -8 && acc.average[1] <= 7 &&
+              acc.last[1] >= -8 && acc.last[1] <= 7,
+              "IMU axes that cross zero average to about zero");
+    sim_check(current_gps_altitude(&altitude) && altitude.altitude == 300 &&
+              altitude.daltitude == 5 && altitude.units == 'M' &&
+              altitude.average_altitude == 300,
+              "GPS altitude decoded");
+    sim_check(current_gps_time(&time) && time.minutes == 0 && time.seconds >= 58,
+              "GPS time decoded");
+}
+
+/* board_death: kill the sensor board, expect a feared dead error, revive it */
+
+#define DEATH_AT_MS 30000
+#define REVIVE_AT_MS 60000
+static uint32_t death_reported_ms = 0;
+static uint8_t boards_while_dead = 0;
+
+static void board_death_tick(uint32_t now_ms)
+{
+    if (now_ms == DEATH_AT_MS) {
+        sim_board_set_alive(SIM_ID_SENSOR, false);
+    } else if (now_ms == REVIVE_AT_MS) {
+        boards_while_dead = sim_ground_last_state()->num_boards_connected;
+        sim_board_set_alive(SIM_ID_SENSOR, true);
+    }
+    if (death_reported_ms == 0 && now_ms > DEATH_AT_MS &&
+        sim_ground_stats.errors_by_type[E_BOARD_FEARED_DEAD] > 0) {
+        death_reported_ms = now_ms;
+    }
+}
+
+static void board_death_finish(void)
+{
+    common_report();
+    uint32_t latency = death_reported_ms - DEATH_AT_MS;
+    printf("board death reported to RLCS after %u ms\n", latency);
+    sim_check(death_reported_ms != 0, "RLCS hears E_BOARD_FEARED_DEAD");
+    sim_check(death_reported_ms != 0 && latency <= MIN_TIME_BETWEEN_BOARD_HEARTBEAT_MS + 2000,
+              "death reported within the heartbeat timeout plus 2 s");
+    sim_check(boards_while_dead == SIM_NUM_BOARDS - 1, "board count drops while dead");
+    sim_check(sim_ground_last_state()->num_boards_connected == SIM_NUM_BOARDS,
+              "board count recovers after revival");
+}
+
+/* valve_commands: toggle the injector every 10 s, measure how long it takes */
+
+#define TOGGLE_PERIOD_MS 10000
+
+static void valve_commands_tick(uint32_t now_ms)
+{
+    if (now_ms >= TOGGLE_PERIOD_MS && now_ms % TOGGLE_PERIOD_MS == 0) {
+        toggle_injector();
+    }
+    track_injector();
+}
+
+static void valve_commands_finish(void)
+{
+    common_report();
+    sim_stat_print("command to actuation", &actuation_latency_ms, "ms");
+    sim_stat_print("command to RLCS confirmation", &confirmation_latency_ms, "ms");
+    sim_check(actuation_latency_ms.count + (awaiting_actuation ? 1 : 0) == commands_toggled,
+              "every injector command actuated");
+    sim_check(actuation_latency_ms.count > 0 &&
+              actuation_latency_ms.max < SIM_VALVE_ACTUATION_MS + 500,
+              "actuation within 500 ms of the valve's own travel time");
+    sim_check(polls_mostly_answered(), "at least 98% of polls answered");
+    // the bus is up from a few seconds in, so the logger should have heard
+    // nearly everything, bar what went out before then and what's still
+    // waiting for its partial flush
+    radio_mirror_stats_t mirror;
+    radio_mirror_get_stats(&mirror);
+    sim_check(mirror.bytes_dropped == 0 &&
+              mirror.bytes_mirrored + mirror.bytes_discarded + RADIO_MIRROR_BUFFER_LEN >=
+              sim_counters.uart_tx_bytes,
+              "everything sent over the radio is mirrored on CAN");
+}
+
+/* radio_loss: RLCS goes quiet for 30 s, vent must go to safe state */
+
+#define LOSS_AT_MS 30000
+#define RECOVER_AT_MS 60000
+static enum VALVE_STATE vent_before_loss, vent_during_loss, vent_after_recovery;
+static enum RADIO_PROTOCOL_VERSION version_during_loss;
+
+static void radio_loss_tick(uint32_t now_ms)
+{
+    if (now_ms == LOSS_AT_MS - 1) {
+        vent_before_loss = radio_get_expected_vent_valve_state();
+    } else if (now_ms == LOSS_AT_MS) {
+        sim_ground_set_silent(true);
+    } else if (now_ms == LOSS_AT_MS + TIME_NO_CONTACT_BEFORE_SAFE_STATE + 500) {
+        vent_during_loss = radio_get_expected_vent_valve_state();
+        version_during_loss = radio_protocol_version();
+    } else if (now_ms == RECOVER_AT_MS) {
+        sim_ground_set_silent(false);
+    } else if (now_ms == RECOVER_AT_MS + 5000) {
+        vent_after_recovery = radio_get_expected_vent_valve_state();
+    }
+}
+
+static void radio_loss_finish(void)
+{
+    common_report();
+    sim_check(vent_before_loss == VALVE_CLOSED, "vent follows RLCS before the loss");
+    sim_check(vent_during_loss == VALVE_OPEN, "vent goes to safe state (open) during the loss");
+    sim_check(vent_after_recovery == VALVE_CLOSED, "vent follows RLCS again after recovery");
+    sim_check(version_during_loss == RADIO_PROTOCOL_DEFAULT,
+              "board goes back to the default protocol version during the loss");
+    sim_check(sim_ground_protocol() == CLEAN_LINK_PROTOCOL &&
+              radio_protocol_version() == CLEAN_LINK_PROTOCOL,
+              "RLCS selects its protocol version again after recovery");
+}
+
+/*
+ * pad_hold: RLCS keeps the bus off for a few minutes while it waits. The
+ * board should mostly sleep, keep answering polls, keep millis() right, and
+ * come back to full speed when the bus is powered again
+ */
+
+#define HOLD_MEASURE_FROM_MS 20000
+#define HOLD_MEASURE_TO_MS 240000
+#define HOLD_POWER_ON_MS 240000
+static uint32_t hold_wakeups_start, hold_wakeups_end;
+static uint32_t hold_polls_start, hold_states_start;
+static uint32_t hold_polls, hold_states;
+static int32_t hold_max_clock_error_ms = 0;
+static int32_t hold_final_clock_error_ms = 0;
+
+static void pad_hold_setup(void)
+{
+    common_setup();
+    sim_ground_send_command(VALVE_CLOSED, VALVE_CLOSED, false, COMMAND_REPEAT_MS);
+}
+
+static void pad_hold_tick(uint32_t now_ms)
+{
+    int32_t clock_error = labs((int32_t) (millis() - now_ms));
+    if (clock_error > hold_max_clock_error_ms) {
+        hold_max_clock_error_ms = clock_error;
+    }
+    hold_final_clock_error_ms = clock_error;
+
+    if (now_ms == HOLD_MEASURE_FROM_MS) {
+        hold_wakeups_start = sim_counters.wakeups;
+        hold_polls_start = sim_ground_stats.polls_sent;
+        hold_states_start = sim_ground_stats.states_received;
+    } else if (now_ms == HOLD_MEASURE_TO_MS) {
+        hold_wakeups_end = sim_counters.wakeups;
+        hold_polls = sim_ground_stats.polls_sent - hold_polls_start;
+        hold_states = sim_ground_stats.states_received - hold_states_start;
+    }
+    if (now_ms == HOLD_POWER_ON_MS) {
+        sim_ground_send_command(VALVE_CLOSED, VALVE_CLOSED, true, COMMAND_REPEAT_MS);
+    }
+}
+
+static void pad_hold_finish(void)
+{
+    common_report();
+    double hold_s = (HOLD_MEASURE_TO_MS - HOLD_MEASURE_FROM_MS) / 1000.0;
+    double wakeups_per_s = (hold_wakeups_end - hold_wakeups_start) / hold_s;
+    printf("while unpowered: %.1f wakeups per second, %u of %u polls answered\n",
+           wakeups_per_s, hold_states, hold_polls);
+    printf("millis() error: max %d ms, %d ms at the end\n",
+           hold_max_clock_error_ms, hold_final_clock_error_ms);
+    sim_check(sim_bus_powered() && sim_ground_last_state()->bus_is_powered,
+              "bus powered again at the end");
+    sim_check(wakeups_per_s < 100, "fewer than 100 wakeups per second while unpowered");
+    sim_check(hold_states * 100 >= hold_polls * 98,
+              "at least 98% of polls answered while unpowered");
+    sim_check(hold_max_clock_error_ms <= 33, "millis() never more than one slow tick behind");
+    sim_check(hold_final_clock_error_ms <= 1, "millis() accurate again at full speed");
+    sim_check(sim_ground_last_state()->num_boards_connected == SIM_NUM_BOARDS,
+              "every board connected after powering back up");
+}
+
+/*
+ * flight_day: hours on the pad. Polling and command traffic the whole time,
+ * a tank fill, the injector being cycled, boards dying and coming back, an
+ * IMU that won't shut up, and a bus power cycle
+ */
+
+static uint32_t states_before_shutdown = 0;
+static uint32_t errors_flagged = 0, errors_cleared = 0;
+static int32_t fill_trend_psi_per_min = 0;
+static bool fill_trend_received = false;
+
+static void flight_day_tick(uint32_t now_ms)
+{
+
+    // fill the tank over the first hour
+    sim_boards_set_tank_pressure(now_ms < 3600000 ? now_ms / 4235 : 850);
+
+    if (now_ms % 600000 == 300000) {
+        toggle_injector();
+    }
+    track_injector();
+
+    // half way through the fill, RLCS asks for the pressure history and
+    // works out the fill rate from the bucket means (10 s apart)
+    if (now_ms == 1800000) {
+        sim_ground_request_telemetry(TELEM_TANK_PRESSURE);
+    } else if (now_ms == 1801000) {
+        uint8_t quantity;
+        const telem_summary_t *summary = sim_ground_last_telemetry(&quantity);
+        fill_trend_received = (quantity == TELEM_TANK_PRESSURE);
+        fill_trend_psi_per_min = ((int32_t) summary->bucket_means[1] -
+                                  summary->bucket_means[TELEM_SUMMARY_BUCKETS - 1]) *
+                                 6 / (TELEM_SUMMARY_BUCKETS - 2);
+        printf("pressure at 30 min: latest %u, %d psi/min from buckets, %d psi/min raw\n",
+               summary->latest, fill_trend_psi_per_min, summary->rate_per_min);
+    }
+
+    // a board drops out for 10 s every 37 minutes
+    if (now_ms % 2220000 == 1000000) {
+        sim_board_set_alive(SIM_ID_GPS, false);
+    } else if (now_ms % 2220000 == 1010000) {
+        sim_board_set_alive(SIM_ID_GPS, true);
+    }
+
+    // chatty IMU for ten minutes every two hours
+    if (now_ms % 7200000 == 4000000) {
+        sim_boards_set_imu_period_ms(5);
+    } else if (now_ms % 7200000 == 4600000) {
+        sim_boards_set_imu_period_ms(50);
+    }
+
+    // a board complains once an hour
+    if (now_ms % 3600000 == 1800000) {
+        sim_board_report_error(SIM_ID_LOGGER, E_BATT_UNDER_VOLTAGE);
+    } else if (now_ms % 3600000 == 1802000 && any_errors_active()) {
+        errors_flagged++;
+    } else if (now_ms % 3600000 == 1815000 && !any_errors_active()) {
+        // 20 nominal statuses at 2 per second clear it
+        errors_cleared++;
+    }
+
+    // bus power cycle: off for 5 minutes, two and a half hours in
+    if (now_ms == 9000000) {
+        states_before_shutdown = sim_ground_stats.states_received;
+        sim_ground_send_command(commanded_inj, VALVE_CLOSED, false, COMMAND_REPEAT_MS);
+    } else if (now_ms == 9300000) {
+        sim_ground_send_command(commanded_inj, VALVE_CLOSED, true, COMMAND_REPEAT_MS);
+    }
+}
+
+static void flight_day_finish(void)
+{
+    common_report();
+    sim_stat_print("command to actuation", &actuation_latency_ms, "ms");
+    sim_stat_print("command to RLCS confirmation", &confirmation_latency_ms, "ms");
+    sim_check(actuation_latency_ms.count + (awaiting_actuation ? 1 : 0) == commands_toggled,
+              "every injector command actuated");
+    sim_check(polls_mostly_answered(), "at least 98% of polls answered");
+    sim_check(sim_ground_stats.errors_by_type[E_BOARD_FEARED_DEAD] > 0,
+              "board dropouts reported");
+    // the tank fills at 60000 / 4235 = 14.2 psi per minute
+    sim_check(fill_trend_received &&
+              fill_trend_psi_per_min >= 12 && fill_trend_psi_per_min <= 16,
+              "fill rate from the telemetry summary matches the fill");
+    sim_check(errors_flagged == 4 && errors_cleared == 4,
+              "board errors flagged, then cleared by nominal statuses");
+    sim_check(sim_ground_last_state()->num_boards_connected == SIM_NUM_BOARDS,
+              "every board connected at the end");
+}
+
+/*
+ * error_burst: every board reports an error at once, which fills the radio
+ * board's error buffer. Measures how long it takes for all of them to get to
+ * RLCS
+ */
+
+#define BURST_AT_MS 10000
+// and RLCS asks how many errors there really were this long after it
+#define BURST_STATS_AFTER_MS 20000
+// and then something claiming to be board 0, which isn't a real board, sends
+// one error and is never heard from again
+#define BOARD_0_ERROR_AFTER_MS 5000
+static uint32_t errors_before_burst = 0, burst_errors = 0;
+static uint32_t last_burst_error_ms = 0;
+
+static void error_burst_tick(uint32_t now_ms)
+{
+    if (now_ms == BURST_AT_MS) {
+        errors_before_burst = sim_ground_stats.errors_received;
+        sim_board_report_error(SIM_ID_INJECTOR, E_BATT_UNDER_VOLTAGE);
+        sim_board_report_error(SIM_ID_SENSOR, E_BATT_UNDER_VOLTAGE);
+        sim_board_report_error(SIM_ID_LOGGER, E_BATT_UNDER_VOLTAGE);
+        sim_board_report_error(SIM_ID_GPS, E_BATT_UNDER_VOLTAGE);
+        sim_board_report_error(SIM_ID_IMU, E_BATT_UNDER_VOLTAGE);
+    } else if (now_ms == BURST_AT_MS + BOARD_0_ERROR_AFTER_MS) {
+        can_msg_t msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.sid = MSG_GENERAL_BOARD_STATUS | 0;
+        msg.data_len = 8;
+        msg.data[3] = E_BATT_UNDER_VOLTAGE;
+        sim_can_board_send(&msg);
+    } else if (now_ms == BURST_AT_MS + BURST_STATS_AFTER_MS) {
+        sim_ground_request_board_stats(BOARD_STATS_ERRORS);
+    } else if (now_ms > BURST_AT_MS && now_ms < BURST_AT_MS + BOARD_0_ERROR_AFTER_MS &&
+               sim_ground_stats.errors_received - errors_before_burst > burst_errors) {
+        burst_errors = sim_ground_stats.errors_received - errors_before_burst;
+        last_burst_error_ms = now_ms;
+    }
+}
+
+static void error_burst_finish(void)
+{
+    common_report();
+    uint32_t drain_ms = last_burst_error_ms - BURST_AT_MS;
+    printf("%u errors from the burst reached RLCS, the last one after %u ms\n",
+           burst_errors, drain_ms);
+    sim_check(burst_errors >= SIM_NUM_BOARDS, "every board's error reached RLCS");
+    sim_check(drain_ms < 5000, "RLCS has every error within 5 s");
+    error_stats_t errors;
+    get_error_stats(&errors);
+    sim_check(errors.dropped == 0, "no errors dropped on the radio board");
+    sim_check(!any_errors_active() && !sim_ground_last_state()->any_errors_detected,
+              "errors stop being active once every board is nominal again");
+    board_stats_t reported;
+    sim_check(sim_ground_board_stats(BOARD_STATS_ERRORS, &reported) &&
+              reported.counters[0] == errors.reported &&
+              reported.counters[1] == errors.coalesced &&
+              reported.counters[2] == errors.dropped &&
+              reported.counters[1] > 0 &&
+              reported.counters[0] > burst_errors,
+              "RLCS can ask how many errors were merged together");
+    sim_check(sim_ground_stats.error_repeats == errors.reported,
+              "RLCS hears how often each error it got was repeated");
+    sim_check(polls_mostly_answered(), "at least 98% of polls answered");
+    // a poll is 3 bytes up and the bundle about 30 down, so with the errors
+    // kept out of the way the whole round trip is under 50 ms
+    sim_check(sim_ground_stats.poll_latency_us.max < 50000,
+              "errors never hold up the answer to a poll");
+}
+
+/*
+ * noisy_link: the radio at the edge of its range, flipping a bit in one byte
+ * in NOISE_ONE_IN each way. RLCS switches to RADIO_PROTOCOL_V4 so that most
+ * of the frames that get hit are repaired rather than thrown away
+ */
+
+#define NOISE_ONE_IN 200
+// RLCS asks how the uplink's doing every so often from this long in, since
+// the question or the answer might not make it
+#define INPUT_STATS_FROM_MS 250000
+#define INPUT_STATS_PERIOD_MS 10000
+
+static void noisy_link_setup(void)
+{
+    setup_with_protocol(RADIO_PROTOCOL_V4);
+    sim_ground_set_noise(NOISE_ONE_IN);
+}
+
+static void noisy_link_tick(uint32_t now_ms)
+{
+    valve_commands_tick(now_ms);
+    if (now_ms >= INPUT_STATS_FROM_MS && now_ms % INPUT_STATS_PERIOD_MS == 0) {
+        sim_ground_request_board_stats(BOARD_STATS_RADIO_INPUT);
+    }
+}
+
+static void noisy_link_finish(void)
+{
+    uint16_t board_corrected, board_uncorrectable;
+    radio_fec_counts(&board_corrected, &board_uncorrectable);
+
+    common_report();
+    radio_parser_stats_t board_input;
+    radio_input_stats(&board_input);
+    printf("firmware FEC: %u commands fixed, %u uncorrectable\n",
+           board_corrected, board_uncorrectable);
+    printf("firmware parser: %u frames ok, %u bad checks, %u truncated, %u resyncs\n",
+           board_input.frames_ok, board_input.bad_checks, board_input.truncated,
+           board_input.resyncs);
+    sim_stat_print("command to actuation", &actuation_latency_ms, "ms");
+    sim_check(sim_ground_protocol() == RADIO_PROTOCOL_V4 &&
+              radio_protocol_version() == RADIO_PROTOCOL_V4,
+              "RLCS and the board agree on the error correcting protocol version");
+    sim_check(sim_ground_parser_stats()->fec_corrected > 0, "RLCS repairs frames from the board");
+    sim_check(board_corrected > 0, "the board repairs commands from RLCS");
+    board_stats_t reported;
+    sim_check(sim_ground_board_stats(BOARD_STATS_RADIO_INPUT, &reported) &&
+              reported.counters[0] > 0 && reported.counters[0] <= board_corrected &&
+              reported.counters[1] <= board_uncorrectable &&
+              reported.counters[2] > board_input.frames_ok / 2 &&
+              reported.counters[2] <= board_input.frames_ok,
+              "RLCS can ask how many of its frames the board repaired");
+    sim_check(sim_ground_stats.states_received * 100 >= sim_ground_stats.polls_sent * 95,
+              "at least 95% of polls answered");
+    sim_check(actuation_latency_ms.count + (awaiting_actuation ? 1 : 0) == commands_toggled,
+              "every injector command actuated");
+}
+
+/*
+ * push_telemetry: valve_commands, but RLCS subscribes instead of polling.
+ * The board should tell RLCS about each actuation as soon as it happens,
+ * rather than at the next poll, without RLCS sending anything but commands
+ */
+
+static void push_telemetry_setup(void)
+{
+    common_setup();
+    sim_ground_set_poll_kind(SIM_POLL_PUSH);
+}
+
+static void push_telemetry_finish(void)
+{
+    common_report();
+    sim_stat_print("command to actuation", &actuation_latency_ms, "ms");
+    sim_stat_print("command to RLCS confirmation", &confirmation_latency_ms, "ms");
+    printf("radio bytes: %u up, %u down\n", sim_counters.uart_rx_bytes,
+           sim_counters.uart_tx_bytes);
+    sim_check(actuation_latency_ms.count + (awaiting_actuation ? 1 : 0) == commands_toggled,
+              "every injector command actuated");
+    sim_check(confirmation_latency_ms.count > 0 &&
+              confirmation_latency_ms.max < actuation_latency_ms.max + 100,
+              "RLCS hears about each actuation within 100 ms");
+    sim_check(sim_ground_stats.polls_sent == 0 && sim_ground_stats.subscribes_sent <= 2,
+              "RLCS subscribes once instead of polling");
+    sim_check(sim_ground_stats.states_received * POLL_PERIOD_MS >= sim_now_ms() * 98 / 100,
+              "a state at least every push period");
+    sim_check(sim_ground_stats.bad_frames == 0 &&
+              sim_ground_parser_stats()->bad_checks == 0, "no bad frames on a clean link");
+}
+
+/*
+ * acked_commands: valve_commands, but RLCS sends acknowledged commands, and
+ * only sends one again if its acknowledgement doesn't come, or every so
+ * often in case the board's been reset, instead of every COMMAND_REPEAT_MS
+ */
+
+static void acked_commands_setup(void)
+{
+    sim_ground_set_acked_commands(true);
+    common_setup();
+}
+
+static void acked_commands_finish(void)
+{
+    common_report();
+    sim_stat_print("command to actuation", &actuation_latency_ms, "ms");
+    sim_stat_print("command to RLCS confirmation", &confirmation_latency_ms, "ms");
+    printf("radio bytes: %u up, %u down\n", sim_counters.uart_rx_bytes,
+           sim_counters.uart_tx_bytes);
+    sim_check(actuation_latency_ms.count + (awaiting_actuation ? 1 : 0) == commands_toggled,
+              "every injector command actuated");
+    // the one from setup, and every toggle but one still on its way
+    sim_check(sim_ground_stats.commands_acked + (awaiting_actuation ? 1 : 0) ==
+              commands_toggled + 1 &&
+              sim_ground_stats.commands_rejected == 0,
+              "every command acknowledged, none turned away");
+    sim_check(sim_ground_stats.command_ack_latency_us.count > 1 &&
+              sim_ground_stats.command_ack_latency_us.max < 100000,
+              "commands acknowledged within 100 ms once the board is up");
+    sim_check(sim_ground_stats.commands_sent * COMMAND_REPEAT_MS * 3 < sim_now_ms(),
+              "less than a third of the commands that repeating them would send");
+    sim_check(polls_mostly_answered(), "at least 98% of polls answered");
+    sim_check(radio_get_expected_vent_valve_state() == VALVE_CLOSED,
+              "the board never went to safe state");
+}
+
+/*
+ * bridge: the boards as in every other scenario, but with the XBee link
+ * handed to whatever's on the other end of -u instead of the RLCS model,
+ * which sits idle. Runs in real time, and is how rlcs_load talks to the
+ * firmware. There's nothing to check, since the other end keeps its own
+ * score; the report just says what the firmware saw
+ */
+
+static void bridge_setup(void)
+{
+    if (!sim_bridge_active()) {
+        fprintf(stderr, "bridge needs a link, see -u\n");
+        exit(2);
+    }
+    sim_boards_set_tank_pressure(420);
+}
+
+static void bridge_finish(void)
+{
+    common_report();
+    radio_parser_stats_t board_input;
+    radio_input_stats(&board_input);
+    printf("firmware parser: %u frames ok, %u bad checks, %u truncated, %u resyncs\n",
+           board_input.frames_ok, board_input.bad_checks, board_input.truncated,
+           board_input.resyncs);
+    printf("radio bytes: %u up, %u down\n", sim_counters.uart_rx_bytes,
+           sim_counters.uart_tx_bytes);
+}
+
+const sim_scenario_t sim_scenarios[] = {
+    { "powerup", "boot, power the bus and find every board",
+      60, &common_setup, &powerup_tick, &powerup_finish },
+    { "board_death", "a board goes silent and comes back",
+      120, &common_setup, &board_death_tick, &board_death_finish },
+    { "valve_commands", "RLCS cycles the injector valve every 10 s",
+      300, &common_setup, &valve_commands_tick, &valve_commands_finish },
+    { "radio_loss", "the radio link drops out for 30 s",
+      120, &common_setup, &radio_loss_tick, &radio_loss_finish },
+    { "pad_hold", "the bus stays off for four minutes, then comes back",
+      300, &pad_hold_setup, &pad_hold_tick, &pad_hold_finish },
+    { "error_burst", "every board reports an error at once",
+      60, &common_setup, &error_burst_tick, &error_burst_finish },
+    { "push_telemetry", "valve_commands, with RLCS subscribed instead of polling",
+      300, &push_telemetry_setup, &valve_commands_tick, &push_telemetry_finish },
+    { "acked_commands", "valve_commands, with commands acknowledged instead of repeated",
+      300, &acked_commands_setup, &valve_commands_tick, &acked_commands_finish },
+    { "noisy_link", "one byte in 200 corrupted each way, with error correction",
+      300, &noisy_link_setup, &noisy_link_tick, &noisy_link_finish },
+    { "bridge", "the XBee link on -u, in real time, for a ground station or rlcs_load",
+      3600, &bridge_setup, NULL, &bridge_finish, true },
+    { "flight_day", "four hours on the pad with everything going on",
+      4 * 3600, &common_setup, &flight_day_tick, &flight_day_finish },
+};
+
+const size_t sim_num_scenarios = sizeof(sim_scenarios) / sizeof(sim_scenarios[0]);
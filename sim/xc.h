@@ -0,0 +1,159 @@
+#ifndef SIM_XC_H_
+#define SIM_XC_H_
+
+/*
+ * Stand-in for microchip's xc.h when building the firmware for the host
+ * simulator. Instead of mapping register names onto SFR addresses, every
+ * register that the firmware touches is a field of one big virtual register
+ * file (sim_regs), which the virtual peripherals in sim_core.c and sim_can.c
+ * read and write as simulated time passes.
+ *
+ * Only the registers and bits that the firmware actually uses are defined
+ * here. If you touch a new register in the firmware, add it here too, the
+ * simulator build will tell you if you forgot.
+ */
+
+#include <stdint.h>
+
+// the register file is only ever written by "hardware" inside sim_sleep, or
+// by the firmware, so plain bitfields are fine. Bit positions match the
+// PIC18F26K83 datasheet where anyone is likely to care.
+#define SIM_REG8(name, fields) \
+    typedef union { uint8_t reg; struct fields bits; } sim_##name##_t
+
+SIM_REG8(INTCON0, { unsigned INT0EDG:1; unsigned INT1EDG:1; unsigned INT2EDG:1;
+                    unsigned :2; unsigned IPEN:1; unsigned GIEL:1; unsigned GIE:1; });
+SIM_REG8(CPUDOZE, { unsigned DOZE:3; unsigned :1; unsigned DOE:1; unsigned ROI:1;
+                    unsigned DOZEN:1; unsigned IDLEN:1; });
+SIM_REG8(OSCCON3, { unsigned :3; unsigned NOSCR:1; unsigned ORDY:1; unsigned :1;
+                    unsigned SOSCPWR:1; unsigned CSWHOLD:1; });
+SIM_REG8(FVRCON, { unsigned ADFVR:2; unsigned CDAFVR:2; unsigned TSRNG:1;
+                   unsigned TSEN:1; unsigned RDY:1; unsigned EN:1; });
+SIM_REG8(ADCON0, { unsigned GO:1; unsigned :1; unsigned FM:1; unsigned :1;
+                   unsigned CS:1; unsigned :1; unsigned CONT:1; unsigned ON:1; });
+SIM_REG8(ADREF, { unsigned PREF:2; unsigned :2; unsigned NREF:1; unsigned :3; });
+SIM_REG8(T0CON0, { unsigned OUTPS:4; unsigned MD16:1; unsigned OUT:1; unsigned :1;
+                   unsigned EN:1; });
+SIM_REG8(T0CON1, { unsigned CKPS:4; unsigned ASYNC:1; unsigned CS:3; });
+SIM_REG8(PIE1, { unsigned ADIE:1; unsigned ADTIE:1; unsigned :6; });
+SIM_REG8(PIR1, { unsigned ADIF:1; unsigned ADTIF:1; unsigned :6; });
+SIM_REG8(PIE3, { unsigned :3; unsigned U1RXIE:1; unsigned U1TXIE:1; unsigned U1EIE:1;
+                 unsigned U1IE:1; unsigned TMR0IE:1; });
+SIM_REG8(PIR3, { unsigned :3; unsigned U1RXIF:1; unsigned U1TXIF:1; unsigned U1EIF:1;
+                 unsigned U1IF:1; unsigned TMR0IF:1; });
+SIM_REG8(U1CON0, { unsigned MODE:4; unsigned RXEN:1; unsigned TXEN:1; unsigned ABDEN:1;
+                   unsigned BRGS:1; });
+SIM_REG8(U1CON1, { unsigned SENDB:1; unsigned BRKOVR:1; unsigned :1; unsigned RXBIMD:1;
+                   unsigned WUE:1; unsigned :2; unsigned ON:1; });
+SIM_REG8(U1CON2, { unsigned FLO:2; unsigned TXPOL:1; unsigned C0EN:1; unsigned STP:2;
+                   unsigned RXPOL:1; unsigned RUNOVF:1; });
+SIM_REG8(PORT, { unsigned b0:1; unsigned b1:1; unsigned b2:1; unsigned b3:1;
+                 unsigned b4:1; unsigned b5:1; unsigned b6:1; unsigned b7:1; });
+
+/*
+ * U1TXB can't tell us when it's been written to, so the virtual UART parks it
+ * at this out of range value whenever the transmit buffer is empty. Anything
+ * else means the firmware has handed us a byte to send.
+ */
+#define SIM_U1TXB_EMPTY 0x100
+
+typedef struct {
+    sim_INTCON0_t intcon0;
+    sim_CPUDOZE_t cpudoze;
+    uint8_t osccon1, osccon2;
+    sim_OSCCON3_t osccon3;
+    sim_FVRCON_t fvrcon;
+    sim_ADCON0_t adcon0;
+    sim_ADREF_t adref;
+    uint8_t adclk, adpch, adresl, adresh;
+    sim_T0CON0_t t0con0;
+    sim_T0CON1_t t0con1;
+    uint8_t tmr0l;
+    sim_PIE1_t pie1;
+    sim_PIR1_t pir1;
+    sim_PIE3_t pie3;
+    sim_PIR3_t pir3;
+    uint8_t pie5, pir5;
+    sim_U1CON0_t u1con0;
+    sim_U1CON1_t u1con1;
+    sim_U1CON2_t u1con2;
+    uint8_t u1brgl, u1brgh, u1errir;
+    uint16_t u1txb;
+    uint8_t u1rxb;
+    uint8_t u1rxpps, u1ctspps, rb4pps, rb2pps, rc3pps, canrxpps;
+    uint8_t ansela, anselb, anselc;
+    uint8_t trisa, trisb, trisc;
+    sim_PORT_t lata, latb, latc;
+} sim_registers_t;
+
+extern sim_registers_t sim_regs;
+
+#define INTCON0bits  sim_regs.intcon0.bits
+#define CPUDOZEbits  sim_regs.cpudoze.bits
+#define OSCCON1      sim_regs.osccon1
+#define OSCCON2      sim_regs.osccon2
+#define OSCCON3bits  sim_regs.osccon3.bits
+#define FVRCONbits   sim_regs.fvrcon.bits
+#define ADCON0bits   sim_regs.adcon0.bits
+#define ADREFbits    sim_regs.adref.bits
+#define ADCLK        sim_regs.adclk
+#define ADPCH        sim_regs.adpch
+#define ADRESL       sim_regs.adresl
+#define ADRESH       sim_regs.adresh
+#define T0CON0bits   sim_regs.t0con0.bits
+#define T0CON1bits   sim_regs.t0con1.bits
+#define TMR0L        sim_regs.tmr0l
+#define PIE1bits     sim_regs.pie1.bits
+#define PIR1bits     sim_regs.pir1.bits
+#define PIE3bits     sim_regs.pie3.bits
+#define PIR3bits     sim_regs.pir3.bits
+#define PIR3         sim_regs.pir3.reg
+#define PIE5         sim_regs.pie5
+#define PIR5         sim_regs.pir5
+#define U1CON0bits   sim_regs.u1con0.bits
+#define U1CON1bits   sim_regs.u1con1.bits
+#define U1CON2bits   sim_regs.u1con2.bits
+#define U1BRGL       sim_regs.u1brgl
+#define U1BRGH       sim_regs.u1brgh
+#define U1ERRIR      sim_regs.u1errir
+#define U1TXB        sim_regs.u1txb
+#define U1RXB        sim_regs.u1rxb
+#define U1RXPPS      sim_regs.u1rxpps
+#define U1CTSPPS     sim_regs.u1ctspps
+#define RB4PPS       sim_regs.rb4pps
+#define RB2PPS       sim_regs.rb2pps
+#define RC3PPS       sim_regs.rc3pps
+#define CANRXPPS     sim_regs.canrxpps
+#define ANSELA       sim_regs.ansela
+#define ANSELB       sim_regs.anselb
+#define ANSELC       sim_regs.anselc
+#define TRISA        sim_regs.trisa
+#define TRISB        sim_regs.trisb
+#define TRISC        sim_regs.trisc
+#define LATA         sim_regs.lata.reg
+#define LATB         sim_regs.latb.reg
+#define LATC         sim_regs.latc.reg
+#define LATA2        sim_regs.lata.bits.b2
+#define LATA4        sim_regs.lata.bits.b4
+#define LATA5        sim_regs.lata.bits.b5
+#define LATC0        sim_regs.latc.bits.b0
+#define LATC1        sim_regs.latc.bits.b1
+#define LATC4        sim_regs.latc.bits.b4
+
+/*
+ * Compiler intrinsics. SLEEP is where simulated time passes: the virtual
+ * peripherals run until something raises an interrupt, and the ISR is called
+ * from in there.
+ */
+void sim_sleep(void);
+void sim_delay_us(uint32_t us);
+
+#define __interrupt(...)
+#define SLEEP()         sim_sleep()
+#define NOP()           do {} while (0)
+#define di()            (INTCON0bits.GIE = 0)
+#define ei()            (INTCON0bits.GIE = 1)
+#define __delay_ms(x)   sim_delay_us((uint32_t) (x) * 1000)
+#define __delay_us(x)   sim_delay_us(x)
+
+#endif
@@ -4,6 +4,9 @@
 #include "pic18_time.h"
 #include "error.h"
 #include "radio_handler.h"
+#include "telemetry_history.h"
+#include <stddef.h> // for NULL
+#include <string.h> // for memset
 
 /* File local macros */
 
@@ -22,20 +25,63 @@
  */
 #define MAX_CONSECUTIVE_NOMINALS 20
 
+/*
+ * Message types are the top 6 bits of the 11 bit SID (get_message_type
+ * masks off the bottom 5, which are the board unique id), so there are 64 of
+ * them, and shifting a type down by 5 gives a table index
+ */
+#define NUM_MESSAGE_TYPES 64
+#define MESSAGE_TYPE_INDEX(type) (((type) >> 5) & (NUM_MESSAGE_TYPES - 1))
+
 /* Internal data */
 
 /*
- * As we keep more and more data about every board (like whether there are
- * any errors present, or what board type it is, etc), put that in this
- * struct. Whenever a message is received, the proper one of these structs
- * (board[unique_id]) is updated with whatever it contains
+ * As we keep more and more data about every board (like what board type it
+ * is, etc), put that in this struct. Whenever a message is received, the
+ * proper one of these structs (board[unique_id]) is updated with whatever it
+ * contains. Yes/no facts about boards go in the bitsets below instead
  */
 static struct {
-    bool valid; //if we have ever received a message from the board, this is true
     uint32_t time_last_message_received_ms;
-    uint8_t consecutive_nominals; //how many nominal statuses we've received in a row
 } boards[MAX_BOARD_UNIQUE_ID + 1]; //+1 because array indexing starts at 0
 
+/*
+ * How many nominal statuses we've received in a row from each board. Kept
+ * out of boards[] so that it packs into one byte per board
+ */
+static uint8_t consecutive_nominals[MAX_BOARD_UNIQUE_ID + 1];
+
+/*
+ * One bit per board unique id (bit n is board n). A board's bit is set when
+ * we receive a message from it, and cleared when it times out
+ */
+static uint16_t valid_boards = 0;
+#define BOARD_BIT(id) ((uint16_t) 1 << (id))
+
+/*
+ * Every valid board (except board 0, which we never count) is kept in a
+ * queue, ordered by when it will time out. Every board gets the same
+ * timeout, so the board that we heard from longest ago is always at the
+ * head. Hearing from a board moves it to the tail, and checking for dead
+ * boards only ever has to look at the head. Both are constant time, no
+ * matter how many boards there are.
+ *
+ * The queue is a doubly linked list, using board unique ids as the links
+ */
+#define NO_BOARD 0xFF
+static uint8_t deadline_head = NO_BOARD;
+static uint8_t deadline_tail = NO_BOARD;
+static uint8_t deadline_next[MAX_BOARD_UNIQUE_ID + 1];
+static uint8_t deadline_prev[MAX_BOARD_UNIQUE_ID + 1];
+
+/*
+ * The injector valve state goes unknown when the injector board times out,
+ * which only works if the two timeouts are the same
+ */
+#if MIN_TIME_BETWEEN_VALVE_UPDATE_MS != MIN_TIME_BETWEEN_BOARD_HEARTBEAT_MS
+#error "valve update timeout must match board heartbeat timeout"
+#endif
+
 /*
  * Keep track of the unique ids of the injector board. If we haven't
  * heard from one of it yet, it's unique ID will be recorded as 0
@@ -50,15 +96,19 @@ static uint8_t  inj_board_unique_id = 0;
 static enum VALVE_STATE  inj_valve_state;
 
 /*
- * Keep track of how many boards we've heard from
+ * Keep track of how many boards we've heard from. This is the number of
+ * boards in the deadline queue
  */
 static uint8_t connected_boards = 0;
 
 /*
- * If we see any error ever, set this to true. If, after that, we receive
- * MAX_CONSECUTIVE_NOMINALS E_NOMINAL messages from that board, mark this false
+ * One bit per board unique id, same as valid_boards. A board's bit is set
+ * when it sends us an error, and cleared once it has sent
+ * MAX_CONSECUTIVE_NOMINALS E_NOMINAL messages in a row after that. Only
+ * boards that are also in valid_boards count towards any_errors_active, and
+ * board 0 never does
  */
-static bool errors_active = false;
+static uint16_t error_boards = 0;
 
 /*
  * Every time we get a pressure reading from sensor, put it here
@@ -77,159 +127,296 @@ static uint16_t inj_battery_voltage_mv = 0;
 static uint8_t lat_deg, lat_min, lat_dmin, lat_dir;
 static uint8_t lon_deg, lon_min, lon_dmin, lon_dir;
 
+/*
+ * IMU readings, GPS altitude and GPS time. A last_received_ms of 0 means we've
+ * never received that message. The sums and counts are the block that's
+ * currently being averaged, they get divided out into the average fields
+ * every IMU_DECIMATION samples
+ */
+static imu_reading_t imu_readings[IMU_NUM_SENSORS];
+static int32_t imu_sums[IMU_NUM_SENSORS][3];
+static uint8_t imu_sample_counts[IMU_NUM_SENSORS];
+
+static gps_altitude_t gps_altitude;
+static uint32_t altitude_sum;
+static uint8_t altitude_sample_count;
+
+static gps_time_t gps_time;
+
+/*
+ * How many of each message type we've received, indexed by
+ * MESSAGE_TYPE_INDEX. Saturates rather than wrapping
+ */
+static uint32_t message_counts[NUM_MESSAGE_TYPES];
+
+/*
+ * One entry in the message dispatch table, see message_handlers below
+ */
+struct message_handler {
+    bool refreshes_liveness;
+    void (*handle)(const can_msg_t *msg, uint8_t sender_unique_id);
+};
+
 /* Private function declarations */
+static void refresh_board(uint8_t unique_id, uint32_t now_ms);
 static void update_all_timeouts(void);
-static void update_errors_active(void);
+
+/* Message handlers */
+
+static void handle_general_board_status(const can_msg_t *msg, uint8_t sender_unique_id)
+{
+    uint8_t error_code = msg->data[3];
+    if (error_code == E_NOMINAL) {
+        if (consecutive_nominals[sender_unique_id] < MAX_CONSECUTIVE_NOMINALS) {
+            consecutive_nominals[sender_unique_id]++;
+            if (consecutive_nominals[sender_unique_id] == MAX_CONSECUTIVE_NOMINALS) {
+                error_boards &= ~BOARD_BIT(sender_unique_id);
+            }
+        }
+    } else {
+        consecutive_nominals[sender_unique_id] = 0;
+        // board 0 isn't a real board, and is never timed out, so if it
+        // counted it could keep errors active forever
+        if (sender_unique_id != 0) {
+            error_boards |= BOARD_BIT(sender_unique_id);
+        }
+        report_error(sender_unique_id,
+                     error_code,
+                     msg->data[4],
+                     msg->data[5],
+                     msg->data[6],
+                     msg->data[7]);
+    }
+}
+
+/* Update our idea of the last inj valve state */
+static void handle_inj_valve_status(const can_msg_t *msg, uint8_t sender_unique_id)
+{
+    //validate byte 3 (valve state), and if it's ok remember it
+    if (sender_unique_id != inj_board_unique_id &&
+        inj_board_unique_id != 0) {
+        //this is very very bad. You cannot have 2 injector boards
+        report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, sender_unique_id, inj_board_unique_id, 0, 0);
+    } else if (msg->data[3] != VALVE_OPEN &&
+               msg->data[3] != VALVE_CLOSED &&
+               msg->data[3] != VALVE_UNK &&
+               msg->data[3] != VALVE_ILLEGAL) {
+        //this is also bad, this is not a valid valve_state
+        report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, 0, 0, 0, 0);
+    } else {
+        //yay, we know the state now
+        inj_valve_state = msg->data[3];
+        inj_board_unique_id = sender_unique_id;
+    }
+}
+
+/* Handle this message by updating last_tank_pressure or the inj battery */
+static void handle_sensor_analog(const can_msg_t *msg, uint8_t sender_unique_id)
+{
+    if (msg->data[2] == SENSOR_PRESSURE_OX) {
+        // we have a pressure, update the pressure
+        last_tank_pressure = ((uint16_t) msg->data[3] << 8) | msg->data[4];
+        telemetry_record(TELEM_TANK_PRESSURE, last_tank_pressure);
+    }
+    if (msg->data[2] == SENSOR_INJ_BATT) {
+        // we have a inj battery voltage, update the battery voltage
+        inj_battery_voltage_mv = ((uint16_t) msg->data[3] << 8) | msg->data[4];
+        telemetry_record(TELEM_INJ_BATT_MV, inj_battery_voltage_mv);
+    }
+}
+
+/* When we get an update on GPS position, update our internal records of
+ * position. */
+static void handle_gps_latitude(const can_msg_t *msg, uint8_t sender_unique_id)
+{
+    if (!get_gps_lat(msg, &lat_deg, &lat_min, &lat_dmin, &lat_dir)) {
+        report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, 0, 0, 0, 0);
+    }
+}
+
+static void handle_gps_longitude(const can_msg_t *msg, uint8_t sender_unique_id)
+{
+    if (!get_gps_lon(msg, &lon_deg, &lon_min, &lon_dmin, &lon_dir)) {
+        report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, 0, 0, 0, 0);
+    }
+}
+
+/* We treat all the bytes in the debug_radio_cmd message as though we just
+   received them from the radio. ie we hand them to the radio handler */
+static void handle_debug_radio_cmd(const can_msg_t *msg, uint8_t sender_unique_id)
+{
+    uint8_t i;
+    for (i = 0; i < msg->data_len; ++i) {
+        radio_handle_input_character(msg->data[i]);
+    }
+}
+
+/*
+ * IMU messages are a 2 byte timestamp followed by x, y and z, each a 16 bit
+ * two's complement number, most significant byte first
+ */
+static void handle_imu_data(enum IMU_SENSOR sensor, const can_msg_t *msg,
+                            uint8_t sender_unique_id)
+{
+    if (msg->data_len < 8) {
+        report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, 0, 0, 0, 0);
+        return;
+    }
+    imu_reading_t *reading = &imu_readings[sensor];
+    uint8_t axis;
+    for (axis = 0; axis < 3; ++axis) {
+        reading->last[axis] = (int16_t) (((uint16_t) msg->data[2 + 2 * axis] << 8) |
+                                         msg->data[3 + 2 * axis]);
+        imu_sums[sensor][axis] += reading->last[axis];
+    }
+    //the dispatcher just refreshed the sender, so this is the time now
+    reading->last_received_ms = boards[sender_unique_id].time_last_message_received_ms;
+
+    if (++imu_sample_counts[sensor] == IMU_DECIMATION) {
+        for (axis = 0; axis < 3; ++axis) {
+            reading->average[axis] = imu_sums[sensor][axis] / IMU_DECIMATION;
+            imu_sums[sensor][axis] = 0;
+        }
+        imu_sample_counts[sensor] = 0;
+    }
+}
+
+static void handle_sensor_acc(const can_msg_t *msg, uint8_t sender_unique_id)
+{
+    handle_imu_data(IMU_ACC, msg, sender_unique_id);
+}
+
+static void handle_sensor_gyro(const can_msg_t *msg, uint8_t sender_unique_id)
+{
+    handle_imu_data(IMU_GYRO, msg, sender_unique_id);
+}
+
+static void handle_sensor_mag(const can_msg_t *msg, uint8_t sender_unique_id)
+{
+    handle_imu_data(IMU_MAG, msg, sender_unique_id);
+}
+
+/* 3 byte timestamp, altitude (16 bits), decimal altitude, units */
+static void handle_gps_altitude(const can_msg_t *msg, uint8_t sender_unique_id)
+{
+    if (msg->data_len < 7) {
+        report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, 0, 0, 0, 0);
+        return;
+    }
+    gps_altitude.altitude = ((uint16_t) msg->data[3] << 8) | msg->data[4];
+    gps_altitude.daltitude = msg->data[5];
+    gps_altitude.units = msg->data[6];
+    gps_altitude.last_received_ms = boards[sender_unique_id].time_last_message_received_ms;
+
+    altitude_sum += gps_altitude.altitude;
+    if (++altitude_sample_count == IMU_DECIMATION) {
+        gps_altitude.average_altitude = altitude_sum / IMU_DECIMATION;
+        altitude_sum = 0;
+        altitude_sample_count = 0;
+    }
+}
+
+/* 3 byte timestamp, then UTC hours, minutes, seconds, hundredths */
+static void handle_gps_timestamp(const can_msg_t *msg, uint8_t sender_unique_id)
+{
+    if (msg->data_len < 7) {
+        report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, 0, 0, 0, 0);
+        return;
+    }
+    gps_time.hours = msg->data[3];
+    gps_time.minutes = msg->data[4];
+    gps_time.seconds = msg->data[5];
+    gps_time.dseconds = msg->data[6];
+    gps_time.last_received_ms = boards[sender_unique_id].time_last_message_received_ms;
+}
+
+/*
+ * What to do with each message type, indexed by MESSAGE_TYPE_INDEX. If
+ * refreshes_liveness is set, receiving that message counts as hearing from
+ * the board that sent it. handle, if not NULL, is then called with the
+ * message. Adding a message type is just adding a line here.
+ *
+ * Message types that aren't listed get all zeros, so they're counted in
+ * message_counts but otherwise ignored. That's either a board sending a SID
+ * it shouldn't, or a message type that we added to canlib and haven't
+ * handled here. We don't throw an error for those because there's a lot of
+ * noise from malformed messages that doesn't need to be reported to RLCS.
+ *
+ * MSG_DEBUG_PRINTF, MSG_DEBUG_MSG, MSG_LEDS_ON and MSG_LEDS_OFF are
+ * deliberately left out, they don't even count as hearing from the sender.
+ * MSG_VENT_VALVE_STATUS is left out because vent board is dead.
+ */
+static const struct message_handler message_handlers[NUM_MESSAGE_TYPES] = {
+    [MESSAGE_TYPE_INDEX(MSG_GENERAL_BOARD_STATUS)] = { true, &handle_general_board_status },
+    [MESSAGE_TYPE_INDEX(MSG_INJ_VALVE_STATUS)]     = { true, &handle_inj_valve_status },
+    [MESSAGE_TYPE_INDEX(MSG_SENSOR_ANALOG)]        = { true, &handle_sensor_analog },
+    [MESSAGE_TYPE_INDEX(MSG_GPS_LATITUDE)]         = { true, &handle_gps_latitude },
+    [MESSAGE_TYPE_INDEX(MSG_GPS_LONGITUDE)]        = { true, &handle_gps_longitude },
+    [MESSAGE_TYPE_INDEX(MSG_DEBUG_RADIO_CMD)]      = { false, &handle_debug_radio_cmd },
+    [MESSAGE_TYPE_INDEX(MSG_SENSOR_ACC)]           = { true, &handle_sensor_acc },
+    [MESSAGE_TYPE_INDEX(MSG_SENSOR_GYRO)]          = { true, &handle_sensor_gyro },
+    [MESSAGE_TYPE_INDEX(MSG_SENSOR_MAG)]           = { true, &handle_sensor_mag },
+    [MESSAGE_TYPE_INDEX(MSG_GPS_ALTITUDE)]         = { true, &handle_gps_altitude },
+    [MESSAGE_TYPE_INDEX(MSG_GPS_TIMESTAMP)]        = { true, &handle_gps_timestamp },
+
+    /* these only tell us that the sender is alive */
+    [MESSAGE_TYPE_INDEX(MSG_VENT_VALVE_CMD)]       = { true, NULL },
+    [MESSAGE_TYPE_INDEX(MSG_INJ_VALVE_CMD)]        = { true, NULL },
+    [MESSAGE_TYPE_INDEX(MSG_GPS_INFO)]             = { true, NULL },
+    [MESSAGE_TYPE_INDEX(MSG_GENERAL_CMD)]          = { true, NULL },
+};
 
 /* Public function definitions */
 void init_sotscon(void)
 {
     /* Mark all boards as invalid */
-    uint8_t i;
-    for (i = 0; i <= MAX_BOARD_UNIQUE_ID; ++i) {
-        boards[i].valid = false;
-    }
+    valid_boards = 0;
+    error_boards = 0;
+    memset(consecutive_nominals, 0, sizeof(consecutive_nominals));
+    deadline_head = NO_BOARD;
+    deadline_tail = NO_BOARD;
 
     /* Set connected boards, unique id's, and valve states */
     connected_boards = 0;
     inj_board_unique_id = 0;
+    memset(message_counts, 0, sizeof(message_counts));
+    memset(imu_readings, 0, sizeof(imu_readings));
+    memset(imu_sums, 0, sizeof(imu_sums));
+    memset(imu_sample_counts, 0, sizeof(imu_sample_counts));
+    memset(&gps_altitude, 0, sizeof(gps_altitude));
+    altitude_sum = 0;
+    altitude_sample_count = 0;
+    memset(&gps_time, 0, sizeof(gps_time));
     inj_valve_state = VALVE_UNK;
 }
 
 void handle_incoming_can_message(const can_msg_t *msg)
 {
-    uint8_t i; //used for MSG_DEBUG_RADIO_CMD, can't declare in case statement
     uint8_t sender_unique_id = get_board_unique_id(msg);
+    uint8_t type_index = MESSAGE_TYPE_INDEX(get_message_type(msg));
+
+    if (message_counts[type_index] != UINT32_MAX) {
+        message_counts[type_index]++;
+    }
+
     if (sender_unique_id > MAX_BOARD_UNIQUE_ID) {
         report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, 0, 0, 0, 0);
-    } else {
-        switch (get_message_type(msg)) {
-            case MSG_GENERAL_BOARD_STATUS:
-                boards[sender_unique_id].valid = true;
-                boards[sender_unique_id].time_last_message_received_ms = millis();
-                uint8_t error_code = msg->data[3];
-                if (error_code == E_NOMINAL) {
-                    if (boards[sender_unique_id].consecutive_nominals < MAX_CONSECUTIVE_NOMINALS) {
-                        boards[sender_unique_id].consecutive_nominals++;
-                    } else {
-                        update_errors_active();
-                    }
-                } else {
-                    boards[sender_unique_id].consecutive_nominals = 0;
-                    errors_active = true;
-                    report_error(sender_unique_id,
-                                 error_code,
-                                 msg->data[4],
-                                 msg->data[5],
-                                 msg->data[6],
-                                 msg->data[7]);
-                }
-                break;
-
-            case MSG_VENT_VALVE_STATUS:
-                //vent board is dead, we ignore these messages
-                break;
-
-            /* Update our idea of the last inj valve state */
-            case MSG_INJ_VALVE_STATUS:
-                boards[sender_unique_id].valid = true;
-                boards[sender_unique_id].time_last_message_received_ms = millis();
-
-                //validate byte 3 (valve state), and if it's ok remember it
-                if (sender_unique_id != inj_board_unique_id &&
-                    inj_board_unique_id != 0) {
-                    //this is very very bad. You cannot have 2 injector boards
-                    report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, sender_unique_id, inj_board_unique_id, 0, 0);
-                } else if (msg->data[3] != VALVE_OPEN &&
-                           msg->data[3] != VALVE_CLOSED &&
-                           msg->data[3] != VALVE_UNK &&
-                           msg->data[3] != VALVE_ILLEGAL) {
-                    //this is also bad, this is not a valid valve_state
-                    report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, 0, 0, 0, 0);
-                } else {
-                    //yay, we know the state now
-                    inj_valve_state = msg->data[3];
-                    inj_board_unique_id = sender_unique_id;
-                }
-                break;
-
-            /* Handle this message by updating last_tank_pressure, then updating last
-             * time we've heard from that board
-             */
-            case MSG_SENSOR_ANALOG:
-                if (msg->data[2] == SENSOR_PRESSURE_OX) {
-                    // we have a pressure, update the pressure
-                    last_tank_pressure = ((uint16_t) msg->data[3] << 8) | msg->data[4];
-                }
-                if (msg->data[2] == SENSOR_INJ_BATT) {
-                    // we have a inj battery voltage, update the battery voltage
-                    inj_battery_voltage_mv = ((uint16_t) msg->data[3] << 8) | msg->data[4];
-                }
-                boards[sender_unique_id].valid = true;
-                boards[sender_unique_id].time_last_message_received_ms = millis();
-                break;
-
-            /* When we get an update on GPS position, update our internal
-             * records of position.
-             */
-            case MSG_GPS_LATITUDE:
-                if (!get_gps_lat(msg, &lat_deg, &lat_min, &lat_dmin, &lat_dir)) {
-                    report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, 0, 0, 0, 0);
-                }
-                boards[sender_unique_id].valid = true;
-                boards[sender_unique_id].time_last_message_received_ms = millis();
-                break;
-            case MSG_GPS_LONGITUDE:
-                if (!get_gps_lon(msg, &lon_deg, &lon_min, &lon_dmin, &lon_dir)) {
-                    report_error(BOARD_UNIQUE_ID, E_ILLEGAL_CAN_MSG, 0, 0, 0, 0);
-                }
-                boards[sender_unique_id].valid = true;
-                boards[sender_unique_id].time_last_message_received_ms = millis();
-                break;
-
-            /* Handle these messages by updating the last time since we've
-               heard from the sender, but otherwise take no action */
-            case MSG_VENT_VALVE_CMD:
-            case MSG_INJ_VALVE_CMD:
-            case MSG_GPS_TIMESTAMP:
-            case MSG_GPS_ALTITUDE:
-            case MSG_GPS_INFO:
-            case MSG_SENSOR_ACC:
-            case MSG_SENSOR_GYRO:
-            case MSG_SENSOR_MAG:
-            case MSG_GENERAL_CMD:
-                boards[sender_unique_id].valid = true;
-                boards[sender_unique_id].time_last_message_received_ms = millis();
-                break;
-            /* We do not handle these message types in any way, not even to
-               update time_last_message_received_ms */
-            case MSG_DEBUG_PRINTF:
-            case MSG_DEBUG_MSG:
-            case MSG_LEDS_ON:
-            case MSG_LEDS_OFF:
-                break;
-
-            /* We treat all the bytes in the debug_radio_cmd message as though
-               we just received them from the radio. ie we hand them to the
-               radio handler */
-            case MSG_DEBUG_RADIO_CMD:
-                for (i = 0; i < msg->data_len; ++i) {
-                    radio_handle_input_character(msg->data[i]);
-                }
-                break;
-
-            /* We have provided cases for every message type in the spreadsheet,
-               so if we get to the default case, that either means that one of
-               the boards is sending a SID that it shouldn't be, or that we added
-               a message type and haven't updated this code.*/
-            default:
-                // Not throwing an error here because there's a lot of noise
-                // from malformed messages that don't need to be reported to RLCS
-                break;
-        }
+        return;
+    }
+
+    const struct message_handler *entry = &message_handlers[type_index];
+    if (entry->refreshes_liveness) {
+        refresh_board(sender_unique_id, millis());
+    }
+    if (entry->handle != NULL) {
+        entry->handle(msg, sender_unique_id);
     }
 }
 
+uint32_t sotscon_message_count(uint16_t message_type)
+{
+    return message_counts[MESSAGE_TYPE_INDEX(message_type)];
+}
 
 enum VALVE_STATE current_inj_valve_position(void)
 {
@@ -245,7 +432,7 @@ uint8_t current_num_boards_connected(void)
 
 bool any_errors_active(void)
 {
-    return errors_active;
+    return (error_boards & valid_boards) != 0;
 }
 
 uint16_t current_tank_pressure(void)
@@ -286,62 +473,110 @@ void current_gps_position(uint8_t *latitude_deg,
         *latitude_dir = 'S';
 }
 
+void sotscon_timeout_heartbeat(void)
+{
+    update_all_timeouts();
+}
+
+bool current_imu_reading(enum IMU_SENSOR sensor, imu_reading_t *reading)
+{
+    if (sensor >= IMU_NUM_SENSORS || imu_readings[sensor].last_received_ms == 0) {
+        return false;
+    }
+    *reading = imu_readings[sensor];
+    return true;
+}
+
+bool current_gps_altitude(gps_altitude_t *altitude)
+{
+    if (gps_altitude.last_received_ms == 0) {
+        return false;
+    }
+    *altitude = gps_altitude;
+    return true;
+}
+
+bool current_gps_time(gps_time_t *time)
+{
+    if (gps_time.last_received_ms == 0) {
+        return false;
+    }
+    *time = gps_time;
+    return true;
+}
+
 /* Private function definitions */
-static void update_all_timeouts(void)
+static void deadline_unlink(uint8_t unique_id)
 {
-    uint32_t current_time_ms = millis();
-    /*
-     * Go through all the boards. If valid bit is set, and we have heard
-     * from the board in the last MIN_TIME_BETWEEN_BOARD_HEARTBEAT_MS
-     * milliseconds, count it in the connected boards.
-     */
-    connected_boards = 0;
-    uint8_t i;
-    for (i = 1; i <= MAX_BOARD_UNIQUE_ID; ++i) {
-        if (boards[i].valid) {
-            if ((current_time_ms - boards[i].time_last_message_received_ms) <
-                MIN_TIME_BETWEEN_BOARD_HEARTBEAT_MS) {
-                connected_boards++;
-            } else {
-                //mark the board as invalid and report it as maybe dead
-                boards[i].valid = false;
-                report_error(BOARD_UNIQUE_ID, E_BOARD_FEARED_DEAD, i, 0, 0, 0);
-            }
-        }
+    uint8_t prev = deadline_prev[unique_id];
+    uint8_t next = deadline_next[unique_id];
+    if (prev == NO_BOARD) {
+        deadline_head = next;
+    } else {
+        deadline_next[prev] = next;
     }
+    if (next == NO_BOARD) {
+        deadline_tail = prev;
+    } else {
+        deadline_prev[next] = prev;
+    }
+}
 
-    if (inj_board_unique_id == 0 || (!boards[inj_board_unique_id].valid) ||
-        ((current_time_ms - boards[inj_board_unique_id].time_last_message_received_ms)
-         >= MIN_TIME_BETWEEN_VALVE_UPDATE_MS)) {
-        //mark the inj valve state as invalid
-        inj_valve_state = VALVE_UNK;
+static void deadline_append(uint8_t unique_id)
+{
+    deadline_prev[unique_id] = deadline_tail;
+    deadline_next[unique_id] = NO_BOARD;
+    if (deadline_tail == NO_BOARD) {
+        deadline_head = unique_id;
+    } else {
+        deadline_next[deadline_tail] = unique_id;
     }
+    deadline_tail = unique_id;
 }
 
 /*
- * Loop through all the boards. If any of them have received fewer than
- * MAX_CONSECUTIVE_NOMINALS E_NOMINAL messages, set errors_active to true,
- * because that board still has an error active. If all boards have received
- * that many nominal messages, set errors_active to false
+ * Called whenever we hear from a board. Marks it as valid, and pushes its
+ * deadline back to MIN_TIME_BETWEEN_BOARD_HEARTBEAT_MS from now. now_ms has
+ * to come from millis(), so that the queue stays in deadline order
  */
-static void update_errors_active(void)
+static void refresh_board(uint8_t unique_id, uint32_t now_ms)
 {
-    /*
-     * errors_active is set true whenever we receive an error message. Therefore,
-     * if errors_active is false, we've never received an error message or all
-     * boards have received enough nominal messages to clear the errors. Either
-     * way, there's no point in checking all the boards
-     */
-    if (errors_active == false) {
+    boards[unique_id].time_last_message_received_ms = now_ms;
+    if (unique_id == 0) {
+        //board 0 isn't a real board, we don't count it or time it out
+        valid_boards |= BOARD_BIT(0);
         return;
     }
-    uint8_t i;
-    for (i = 1; i < MAX_BOARD_UNIQUE_ID; ++i) {
-        if (boards[i].valid &&
-            (boards[i].consecutive_nominals < MAX_CONSECUTIVE_NOMINALS)) {
-            errors_active = true;
-            return;
+
+    if (valid_boards & BOARD_BIT(unique_id)) {
+        deadline_unlink(unique_id);
+    } else {
+        valid_boards |= BOARD_BIT(unique_id);
+        connected_boards++;
+    }
+    deadline_append(unique_id);
+}
+
+/*
+ * Times out every board whose deadline has passed. Since the queue is in
+ * deadline order, we stop at the first board that's still alive
+ */
+static void update_all_timeouts(void)
+{
+    uint32_t current_time_ms = millis();
+    while (deadline_head != NO_BOARD &&
+           (current_time_ms - boards[deadline_head].time_last_message_received_ms) >=
+           MIN_TIME_BETWEEN_BOARD_HEARTBEAT_MS) {
+        uint8_t dead = deadline_head;
+        deadline_unlink(dead);
+        valid_boards &= ~BOARD_BIT(dead);
+        connected_boards--;
+
+        if (dead == inj_board_unique_id) {
+            //mark the inj valve state as invalid
+            inj_valve_state = VALVE_UNK;
         }
+        //report the board as maybe dead
+        report_error(BOARD_UNIQUE_ID, E_BOARD_FEARED_DEAD, dead, 0, 0, 0);
     }
-    errors_active = false;
 }
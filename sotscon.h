@@ -28,15 +28,29 @@ void init_sotscon(void);
 
 /*
  * Call this function every time we receive a CAN message over the bus.
- * This will update our current knowledge of the rocket state. This function
- * is not designed to be thread safe or particularly efficient, so it
- * shouldn't be called from an ISR.
- *
- * TODO, add a buffering layer for CAN messages so that we don't have to call
- * this from an ISR
+ * This will update our current knowledge of the rocket state. Messages are
+ * dispatched through a table indexed by message type, so this takes the same
+ * time regardless of type. It is not designed to be thread safe, so it
+ * shouldn't be called from an ISR (can_ingest calls it from the main loop).
  */
 void handle_incoming_can_message(const can_msg_t *msg);
 
+/*
+ * Call this function every 10ms or so. Any board that we haven't heard from in
+ * MIN_TIME_BETWEEN_BOARD_HEARTBEAT_MS is marked dead (and E_BOARD_FEARED_DEAD
+ * is reported) right when its time runs out, rather than the next time
+ * someone asks how many boards there are. Only looks at the board we heard
+ * from least recently, so it's cheap when nothing has died
+ */
+void sotscon_timeout_heartbeat(void);
+
+/*
+ * Returns how many messages of message_type (one of the MSG_* values from
+ * message_types.h) we've received since bootup, from any board, including
+ * ones that we otherwise ignore. Saturates at UINT32_MAX
+ */
+uint32_t sotscon_message_count(uint16_t message_type);
+
 /*
  * If we have received a VENT_VALVE_STATUS message in the last
  * MIN_TIME_BETWEEN_VALVE_UPDATE_MS, this function will return either
@@ -72,7 +86,8 @@ uint8_t current_num_boards_connected(void);
  *
  * So if the vent board sends a "battery voltage low" error message, this
  * function will return true until the vent board has sent MAX_CONSECUTIVE_NOMINALS
- * "Everything is find" messages.
+ * "Everything is find" messages. Boards that have timed out (see
+ * current_num_boards_connected) don't count until we hear from them again.
  */
 bool any_errors_active(void);
 
@@ -92,6 +107,52 @@ uint16_t current_tank_pressure(void);
 uint16_t current_vent_batt_mv(void);
 uint16_t current_inj_batt_mv(void);
 
+/*
+ * Everything below here is data that the boards send, which we keep so that
+ * the radio side can send it to the ground without needing a second radio on
+ * the rocket. Each accessor copies out a small struct, and returns false if
+ * we've never received that data.
+ *
+ * IMU readings are kept as the last sample received, plus the average of the
+ * most recent complete block of IMU_DECIMATION samples, which is a lot less
+ * noisy and updates at a rate the radio can keep up with (every 800ms at the
+ * IMU's usual 20Hz).
+ */
+#define IMU_DECIMATION 16
+
+enum IMU_SENSOR {
+    IMU_ACC = 0,
+    IMU_GYRO,
+    IMU_MAG,
+    IMU_NUM_SENSORS
+};
+
+typedef struct {
+    int16_t last[3];           // x, y, z, as sent by the IMU, two's complement
+    int16_t average[3];        // 0 until the first block is complete
+    uint32_t last_received_ms; // millis() when the last sample arrived
+} imu_reading_t;
+
+typedef struct {
+    uint16_t altitude;
+    uint8_t daltitude;         // decimal part of the altitude
+    uint8_t units;             // as sent by GPS, 'M' for metres
+    uint16_t average_altitude; // average of the last IMU_DECIMATION altitudes
+    uint32_t last_received_ms;
+} gps_altitude_t;
+
+typedef struct {
+    uint8_t hours;
+    uint8_t minutes;
+    uint8_t seconds;
+    uint8_t dseconds;          // hundredths of a second
+    uint32_t last_received_ms;
+} gps_time_t;
+
+bool current_imu_reading(enum IMU_SENSOR sensor, imu_reading_t *reading);
+bool current_gps_altitude(gps_altitude_t *altitude);
+bool current_gps_time(gps_time_t *time);
+
 /*
  * Gets the last position that we received from GPS board. It's your
  * responsibility to decode the degrees, minutes, and decimal minutes
@@ -0,0 +1,226 @@
+#include "telemetry_history.h"
+#include <string.h> // for memset
+
+// how many raw samples (heartbeats) go by before we close a bucket
+#define TICKS_PER_BUCKET (TELEM_BUCKET_PERIOD_MS / TELEM_RAW_PERIOD_MS)
+#define SAMPLES_PER_MIN (60000 / TELEM_RAW_PERIOD_MS)
+
+/*
+ * For a least squares fit of y against sample index i (0 is the oldest raw
+ * sample), over a full raw tier:
+ *
+ *   slope = (N * sum(i*y) - sum(i) * sum(y)) / (N * sum(i*i) - sum(i)^2)
+ *
+ * sum(i) and sum(i*i) only depend on N, so they're constants
+ */
+#define SUM_I ((int32_t) TELEM_RAW_LEN * (TELEM_RAW_LEN - 1) / 2)
+#define SUM_II ((int32_t) (TELEM_RAW_LEN - 1) * TELEM_RAW_LEN * (2 * TELEM_RAW_LEN - 1) / 6)
+#define SLOPE_DENOMINATOR ((int32_t) TELEM_RAW_LEN * SUM_II - SUM_I * SUM_I)
+
+static struct {
+    bool ever_recorded;
+    uint16_t latest;
+
+    // the bucket that's currently filling up
+    uint16_t acc_min;
+    uint16_t acc_max;
+    uint32_t acc_sum;
+    uint16_t acc_count;
+
+    // raw tier. raw_next is where the next sample goes, which is also the
+    // oldest sample once the tier is full
+    uint16_t raw[TELEM_RAW_LEN];
+    uint8_t raw_next;
+    uint8_t raw_count;
+    int32_t sum_y;
+    int32_t sum_iy;
+
+    // bucket tier, same layout as raw
+    telem_bucket_t buckets[TELEM_NUM_BUCKETS];
+    uint8_t bucket_next;
+    uint8_t bucket_count;
+} history[TELEM_NUM_QUANTITIES];
+
+static uint8_t ticks_in_bucket = 0;
+
+void init_telemetry_history(void)
+{
+    memset(history, 0, sizeof(history));
+    ticks_in_bucket = 0;
+}
+
+void telemetry_record(uint8_t quantity, uint16_t value)
+{
+    if (quantity >= TELEM_NUM_QUANTITIES) {
+        return;
+    }
+    history[quantity].ever_recorded = true;
+    history[quantity].latest = value;
+    if (history[quantity].acc_count == 0 || value < history[quantity].acc_min) {
+        history[quantity].acc_min = value;
+    }
+    if (history[quantity].acc_count == 0 || value > history[quantity].acc_max) {
+        history[quantity].acc_max = value;
+    }
+    //if samples arrive so fast that the count would overflow, the mean of
+    //what we've got is good enough
+    if (history[quantity].acc_count != UINT16_MAX) {
+        history[quantity].acc_sum += value;
+        history[quantity].acc_count++;
+    }
+}
+
+/*
+ * Adds a sample to the raw tier, and updates the running sums. When the tier
+ * is full, the oldest sample leaves and every other sample's index drops by
+ * one, which takes sum(y) (minus the leaving sample, whose index was 0) off
+ * of sum(i*y)
+ */
+static void push_raw(uint8_t quantity, uint16_t value)
+{
+    uint8_t next = history[quantity].raw_next;
+    if (history[quantity].raw_count < TELEM_RAW_LEN) {
+        history[quantity].sum_iy += (int32_t) history[quantity].raw_count * value;
+        history[quantity].sum_y += value;
+        history[quantity].raw_count++;
+    } else {
+        uint16_t oldest = history[quantity].raw[next];
+        history[quantity].sum_iy -= history[quantity].sum_y - oldest;
+        history[quantity].sum_iy += (int32_t) (TELEM_RAW_LEN - 1) * value;
+        history[quantity].sum_y += (int32_t) value - oldest;
+    }
+    history[quantity].raw[next] = value;
+    history[quantity].raw_next = (next + 1) % TELEM_RAW_LEN;
+}
+
+static void close_bucket(uint8_t quantity)
+{
+    telem_bucket_t *bucket = &history[quantity].buckets[history[quantity].bucket_next];
+    if (history[quantity].acc_count == 0) {
+        bucket->min = TELEM_NO_DATA;
+        bucket->max = TELEM_NO_DATA;
+        bucket->mean = TELEM_NO_DATA;
+    } else {
+        bucket->min = history[quantity].acc_min;
+        bucket->max = history[quantity].acc_max;
+        bucket->mean = history[quantity].acc_sum / history[quantity].acc_count;
+    }
+    history[quantity].acc_sum = 0;
+    history[quantity].acc_count = 0;
+
+    history[quantity].bucket_next = (history[quantity].bucket_next + 1) % TELEM_NUM_BUCKETS;
+    if (history[quantity].bucket_count < TELEM_NUM_BUCKETS) {
+        history[quantity].bucket_count++;
+    }
+}
+
+void telemetry_history_heartbeat(void)
+{
+    bool bucket_done = false;
+    if (++ticks_in_bucket >= TICKS_PER_BUCKET) {
+        ticks_in_bucket = 0;
+        bucket_done = true;
+    }
+
+    uint8_t q;
+    for (q = 0; q < TELEM_NUM_QUANTITIES; ++q) {
+        if (!history[q].ever_recorded) {
+            continue;
+        }
+        push_raw(q, history[q].latest);
+        if (bucket_done) {
+            close_bucket(q);
+        }
+    }
+}
+
+int16_t telemetry_rate_per_min(uint8_t quantity)
+{
+    if (quantity >= TELEM_NUM_QUANTITIES ||
+        history[quantity].raw_count < TELEM_RAW_LEN) {
+        return 0;
+    }
+
+    // slope is in units per sample. Split the division so that multiplying
+    // by SAMPLES_PER_MIN can't overflow
+    int32_t numerator = TELEM_RAW_LEN * history[quantity].sum_iy -
+                        SUM_I * history[quantity].sum_y;
+    int32_t whole = numerator / SLOPE_DENOMINATOR;
+    int32_t part = numerator % SLOPE_DENOMINATOR;
+    int32_t rate = whole * SAMPLES_PER_MIN + part * SAMPLES_PER_MIN / SLOPE_DENOMINATOR;
+
+    if (rate > INT16_MAX) {
+        return INT16_MAX;
+    } else if (rate < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return rate;
+}
+
+uint8_t telemetry_get_buckets(uint8_t quantity, telem_bucket_t *out, uint8_t max_buckets)
+{
+    if (quantity >= TELEM_NUM_QUANTITIES) {
+        return 0;
+    }
+    uint8_t count = history[quantity].bucket_count;
+    if (count > max_buckets) {
+        count = max_buckets;
+    }
+    uint8_t idx = history[quantity].bucket_next;
+    uint8_t i;
+    for (i = 0; i < count; ++i) {
+        idx = (idx + TELEM_NUM_BUCKETS - 1) % TELEM_NUM_BUCKETS;
+        out[i] = history[quantity].buckets[idx];
+    }
+    return count;
+}
+
+bool telemetry_get_summary(uint8_t quantity, telem_summary_t *summary)
+{
+    if (quantity >= TELEM_NUM_QUANTITIES || !history[quantity].ever_recorded) {
+        return false;
+    }
+
+    summary->latest = history[quantity].latest;
+    summary->rate_per_min = telemetry_rate_per_min(quantity);
+
+    // start with the bucket that's still filling up
+    if (history[quantity].acc_count == 0) {
+        summary->min = TELEM_NO_DATA;
+        summary->max = 0;
+        summary->bucket_means[0] = TELEM_NO_DATA;
+    } else {
+        summary->min = history[quantity].acc_min;
+        summary->max = history[quantity].acc_max;
+        summary->bucket_means[0] = history[quantity].acc_sum / history[quantity].acc_count;
+    }
+
+    uint8_t i;
+    for (i = 1; i < TELEM_SUMMARY_BUCKETS; ++i) {
+        summary->bucket_means[i] = TELEM_NO_DATA;
+    }
+
+    uint8_t idx = history[quantity].bucket_next;
+    for (i = 0; i < history[quantity].bucket_count; ++i) {
+        idx = (idx + TELEM_NUM_BUCKETS - 1) % TELEM_NUM_BUCKETS;
+        const telem_bucket_t *bucket = &history[quantity].buckets[idx];
+        if (i + 1 < TELEM_SUMMARY_BUCKETS) {
+            summary->bucket_means[i + 1] = bucket->mean;
+        }
+        if (bucket->mean == TELEM_NO_DATA) {
+            continue;
+        }
+        if (bucket->min < summary->min) {
+            summary->min = bucket->min;
+        }
+        if (bucket->max > summary->max) {
+            summary->max = bucket->max;
+        }
+    }
+
+    // nothing arrived in the whole history window
+    if (summary->min == TELEM_NO_DATA) {
+        summary->max = TELEM_NO_DATA;
+    }
+    return true;
+}
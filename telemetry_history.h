@@ -0,0 +1,106 @@
+#ifndef TELEMETRY_HISTORY_H_
+#define TELEMETRY_HISTORY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Keeps a short history of the quantities that RLCS cares about while it's
+ * waiting (tank pressure and battery voltages), so that one radio request can
+ * get the trend, rather than polling state at a high rate and piecing it
+ * together on the ground.
+ *
+ * Every sample that arrives is handed to telemetry_record. History is kept in
+ * two tiers per quantity:
+ *
+ *   raw:     the latest value, taken every TELEM_RAW_PERIOD_MS, for the last
+ *            TELEM_RAW_LEN samples (4 seconds)
+ *   buckets: min, max and mean of every sample that arrived in each
+ *            TELEM_BUCKET_PERIOD_MS, for the last TELEM_NUM_BUCKETS buckets
+ *            (5 minutes)
+ *
+ * The rate of change is a least squares fit over the raw tier, kept up to
+ * date with running sums as samples enter and leave it, so it costs the same
+ * no matter how long the window is.
+ *
+ * RAM use is about 2 * TELEM_RAW_LEN + 6 * TELEM_NUM_BUCKETS + 20 bytes per
+ * quantity, ~240 bytes each with the sizes below. Shrink TELEM_NUM_BUCKETS
+ * first if that's too much.
+ */
+
+enum TELEM_QUANTITY {
+    TELEM_TANK_PRESSURE = 0, // from sensor, psi, not clamped
+    TELEM_INJ_BATT_MV,       // from injector
+    TELEM_RADIO_BATT_MV,     // our own battery, from analog.c
+    TELEM_NUM_QUANTITIES
+};
+
+#define TELEM_RAW_PERIOD_MS 250
+#define TELEM_RAW_LEN 16
+#define TELEM_BUCKET_PERIOD_MS 10000
+#define TELEM_NUM_BUCKETS 30
+
+// how many bucket means go into a summary for the radio
+#define TELEM_SUMMARY_BUCKETS 8
+
+// mean (and min and max) of a bucket that no samples arrived in. A real
+// sample of 65535 looks the same, none of our quantities get that high
+#define TELEM_NO_DATA 0xFFFF
+
+typedef struct {
+    uint16_t min;
+    uint16_t max;
+    uint16_t mean;
+} telem_bucket_t;
+
+typedef struct {
+    uint16_t latest;
+    // change per minute, from the raw tier. 0 until the raw tier fills up
+    int16_t rate_per_min;
+    // min and max over the whole bucket tier, including the bucket that's
+    // still filling up. TELEM_NO_DATA if nothing arrived in all that time
+    uint16_t min;
+    uint16_t max;
+    // means of the most recent TELEM_SUMMARY_BUCKETS buckets, newest first.
+    // The first one is the bucket that's still filling up
+    uint16_t bucket_means[TELEM_SUMMARY_BUCKETS];
+} telem_summary_t;
+
+/*
+ * Call this function at bootup. Forgets all history
+ */
+void init_telemetry_history(void);
+
+/*
+ * Records a new value of quantity. Call this every time a sample arrives, it
+ * goes into the current bucket's min/max/mean, and becomes the value that the
+ * next raw sample takes
+ */
+void telemetry_record(uint8_t quantity, uint16_t value);
+
+/*
+ * Call this every TELEM_RAW_PERIOD_MS. Takes a raw sample of every quantity
+ * that has ever been recorded, and closes the current bucket every
+ * TELEM_BUCKET_PERIOD_MS
+ */
+void telemetry_history_heartbeat(void);
+
+/*
+ * Returns the rate of change of quantity, in units per minute. 0 if the raw
+ * tier isn't full yet
+ */
+int16_t telemetry_rate_per_min(uint8_t quantity);
+
+/*
+ * Copies up to max_buckets closed buckets of quantity into out, newest first.
+ * Returns how many it copied
+ */
+uint8_t telemetry_get_buckets(uint8_t quantity, telem_bucket_t *out, uint8_t max_buckets);
+
+/*
+ * Fills in summary for quantity. Returns false if quantity doesn't exist or
+ * has never been recorded
+ */
+bool telemetry_get_summary(uint8_t quantity, telem_summary_t *summary);
+
+#endif
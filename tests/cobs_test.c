@@ -0,0 +1,105 @@
+#include "cobs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COLOR_GREEN "\x1B[32m"
+#define COLOR_RED   "\x1B[31m"
+#define COLOR_NONE  "\x1B[0m"
+
+static int total_tests = 0;
+static int failing_tests = 0;
+#define UNIT_TEST(expected_result, description)                                 \
+    if( (expected_result) ) {                                                   \
+        printf("%sTest Passed:%s %s\n", COLOR_GREEN, COLOR_NONE, description);  \
+    } else {                                                                    \
+        printf("%sTest Failed:%s %s\n", COLOR_RED, COLOR_NONE, description);    \
+        failing_tests++;                                                        \
+    }                                                                           \
+    total_tests++;
+
+//encodes len bytes of src, and checks that the result has no zeroes in it
+//and decodes back to src
+static bool round_trips(const uint8_t *src, uint8_t len)
+{
+    uint8_t encoded[COBS_MAX_ENCODED_LEN(255)];
+    uint8_t decoded[COBS_MAX_ENCODED_LEN(255)];
+    uint8_t encoded_len = cobs_encode(src, len, encoded);
+    uint8_t decoded_len;
+    if (encoded_len > COBS_MAX_ENCODED_LEN(len) ||
+        memchr(encoded, 0, encoded_len) != NULL ||
+        !cobs_decode(encoded, encoded_len, decoded, &decoded_len)) {
+        return false;
+    }
+    return decoded_len == len && memcmp(src, decoded, len) == 0;
+}
+
+int main() {
+    uint8_t src[255];
+    uint8_t encoded[COBS_MAX_ENCODED_LEN(255)];
+    uint8_t decoded[COBS_MAX_ENCODED_LEN(255)];
+    uint8_t decoded_len;
+    uint16_t i;
+
+    //examples from the original COBS paper
+    const uint8_t one_zero[] = {0x00};
+    UNIT_TEST(cobs_encode(one_zero, 1, encoded) == 2 &&
+              encoded[0] == 0x01 && encoded[1] == 0x01,
+              "a single zero encodes to 01 01");
+    const uint8_t mixed[] = {0x11, 0x22, 0x00, 0x33};
+    UNIT_TEST(cobs_encode(mixed, 4, encoded) == 5 &&
+              memcmp(encoded, "\x03\x11\x22\x02\x33", 5) == 0,
+              "11 22 00 33 encodes to 03 11 22 02 33");
+    UNIT_TEST(cobs_encode(mixed, 0, encoded) == 1 && encoded[0] == 0x01,
+              "nothing encodes to 01");
+
+    UNIT_TEST(round_trips(one_zero, 1), "a single zero round trips");
+    UNIT_TEST(round_trips(mixed, 4), "bytes with a zero in the middle round trip");
+    memset(src, 0, sizeof(src));
+    UNIT_TEST(round_trips(src, 40), "a run of zeroes round trips");
+    for (i = 0; i < sizeof(src); ++i) {
+        src[i] = (uint8_t) (i % 255 + 1);
+    }
+    UNIT_TEST(round_trips(src, COBS_MAX_LEN), "the longest run of non zero bytes round trips");
+    UNIT_TEST(cobs_encode(src, COBS_MAX_LEN, encoded) == COBS_MAX_ENCODED_LEN(COBS_MAX_LEN),
+              "the longest input encodes to COBS_MAX_ENCODED_LEN bytes");
+
+    //a full block of 254 bytes, which doesn't stand for a zero after it
+    encoded[0] = 0xff;
+    memcpy(encoded + 1, src, 254);
+    UNIT_TEST(cobs_decode(encoded, 255, decoded, &decoded_len) &&
+              decoded_len == 254 && memcmp(decoded, src, 254) == 0,
+              "a full block decodes without a zero after it");
+
+    bool all_ok = true;
+    uint16_t trial;
+    srand(14);
+    for (trial = 0; trial < 10000; ++trial) {
+        uint8_t len = (uint8_t) (rand() % 64);
+        for (i = 0; i < len; ++i) {
+            //plenty of zeroes, so that blocks come in all sizes
+            src[i] = rand() % 4 ? (uint8_t) rand() : 0;
+        }
+        all_ok = all_ok && round_trips(src, len);
+    }
+    UNIT_TEST(all_ok, "random buffers round trip");
+
+    const uint8_t has_zero[] = {0x03, 0x11, 0x00, 0x02, 0x33};
+    UNIT_TEST(!cobs_decode(has_zero, sizeof(has_zero), decoded, &decoded_len),
+              "a zero in the encoded bytes is rejected");
+    const uint8_t overrun[] = {0x05, 0x11, 0x22};
+    UNIT_TEST(!cobs_decode(overrun, sizeof(overrun), decoded, &decoded_len),
+              "a code byte pointing past the end is rejected");
+
+    //decoding in place is allowed
+    cobs_encode(mixed, 4, encoded);
+    UNIT_TEST(cobs_decode(encoded, 5, encoded, &decoded_len) &&
+              decoded_len == 4 && memcmp(encoded, mixed, 4) == 0,
+              "decoding in place works");
+
+    printf("%s Test Results: %i tests, %i passed, %i %sfailed%s\n",
+           __FILE__,
+           total_tests,
+           total_tests - failing_tests,
+           failing_tests, failing_tests ? COLOR_RED : COLOR_GREEN, COLOR_NONE);
+}
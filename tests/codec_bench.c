@@ -0,0 +1,435 @@
+/*
+ * Host benchmarks for the radio codec and input paths. Each benchmark is
+ * timed here and compared with a baseline file (bench_baseline.txt by
+ * default), and the program fails if anything got slower by more than the
+ * tolerance.
+ *
+ * Timings from different computers can't be compared directly, so every run
+ * also times a fixed calibration loop, and baseline timings are scaled by how
+ * much faster or slower that loop is here than it was on the computer that
+ * wrote the baseline.
+ *
+ *   ./codec_bench [-t percent] [baseline]   compare against baseline
+ *   ./codec_bench -w [baseline]             write a new baseline
+ */
+#include "radio_handler.h"
+#include "serialize.h"
+#include "sotscon.h"
+#include "can_common.h"
+#include "can_ingest.h"
+#include "radio_mirror.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//pic18_time.c depends on xc.h, so we can't use its millis function
+uint32_t millis(void) { return 0; }
+
+//radio_handler talks to the rest of the board through these, same as in
+//radio_handler_test. What it transmits is thrown away
+void uart_transmit_buffer(uint8_t *tx, uint8_t len) { }
+uint8_t uart_transmit_pending(void) { return 0; }
+bool is_bus_powered(void) { return true; }
+void trigger_bus_powerup(void) { }
+void trigger_bus_shutdown(void) { }
+enum VALVE_STATE current_inj_valve_position(void) { return VALVE_CLOSED; }
+uint8_t current_num_boards_connected(void) { return 5; }
+bool any_errors_active(void) { return false; }
+uint16_t current_tank_pressure(void) { return 420; }
+uint16_t current_inj_batt_mv(void) { return 12100; }
+void current_gps_position(uint8_t *latitude_deg,
+                          uint8_t *latitude_min,
+                          uint8_t *latitude_dmin,
+                          uint8_t *latitude_dir,
+                          uint8_t *longitude_deg,
+                          uint8_t *longitude_min,
+                          uint8_t *longitude_dmin,
+                          uint8_t *longitude_dir) { }
+bool perf_stats_get(uint8_t slot, perf_stat_t *out) { return false; }
+uint16_t perf_stats_mean_us(const perf_stat_t *stat) { return 0; }
+bool telemetry_get_summary(uint8_t quantity, telem_summary_t *summary) { return false; }
+void can_ingest_get_stats(can_ingest_stats_t *stats) { }
+void radio_mirror_set_enabled(bool enabled) { }
+bool radio_mirror_enabled(void) { return false; }
+void radio_mirror_get_stats(radio_mirror_stats_t *stats) { }
+bool build_board_stat_msg(uint32_t timestamp, enum BOARD_STATUS error_code,
+                          const uint8_t *error_data, uint8_t error_data_len,
+                          can_msg_t *output) { return true; }
+bool txb_enqueue(const can_msg_t *msg) { return true; }
+
+#define COLOR_GREEN "\x1B[32m"
+#define COLOR_RED   "\x1B[31m"
+#define COLOR_NONE  "\x1B[0m"
+
+#define DEFAULT_BASELINE "bench_baseline.txt"
+#define DEFAULT_TOLERANCE_PERCENT 50
+// each timed batch runs for at least this long, and the best of
+// BATCHES_PER_BENCH batches counts
+#define MIN_BATCH_NS 10000000.0
+#define BATCHES_PER_BENCH 15
+
+// results go here so that the compiler can't throw the work away
+static volatile uint32_t sink;
+
+/*
+ * Inputs, set up once in main
+ */
+static const system_state state = {
+    .tank_pressure = 420,
+    .num_boards_connected = 5,
+    .injector_valve_state = VALVE_CLOSED,
+    .vent_valve_state = VALVE_CLOSED,
+    .bus_is_powered = true,
+    .any_errors_detected = false,
+    .bus_battery_voltage_mv = 12100,
+    .vent_battery_voltage_mv = 11900,
+};
+static const error_t error = { 3, E_BATT_UNDER_VOLTAGE, 1, 2, 3, 4 };
+static char serialized_state[SERIALIZED_OUTPUT_LEN];
+static char telemetry_message[TELEMETRY_SUMMARY_MSG_LEN];
+static char corrupt_command[STATE_COMMAND_LEN];
+
+/*
+ * What RLCS sends the radio board, as it comes in over the UART: a version
+ * select, then a poll and a state command every half second or so. One in
+ * ASCII, one in binary
+ */
+#define STREAM_ROUNDS 32
+static uint8_t ascii_stream[VERSION_SELECT_LEN + STREAM_ROUNDS * (2 + STATE_COMMAND_LEN)];
+static uint16_t ascii_stream_len = 0;
+static uint8_t binary_stream[1 + VERSION_SELECT_LEN + STREAM_ROUNDS * (2 + BINARY_FRAME_MAX_LEN)];
+static uint16_t binary_stream_len = 0;
+
+static uint16_t build_stream(uint8_t *stream, enum RADIO_PROTOCOL_VERSION version)
+{
+    uint16_t len = 0;
+    uint8_t round;
+    stream[len++] = 0;
+    create_version_select(version, (char *) stream + len);
+    len += VERSION_SELECT_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V1);
+    char cmd[STATE_COMMAND_LEN];
+    create_state_command(cmd, &state, version);
+    for (round = 0; round < STREAM_ROUNDS; ++round) {
+        stream[len++] = BUNDLE_REQUEST_HEADER;
+        stream[len++] = binary_to_base64(round % STATE_DELTA_NO_SNAPSHOT);
+        if (version == RADIO_PROTOCOL_V3) {
+            len += frame_to_binary(cmd, STATE_COMMAND_BODY_LEN, stream + len);
+        } else {
+            memcpy(stream + len, cmd, STATE_COMMAND_BODY_LEN + frame_check_len(version));
+            len += STATE_COMMAND_BODY_LEN + frame_check_len(version);
+        }
+    }
+    return len;
+}
+
+/*
+ * The benchmarks. Each one does its operation iterations times
+ */
+static void bench_calibration(uint32_t iterations)
+{
+    uint32_t x = 2463534242u;
+    uint32_t i;
+    uint8_t j;
+    for (i = 0; i < iterations; ++i) {
+        for (j = 0; j < 64; ++j) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+        }
+        sink = x;
+    }
+}
+
+static void bench_serialize_state(uint32_t iterations)
+{
+    char out[SERIALIZED_OUTPUT_LEN];
+    uint32_t i;
+    for (i = 0; i < iterations; ++i) {
+        serialize_state(&state, out);
+        sink = out[3];
+    }
+}
+
+static void bench_deserialize_state(uint32_t iterations)
+{
+    system_state out;
+    uint32_t i;
+    for (i = 0; i < iterations; ++i) {
+        deserialize_state(&out, serialized_state);
+        sink = out.tank_pressure;
+    }
+}
+
+static void bench_serialize_error(uint32_t iterations)
+{
+    char out[ERROR_COMMAND_LENGTH];
+    uint32_t i;
+    for (i = 0; i < iterations; ++i) {
+        serialize_error(&error, out);
+        sink = out[3];
+    }
+}
+
+static void bench_create_gps_message(uint32_t iterations)
+{
+    char out[GPS_MSG_LEN];
+    uint32_t i;
+    for (i = 0; i < iterations; ++i) {
+        create_gps_message(49, 15, 77, 'N', 123, 6, 12, 'W', out, RADIO_PROTOCOL_V2);
+        sink = out[3];
+    }
+}
+
+static void bench_checksum(uint32_t iterations)
+{
+    uint32_t i;
+    for (i = 0; i < iterations; ++i) {
+        sink = checksum(serialized_state);
+    }
+}
+
+static void bench_binary_to_base64(uint32_t iterations)
+{
+    uint32_t i;
+    for (i = 0; i < iterations; ++i) {
+        sink = binary_to_base64(i & 0x3f);
+    }
+}
+
+static void bench_base64_to_binary(uint32_t iterations)
+{
+    uint32_t i;
+    for (i = 0; i < iterations; ++i) {
+        sink = base64_to_binary(serialized_state[i & 7]);
+    }
+}
+
+static void bench_frame_check_ok(uint32_t iterations)
+{
+    uint32_t i;
+    for (i = 0; i < iterations; ++i) {
+        sink = frame_check_ok(telemetry_message, TELEMETRY_SUMMARY_MSG_BODY_LEN,
+                              RADIO_PROTOCOL_V2);
+    }
+}
+
+static void bench_fec_correct_frame(uint32_t iterations)
+{
+    char cmd[STATE_COMMAND_LEN];
+    uint32_t i;
+    for (i = 0; i < iterations; ++i) {
+        memcpy(cmd, corrupt_command, sizeof(cmd));
+        sink = fec_correct_frame(cmd, STATE_COMMAND_BODY_LEN, RADIO_PROTOCOL_V4);
+    }
+}
+
+static void bench_frame_to_binary(uint32_t iterations)
+{
+    uint8_t out[BINARY_FRAME_MAX_LEN];
+    uint32_t i;
+    for (i = 0; i < iterations; ++i) {
+        sink = frame_to_binary(telemetry_message, TELEMETRY_SUMMARY_MSG_BODY_LEN, out);
+    }
+}
+
+static void feed_stream(const uint8_t *stream, uint16_t len, uint32_t iterations)
+{
+    static uint16_t pos = 0;
+    uint32_t i;
+    for (i = 0; i < iterations; ++i) {
+        radio_handle_input_character(stream[pos]);
+        pos = (pos + 1) % len;
+    }
+}
+
+static void bench_radio_input_ascii(uint32_t iterations)
+{
+    feed_stream(ascii_stream, ascii_stream_len, iterations);
+}
+
+static void bench_radio_input_binary(uint32_t iterations)
+{
+    feed_stream(binary_stream, binary_stream_len, iterations);
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(uint32_t iterations);
+} bench_t;
+
+// the calibration loop has to come first
+static const bench_t benches[] = {
+    { "calibration", &bench_calibration },
+    { "serialize_state", &bench_serialize_state },
+    { "deserialize_state", &bench_deserialize_state },
+    { "serialize_error", &bench_serialize_error },
+    { "create_gps_message", &bench_create_gps_message },
+    { "checksum", &bench_checksum },
+    { "binary_to_base64", &bench_binary_to_base64 },
+    { "base64_to_binary", &bench_base64_to_binary },
+    { "frame_check_ok/v2_telemetry", &bench_frame_check_ok },
+    { "fec_correct_frame/one_error", &bench_fec_correct_frame },
+    { "frame_to_binary/telemetry", &bench_frame_to_binary },
+    { "radio_handle_input_character/ascii", &bench_radio_input_ascii },
+    { "radio_handle_input_character/binary", &bench_radio_input_binary },
+};
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// the time per call of one benchmark, in ns
+static double time_bench(const bench_t *bench)
+{
+    uint32_t iterations = 1;
+    double start, elapsed;
+    // grow the batch until it's long enough to time properly
+    for (;;) {
+        start = now_ns();
+        bench->run(iterations);
+        elapsed = now_ns() - start;
+        if (elapsed >= MIN_BATCH_NS || iterations >= 0x80000000u) {
+            break;
+        }
+        iterations *= 2;
+    }
+    double best = elapsed;
+    uint8_t batch;
+    for (batch = 1; batch < BATCHES_PER_BENCH; ++batch) {
+        start = now_ns();
+        bench->run(iterations);
+        elapsed = now_ns() - start;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best / iterations;
+}
+
+/*
+ * Reads the baseline's time for each benchmark into baseline_ns, which is 0
+ * for any that aren't in it. Returns false if the file can't be read
+ */
+static bool read_baseline(const char *path, double *baseline_ns)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    char line[128], name[96];
+    double ns;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%95s %lf", name, &ns) != 2) {
+            continue;
+        }
+        size_t i;
+        for (i = 0; i < NUM_BENCHES; ++i) {
+            if (strcmp(name, benches[i].name) == 0) {
+                baseline_ns[i] = ns;
+            }
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static bool write_baseline(const char *path, const double *ns)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        return false;
+    }
+    fprintf(f, "# ns per call, written by codec_bench -w. calibration is what the\n"
+               "# others are scaled by when they're compared on another computer\n");
+    size_t i;
+    for (i = 0; i < NUM_BENCHES; ++i) {
+        fprintf(f, "%s %.2f\n", benches[i].name, ns[i]);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *baseline_path = DEFAULT_BASELINE;
+    int tolerance_percent = DEFAULT_TOLERANCE_PERCENT;
+    bool write = false;
+    int arg;
+    for (arg = 1; arg < argc; ++arg) {
+        if (strcmp(argv[arg], "-w") == 0) {
+            write = true;
+        } else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+            tolerance_percent = atoi(argv[++arg]);
+        } else {
+            baseline_path = argv[arg];
+        }
+    }
+
+    serialize_state(&state, serialized_state);
+    create_state_command(corrupt_command, &state, RADIO_PROTOCOL_V4);
+    corrupt_command[4] = corrupt_command[4] == 'A' ? 'B' : 'A';
+    telem_summary_t summary = { 420, -12, 400, 440, { 420, 421, 422, 423, 424, 425, 426, 427 } };
+    create_telemetry_summary_message(TELEM_TANK_PRESSURE, &summary, telemetry_message,
+                                     RADIO_PROTOCOL_V2);
+    ascii_stream_len = build_stream(ascii_stream, RADIO_PROTOCOL_V2);
+    binary_stream_len = build_stream(binary_stream, RADIO_PROTOCOL_V3);
+
+    double ns[NUM_BENCHES];
+    size_t i;
+    for (i = 0; i < NUM_BENCHES; ++i) {
+        ns[i] = time_bench(&benches[i]);
+    }
+    // and the calibration loop again, in case the computer was busy with
+    // something else the first time
+    double calibration_again = time_bench(&benches[0]);
+    if (calibration_again < ns[0]) {
+        ns[0] = calibration_again;
+    }
+
+    if (write) {
+        if (!write_baseline(baseline_path, ns)) {
+            printf("couldn't write %s\n", baseline_path);
+            return 1;
+        }
+        printf("wrote %s\n", baseline_path);
+    }
+
+    double baseline_ns[NUM_BENCHES] = {0};
+    bool have_baseline = !write && read_baseline(baseline_path, baseline_ns) &&
+                         baseline_ns[0] > 0;
+    if (!write && !have_baseline) {
+        printf("no baseline in %s, nothing to compare with\n", baseline_path);
+    }
+    // how much slower this computer is than the baseline's
+    double scale = have_baseline ? ns[0] / baseline_ns[0] : 1;
+
+    int regressions = 0;
+    printf("%-38s %12s %14s %12s %8s\n", "benchmark", "ns/call", "calls/s", "baseline", "change");
+    for (i = 0; i < NUM_BENCHES; ++i) {
+        printf("%-38s %12.2f %14.0f", benches[i].name, ns[i], 1e9 / ns[i]);
+        if (i == 0 || !have_baseline || baseline_ns[i] == 0) {
+            printf("\n");
+            continue;
+        }
+        double expected = baseline_ns[i] * scale;
+        double change = (ns[i] - expected) * 100 / expected;
+        bool regressed = change > tolerance_percent;
+        printf(" %12.2f %s%+7.1f%%%s\n", expected, regressed ? COLOR_RED : "",
+               change, regressed ? COLOR_NONE : "");
+        if (regressed) {
+            regressions++;
+        }
+    }
+
+    if (have_baseline) {
+        printf("%s Bench Results: %u benchmarks, %i %sslower than baseline + %i%%%s\n",
+               __FILE__, (unsigned) NUM_BENCHES - 1, regressions,
+               regressions ? COLOR_RED : COLOR_GREEN, tolerance_percent, COLOR_NONE);
+    }
+    return regressions ? 1 : 0;
+}
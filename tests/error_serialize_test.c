@@ -1,12 +1,22 @@
 #include "radio_handler.h"
 #include "error.h"
 #include "serialize.h"
+#include "can_common.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 //pic18_time.c depends on xc.h, so we can't use its millis function
-//just declare a fake one, we don't really need it for these tests
-uint32_t millis(void) { return 0; }
+//just declare a fake one, which only the coalescing tests move along
+static uint32_t now_ms = 0;
+uint32_t millis(void) { return now_ms; }
+
+//report_error also sends the error out over CAN, which we don't care about here
+bool build_board_stat_msg(uint32_t timestamp, enum BOARD_STATUS error_code,
+                          const uint8_t *error_data, uint8_t error_data_len,
+                          can_msg_t *output) { return true; }
+bool txb_enqueue(const can_msg_t *msg) { return true; }
+uint16_t perf_stats_mean_us(const perf_stat_t *stat) { return 0; }
 
 #define COLOR_GREEN "\x1B[32m"
 #define COLOR_RED   "\x1B[31m"
@@ -99,6 +109,55 @@ int main()
         UNIT_TEST(true, "randomized test");
     }
 
+    //a board repeating itself takes up one entry, however often it does
+    error_stats_t before, after;
+    error_record_t record;
+    get_error_stats(&before);
+    uint8_t i;
+    for (i = 0; i < 50; ++i) {
+        now_ms = 1000 + i * 10;
+        report_error(3, E_BOARD_FEARED_DEAD, 0x10, 0, 0, 0);
+    }
+    report_error(3, E_BOARD_FEARED_DEAD, 0x08, 0, 0, 0);
+    UNIT_TEST(get_next_error(&record) && record.err.board_id == 3 &&
+              record.err.byte4 == 0x10 && record.count == 50 &&
+              record.last_ms == 1490,
+              "repeats of an error are merged, with a count and the last time");
+    UNIT_TEST(get_next_error(&record) && record.err.byte4 == 0x08 && record.count == 1,
+              "an error with a different payload is kept separately");
+    UNIT_TEST(!get_next_error(&record), "and that's all that was buffered");
+    get_error_stats(&after);
+    UNIT_TEST(after.reported - before.reported == 51 &&
+              after.coalesced - before.coalesced == 49 &&
+              after.dropped == before.dropped,
+              "merged reports are counted");
+
+    //once it's gone out, the next repeat starts a new entry
+    report_error(3, E_BOARD_FEARED_DEAD, 0x10, 0, 0, 0);
+    UNIT_TEST(get_next_error(&record) && record.count == 1 && record.last_ms == now_ms,
+              "an error that's already been sent is buffered again");
+
+    //when it's full, new errors are dropped and counted, repeats still merge
+    for (i = 0; i < ERROR_MESSAGE_RING_BUFFER_SIZE + 2; ++i) {
+        report_error(i % 16, E_BATT_UNDER_VOLTAGE, i, 0, 0, 0);
+    }
+    report_error(0, E_BATT_UNDER_VOLTAGE, 0, 0, 0, 0);
+    get_error_stats(&after);
+    UNIT_TEST(after.dropped - before.dropped == 2 &&
+              after.max_pending == ERROR_MESSAGE_RING_BUFFER_SIZE,
+              "errors that don't fit are counted as dropped");
+    UNIT_TEST(get_next_error(&record) && record.err.byte4 == 0 && record.count == 2,
+              "a repeat still merges when the buffer is full");
+    for (i = 1; get_next_error(&record); ++i);
+    UNIT_TEST(i == ERROR_MESSAGE_RING_BUFFER_SIZE && record.err.byte4 == i - 1,
+              "the errors that were there first are kept");
+
+    uint16_t j;
+    for (j = 0; j < 300; ++j) {
+        report_error(3, E_BOARD_FEARED_DEAD, 0x10, 0, 0, 0);
+    }
+    UNIT_TEST(get_next_error(&record) && record.count == UINT8_MAX,
+              "the count of a merged error saturates");
 
     printf("%s Test Results: %i tests, %i passed, %i %sfailed%s\n",
            __FILE__,
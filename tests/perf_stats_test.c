@@ -0,0 +1,106 @@
+#include "perf_stats.h"
+#include "serialize.h"
+#include "can_common.h"
+#include <stdio.h>
+
+//pic18_time.c depends on xc.h, so we can't use its millis function
+uint32_t millis(void) { return 0; }
+
+//perf_stats_heartbeat only sends over CAN when the bus is powered, and hands
+//its messages to the transmit buffer. Catch them here instead
+static bool bus_powered = false;
+bool is_bus_powered(void) { return bus_powered; }
+static can_msg_t last_sent;
+static int num_sent = 0;
+bool txb_enqueue(const can_msg_t *msg)
+{
+    last_sent = *msg;
+    num_sent++;
+    return true;
+}
+
+#define COLOR_GREEN "\x1B[32m"
+#define COLOR_RED   "\x1B[31m"
+#define COLOR_NONE  "\x1B[0m"
+
+static int total_tests = 0;
+static int failing_tests = 0;
+#define UNIT_TEST(expected_result, description)                                 \
+    if( (expected_result) ) {                                                   \
+        printf("%sTest Passed:%s %s\n", COLOR_GREEN, COLOR_NONE, description);  \
+    } else {                                                                    \
+        printf("%sTest Failed:%s %s\n", COLOR_RED, COLOR_NONE, description);    \
+        failing_tests++;                                                        \
+    }                                                                           \
+    total_tests++;
+
+int main() {
+    perf_stat_t stat;
+    init_perf_stats();
+    UNIT_TEST(!perf_stats_get(PERF_SLOT_LOOP, &stat),
+              "empty slots have no stats");
+    UNIT_TEST(!perf_stats_get(PERF_NUM_SLOTS, &stat),
+              "slots past the end don't exist");
+
+    perf_stats_record(PERF_SLOT_LOOP, 10);
+    perf_stats_record(PERF_SLOT_LOOP, 100);
+    perf_stats_record(PERF_SLOT_LOOP, 3000);
+    perf_stats_record(PERF_SLOT_LOOP, 90);
+    UNIT_TEST(perf_stats_get(PERF_SLOT_LOOP, &stat), "slot has stats");
+    UNIT_TEST(stat.count == 4 && stat.min_us == 10 && stat.max_us == 3000,
+              "count, min and max are tracked");
+    UNIT_TEST(perf_stats_mean_us(&stat) == 800, "mean is total / count");
+    UNIT_TEST(stat.histogram[0] == 1 && stat.histogram[2] == 2 &&
+              stat.histogram[PERF_STATS_NUM_BUCKETS - 1] == 1,
+              "samples land in power of two buckets");
+
+    //min and max saturate rather than wrapping
+    perf_stats_record(PERF_SLOT_CAN_INGEST, 100000);
+    perf_stats_get(PERF_SLOT_CAN_INGEST, &stat);
+    UNIT_TEST(stat.max_us == UINT16_MAX, "max saturates at 16 bits");
+
+    //once the total is about to overflow, count and total get halved, which
+    //keeps the mean the same
+    init_perf_stats();
+    uint32_t i;
+    for (i = 0; i < 70000; ++i) {
+        perf_stats_record(PERF_SLOT_RADIO_INPUT, 65536);
+    }
+    perf_stats_get(PERF_SLOT_RADIO_INPUT, &stat);
+    UNIT_TEST(stat.count < 70000 && perf_stats_mean_us(&stat) == UINT16_MAX,
+              "count and total are halved instead of overflowing");
+    UNIT_TEST(stat.histogram[PERF_STATS_NUM_BUCKETS - 1] < 70000 &&
+              stat.histogram[PERF_STATS_NUM_BUCKETS - 1] > 30000,
+              "histogram buckets are halved instead of overflowing");
+
+    //the radio message has the header, and a checksum that matches
+    char msg[PERF_STATS_MSG_LEN];
+    UNIT_TEST(create_perf_stats_message(PERF_SLOT_RADIO_INPUT, &stat, msg, RADIO_PROTOCOL_V1),
+              "create perf stats message");
+    char received_checksum = msg[PERF_STATS_MSG_BODY_LEN];
+    msg[PERF_STATS_MSG_BODY_LEN] = '\0';
+    UNIT_TEST(msg[0] == PERF_STATS_REQUEST_HEADER &&
+              base64_to_binary(msg[1]) == PERF_SLOT_RADIO_INPUT &&
+              checksum(msg) == received_checksum,
+              "perf stats message has header, slot and checksum");
+
+    //only slots with something in them go out over CAN, and only when
+    //the bus is powered
+    perf_stats_heartbeat();
+    UNIT_TEST(num_sent == 0, "nothing sent while the bus is unpowered");
+    bus_powered = true;
+    perf_stats_heartbeat();
+    UNIT_TEST(num_sent == 1 && last_sent.data[3] == PERF_SLOT_RADIO_INPUT,
+              "heartbeat sends the first slot with stats");
+    perf_stats_record(PERF_SLOT_FIRST_TASK, 40);
+    perf_stats_heartbeat();
+    UNIT_TEST(num_sent == 2 && last_sent.data[3] == PERF_SLOT_FIRST_TASK &&
+              last_sent.data[5] == 40,
+              "heartbeat moves on to the next slot with stats");
+
+    printf("%s Test Results: %i tests, %i passed, %i %sfailed%s\n",
+           __FILE__,
+           total_tests,
+           total_tests - failing_tests,
+           failing_tests, failing_tests ? COLOR_RED : COLOR_GREEN, COLOR_NONE);
+}
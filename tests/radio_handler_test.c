@@ -1,10 +1,60 @@
 #include "radio_handler.h"
 #include "serialize.h"
+#include "sotscon.h"
+#include "can_common.h"
+#include "can_ingest.h"
+#include "radio_tx.h"
+#include "radio_mirror.h"
 #include <stdio.h>
+#include <string.h>
 
 //pic18_time.c depends on xc.h, so we can't use its millis function
-//just declare a fake one, we don't really need it for these tests
-uint32_t millis(void) { return 0; }
+//just declare a fake one, which only the push and board stats tests move on
+static uint32_t now_ms = 0;
+uint32_t millis(void) { return now_ms; }
+
+//radio_handler talks to the rest of the board through these. Only what
+//gets sent back over the radio is looked at, the rest are dummies
+static char last_transmitted[64];
+static uint8_t last_transmitted_len = 0;
+void uart_transmit_buffer(uint8_t *tx, uint8_t len)
+{
+    memcpy(last_transmitted, tx, len);
+    last_transmitted_len = len;
+}
+//the UART's always caught up, so radio_tx hands frames straight over
+uint8_t uart_transmit_pending(void) { return 0; }
+bool is_bus_powered(void) { return true; }
+void trigger_bus_powerup(void) { }
+void trigger_bus_shutdown(void) { }
+enum VALVE_STATE current_inj_valve_position(void) { return VALVE_UNK; }
+uint8_t current_num_boards_connected(void) { return 0; }
+static bool errors_active = false;
+bool any_errors_active(void) { return errors_active; }
+uint16_t current_tank_pressure(void) { return 0; }
+uint16_t current_inj_batt_mv(void) { return 0; }
+void current_gps_position(uint8_t *latitude_deg,
+                          uint8_t *latitude_min,
+                          uint8_t *latitude_dmin,
+                          uint8_t *latitude_dir,
+                          uint8_t *longitude_deg,
+                          uint8_t *longitude_min,
+                          uint8_t *longitude_dmin,
+                          uint8_t *longitude_dir) { }
+bool perf_stats_get(uint8_t slot, perf_stat_t *out) { return false; }
+uint16_t perf_stats_mean_us(const perf_stat_t *stat) { return 0; }
+bool telemetry_get_summary(uint8_t quantity, telem_summary_t *summary) { return false; }
+static can_ingest_stats_t ingest_stats;
+void can_ingest_get_stats(can_ingest_stats_t *stats) { *stats = ingest_stats; }
+static bool mirror_enabled = true;
+static radio_mirror_stats_t mirror_stats;
+void radio_mirror_set_enabled(bool enabled) { mirror_enabled = enabled; }
+bool radio_mirror_enabled(void) { return mirror_enabled; }
+void radio_mirror_get_stats(radio_mirror_stats_t *stats) { *stats = mirror_stats; }
+bool build_board_stat_msg(uint32_t timestamp, enum BOARD_STATUS error_code,
+                          const uint8_t *error_data, uint8_t error_data_len,
+                          can_msg_t *output) { return true; }
+bool txb_enqueue(const can_msg_t *msg) { return true; }
 
 #define COLOR_GREEN "\x1B[32m"
 #define COLOR_RED   "\x1B[31m"
@@ -25,14 +75,13 @@ int main() {
     // Test that we can send a state update request, and it will update the valves
     char open_valves_command[STATE_COMMAND_LEN];
     system_state open_both_valves = {
-        .injector_valve_open = true,
-        .vent_valve_open = true,
-        .running_self_test = false,
+        .injector_valve_state = VALVE_OPEN,
+        .vent_valve_state = VALVE_OPEN,
     };
-    create_state_command(open_valves_command, &open_both_valves);
+    create_state_command(open_valves_command, &open_both_valves, RADIO_PROTOCOL_V1);
     // pass this state command into the radio handler
     uint8_t i;
-    for (i = 0; i < STATE_COMMAND_LEN - 1; ++i) {
+    for (i = 0; i < strlen(open_valves_command); ++i) {
         radio_handle_input_character(open_valves_command[i]);
     }
     // make sure that both valves are open
@@ -42,12 +91,11 @@ int main() {
 
     char close_valves_command[STATE_COMMAND_LEN];
     system_state close_both_valves = {
-        .injector_valve_open = false,
-        .vent_valve_open = false,
-        .running_self_test = false,
+        .injector_valve_state = VALVE_CLOSED,
+        .vent_valve_state = VALVE_CLOSED,
     };
-    create_state_command(close_valves_command, &close_both_valves);
-    for (i = 0; i < STATE_COMMAND_LEN - 1; ++i) {
+    create_state_command(close_valves_command, &close_both_valves, RADIO_PROTOCOL_V1);
+    for (i = 0; i < strlen(close_valves_command); ++i) {
         radio_handle_input_character(close_valves_command[i]);
     }
     // make sure that both valves are closed
@@ -59,7 +107,7 @@ int main() {
     for (i = 0; i < (STATE_COMMAND_LEN / 2); ++i) {
         radio_handle_input_character(close_valves_command[i]);
     }
-    for (i = 0; i < STATE_COMMAND_LEN - 1; ++i) {
+    for (i = 0; i < strlen(open_valves_command); ++i) {
         radio_handle_input_character(open_valves_command[i]);
     }
     // this should cause the valves to be open
@@ -70,13 +118,534 @@ int main() {
     // change one byte in the close command. This should screw up the CRC
     // check, and that state should not be applied
     close_valves_command[1]++; //change the second byte
-    for (i = 0; i < STATE_COMMAND_LEN - 1; ++i) {
+    for (i = 0; i < strlen(close_valves_command); ++i) {
         radio_handle_input_character(close_valves_command[i]);
     }
     UNIT_TEST( (radio_get_expected_inj_valve_state() == VALVE_OPEN &&
                 radio_get_expected_vent_valve_state() == VALVE_OPEN),
                 "changing a byte in the close command doesn't cause CRC to fail");
 
+    // replace a byte in the close command with something that isn't base64,
+    // and fix up the checksum so it still matches. The command should still
+    // be ignored
+    create_state_command(close_valves_command, &close_both_valves, RADIO_PROTOCOL_V1);
+    close_valves_command[2] = '!';
+    append_frame_check(close_valves_command + 1, SERIALIZED_OUTPUT_LEN - 1, RADIO_PROTOCOL_V1);
+    for (i = 0; i < strlen(close_valves_command); ++i) {
+        radio_handle_input_character(close_valves_command[i]);
+    }
+    UNIT_TEST( (radio_get_expected_inj_valve_state() == VALVE_OPEN &&
+                radio_get_expected_vent_valve_state() == VALVE_OPEN),
+                "a command with a character that isn't base64 is ignored");
+
+    // junk, a frame the board doesn't know about, and a close command with a
+    // byte dropped out of the middle, all straight before an open command.
+    // The open command should still get through
+    radio_parser_stats_t before, after;
+    radio_input_stats(&before);
+    const char junk[] = "\r\nxyz$AAAA";
+    for (i = 0; i < strlen(junk); ++i) {
+        radio_handle_input_character(junk[i]);
+    }
+    create_state_command(close_valves_command, &close_both_valves, RADIO_PROTOCOL_V1);
+    for (i = 0; i < strlen(close_valves_command); ++i) {
+        if (i != 6) {
+            radio_handle_input_character(close_valves_command[i]);
+        }
+    }
+    for (i = 0; i < strlen(open_valves_command); ++i) {
+        radio_handle_input_character(open_valves_command[i]);
+    }
+    radio_input_stats(&after);
+    UNIT_TEST(radio_get_expected_inj_valve_state() == VALVE_OPEN &&
+              after.frames_ok == before.frames_ok + 1 &&
+              after.truncated == before.truncated + 1 &&
+              after.resyncs == before.resyncs + 1,
+              "the board resyncs on the next header after junk and a dropped byte");
+
+    // switch to version 2. The board should answer in version 2
+    char select[VERSION_SELECT_LEN];
+    create_version_select(RADIO_PROTOCOL_V2, select);
+    for (i = 0; i < VERSION_SELECT_BODY_LEN + 1; ++i) {
+        radio_handle_input_character(select[i]);
+    }
+    UNIT_TEST(radio_protocol_version() == RADIO_PROTOCOL_V2 &&
+              last_transmitted_len == VERSION_SELECT_BODY_LEN + 2 &&
+              last_transmitted[0] == VERSION_SELECT_HEADER &&
+              base64_to_binary(last_transmitted[1]) == RADIO_PROTOCOL_V2 &&
+              frame_check_ok(last_transmitted, VERSION_SELECT_BODY_LEN, RADIO_PROTOCOL_V2),
+              "select version 2, and get told so in version 2");
+
+    // a version 1 command isn't accepted any more, but a version 2 one is
+    create_state_command(close_valves_command, &close_both_valves, RADIO_PROTOCOL_V1);
+    for (i = 0; i < strlen(close_valves_command); ++i) {
+        radio_handle_input_character(close_valves_command[i]);
+    }
+    UNIT_TEST(radio_get_expected_inj_valve_state() == VALVE_OPEN,
+              "version 1 command ignored after selecting version 2");
+    create_state_command(close_valves_command, &close_both_valves, RADIO_PROTOCOL_V2);
+    for (i = 0; i < strlen(close_valves_command); ++i) {
+        radio_handle_input_character(close_valves_command[i]);
+    }
+    UNIT_TEST(radio_get_expected_inj_valve_state() == VALVE_CLOSED,
+              "version 2 command accepted after selecting version 2");
+
+    // state replies come back in version 2
+    radio_handle_input_character(STATE_REQUEST_HEADER);
+    system_state reply;
+    UNIT_TEST(last_transmitted_len == STATE_COMMAND_BODY_LEN + 2 &&
+              expand_state_command(&reply, last_transmitted, RADIO_PROTOCOL_V2),
+              "state reply is in version 2");
+
+    // the first delta poll gets a keyframe, and the next one a delta
+    // relative to it, which has nothing in it since nothing's changed
+    system_state held;
+    uint8_t held_seq = STATE_DELTA_NO_SNAPSHOT;
+    radio_handle_input_character(STATE_DELTA_REQUEST_HEADER);
+    radio_handle_input_character(binary_to_base64(held_seq));
+    UNIT_TEST(last_transmitted_len == STATE_DELTA_MAX_BODY_LEN + 2 &&
+              expand_state_delta(&held, &held_seq, last_transmitted, RADIO_PROTOCOL_V2) &&
+              compare_system_states(&held, &reply),
+              "first delta poll gets a keyframe");
+    uint8_t keyframe_seq = held_seq;
+    radio_handle_input_character(STATE_DELTA_REQUEST_HEADER);
+    radio_handle_input_character(binary_to_base64(held_seq));
+    UNIT_TEST(last_transmitted_len == STATE_DELTA_PREFIX_LEN + 2 &&
+              expand_state_delta(&held, &held_seq, last_transmitted, RADIO_PROTOCOL_V2) &&
+              held_seq != keyframe_seq && compare_system_states(&held, &reply),
+              "second delta poll gets an empty delta");
+    radio_handle_input_character(STATE_DELTA_REQUEST_HEADER);
+    radio_handle_input_character(binary_to_base64(40));
+    UNIT_TEST(last_transmitted_len == STATE_DELTA_MAX_BODY_LEN + 2,
+              "delta poll for a frame that was never sent gets a keyframe");
+
+    // bundle polls carry the same delta states, plus as many of the errors
+    // that are waiting as fit
+    bundle_records_t records;
+    bool state_applied;
+    for (i = 0; i < BUNDLE_MAX_RECORDS + 1; ++i) {
+        report_error(3, E_BATT_UNDER_VOLTAGE, i, 0, 0, 0);
+    }
+    radio_handle_input_character(BUNDLE_REQUEST_HEADER);
+    radio_handle_input_character(binary_to_base64(held_seq));
+    UNIT_TEST(expand_bundle(&held, &held_seq, &state_applied, &records,
+                            last_transmitted, RADIO_PROTOCOL_V2) &&
+              state_applied && compare_system_states(&held, &reply) &&
+              !records.has_gps && records.num_errors == BUNDLE_MAX_RECORDS &&
+              records.errors[0].err.board_id == 3 && records.errors[0].err.byte4 == 0 &&
+              records.errors[0].count == 1 && records.errors[2].err.byte4 == 2,
+              "bundle poll gets a delta state and the first errors");
+    radio_handle_input_character(BUNDLE_REQUEST_HEADER);
+    radio_handle_input_character(binary_to_base64(held_seq));
+    UNIT_TEST(expand_bundle(&held, &held_seq, &state_applied, &records,
+                            last_transmitted, RADIO_PROTOCOL_V2) &&
+              state_applied && records.num_errors == 1 &&
+              records.errors[0].err.byte4 == BUNDLE_MAX_RECORDS,
+              "the next bundle poll gets the rest of the errors");
+    radio_handle_input_character(BUNDLE_REQUEST_HEADER);
+    radio_handle_input_character(binary_to_base64(held_seq));
+    UNIT_TEST(last_transmitted_len == BUNDLE_PREFIX_LEN + 2 &&
+              expand_bundle(&held, &held_seq, &state_applied, &records,
+                            last_transmitted, RADIO_PROTOCOL_V2) &&
+              state_applied && records.num_errors == 0,
+              "a bundle with nothing new in it is just the prefix");
+
+    // asking for a version we don't know leaves us where we were
+    create_version_select(9, select);
+    for (i = 0; i < VERSION_SELECT_BODY_LEN + 1; ++i) {
+        radio_handle_input_character(select[i]);
+    }
+    UNIT_TEST(radio_protocol_version() == RADIO_PROTOCOL_V2 &&
+              base64_to_binary(last_transmitted[1]) == RADIO_PROTOCOL_V2,
+              "unsupported version select is refused");
+
+    // switch to binary. The answer is ASCII with a version 1 frame check,
+    // after a 0x00 to end any binary frame RLCS might be in the middle of
+    create_version_select(RADIO_PROTOCOL_V3, select);
+    for (i = 0; i < VERSION_SELECT_BODY_LEN + 1; ++i) {
+        radio_handle_input_character(select[i]);
+    }
+    UNIT_TEST(radio_protocol_version() == RADIO_PROTOCOL_V3 &&
+              last_transmitted_len == 1 + VERSION_SELECT_BODY_LEN + 1 &&
+              last_transmitted[0] == 0 &&
+              last_transmitted[1] == VERSION_SELECT_HEADER &&
+              base64_to_binary(last_transmitted[2]) == RADIO_PROTOCOL_V3 &&
+              frame_check_ok(last_transmitted + 1, VERSION_SELECT_BODY_LEN, RADIO_PROTOCOL_V1),
+              "select binary, and get told so in ASCII");
+
+    // polls can be ASCII or binary in binary, but the reply is binary
+    uint8_t binary[BINARY_FRAME_MAX_LEN];
+    uint8_t binary_len;
+    char body[RADIO_FRAME_MAX_BODY_LEN + 1];
+    last_transmitted_len = 0;
+    radio_handle_input_character(STATE_REQUEST_HEADER);
+    UNIT_TEST(last_transmitted_len > 0 &&
+              last_transmitted[last_transmitted_len - 1] == 0 &&
+              binary_to_frame((uint8_t *) last_transmitted, last_transmitted_len - 1,
+                              body) >= STATE_COMMAND_BODY_LEN &&
+              expand_state_command(&reply, body, RADIO_PROTOCOL_V3),
+              "ASCII poll gets a binary state reply");
+    last_transmitted_len = 0;
+    char poll = STATE_REQUEST_HEADER;
+    binary_len = frame_to_binary(&poll, 1, binary);
+    for (i = 0; i < binary_len; ++i) {
+        radio_handle_input_character(binary[i]);
+    }
+    UNIT_TEST(last_transmitted_len > 0 &&
+              last_transmitted[last_transmitted_len - 1] == 0 &&
+              binary_to_frame((uint8_t *) last_transmitted, last_transmitted_len - 1,
+                              body) >= STATE_COMMAND_BODY_LEN &&
+              expand_state_command(&reply, body, RADIO_PROTOCOL_V3),
+              "binary poll gets a binary state reply");
+
+    // binary commands are accepted, unless they've been corrupted
+    create_state_command(open_valves_command, &open_both_valves, RADIO_PROTOCOL_V3);
+    binary_len = frame_to_binary(open_valves_command, STATE_COMMAND_BODY_LEN, binary);
+    for (i = 0; i < binary_len; ++i) {
+        radio_handle_input_character(binary[i]);
+    }
+    UNIT_TEST(radio_get_expected_inj_valve_state() == VALVE_OPEN,
+              "binary command accepted");
+
+    // an ASCII state command has no frame check in binary, so it's ignored
+    create_state_command(close_valves_command, &close_both_valves, RADIO_PROTOCOL_V3);
+    for (i = 0; i < STATE_COMMAND_BODY_LEN; ++i) {
+        radio_handle_input_character(close_valves_command[i]);
+    }
+    radio_handle_input_character(0);
+    UNIT_TEST(radio_get_expected_inj_valve_state() == VALVE_OPEN,
+              "ASCII command ignored in binary");
+    create_state_command(close_valves_command, &close_both_valves, RADIO_PROTOCOL_V3);
+    binary_len = frame_to_binary(close_valves_command, STATE_COMMAND_BODY_LEN, binary);
+    binary[3] ^= 0x10;
+    for (i = 0; i < binary_len; ++i) {
+        radio_handle_input_character(binary[i]);
+    }
+    UNIT_TEST(radio_get_expected_inj_valve_state() == VALVE_OPEN,
+              "corrupted binary command ignored");
+
+    // a frame's worth of garbage with no 0x00 on the end doesn't stop the
+    // next frame getting through
+    for (i = 0; i < 2 * BINARY_FRAME_MAX_LEN; ++i) {
+        radio_handle_input_character(0x55);
+    }
+    radio_handle_input_character(0);
+    binary_len = frame_to_binary(close_valves_command, STATE_COMMAND_BODY_LEN, binary);
+    for (i = 0; i < binary_len; ++i) {
+        radio_handle_input_character(binary[i]);
+    }
+    UNIT_TEST(radio_get_expected_inj_valve_state() == VALVE_CLOSED,
+              "binary command accepted after garbage");
+
+    // version 4 commands with one wrong character get fixed, but ones with
+    // two wrong characters are still refused
+    radio_handle_input_character(0);
+    create_version_select(RADIO_PROTOCOL_V4, select);
+    for (i = 0; i < VERSION_SELECT_BODY_LEN + 1; ++i) {
+        radio_handle_input_character(select[i]);
+    }
+    UNIT_TEST(radio_protocol_version() == RADIO_PROTOCOL_V4 &&
+              frame_check_ok(last_transmitted, VERSION_SELECT_BODY_LEN, RADIO_PROTOCOL_V4),
+              "select version 4, and get told so in version 4");
+    uint16_t corrected, uncorrectable;
+    create_state_command(open_valves_command, &open_both_valves, RADIO_PROTOCOL_V4);
+    open_valves_command[3] = open_valves_command[3] == 'A' ? 'B' : 'A';
+    for (i = 0; i < strlen(open_valves_command); ++i) {
+        radio_handle_input_character(open_valves_command[i]);
+    }
+    radio_fec_counts(&corrected, &uncorrectable);
+    UNIT_TEST(radio_get_expected_inj_valve_state() == VALVE_OPEN &&
+              corrected == 1 && uncorrectable == 0,
+              "version 4 command with a wrong character fixed and accepted");
+    create_state_command(close_valves_command, &close_both_valves, RADIO_PROTOCOL_V4);
+    close_valves_command[2] = close_valves_command[2] == 'A' ? 'B' : 'A';
+    close_valves_command[5] = close_valves_command[5] == 'A' ? 'B' : 'A';
+    for (i = 0; i < strlen(close_valves_command); ++i) {
+        radio_handle_input_character(close_valves_command[i]);
+    }
+    radio_fec_counts(&corrected, &uncorrectable);
+    UNIT_TEST(radio_get_expected_inj_valve_state() == VALVE_OPEN &&
+              corrected == 1 && uncorrectable == 1,
+              "version 4 command with two wrong characters ignored");
+
+    // and going back to version 1 works
+    create_version_select(RADIO_PROTOCOL_V1, select);
+    for (i = 0; i < VERSION_SELECT_BODY_LEN + 1; ++i) {
+        radio_handle_input_character(select[i]);
+    }
+    UNIT_TEST(radio_protocol_version() == RADIO_PROTOCOL_V1 &&
+              last_transmitted_len == VERSION_SELECT_BODY_LEN + 1,
+              "select version 1 again");
+
+    // subscribe for a bundle every 200 ms. One comes straight away, and then
+    // one every 200 ms, each relative to the last
+    char subscribe[SUBSCRIBE_LEN];
+    uint8_t subscribe_len = SUBSCRIBE_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V1);
+    create_subscribe(subscribe, 2, STATE_DELTA_NO_SNAPSHOT, RADIO_PROTOCOL_V1);
+    subscribe[2] ^= 0x01;
+    last_transmitted_len = 0;
+    for (i = 0; i < subscribe_len; ++i) {
+        radio_handle_input_character(subscribe[i]);
+    }
+    subscribe[2] ^= 0x01;
+    UNIT_TEST(last_transmitted_len == 0, "a subscribe with a bad frame check is ignored");
+    for (i = 0; i < subscribe_len; ++i) {
+        radio_handle_input_character(subscribe[i]);
+    }
+    held_seq = STATE_DELTA_NO_SNAPSHOT;
+    UNIT_TEST(expand_bundle(&held, &held_seq, &state_applied, &records,
+                            last_transmitted, RADIO_PROTOCOL_V1) &&
+              state_applied && !held.any_errors_detected,
+              "subscribing gets a bundle straight away");
+    last_transmitted_len = 0;
+    now_ms += 100;
+    radio_heartbeat();
+    UNIT_TEST(last_transmitted_len == 0, "nothing pushed before the period is up");
+    now_ms += 100;
+    radio_heartbeat();
+    UNIT_TEST(last_transmitted_len == BUNDLE_PREFIX_LEN + 1 &&
+              expand_bundle(&held, &held_seq, &state_applied, &records,
+                            last_transmitted, RADIO_PROTOCOL_V1) &&
+              state_applied,
+              "a bundle is pushed when the period is up, relative to the last one");
+    last_transmitted_len = 0;
+    errors_active = true;
+    radio_heartbeat();
+    UNIT_TEST(expand_bundle(&held, &held_seq, &state_applied, &records,
+                            last_transmitted, RADIO_PROTOCOL_V1) &&
+              state_applied && held.any_errors_detected,
+              "a bundle is pushed straight away when the error flag goes up");
+
+    // pushing isn't contact with RLCS, so the subscription lapses if it
+    // goes quiet
+    now_ms += TIME_NO_CONTACT_BEFORE_SAFE_STATE;
+    last_transmitted_len = 0;
+    radio_heartbeat();
+    now_ms += 200;
+    radio_heartbeat();
+    UNIT_TEST(last_transmitted_len == 0 &&
+              radio_get_expected_vent_valve_state() == VALVE_OPEN,
+              "pushes stop when RLCS goes quiet, and the vent still goes to safe state");
+
+    // acknowledged state commands
+    char seq_cmd[SEQ_COMMAND_LEN];
+    command_ack_t ack;
+    uint8_t seq_cmd_len = SEQ_COMMAND_BODY_LEN + frame_check_len(radio_protocol_version());
+    create_seq_command(seq_cmd, 40, &open_both_valves, radio_protocol_version());
+    for (i = 0; i < seq_cmd_len; ++i) {
+        radio_handle_input_character(seq_cmd[i]);
+    }
+    UNIT_TEST(expand_command_ack(&ack, last_transmitted, radio_protocol_version()) &&
+              ack.seq == 40 && ack.last_seq == 40 && ack.accepted &&
+              ack.injector_valve_state == VALVE_OPEN && ack.vent_valve_state == VALVE_OPEN &&
+              radio_get_expected_inj_valve_state() == VALVE_OPEN,
+              "an acknowledged command is applied and acknowledged");
+
+    // the next one, then the old one again, as if it had been resent late
+    create_seq_command(seq_cmd, 41, &close_both_valves, radio_protocol_version());
+    for (i = 0; i < seq_cmd_len; ++i) {
+        radio_handle_input_character(seq_cmd[i]);
+    }
+    create_seq_command(seq_cmd, 40, &open_both_valves, radio_protocol_version());
+    for (i = 0; i < seq_cmd_len; ++i) {
+        radio_handle_input_character(seq_cmd[i]);
+    }
+    UNIT_TEST(expand_command_ack(&ack, last_transmitted, radio_protocol_version()) &&
+              ack.seq == 40 && ack.last_seq == 41 && !ack.accepted &&
+              ack.injector_valve_state == VALVE_CLOSED &&
+              radio_get_expected_inj_valve_state() == VALVE_CLOSED,
+              "an old command is turned away, and doesn't undo a newer one");
+
+    create_seq_command(seq_cmd, 41, &close_both_valves, radio_protocol_version());
+    for (i = 0; i < seq_cmd_len; ++i) {
+        radio_handle_input_character(seq_cmd[i]);
+    }
+    UNIT_TEST(expand_command_ack(&ack, last_transmitted, radio_protocol_version()) &&
+              ack.seq == 41 && ack.accepted,
+              "a resent command that was already applied is acknowledged again");
+
+    // sequence numbers wrap round
+    create_seq_command(seq_cmd, (41 + COMMAND_SEQ_WINDOW) % COMMAND_SEQ_NONE,
+                       &open_both_valves, radio_protocol_version());
+    for (i = 0; i < seq_cmd_len; ++i) {
+        radio_handle_input_character(seq_cmd[i]);
+    }
+    UNIT_TEST(expand_command_ack(&ack, last_transmitted, radio_protocol_version()) &&
+              ack.accepted && ack.last_seq == (41 + COMMAND_SEQ_WINDOW) % COMMAND_SEQ_NONE,
+              "a command up to COMMAND_SEQ_WINDOW ahead is new, across the wrap");
+
+    // a corrupted one gets no answer at all
+    create_seq_command(seq_cmd, 10, &close_both_valves, radio_protocol_version());
+    seq_cmd[4] ^= 0x01;
+    last_transmitted_len = 0;
+    for (i = 0; i < seq_cmd_len; ++i) {
+        radio_handle_input_character(seq_cmd[i]);
+    }
+    UNIT_TEST(last_transmitted_len == 0 && radio_get_expected_inj_valve_state() == VALVE_OPEN,
+              "an acknowledged command with a bad frame check is ignored");
+
+    // board stats come back a page at a time
+    board_stats_t stats;
+    uint8_t page;
+    ingest_stats.frames_processed = 123456;
+    ingest_stats.frames_dropped = 7;
+    ingest_stats.backlog_high_water = 9;
+    char stats_query[2] = { BOARD_STATS_REQUEST_HEADER, binary_to_base64(BOARD_STATS_CAN_INGEST) };
+    last_transmitted_len = 0;
+    for (i = 0; i < sizeof(stats_query); ++i) {
+        radio_handle_input_character(stats_query[i]);
+    }
+    UNIT_TEST(expand_board_stats_message(&page, &stats, last_transmitted,
+                                         radio_protocol_version()) &&
+              page == BOARD_STATS_CAN_INGEST && stats.counters[0] == 123456 &&
+              stats.counters[2] == 7 && stats.counters[5] == 9,
+              "a board stats query is answered with the CAN ingest counters");
+
+    radio_tx_stats_t tx;
+    radio_tx_get_stats(RADIO_TX_SAFETY, &tx);
+    stats_query[1] = binary_to_base64(BOARD_STATS_RADIO_TX_SAFETY);
+    last_transmitted_len = 0;
+    for (i = 0; i < sizeof(stats_query); ++i) {
+        radio_handle_input_character(stats_query[i]);
+    }
+    UNIT_TEST(expand_board_stats_message(&page, &stats, last_transmitted,
+                                         radio_protocol_version()) &&
+              page == BOARD_STATS_RADIO_TX_SAFETY && tx.frames_sent > 0 &&
+              stats.counters[0] == tx.frames_sent &&
+              stats.counters[1] == tx.frames_dropped &&
+              stats.counters[3] == tx.max_depth &&
+              stats.counters[5] == tx.max_latency_ms,
+              "a board stats query is answered with a radio tx class's counters");
+
+    // errors that were merged together or dropped still get counted
+    error_stats_t errors_before, errors;
+    get_error_stats(&errors_before);
+    for (i = 0; i < 3; ++i) {
+        report_error(BOARD_UNIQUE_ID, E_BATT_UNDER_VOLTAGE, 0, 0, 0, 0);
+    }
+    get_error_stats(&errors);
+    // and the debug class has used up its share of the link, so let it
+    // refill first
+    now_ms += 1000;
+    stats_query[1] = binary_to_base64(BOARD_STATS_ERRORS);
+    last_transmitted_len = 0;
+    for (i = 0; i < sizeof(stats_query); ++i) {
+        radio_handle_input_character(stats_query[i]);
+    }
+    UNIT_TEST(expand_board_stats_message(&page, &stats, last_transmitted,
+                                         radio_protocol_version()) &&
+              page == BOARD_STATS_ERRORS && errors.reported == errors_before.reported + 3 &&
+              stats.counters[0] == errors.reported &&
+              stats.counters[1] == errors.coalesced &&
+              stats.counters[2] == errors.dropped &&
+              stats.counters[3] == errors.max_pending,
+              "a board stats query is answered with the error counters");
+
+    stats_query[1] = binary_to_base64(BOARD_STATS_NUM_PAGES);
+    last_transmitted_len = 0;
+    for (i = 0; i < sizeof(stats_query); ++i) {
+        radio_handle_input_character(stats_query[i]);
+    }
+    UNIT_TEST(last_transmitted_len == 0, "a query for a board stats page we don't have is ignored");
+
+    // RLCS switches the radio mirror, and gets its stats back to say so
+    mirror_stats.bytes_mirrored = 4321;
+    mirror_stats.messages_sent = 541;
+    now_ms += 1000;
+    char mirror_cmd[RADIO_MIRROR_LEN];
+    uint8_t mirror_cmd_len = RADIO_MIRROR_BODY_LEN + frame_check_len(radio_protocol_version());
+    create_radio_mirror(mirror_cmd, 0, radio_protocol_version());
+    last_transmitted_len = 0;
+    for (i = 0; i < mirror_cmd_len; ++i) {
+        radio_handle_input_character(mirror_cmd[i]);
+    }
+    UNIT_TEST(!mirror_enabled &&
+              expand_board_stats_message(&page, &stats, last_transmitted,
+                                         radio_protocol_version()) &&
+              page == BOARD_STATS_RADIO_MIRROR && stats.counters[0] == 0 &&
+              stats.counters[1] == 4321 && stats.counters[4] == 541,
+              "RLCS can turn the radio mirror off, and is told it's off");
+
+    // a bit flip that turns an off into an on is caught by the frame check
+    now_ms += 1000;
+    mirror_cmd[1] = binary_to_base64(1);
+    last_transmitted_len = 0;
+    for (i = 0; i < mirror_cmd_len; ++i) {
+        radio_handle_input_character(mirror_cmd[i]);
+    }
+    UNIT_TEST(!mirror_enabled && last_transmitted_len == 0,
+              "a corrupted radio mirror switch is ignored");
+
+    create_radio_mirror(mirror_cmd, 1, radio_protocol_version());
+    for (i = 0; i < mirror_cmd_len; ++i) {
+        radio_handle_input_character(mirror_cmd[i]);
+    }
+    UNIT_TEST(mirror_enabled &&
+              expand_board_stats_message(&page, &stats, last_transmitted,
+                                         radio_protocol_version()) &&
+              stats.counters[0] == 1,
+              "RLCS can turn the radio mirror back on");
+
+    now_ms += 1000;
+    create_radio_mirror(mirror_cmd, 2, radio_protocol_version());
+    memset(last_transmitted, 0, sizeof(last_transmitted));
+    for (i = 0; i < mirror_cmd_len; ++i) {
+        radio_handle_input_character(mirror_cmd[i]);
+    }
+    UNIT_TEST(mirror_enabled &&
+              expand_board_stats_message(&page, &stats, last_transmitted,
+                                         radio_protocol_version()) &&
+              stats.counters[0] == 1,
+              "anything but 0 or 1 just asks whether the radio mirror is on");
+
+    // and how the uplink's holding up
+    radio_parser_stats_t input;
+    now_ms += 1000;
+    stats_query[1] = binary_to_base64(BOARD_STATS_RADIO_INPUT);
+    memset(last_transmitted, 0, sizeof(last_transmitted));
+    for (i = 0; i < sizeof(stats_query); ++i) {
+        radio_handle_input_character(stats_query[i]);
+    }
+    radio_input_stats(&input);
+    UNIT_TEST(expand_board_stats_message(&page, &stats, last_transmitted,
+                                         radio_protocol_version()) &&
+              page == BOARD_STATS_RADIO_INPUT && input.fec_corrected > 0 &&
+              stats.counters[0] == input.fec_corrected &&
+              stats.counters[1] == input.fec_uncorrectable &&
+              stats.counters[2] == input.frames_ok &&
+              stats.counters[3] == input.bad_checks &&
+              stats.counters[4] == input.truncated &&
+              stats.counters[5] == input.resyncs,
+              "a board stats query is answered with the radio input counters");
+
+    // the errors merged together above go out as one. RADIO_PROTOCOL_V1
+    // can't say how often it was repeated
+    now_ms += 1000;
+    memset(last_transmitted, 0, sizeof(last_transmitted));
+    radio_heartbeat();
+    UNIT_TEST(radio_protocol_version() == RADIO_PROTOCOL_V1 &&
+              last_transmitted_len == ERROR_MSG_BODY_LEN + 1 &&
+              last_transmitted[0] == ERROR_COMMAND_HEADER,
+              "version 1 gets a repeated error as a plain error");
+
+    // but later versions can
+    error_report_t report;
+    create_version_select(RADIO_PROTOCOL_V2, select);
+    for (i = 0; i < VERSION_SELECT_BODY_LEN + 1; ++i) {
+        radio_handle_input_character(select[i]);
+    }
+    for (i = 0; i < 3; ++i) {
+        report_error(BOARD_UNIQUE_ID, E_BATT_UNDER_VOLTAGE, 0, 0, 0, 0);
+    }
+    now_ms += 2000;
+    memset(last_transmitted, 0, sizeof(last_transmitted));
+    radio_heartbeat();
+    UNIT_TEST(last_transmitted_len == ERROR_REPORT_BODY_LEN + 2 &&
+              expand_error_report(&report, last_transmitted, RADIO_PROTOCOL_V2) &&
+              report.err.board_id == BOARD_UNIQUE_ID && report.count == 3 &&
+              report.age_s == 2,
+              "a repeated error goes out with how often and how long ago it was reported");
+
     printf("%s Test Results: %i tests, %i passed, %i %sfailed%s\n",
             __FILE__,
             total_tests,
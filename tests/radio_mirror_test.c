@@ -0,0 +1,160 @@
+#include "radio_mirror.h"
+#include "message_types.h"
+#include "can.h"
+#include <stdio.h>
+#include <string.h>
+
+//pic18_time.c depends on xc.h, so we can't use its millis function
+static uint32_t now_ms = 0;
+uint32_t millis(void) { return now_ms; }
+
+static bool bus_powered = true;
+bool is_bus_powered(void) { return bus_powered; }
+
+//what went to the CAN transmit buffer, which the tests can fill up
+static can_msg_t sent[32];
+static int num_sent = 0;
+static bool txb_full = false;
+bool txb_enqueue(const can_msg_t *msg)
+{
+    if (txb_full || num_sent == sizeof(sent) / sizeof(sent[0])) {
+        return false;
+    }
+    sent[num_sent++] = *msg;
+    return true;
+}
+
+#define COLOR_GREEN "\x1B[32m"
+#define COLOR_RED   "\x1B[31m"
+#define COLOR_NONE  "\x1B[0m"
+
+static int total_tests = 0;
+static int failing_tests = 0;
+#define UNIT_TEST(expected_result, description)                                 \
+    if( (expected_result) ) {                                                   \
+        printf("%sTest Passed:%s %s\n", COLOR_GREEN, COLOR_NONE, description);  \
+    } else {                                                                    \
+        printf("%sTest Failed:%s %s\n", COLOR_RED, COLOR_NONE, description);    \
+        failing_tests++;                                                        \
+    }                                                                           \
+    total_tests++;
+
+static void append(const char *bytes, uint8_t len)
+{
+    while (len--) {
+        radio_mirror_append((uint8_t) *bytes++);
+    }
+}
+
+int main() {
+    radio_mirror_stats_t stats;
+    init_radio_mirror();
+    now_ms = 1000;
+
+    //nothing goes out until the heartbeat
+    append("{ABCDEFGHI", 10);
+    UNIT_TEST(num_sent == 0, "appending doesn't send anything");
+
+    radio_mirror_heartbeat();
+    UNIT_TEST(num_sent == 1 && sent[0].data_len == 8 &&
+              memcmp(sent[0].data, "{ABCDEFG", 8) == 0,
+              "the heartbeat sends a full chunk");
+    UNIT_TEST(sent[0].sid == (MSG_DEBUG_PRINTF | BOARD_UNIQUE_ID),
+              "as a MSG_DEBUG_PRINTF from this board");
+
+    //the two left over wait a while, then go on their own
+    now_ms += RADIO_MIRROR_FLUSH_MS - 1;
+    radio_mirror_heartbeat();
+    UNIT_TEST(num_sent == 1, "a partial chunk waits for more");
+    now_ms += 1;
+    radio_mirror_heartbeat();
+    UNIT_TEST(num_sent == 2 && sent[1].data_len == 2 && memcmp(sent[1].data, "HI", 2) == 0,
+              "a partial chunk goes out once it's waited long enough");
+
+    //binary frames are full of zeros, which have to survive
+    num_sent = 0;
+    const char binary[8] = { 0x05, 0x00, 0x11, 0x00, 0x22, 0x33, 0x00, 0x44 };
+    append(binary, sizeof(binary));
+    radio_mirror_heartbeat();
+    UNIT_TEST(num_sent == 1 && sent[0].data_len == 8 && memcmp(sent[0].data, binary, 8) == 0,
+              "zero bytes are mirrored like any other");
+
+    //a burst goes out in as many chunks as it takes, in order
+    num_sent = 0;
+    append("0123456789abcdefghijklmnopqrstuv", 32);
+    radio_mirror_heartbeat();
+    UNIT_TEST(num_sent == 4 && memcmp(sent[3].data, "opqrstuv", 8) == 0,
+              "a burst goes out in order, a chunk at a time");
+
+    //when CAN is backed up, bytes wait rather than getting lost
+    num_sent = 0;
+    txb_full = true;
+    append("waiting!", 8);
+    radio_mirror_heartbeat();
+    txb_full = false;
+    radio_mirror_heartbeat();
+    UNIT_TEST(num_sent == 1 && memcmp(sent[0].data, "waiting!", 8) == 0,
+              "bytes wait for room in the CAN transmit buffer");
+
+    //but once the buffer's full, more get dropped
+    num_sent = 0;
+    init_radio_mirror();
+    uint8_t i;
+    for (i = 0; i < RADIO_MIRROR_BUFFER_LEN + 3; ++i) {
+        radio_mirror_append(i);
+    }
+    radio_mirror_get_stats(&stats);
+    UNIT_TEST(stats.bytes_dropped == 3, "bytes that don't fit are counted as dropped");
+    radio_mirror_heartbeat();
+    UNIT_TEST(num_sent == RADIO_MIRROR_BUFFER_LEN / 8 &&
+              sent[num_sent - 1].data[7] == RADIO_MIRROR_BUFFER_LEN - 1,
+              "and the ones that did fit still go out");
+
+    //with the bus off, there's no one to send to
+    num_sent = 0;
+    bus_powered = false;
+    append("nobody", 6);
+    radio_mirror_heartbeat();
+    bus_powered = true;
+    now_ms += 10 * RADIO_MIRROR_FLUSH_MS;
+    radio_mirror_heartbeat();
+    radio_mirror_heartbeat();
+    radio_mirror_get_stats(&stats);
+    UNIT_TEST(num_sent == 0 && stats.bytes_discarded == 6,
+              "nothing is sent while the bus is off, and what was waiting is discarded");
+
+    //mirroring can be turned off and back on
+    radio_mirror_set_enabled(false);
+    append("ignored!", 8);
+    radio_mirror_heartbeat();
+    UNIT_TEST(!radio_mirror_enabled() && num_sent == 0, "nothing is mirrored while it's off");
+    radio_mirror_set_enabled(true);
+    append("mirrored", 8);
+    radio_mirror_heartbeat();
+    UNIT_TEST(num_sent == 1 && memcmp(sent[0].data, "mirrored", 8) == 0,
+              "and it starts again when it's turned back on");
+
+    radio_mirror_get_stats(&stats);
+    UNIT_TEST(stats.messages_sent == RADIO_MIRROR_BUFFER_LEN / 8 + 1 &&
+              stats.bytes_mirrored == RADIO_MIRROR_BUFFER_LEN + 8 &&
+              stats.partial_flushes == 0,
+              "messages and bytes are counted");
+
+    //the counters don't stop at 16 bits
+    uint16_t j;
+    for (j = 0; j < 65536 / RADIO_MIRROR_BUFFER_LEN + 1; ++j) {
+        num_sent = 0;
+        append("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef",
+               RADIO_MIRROR_BUFFER_LEN);
+        radio_mirror_heartbeat();
+    }
+    radio_mirror_get_stats(&stats);
+    UNIT_TEST(stats.bytes_mirrored == 65536 + 2 * RADIO_MIRROR_BUFFER_LEN + 8,
+              "the byte count goes past 65535");
+
+    printf("%s Test Results: %i tests, %i passed, %i %sfailed%s\n",
+           __FILE__,
+           total_tests,
+           total_tests - failing_tests,
+           failing_tests, failing_tests ? COLOR_RED : COLOR_GREEN, COLOR_NONE);
+}
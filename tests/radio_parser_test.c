@@ -0,0 +1,210 @@
+#include "radio_parser.h"
+#include <stdio.h>
+#include <string.h>
+
+//serialize.o needs this for perf stats messages, which we don't test here
+uint16_t perf_stats_mean_us(const perf_stat_t *stat) { return 0; }
+
+#define COLOR_GREEN "\x1B[32m"
+#define COLOR_RED   "\x1B[31m"
+#define COLOR_NONE  "\x1B[0m"
+
+static int total_tests = 0;
+static int failing_tests = 0;
+#define UNIT_TEST(expected_result, description)                                 \
+    if( (expected_result) ) {                                                   \
+        printf("%sTest Passed:%s %s\n", COLOR_GREEN, COLOR_NONE, description);  \
+    } else {                                                                    \
+        printf("%sTest Failed:%s %s\n", COLOR_RED, COLOR_NONE, description);    \
+        failing_tests++;                                                        \
+    }                                                                           \
+    total_tests++;
+
+//the frames handed over, one after the other
+static char handled[512];
+static uint16_t handled_len = 0;
+static uint8_t frames_handled = 0;
+
+static void handler(char *frame, uint8_t body_len)
+{
+    memcpy(handled + handled_len, frame, body_len);
+    handled_len += body_len;
+    frames_handled++;
+}
+
+static void forget_handled(void)
+{
+    handled_len = 0;
+    frames_handled = 0;
+}
+
+//a frame whose length is in its second character, like a delta state
+static uint8_t length_in_prefix(const char *prefix)
+{
+    uint8_t len = base64_to_binary(prefix[1]);
+    return len == BASE64_INVALID || len < 2 ? 0 : len;
+}
+
+static const radio_frame_type_t types[] = {
+    { STATE_COMMAND_HEADER, STATE_COMMAND_BODY_LEN, 0, NULL, PARSER_CHECK_VERSION_AFTER_HEADER },
+    { STATE_REQUEST_HEADER, 1, 0, NULL, PARSER_CHECK_NONE },
+    { STATE_DELTA_REQUEST_HEADER, 2, 0, NULL, PARSER_CHECK_NONE },
+    { ERROR_COMMAND_HEADER, 0, 2, &length_in_prefix, PARSER_CHECK_VERSION },
+    { VERSION_SELECT_HEADER, VERSION_SELECT_BODY_LEN, 0, NULL, PARSER_CHECK_V1 },
+};
+
+static radio_parser_t parser;
+
+static void feed(const char *bytes, uint8_t len, enum RADIO_PROTOCOL_VERSION version)
+{
+    while (len--) {
+        radio_parser_feed(&parser, (uint8_t) *bytes++, version);
+    }
+}
+
+int main() {
+    char cmd[STATE_COMMAND_LEN];
+    char variable[RADIO_PARSER_MAX_LEN];
+    char select[VERSION_SELECT_LEN];
+    system_state state;
+    memset(&state, 0, sizeof(state));
+    state.tank_pressure = 700;
+    state.bus_is_powered = true;
+
+    init_radio_parser(&parser, types, sizeof(types) / sizeof(types[0]), &handler);
+    UNIT_TEST(radio_parser_is_header(&parser, STATE_COMMAND_HEADER) &&
+              !radio_parser_is_header(&parser, 'A') &&
+              !radio_parser_is_header(&parser, GPS_MSG_HEADER),
+              "only headers in the table are headers");
+
+    uint8_t version;
+    for (version = RADIO_PROTOCOL_V1; version <= RADIO_PROTOCOL_LATEST; ++version) {
+        if (version == RADIO_PROTOCOL_V3) {
+            continue;
+        }
+        uint8_t cmd_len = STATE_COMMAND_BODY_LEN + frame_check_len(version);
+        create_state_command(cmd, &state, version);
+        init_radio_parser(&parser, types, sizeof(types) / sizeof(types[0]), &handler);
+        forget_handled();
+        feed(cmd, cmd_len, version);
+        UNIT_TEST(frames_handled == 1 && handled_len == STATE_COMMAND_BODY_LEN &&
+                  memcmp(handled, cmd, STATE_COMMAND_BODY_LEN) == 0 &&
+                  parser.stats.frames_ok == 1,
+                  "a state command comes out whole, without its frame check");
+
+        forget_handled();
+        cmd[5] ^= 0x01;
+        feed(cmd, cmd_len, version);
+        cmd[5] ^= 0x01;
+        if (version == RADIO_PROTOCOL_V4) {
+            UNIT_TEST(frames_handled == 1 && parser.stats.fec_corrected == 1,
+                      "FEC fixes a state command with a bit flipped");
+        } else {
+            UNIT_TEST(frames_handled == 0 && parser.stats.bad_checks == 1,
+                      "a state command with a bit flipped is turned away");
+        }
+    }
+
+    //a frame cut short by another one only loses itself
+    init_radio_parser(&parser, types, sizeof(types) / sizeof(types[0]), &handler);
+    forget_handled();
+    create_state_command(cmd, &state, RADIO_PROTOCOL_V2);
+    feed(cmd, 10, RADIO_PROTOCOL_V2);
+    feed(cmd, STATE_COMMAND_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V2), RADIO_PROTOCOL_V2);
+    UNIT_TEST(frames_handled == 1 && parser.stats.truncated == 1,
+              "a frame restarts straight away on a header, and the old one counts as truncated");
+
+    //nor does one with a byte dropped out of the middle
+    forget_handled();
+    feed(cmd, 7, RADIO_PROTOCOL_V2);
+    feed(cmd + 8, STATE_COMMAND_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V2) - 8,
+         RADIO_PROTOCOL_V2);
+    radio_parser_feed(&parser, STATE_REQUEST_HEADER, RADIO_PROTOCOL_V2);
+    UNIT_TEST(frames_handled == 1 && handled[0] == STATE_REQUEST_HEADER,
+              "the frame after one with a byte dropped still comes through");
+
+    //junk between frames
+    init_radio_parser(&parser, types, sizeof(types) / sizeof(types[0]), &handler);
+    forget_handled();
+    feed("xyz\r\n", 5, RADIO_PROTOCOL_V2);
+    feed("]B", 2, RADIO_PROTOCOL_V2);
+    feed("$$AAAA", 6, RADIO_PROTOCOL_V2);
+    feed("}", 1, RADIO_PROTOCOL_V2);
+    UNIT_TEST(frames_handled == 2 && memcmp(handled, "]B}", 3) == 0 &&
+              parser.stats.resyncs == 2 && parser.stats.bytes_discarded == 11,
+              "bytes outside frames and frames we don't know are skipped");
+
+    //variable length frames
+    init_radio_parser(&parser, types, sizeof(types) / sizeof(types[0]), &handler);
+    forget_handled();
+    memset(variable, 'A', sizeof(variable));
+    variable[0] = ERROR_COMMAND_HEADER;
+    variable[1] = binary_to_base64(12);
+    uint8_t variable_len = 12 + append_frame_check(variable, 12, RADIO_PROTOCOL_V4);
+    feed(variable, variable_len, RADIO_PROTOCOL_V4);
+    UNIT_TEST(frames_handled == 1 && handled_len == 12,
+              "a variable length frame is as long as its prefix says");
+    variable[1] = binary_to_base64(1);
+    feed(variable, variable_len, RADIO_PROTOCOL_V4);
+    UNIT_TEST(frames_handled == 1 && parser.stats.bad_checks == 1,
+              "a variable length frame whose prefix makes no sense is turned away");
+    variable[1] = binary_to_base64(60);
+    feed(variable, 2, RADIO_PROTOCOL_V4);
+    UNIT_TEST(!radio_parser_in_frame(&parser) && parser.stats.bad_checks == 2,
+              "a frame too long for the parser is turned away");
+
+    //the frame check is worked out as the bytes come in, before the
+    //parser knows how long the frame is
+    for (version = RADIO_PROTOCOL_V1; version <= RADIO_PROTOCOL_V2; ++version) {
+        init_radio_parser(&parser, types, sizeof(types) / sizeof(types[0]), &handler);
+        forget_handled();
+        memset(variable, 'B', sizeof(variable));
+        variable[0] = ERROR_COMMAND_HEADER;
+        variable[1] = binary_to_base64(9);
+        variable_len = 9 + append_frame_check(variable, 9, version);
+        feed(variable, variable_len, version);
+        variable[variable_len - 1] = variable[variable_len - 1] == 'A' ? 'B' : 'A';
+        feed(variable, variable_len, version);
+        UNIT_TEST(frames_handled == 1 && handled_len == 9 &&
+                  parser.stats.frames_ok == 1 && parser.stats.bad_checks == 1,
+                  "a variable length frame's frame check covers its prefix");
+    }
+
+    //frame checks that don't depend on the version
+    init_radio_parser(&parser, types, sizeof(types) / sizeof(types[0]), &handler);
+    forget_handled();
+    create_version_select(RADIO_PROTOCOL_V3, select);
+    feed(select, VERSION_SELECT_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V1),
+         RADIO_PROTOCOL_V4);
+    UNIT_TEST(frames_handled == 1 && handled[0] == VERSION_SELECT_HEADER,
+              "a version select always has a RADIO_PROTOCOL_V1 frame check");
+    feed(select, VERSION_SELECT_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V1),
+         RADIO_PROTOCOL_V3);
+    create_state_command(cmd, &state, RADIO_PROTOCOL_V3);
+    feed(cmd, STATE_COMMAND_BODY_LEN, RADIO_PROTOCOL_V3);
+    UNIT_TEST(frames_handled == 2 && !radio_parser_in_frame(&parser),
+              "frames that need an ASCII frame check are skipped in RADIO_PROTOCOL_V3");
+
+    //bursts, as they come off the UART
+    init_radio_parser(&parser, types, sizeof(types) / sizeof(types[0]), &handler);
+    forget_handled();
+    create_state_command(cmd, &state, RADIO_PROTOCOL_V4);
+    uint8_t i;
+    for (i = 0; i < 10; ++i) {
+        feed(cmd, STATE_COMMAND_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V4), RADIO_PROTOCOL_V4);
+        feed("]A}", 3, RADIO_PROTOCOL_V4);
+    }
+    UNIT_TEST(frames_handled == 30 && parser.stats.frames_ok == 30 &&
+              parser.stats.resyncs == 0 && parser.stats.truncated == 0,
+              "back to back frames all come through");
+
+    radio_parser_reset(&parser);
+    UNIT_TEST(!radio_parser_in_frame(&parser) && parser.stats.frames_ok == 30,
+              "resetting the parser keeps its stats");
+
+    printf("%s Test Results: %i tests, %i passed, %i %sfailed%s\n",
+           __FILE__,
+           total_tests,
+           total_tests - failing_tests,
+           failing_tests, failing_tests ? COLOR_RED : COLOR_GREEN, COLOR_NONE);
+}
@@ -0,0 +1,153 @@
+#include "radio_tx.h"
+#include <stdio.h>
+#include <string.h>
+
+//pic18_time.c depends on xc.h, so we can't use its millis function
+static uint32_t now_ms = 0;
+uint32_t millis(void) { return now_ms; }
+
+//what the UART was handed, one frame after the other, and how much it's got
+//left to send, which the tests set to hold radio_tx back
+static uint8_t sent[1024];
+static uint16_t sent_len = 0;
+static uint8_t frames_sent = 0;
+static uint8_t pending = 0;
+void uart_transmit_buffer(uint8_t *tx, uint8_t len)
+{
+    if (sent_len + len <= sizeof(sent)) {
+        memcpy(sent + sent_len, tx, len);
+        sent_len += len;
+    }
+    frames_sent++;
+}
+uint8_t uart_transmit_pending(void) { return pending; }
+
+#define COLOR_GREEN "\x1B[32m"
+#define COLOR_RED   "\x1B[31m"
+#define COLOR_NONE  "\x1B[0m"
+
+static int total_tests = 0;
+static int failing_tests = 0;
+#define UNIT_TEST(expected_result, description)                                 \
+    if( (expected_result) ) {                                                   \
+        printf("%sTest Passed:%s %s\n", COLOR_GREEN, COLOR_NONE, description);  \
+    } else {                                                                    \
+        printf("%sTest Failed:%s %s\n", COLOR_RED, COLOR_NONE, description);    \
+        failing_tests++;                                                        \
+    }                                                                           \
+    total_tests++;
+
+static void forget_sent(void)
+{
+    sent_len = 0;
+    frames_sent = 0;
+}
+
+int main() {
+    uint8_t frame[RADIO_TX_MAX_FRAME_LEN];
+    radio_tx_stats_t stats;
+    uint8_t i;
+    now_ms = 1000;
+
+    //with nothing in the way, frames go straight out
+    memset(frame, 'S', sizeof(frame));
+    UNIT_TEST(radio_tx_send(RADIO_TX_SAFETY, frame, 10) && frames_sent == 1 &&
+              sent_len == 10 && sent[0] == 'S',
+              "a frame goes to the UART straight away when it's idle");
+
+    //when the UART's busy, frames wait, then go highest priority first
+    forget_sent();
+    pending = 90;
+    memset(frame, 'D', sizeof(frame));
+    radio_tx_send(RADIO_TX_DEBUG, frame, 5);
+    memset(frame, 'E', sizeof(frame));
+    radio_tx_send(RADIO_TX_ERROR, frame, 5);
+    memset(frame, 'S', sizeof(frame));
+    radio_tx_send(RADIO_TX_SAFETY, frame, 5);
+    UNIT_TEST(frames_sent == 0, "nothing goes to the UART while it's busy");
+    radio_tx_get_stats(RADIO_TX_ERROR, &stats);
+    UNIT_TEST(stats.depth == 1, "a frame waits in its class's queue");
+
+    pending = 0;
+    now_ms += 20;
+    radio_tx_service();
+    UNIT_TEST(frames_sent == 3 && sent[0] == 'S' && sent[5] == 'E' && sent[10] == 'D',
+              "waiting frames go out highest priority first");
+    radio_tx_get_stats(RADIO_TX_SAFETY, &stats);
+    UNIT_TEST(stats.frames_sent == 2 && stats.max_latency_ms == 20 && stats.depth == 0,
+              "frames sent and latency are counted");
+
+    //a full queue drops what's sent to it
+    forget_sent();
+    pending = 90;
+    for (i = 0; i < RADIO_TX_QUEUE_DEPTH; ++i) {
+        radio_tx_send(RADIO_TX_GPS, frame, 5);
+    }
+    UNIT_TEST(!radio_tx_ready(RADIO_TX_GPS) && !radio_tx_send(RADIO_TX_GPS, frame, 5),
+              "a class with a full queue isn't ready, and turns frames away");
+    radio_tx_get_stats(RADIO_TX_GPS, &stats);
+    UNIT_TEST(stats.frames_dropped == 1 && stats.max_depth == RADIO_TX_QUEUE_DEPTH,
+              "frames turned away are counted as dropped");
+
+    radio_tx_flush();
+    radio_tx_get_stats(RADIO_TX_GPS, &stats);
+    UNIT_TEST(stats.depth == 0 && stats.frames_dropped == 1 + RADIO_TX_QUEUE_DEPTH,
+              "flushing throws away everything that's waiting");
+    pending = 0;
+    radio_tx_service();
+    UNIT_TEST(frames_sent == 0, "nothing that was flushed gets sent");
+
+    //a rate limited class can only burst so far, then has to wait
+    forget_sent();
+    memset(frame, 'E', sizeof(frame));
+    uint16_t error_bytes = 0;
+    for (i = 0; i < 100 && radio_tx_ready(RADIO_TX_ERROR); ++i) {
+        radio_tx_send(RADIO_TX_ERROR, frame, RADIO_TX_MAX_FRAME_LEN);
+        error_bytes += RADIO_TX_MAX_FRAME_LEN;
+    }
+    UNIT_TEST(i < 100 && error_bytes <= 4 * RADIO_TX_MAX_FRAME_LEN + RADIO_TX_MAX_FRAME_LEN,
+              "errors stop being ready once they've had their burst");
+    UNIT_TEST(radio_tx_ready(RADIO_TX_SAFETY),
+              "state replies are never rate limited");
+
+    //one that can't afford its next frame lets lower priorities go first
+    forget_sent();
+    radio_tx_send(RADIO_TX_ERROR, frame, RADIO_TX_MAX_FRAME_LEN);
+    memset(frame, 'D', sizeof(frame));
+    radio_tx_send(RADIO_TX_DEBUG, frame, 5);
+    UNIT_TEST(frames_sent == 1 && sent[0] == 'D',
+              "a class over its budget doesn't hold up the ones under theirs");
+
+    //and gets its turn once it's saved up enough
+    forget_sent();
+    now_ms += 1000;
+    radio_tx_service();
+    UNIT_TEST(frames_sent == 1 && sent[0] == 'E', "a class over its budget sends once it's refilled");
+    UNIT_TEST(radio_tx_ready(RADIO_TX_ERROR), "and is ready again");
+
+    //over a long stretch, errors get about a quarter of the link
+    forget_sent();
+    uint32_t start = now_ms;
+    uint32_t error_total = 0;
+    memset(frame, 'E', sizeof(frame));
+    for (now_ms = start; now_ms < start + 10000; now_ms += 10) {
+        radio_tx_service();
+        if (radio_tx_ready(RADIO_TX_ERROR)) {
+            radio_tx_send(RADIO_TX_ERROR, frame, RADIO_TX_MAX_FRAME_LEN);
+            error_total += RADIO_TX_MAX_FRAME_LEN;
+        }
+    }
+    UNIT_TEST(error_total <= 10 * RADIO_TX_BYTES_PER_S / 4 + 5 * RADIO_TX_MAX_FRAME_LEN &&
+              error_total >= 10 * RADIO_TX_BYTES_PER_S / 4 - RADIO_TX_MAX_FRAME_LEN,
+              "errors are held to their share of the link");
+
+    UNIT_TEST(!radio_tx_send(RADIO_TX_SAFETY, frame, RADIO_TX_MAX_FRAME_LEN + 1) &&
+              !radio_tx_send(RADIO_TX_NUM_CLASSES, frame, 5),
+              "frames too long for the queue or in no class are turned away");
+
+    printf("%s Test Results: %i tests, %i passed, %i %sfailed%s\n",
+           __FILE__,
+           total_tests,
+           total_tests - failing_tests,
+           failing_tests, failing_tests ? COLOR_RED : COLOR_GREEN, COLOR_NONE);
+}
@@ -0,0 +1,105 @@
+#include "scheduler.h"
+#include "perf_stats.h"
+#include <stdio.h>
+
+//pic18_time.c depends on xc.h, so we can't use its millis function.
+//Instead we drive the scheduler off of a fake clock that we move by hand
+static uint32_t fake_millis = 0;
+uint32_t millis(void) { return fake_millis; }
+
+//the scheduler times each task with micros(). Make every task look like it
+//took 7us, and remember which slots got a measurement
+static uint32_t fake_micros = 0;
+uint32_t micros(void) { fake_micros += 7; return fake_micros; }
+static uint32_t slot_records[PERF_NUM_SLOTS];
+static uint32_t last_recorded_us = 0;
+void perf_stats_record(uint8_t slot, uint32_t elapsed_us)
+{
+    slot_records[slot]++;
+    last_recorded_us = elapsed_us;
+}
+
+#define COLOR_GREEN "\x1B[32m"
+#define COLOR_RED   "\x1B[31m"
+#define COLOR_NONE  "\x1B[0m"
+
+static int total_tests = 0;
+static int failing_tests = 0;
+#define UNIT_TEST(expected_result, description)                                 \
+    if( (expected_result) ) {                                                   \
+        printf("%sTest Passed:%s %s\n", COLOR_GREEN, COLOR_NONE, description);  \
+    } else {                                                                    \
+        printf("%sTest Failed:%s %s\n", COLOR_RED, COLOR_NONE, description);    \
+        failing_tests++;                                                        \
+    }                                                                           \
+    total_tests++;
+
+static int fast_runs = 0;
+static int slow_runs = 0;
+static void fast_task(void) { fast_runs++; }
+static void slow_task(void) { slow_runs++; }
+
+//advance the fake clock one millisecond at a time, running the scheduler
+//whenever something is due, like the main loop does
+static void run_until(uint32_t end)
+{
+    while (fake_millis < end) {
+        scheduler_run_due_tasks();
+        fake_millis++;
+    }
+}
+
+int main() {
+    init_scheduler();
+    UNIT_TEST(scheduler_ms_until_next_deadline() == UINT32_MAX,
+              "no tasks means no deadline");
+    UNIT_TEST(scheduler_add_task(&fast_task, 10), "add a 10ms task");
+    UNIT_TEST(scheduler_add_task(&slow_task, 100), "add a 100ms task");
+    UNIT_TEST(!scheduler_add_task(NULL, 10), "adding a NULL task fails");
+
+    UNIT_TEST(scheduler_ms_until_next_deadline() == 0,
+              "new tasks are due immediately");
+    scheduler_run_due_tasks();
+    UNIT_TEST(fast_runs == 1 && slow_runs == 1, "both tasks run at time 0");
+    UNIT_TEST(slot_records[PERF_SLOT_FIRST_TASK] == 1 &&
+              slot_records[PERF_SLOT_FIRST_TASK + 1] == 1 &&
+              last_recorded_us == 7,
+              "each task's run time is recorded in its own perf slot");
+    UNIT_TEST(scheduler_ms_until_next_deadline() == 10,
+              "next deadline is the fast task's");
+
+    //running the scheduler again without time passing shouldn't run anything
+    scheduler_run_due_tasks();
+    UNIT_TEST(fast_runs == 1 && slow_runs == 1, "nothing runs twice in 1ms");
+
+    fake_millis = 1;
+    run_until(1000);
+    UNIT_TEST(fast_runs == 100, "10ms task ran 100 times in a second");
+    UNIT_TEST(slow_runs == 10, "100ms task ran 10 times in a second");
+
+    //stall the main loop for 55ms. The fast task should run once when we get
+    //back, not 5 times in a row to catch up
+    fast_runs = 0;
+    fake_millis = 1055;
+    scheduler_run_due_tasks();
+    scheduler_run_due_tasks();
+    UNIT_TEST(fast_runs == 1, "missed periods are skipped, not replayed");
+    UNIT_TEST(scheduler_ms_until_next_deadline() == 10,
+              "after a stall, the next deadline is one period from now");
+
+    //make sure deadlines survive millis() wrapping around
+    init_scheduler();
+    fast_runs = 0;
+    fake_millis = UINT32_MAX - 25;
+    scheduler_add_task(&fast_task, 10);
+    run_until(UINT32_MAX);
+    fake_millis = 0;
+    run_until(25);
+    UNIT_TEST(fast_runs == 6, "10ms task keeps running across millis() wrap");
+
+    printf("%s Test Results: %i tests, %i passed, %i %sfailed%s\n",
+           __FILE__,
+           total_tests,
+           total_tests - failing_tests,
+           failing_tests, failing_tests ? COLOR_RED : COLOR_GREEN, COLOR_NONE);
+}
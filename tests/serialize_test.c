@@ -1,10 +1,36 @@
 #include "serialize.h"
 #include <stdio.h>
+#include <string.h>
 
 //pic18_time.c depends on xc.h, so we can't use its millis function
 //just declare a fake one, we don't really need it for these tests
 uint32_t millis(void) { return 0; }
 
+//create_perf_stats_message uses this, but none of these tests make one
+uint16_t perf_stats_mean_us(const perf_stat_t *stat) { return 0; }
+
+//corrupts each character of frame in turn (other than the header, which says
+//what kind of frame it is) to every other base64 character and to something
+//that isn't base64, and checks that fec_correct_frame puts it back
+static bool fec_fixes_every_single_corruption(const char *frame, uint8_t body_len)
+{
+    uint8_t len = body_len + frame_check_len(RADIO_PROTOCOL_V4);
+    uint8_t i, value;
+    for (i = 1; i < len; ++i) {
+        for (value = 0; value <= 64; ++value) {
+            char corrupt[RADIO_FRAME_MAX_BODY_LEN + FRAME_CHECK_MAX_LEN];
+            memcpy(corrupt, frame, len);
+            corrupt[i] = value < 64 ? binary_to_base64(value) : '~';
+            if (corrupt[i] == frame[i])
+                continue;
+            if (fec_correct_frame(corrupt, body_len, RADIO_PROTOCOL_V4) != FEC_CORRECTED ||
+                memcmp(corrupt, frame, len) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
 #define COLOR_GREEN "\x1B[32m"
 #define COLOR_RED   "\x1B[31m"
 #define COLOR_NONE  "\x1B[0m"
@@ -25,10 +51,13 @@ int main() {
     // test that comparing two identical states returns true
     system_state s = {
         .num_boards_connected = 2,
-        .injector_valve_open = true,
-        .vent_valve_open = false,
-        .running_self_test = false,
+        .injector_valve_state = VALVE_OPEN,
+        .vent_valve_state = VALVE_CLOSED,
+        .tank_pressure = 853,
+        .bus_is_powered = true,
         .any_errors_detected = true,
+        .bus_battery_voltage_mv = 12345,
+        .vent_battery_voltage_mv = 9876,
     };
     system_state p = s;
     UNIT_TEST( compare_system_states(&s, &p), "Compare identical system_state's");
@@ -44,8 +73,127 @@ int main() {
     UNIT_TEST(deserialize_state(&p, serialized_output), "Deserializing vaid output returns true");
     UNIT_TEST(compare_system_states(&s, &p), "Serializing and deserializing results in identical states");
 
+    //test that compare_system_states looks at every field that goes over the radio
+    p = s;
+    p.tank_pressure++;
+    UNIT_TEST(!compare_system_states(&s, &p), "Compare states with different tank pressures");
+    p = s;
+    p.bus_battery_voltage_mv--;
+    UNIT_TEST(!compare_system_states(&s, &p), "Compare states with different bus battery voltages");
+    p = s;
+    p.vent_battery_voltage_mv++;
+    UNIT_TEST(!compare_system_states(&s, &p), "Compare states with different vent battery voltages");
+    p = s;
+    p.bus_is_powered = false;
+    UNIT_TEST(!compare_system_states(&s, &p), "Compare states with different bus power");
+
+    //test that every field survives a round trip at the top of its range
+    system_state max_state = {
+        .num_boards_connected = 15,
+        .injector_valve_state = VALVE_ILLEGAL,
+        .vent_valve_state = VALVE_ILLEGAL,
+        .tank_pressure = 1023,
+        .bus_is_powered = true,
+        .any_errors_detected = true,
+        .bus_battery_voltage_mv = 16383,
+        .vent_battery_voltage_mv = 16383,
+    };
+    serialize_state(&max_state, serialized_output);
+    deserialize_state(&p, serialized_output);
+    UNIT_TEST(compare_system_states(&max_state, &p), "Round trip a state with every field maxed out");
+
+    //test that a signed field comes back negative
+    telem_summary_t summary = {
+        .latest = 512,
+        .rate_per_min = -1234,
+        .min = 3,
+        .max = 65535,
+        .bucket_means = {1, 2, 3, 4, 5, 6, 7, TELEM_NO_DATA},
+    };
+    telem_summary_t expanded;
+    uint8_t quantity = 0;
+    char telemetry_message[TELEMETRY_SUMMARY_MSG_LEN];
+    create_telemetry_summary_message(TELEM_INJ_BATT_MV, &summary, telemetry_message,
+                                     RADIO_PROTOCOL_V2);
+    UNIT_TEST(expand_telemetry_summary_message(&quantity, &expanded, telemetry_message,
+                                               RADIO_PROTOCOL_V2) &&
+              quantity == TELEM_INJ_BATT_MV &&
+              expanded.rate_per_min == -1234 &&
+              expanded.max == 65535 &&
+              expanded.bucket_means[7] == TELEM_NO_DATA,
+              "Round trip a telemetry summary with a negative rate");
+
+    //test that corrupting the summary makes the checksum fail
+    create_telemetry_summary_message(TELEM_INJ_BATT_MV, &summary, telemetry_message,
+                                     RADIO_PROTOCOL_V2);
+    telemetry_message[5]++;
+    UNIT_TEST(!expand_telemetry_summary_message(&quantity, &expanded, telemetry_message,
+                                                RADIO_PROTOCOL_V2),
+              "Expanding a corrupted telemetry summary returns false");
+
+    //board stats round trip, saturating counters that don't fit
+    board_stats_t board_stats = { { 1, 0xFFFFFF, 0x1000000, 0, 65535, 42 } };
+    board_stats_t expanded_stats;
+    uint8_t stats_page = 0;
+    char board_stats_message[BOARD_STATS_MSG_LEN];
+    create_board_stats_message(BOARD_STATS_CAN_INGEST, &board_stats, board_stats_message,
+                               RADIO_PROTOCOL_V4);
+    UNIT_TEST(expand_board_stats_message(&stats_page, &expanded_stats, board_stats_message,
+                                         RADIO_PROTOCOL_V4) &&
+              stats_page == BOARD_STATS_CAN_INGEST &&
+              expanded_stats.counters[0] == 1 &&
+              expanded_stats.counters[1] == 0xFFFFFF &&
+              expanded_stats.counters[2] == BOARD_STATS_COUNTER_MAX &&
+              expanded_stats.counters[4] == 65535 &&
+              expanded_stats.counters[5] == 42,
+              "Round trip board stats, saturating a counter that's too big");
+    create_board_stats_message(BOARD_STATS_CAN_INGEST, &board_stats, board_stats_message,
+                               RADIO_PROTOCOL_V2);
+    board_stats_message[7]++;
+    UNIT_TEST(!expand_board_stats_message(&stats_page, &expanded_stats, board_stats_message,
+                                          RADIO_PROTOCOL_V2),
+              "Expanding corrupted board stats returns false");
+
+
     //test that passing deserialize an empty string causes it to return false
-    UNIT_TEST(deserialize_state(&p, ""), "Deserializing empty string returns false");
+    UNIT_TEST(!deserialize_state(&p, ""), "Deserializing empty string returns false");
+
+    //test that a frame with a character that isn't base64 gets rejected
+    serialize_state(&s, serialized_output);
+    serialized_output[3] = '+';
+    UNIT_TEST(!deserialize_state(&p, serialized_output), "Deserializing a state containing '+' returns false");
+    serialize_state(&s, serialized_output);
+    serialized_output[SERIALIZED_OUTPUT_LEN - 2] = (char) 0xC3;
+    UNIT_TEST(!deserialize_state(&p, serialized_output), "Deserializing a state containing a non-ASCII byte returns false");
+
+    //test that the tables agree with each other for every value and every character
+    bool tables_agree = true;
+    int c;
+    for (c = 0; c < 64; ++c) {
+        if (base64_to_binary(binary_to_base64(c)) != c)
+            tables_agree = false;
+    }
+    int valid_chars = 0;
+    for (c = 0; c < 256; ++c) {
+        uint8_t value = base64_to_binary((char) c);
+        if (value == BASE64_INVALID)
+            continue;
+        valid_chars++;
+        if (binary_to_base64(value) != (char) c)
+            tables_agree = false;
+    }
+    UNIT_TEST(tables_agree && valid_chars == 64, "Encode and decode tables are inverses");
+    UNIT_TEST(binary_to_base64(64) == 0, "Encoding a value bigger than 63 returns 0");
+
+    //test the bulk functions
+    uint8_t bits[4] = {0, 25, 62, 63};
+    char encoded[5] = {0};
+    encode_bits(bits, encoded, 4);
+    uint8_t decoded[4];
+    UNIT_TEST(strcmp(encoded, "AZ&/") == 0 &&
+              decode_bits(encoded, decoded, 4) &&
+              memcmp(bits, decoded, 4) == 0, "Round trip through encode_bits and decode_bits");
+    UNIT_TEST(!decode_bits("AB=D", decoded, 4), "decode_bits rejects '='");
 
     //test that passing a null pointer to serialize_state causes it to return false
     UNIT_TEST(!serialize_state(&s, NULL), "Passing serialize_state a null output pointer");
@@ -55,5 +203,317 @@ int main() {
     UNIT_TEST(!deserialize_state(&p, NULL), "Passing deserialize_state a null input pointer");
     UNIT_TEST(!deserialize_state(NULL, serialized_output), "Passing deserialize_state a null output pointer");
 
+    //test the CRC against the standard check value for CRC-12 with this polynomial
+    const char *crc_check_input = "123456789";
+    uint16_t crc = FRAME_CHECK_INIT;
+    for (c = 0; crc_check_input[c] != '\0'; ++c) {
+        crc = crc12_update(crc, crc_check_input[c]);
+    }
+    UNIT_TEST(crc == 0xF5B, "CRC-12 of \"123456789\" is 0xF5B");
+
+    //test that the table driven Luhn checksum matches the definition in serialize.h
+    bool luhn_matches = true;
+    char one_char[2] = {0};
+    for (c = 1; c < 256; ++c) {
+        uint8_t byte = c, odd_sum = 0, even_sum = 0, bit;
+        for (bit = 0; bit < 4; ++bit) {
+            odd_sum += 0b10 & byte;
+            even_sum += 0b01 & byte;
+            byte >>= 2;
+        }
+        one_char[0] = (char) c;
+        if (checksum(one_char) != binary_to_base64((odd_sum + 3 * even_sum) % 64))
+            luhn_matches = false;
+    }
+    UNIT_TEST(luhn_matches, "Table driven Luhn checksum matches the bit by bit one");
+
+    //test that each protocol version's frame check goes where it should, and
+    //that the other version doesn't accept it
+    char state_command[STATE_COMMAND_LEN];
+    UNIT_TEST(create_state_command(state_command, &s, RADIO_PROTOCOL_V1) &&
+              strlen(state_command) == STATE_COMMAND_BODY_LEN + 1 &&
+              expand_state_command(&p, state_command, RADIO_PROTOCOL_V1) &&
+              compare_system_states(&s, &p),
+              "Round trip a version 1 state command");
+    UNIT_TEST(create_state_command(state_command, &s, RADIO_PROTOCOL_V2) &&
+              strlen(state_command) == STATE_COMMAND_BODY_LEN + 2 &&
+              expand_state_command(&p, state_command, RADIO_PROTOCOL_V2) &&
+              compare_system_states(&s, &p),
+              "Round trip a version 2 state command");
+
+    //acknowledged commands, and their acknowledgements
+    char seq_command[SEQ_COMMAND_LEN];
+    uint8_t seq;
+    UNIT_TEST(create_seq_command(seq_command, 62, &s, RADIO_PROTOCOL_V2) &&
+              expand_seq_command(&seq, &p, seq_command, RADIO_PROTOCOL_V2) &&
+              seq == 62 && compare_system_states(&s, &p),
+              "Round trip an acknowledged state command");
+    seq = COMMAND_SEQ_NONE;
+    seq_command[1] = binary_to_base64(61);
+    UNIT_TEST(!expand_seq_command(&seq, &p, seq_command, RADIO_PROTOCOL_V2) &&
+              seq == COMMAND_SEQ_NONE,
+              "A corrupted acknowledged state command is turned away, header and all");
+    UNIT_TEST(!create_seq_command(seq_command, COMMAND_SEQ_NONE, &s, RADIO_PROTOCOL_V2),
+              "Acknowledged state commands need a real sequence number");
+    command_ack_t ack = {
+        .seq = 17, .last_seq = COMMAND_SEQ_NONE, .accepted = true,
+        .injector_valve_state = VALVE_OPEN, .vent_valve_state = VALVE_CLOSED,
+        .bus_is_powered = true,
+    }, ack_out;
+    char ack_msg[COMMAND_ACK_LEN];
+    UNIT_TEST(create_command_ack(&ack, ack_msg, RADIO_PROTOCOL_V4) &&
+              expand_command_ack(&ack_out, ack_msg, RADIO_PROTOCOL_V4) &&
+              ack_out.seq == 17 && ack_out.last_seq == COMMAND_SEQ_NONE &&
+              ack_out.accepted && ack_out.injector_valve_state == VALVE_OPEN &&
+              ack_out.vent_valve_state == VALVE_CLOSED && ack_out.bus_is_powered,
+              "Round trip a command acknowledgement");
+    ack_msg[2] ^= 0x02;
+    UNIT_TEST(!expand_command_ack(&ack_out, ack_msg, RADIO_PROTOCOL_V4),
+              "A corrupted command acknowledgement is turned away");
+
+    //subscribes
+    char subscribe[SUBSCRIBE_LEN];
+    uint8_t period, acked_seq;
+    UNIT_TEST(create_subscribe(subscribe, 10, 33, RADIO_PROTOCOL_V2) &&
+              expand_subscribe(&period, &acked_seq, subscribe, RADIO_PROTOCOL_V2) &&
+              period == 10 && acked_seq == 33,
+              "Round trip a subscribe");
+    subscribe[1] = binary_to_base64(50);
+    UNIT_TEST(!expand_subscribe(&period, &acked_seq, subscribe, RADIO_PROTOCOL_V2),
+              "A corrupted subscribe is turned away");
+
+    //radio mirror switches
+    char mirror[RADIO_MIRROR_LEN];
+    uint8_t which;
+    UNIT_TEST(create_radio_mirror(mirror, 1, RADIO_PROTOCOL_V1) &&
+              expand_radio_mirror(&which, mirror, RADIO_PROTOCOL_V1) && which == 1,
+              "Round trip a radio mirror switch");
+    mirror[1] = binary_to_base64(0);
+    UNIT_TEST(!expand_radio_mirror(&which, mirror, RADIO_PROTOCOL_V1),
+              "A corrupted radio mirror switch is turned away");
+
+    //corrupt one or two characters of a GPS message in every way (well, a
+    //lot of ways for two), and count how many times each frame check misses
+    //it. A single corrupted character is a burst of at most 8 bits, which
+    //the CRC always catches
+    char gps[GPS_MSG_LEN];
+    char corrupt_command[STATE_COMMAND_LEN];
+    char luhn_check;
+    create_gps_message(49, 15, 77, 'N', 123, 6, 12, 'W', gps, RADIO_PROTOCOL_V1);
+    luhn_check = gps[GPS_MSG_BODY_LEN];
+    create_gps_message(49, 15, 77, 'N', 123, 6, 12, 'W', gps, RADIO_PROTOCOL_V2);
+    int missed_crc_single = 0, missed_crc = 0, missed_luhn = 0;
+    int i, j, di, dj;
+    for (i = 1; i < GPS_MSG_BODY_LEN; ++i) {
+        for (j = i; j < GPS_MSG_BODY_LEN; ++j) {
+            for (di = 1; di < 64; ++di) {
+                for (dj = (i == j) ? 0 : 1; dj < ((i == j) ? 1 : 64); dj += 7) {
+                    char corrupt[GPS_MSG_LEN];
+                    memcpy(corrupt, gps, GPS_MSG_LEN);
+                    corrupt[i] = binary_to_base64((base64_to_binary(gps[i]) + di) % 64);
+                    if (j != i)
+                        corrupt[j] = binary_to_base64((base64_to_binary(gps[j]) + dj) % 64);
+                    if (frame_check_ok(corrupt, GPS_MSG_BODY_LEN, RADIO_PROTOCOL_V2)) {
+                        if (i == j)
+                            missed_crc_single++;
+                        missed_crc++;
+                    }
+                    corrupt[GPS_MSG_BODY_LEN] = luhn_check;
+                    if (frame_check_ok(corrupt, GPS_MSG_BODY_LEN, RADIO_PROTOCOL_V1))
+                        missed_luhn++;
+                }
+            }
+        }
+    }
+    printf("corrupted GPS messages missed: %d by CRC-12, %d by Luhn\n", missed_crc, missed_luhn);
+    UNIT_TEST(missed_crc_single == 0, "CRC-12 catches every single character corruption");
+    UNIT_TEST(missed_crc * 50 < missed_luhn, "CRC-12 misses far fewer corruptions than Luhn");
+
+    //a keyframe has everything in it, and a delta only what changed
+    char delta[STATE_DELTA_MAX_LEN];
+    system_state held;
+    uint8_t held_seq = STATE_DELTA_NO_SNAPSHOT;
+    uint8_t delta_len = create_state_delta(&s, 5, NULL, 0, delta, RADIO_PROTOCOL_V2);
+    memset(&held, 0, sizeof(held));
+    UNIT_TEST(delta_len == STATE_DELTA_MAX_BODY_LEN &&
+              state_delta_body_len(delta) == delta_len &&
+              expand_state_delta(&held, &held_seq, delta, RADIO_PROTOCOL_V2) &&
+              held_seq == 5 && compare_system_states(&s, &held),
+              "Round trip a delta state keyframe");
+    p = s;
+    p.tank_pressure = 900;
+    delta_len = create_state_delta(&p, 6, &s, 5, delta, RADIO_PROTOCOL_V2);
+    UNIT_TEST(delta_len == 1 + (STATE_DELTA_PREFIX_BITS + 10 + 5) / 6 &&
+              state_delta_body_len(delta) == delta_len &&
+              expand_state_delta(&held, &held_seq, delta, RADIO_PROTOCOL_V2) &&
+              held_seq == 6 && compare_system_states(&p, &held),
+              "A delta with only tank pressure in it applies to the frame before");
+    UNIT_TEST(!expand_state_delta(&held, &held_seq, delta, RADIO_PROTOCOL_V2) &&
+              held_seq == 6,
+              "A delta relative to a frame we don't have is refused");
+    delta_len = create_state_delta(&p, 7, &p, 6, delta, RADIO_PROTOCOL_V2);
+    delta[3] = binary_to_base64((base64_to_binary(delta[3]) + 1) % 64);
+    UNIT_TEST(delta_len == STATE_DELTA_PREFIX_LEN &&
+              !expand_state_delta(&held, &held_seq, delta, RADIO_PROTOCOL_V2) &&
+              held_seq == 6,
+              "A corrupted delta is refused");
+
+    //a bundle holds a delta state and records, and the longest one, with
+    //nothing but errors in it, is BUNDLE_MAX_BODY_LEN long
+    char bundle[BUNDLE_MAX_LEN];
+    bundle_records_t records, expanded_records;
+    bool state_applied;
+    memset(&records, 0, sizeof(records));
+    records.has_gps = true;
+    records.gps = (gps_position_t) { 49, 15, 77, 'N', 123, 6, 12, 'W' };
+    records.num_errors = BUNDLE_MAX_RECORDS - 1;
+    records.errors[0] = (error_report_t) { { 3, E_BATT_UNDER_VOLTAGE, 1, 2, 3, 4 }, 1, 0 };
+    records.errors[1] = (error_report_t) { { 12, E_BOARD_FEARED_DEAD, 5, 6, 7, 8 },
+                                           ERROR_REPEAT_MAX, 17 };
+    held_seq = STATE_DELTA_NO_SNAPSHOT;
+    memset(&held, 0, sizeof(held));
+    uint8_t bundle_len = create_bundle(&s, 9, NULL, 0, &records, bundle, RADIO_PROTOCOL_V2);
+    UNIT_TEST(bundle_body_len(bundle) == bundle_len &&
+              expand_bundle(&held, &held_seq, &state_applied, &expanded_records,
+                            bundle, RADIO_PROTOCOL_V2) &&
+              state_applied && held_seq == 9 && compare_system_states(&s, &held) &&
+              expanded_records.has_gps &&
+              memcmp(&expanded_records.gps, &records.gps, sizeof(records.gps)) == 0 &&
+              expanded_records.num_errors == 2 &&
+              expanded_records.errors[1].err.board_id == 12 &&
+              expanded_records.errors[1].err.err_type == E_BOARD_FEARED_DEAD &&
+              expanded_records.errors[1].err.byte7 == 8 &&
+              expanded_records.errors[1].count == ERROR_REPEAT_MAX &&
+              expanded_records.errors[1].age_s == 17,
+              "Round trip a bundle with a keyframe, a GPS position and errors");
+    records.num_errors = BUNDLE_MAX_RECORDS;
+    UNIT_TEST(create_bundle(&s, 10, &s, 9, &records, bundle, RADIO_PROTOCOL_V2) == 0,
+              "A bundle with too many records isn't made");
+    records.has_gps = false;
+    records.errors[2] = records.errors[0];
+    bundle_len = create_bundle(&s, 10, &s, 8, &records, bundle, RADIO_PROTOCOL_V2);
+    UNIT_TEST(bundle_len == bundle_body_len(bundle) &&
+              expand_bundle(&held, &held_seq, &state_applied, &expanded_records,
+                            bundle, RADIO_PROTOCOL_V2) &&
+              !state_applied && held_seq == 9 && !expanded_records.has_gps &&
+              expanded_records.num_errors == BUNDLE_MAX_RECORDS &&
+              expanded_records.errors[2].err.byte4 == 1,
+              "A bundle relative to a frame we don't have still has its records");
+    UNIT_TEST(create_bundle(&s, 11, NULL, 0, &records, bundle, RADIO_PROTOCOL_V2) ==
+              BUNDLE_MAX_BODY_LEN,
+              "A keyframe bundle full of errors is as long as bundles get");
+    bundle[2] = binary_to_base64((base64_to_binary(bundle[2]) + 1) % 64);
+    UNIT_TEST(!expand_bundle(&held, &held_seq, &state_applied, &expanded_records,
+                             bundle, RADIO_PROTOCOL_V2),
+              "A corrupted bundle is refused");
+
+    //error reports
+    char report_msg[ERROR_REPORT_LEN];
+    error_report_t expanded_report;
+    uint8_t version;
+    for (version = RADIO_PROTOCOL_V1; version <= RADIO_PROTOCOL_LATEST; ++version) {
+        memset(&expanded_report, 0, sizeof(expanded_report));
+        UNIT_TEST(create_error_report(&records.errors[1], report_msg, version) &&
+                  report_msg[0] == ERROR_REPORT_HEADER &&
+                  expand_error_report(&expanded_report, report_msg, version) &&
+                  memcmp(&expanded_report.err, &records.errors[1].err,
+                         sizeof(expanded_report.err)) == 0 &&
+                  expanded_report.count == ERROR_REPEAT_MAX && expanded_report.age_s == 17,
+                  "Round trip an error report");
+    }
+    create_error_report(&records.errors[1], report_msg, RADIO_PROTOCOL_V2);
+    report_msg[ERROR_REPORT_BODY_LEN - 1] =
+        report_msg[ERROR_REPORT_BODY_LEN - 1] == 'A' ? 'B' : 'A';
+    UNIT_TEST(!expand_error_report(&expanded_report, report_msg, RADIO_PROTOCOL_V2),
+              "A corrupted error report is refused");
+
+    //binary frames round trip, and only have a 0x00 on the end
+    uint8_t binary[BINARY_FRAME_MAX_LEN];
+    char body[RADIO_FRAME_MAX_BODY_LEN + 1];
+    uint8_t binary_len, body_len;
+    create_state_command(state_command, &s, RADIO_PROTOCOL_V3);
+    binary_len = frame_to_binary(state_command, STATE_COMMAND_BODY_LEN, binary);
+    body_len = binary_to_frame(binary, binary_len - 1, body);
+    UNIT_TEST(binary_len > 0 && binary[binary_len - 1] == 0 &&
+              memchr(binary, 0, binary_len - 1) == NULL &&
+              body_len >= STATE_COMMAND_BODY_LEN &&
+              expand_state_command(&p, body, RADIO_PROTOCOL_V3) &&
+              compare_system_states(&s, &p),
+              "Round trip a binary state command");
+
+    //the longest frame is where binary saves the most
+    create_telemetry_summary_message(TELEM_INJ_BATT_MV, &summary, telemetry_message,
+                                     RADIO_PROTOCOL_V3);
+    binary_len = frame_to_binary(telemetry_message, TELEMETRY_SUMMARY_MSG_BODY_LEN, binary);
+    printf("telemetry summary: %d bytes in version 2, %d in binary\n",
+           TELEMETRY_SUMMARY_MSG_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V2), binary_len);
+    UNIT_TEST(binary_len > 0 && binary_len <= BINARY_FRAME_MAX_LEN &&
+              binary_len < TELEMETRY_SUMMARY_MSG_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V2),
+              "Binary telemetry summary is shorter than version 2");
+
+    //flip every bit of a binary frame in turn, none of which should get through
+    int missed_binary = 0;
+    for (i = 0; i < binary_len - 1; ++i) {
+        for (j = 0; j < 8; ++j) {
+            uint8_t corrupt[BINARY_FRAME_MAX_LEN];
+            memcpy(corrupt, binary, binary_len);
+            corrupt[i] ^= 1 << j;
+            if (binary_to_frame(corrupt, binary_len - 1, body) != 0)
+                missed_binary++;
+        }
+    }
+    UNIT_TEST(missed_binary == 0, "Binary frames with a flipped bit are rejected");
+    UNIT_TEST(frame_to_binary("{!", 2, binary) == 0,
+              "Frames that aren't base64 aren't converted to binary");
+
+    //version 4 fixes any one wrong character
+    create_state_command(state_command, &s, RADIO_PROTOCOL_V4);
+    memcpy(corrupt_command, state_command, STATE_COMMAND_LEN);
+    UNIT_TEST(fec_correct_frame(corrupt_command, STATE_COMMAND_BODY_LEN, RADIO_PROTOCOL_V4) == FEC_CLEAN &&
+              memcmp(corrupt_command, state_command, STATE_COMMAND_LEN) == 0 &&
+              expand_state_command(&p, corrupt_command, RADIO_PROTOCOL_V4) &&
+              compare_system_states(&s, &p),
+              "A clean version 4 state command needs no fixing");
+    UNIT_TEST(fec_fixes_every_single_corruption(state_command, STATE_COMMAND_BODY_LEN),
+              "FEC fixes every single character corruption of a state command");
+    create_gps_message(49, 15, 77, 'N', 123, 6, 12, 'W', gps, RADIO_PROTOCOL_V4);
+    UNIT_TEST(fec_fixes_every_single_corruption(gps, GPS_MSG_BODY_LEN),
+              "FEC fixes every single character corruption of a GPS message");
+    delta_len = create_state_delta(&p, 8, &s, 7, delta, RADIO_PROTOCOL_V4);
+    UNIT_TEST(fec_fixes_every_single_corruption(delta, delta_len),
+              "FEC fixes every single character corruption of a delta state");
+    create_state_command(corrupt_command, &s, RADIO_PROTOCOL_V2);
+    corrupt_command[2] ^= 1;
+    UNIT_TEST(fec_correct_frame(corrupt_command, STATE_COMMAND_BODY_LEN, RADIO_PROTOCOL_V2) == FEC_CLEAN &&
+              !frame_check_ok(corrupt_command, STATE_COMMAND_BODY_LEN, RADIO_PROTOCOL_V2),
+              "Versions without FEC leave corrupted frames alone");
+
+    //two wrong characters are too many to fix. Make sure they're (almost
+    //always) caught rather than "fixed" into some other frame
+    int fec_refused = 0, fec_miscorrected = 0, fec_tried = 0;
+    uint8_t gps_len = GPS_MSG_BODY_LEN + frame_check_len(RADIO_PROTOCOL_V4);
+    for (i = 1; i < gps_len; ++i) {
+        for (j = i + 1; j < gps_len; ++j) {
+            for (di = 1; di < 64; di += 5) {
+                for (dj = 1; dj < 64; dj += 11) {
+                    char corrupt[GPS_MSG_LEN];
+                    memcpy(corrupt, gps, gps_len);
+                    corrupt[i] = binary_to_base64((base64_to_binary(gps[i]) + di) % 64);
+                    corrupt[j] = binary_to_base64((base64_to_binary(gps[j]) + dj) % 64);
+                    fec_tried++;
+                    if (fec_correct_frame(corrupt, GPS_MSG_BODY_LEN, RADIO_PROTOCOL_V4) ==
+                        FEC_UNCORRECTABLE)
+                        fec_refused++;
+                    else if (frame_check_ok(corrupt, GPS_MSG_BODY_LEN, RADIO_PROTOCOL_V4))
+                        fec_miscorrected++;
+                }
+            }
+        }
+    }
+    printf("two character corruptions: %d tried, %d uncorrectable, %d fixed into the wrong frame\n",
+           fec_tried, fec_refused, fec_miscorrected);
+    UNIT_TEST(fec_refused == fec_tried - fec_miscorrected && fec_miscorrected * 1000 < fec_tried,
+              "FEC refuses nearly all two character corruptions");
+
     printf("%s Test Results: %i tests, %i passed, %i %sfailed%s\n", __FILE__, total_tests, total_tests - failing_tests, failing_tests, failing_tests ? COLOR_RED : COLOR_GREEN, COLOR_NONE);
 }
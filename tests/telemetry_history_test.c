@@ -0,0 +1,128 @@
+#include "telemetry_history.h"
+#include "serialize.h"
+#include <stdio.h>
+
+//serialize.o needs this for perf stats messages, which we don't test here
+uint16_t perf_stats_mean_us(const perf_stat_t *stat) { return 0; }
+
+#define COLOR_GREEN "\x1B[32m"
+#define COLOR_RED   "\x1B[31m"
+#define COLOR_NONE  "\x1B[0m"
+
+static int total_tests = 0;
+static int failing_tests = 0;
+#define UNIT_TEST(expected_result, description)                                 \
+    if( (expected_result) ) {                                                   \
+        printf("%sTest Passed:%s %s\n", COLOR_GREEN, COLOR_NONE, description);  \
+    } else {                                                                    \
+        printf("%sTest Failed:%s %s\n", COLOR_RED, COLOR_NONE, description);    \
+        failing_tests++;                                                        \
+    }                                                                           \
+    total_tests++;
+
+//one heartbeat's worth of time, with a sample arriving each time
+static void tick(uint8_t quantity, uint16_t value)
+{
+    telemetry_record(quantity, value);
+    telemetry_history_heartbeat();
+}
+
+int main() {
+    telem_summary_t summary;
+    telem_bucket_t buckets[TELEM_NUM_BUCKETS];
+    uint16_t i;
+
+    init_telemetry_history();
+    UNIT_TEST(!telemetry_get_summary(TELEM_TANK_PRESSURE, &summary),
+              "no summary before anything is recorded");
+    UNIT_TEST(!telemetry_get_summary(TELEM_NUM_QUANTITIES, &summary),
+              "no summary for quantities that don't exist");
+
+    //a steady fill: +1 psi every raw sample is 240 psi per minute
+    for (i = 0; i < TELEM_RAW_LEN - 1; ++i) {
+        tick(TELEM_TANK_PRESSURE, 100 + i);
+    }
+    UNIT_TEST(telemetry_rate_per_min(TELEM_TANK_PRESSURE) == 0,
+              "no rate until the raw tier is full");
+    tick(TELEM_TANK_PRESSURE, 100 + i);
+    UNIT_TEST(telemetry_rate_per_min(TELEM_TANK_PRESSURE) == 240,
+              "rate of a steady ramp once the raw tier fills");
+    //keep going well past the raw tier, the running sums have to keep up
+    for (++i; i < 200; ++i) {
+        tick(TELEM_TANK_PRESSURE, 100 + i);
+    }
+    UNIT_TEST(telemetry_rate_per_min(TELEM_TANK_PRESSURE) == 240,
+              "rate stays right as samples slide through the raw tier");
+
+    //now hold steady, and the rate should go to 0 once the ramp has left
+    for (i = 0; i < TELEM_RAW_LEN; ++i) {
+        tick(TELEM_TANK_PRESSURE, 500);
+    }
+    UNIT_TEST(telemetry_rate_per_min(TELEM_TANK_PRESSURE) == 0,
+              "rate of a flat line is 0");
+    for (i = 0; i < TELEM_RAW_LEN; ++i) {
+        tick(TELEM_TANK_PRESSURE, 500 - i * 2);
+    }
+    UNIT_TEST(telemetry_rate_per_min(TELEM_TANK_PRESSURE) == -480,
+              "negative rates work too");
+
+    //buckets: start again, and fill exactly two buckets
+    init_telemetry_history();
+    uint16_t ticks_per_bucket = TELEM_BUCKET_PERIOD_MS / TELEM_RAW_PERIOD_MS;
+    for (i = 0; i < ticks_per_bucket; ++i) {
+        tick(TELEM_INJ_BATT_MV, 12000 + (i % 2) * 100);
+    }
+    for (i = 0; i < ticks_per_bucket; ++i) {
+        //nothing arrives during the second bucket
+        telemetry_history_heartbeat();
+    }
+    UNIT_TEST(telemetry_get_buckets(TELEM_INJ_BATT_MV, buckets, TELEM_NUM_BUCKETS) == 2,
+              "two buckets closed");
+    UNIT_TEST(buckets[0].mean == TELEM_NO_DATA,
+              "newest bucket had no samples");
+    UNIT_TEST(buckets[1].min == 12000 && buckets[1].max == 12100 &&
+              buckets[1].mean == 12050,
+              "older bucket has min, max and mean");
+
+    //bucket tier wraps, keeping the newest
+    for (i = 0; i < ticks_per_bucket * TELEM_NUM_BUCKETS; ++i) {
+        tick(TELEM_INJ_BATT_MV, 11000 + i / ticks_per_bucket);
+    }
+    UNIT_TEST(telemetry_get_buckets(TELEM_INJ_BATT_MV, buckets, TELEM_NUM_BUCKETS) ==
+              TELEM_NUM_BUCKETS &&
+              buckets[0].mean == 11000 + TELEM_NUM_BUCKETS - 1 &&
+              buckets[TELEM_NUM_BUCKETS - 1].mean == 11000,
+              "bucket tier keeps the newest buckets when it wraps");
+
+    tick(TELEM_INJ_BATT_MV, 10500);
+    UNIT_TEST(telemetry_get_summary(TELEM_INJ_BATT_MV, &summary),
+              "summary of a recorded quantity");
+    UNIT_TEST(summary.latest == 10500 && summary.bucket_means[0] == 10500 &&
+              summary.bucket_means[1] == 11000 + TELEM_NUM_BUCKETS - 1,
+              "summary starts with the bucket that's filling up");
+    UNIT_TEST(summary.min == 10500 && summary.max == 11000 + TELEM_NUM_BUCKETS - 1,
+              "summary min and max cover every bucket");
+
+    //the radio message has the header, and a checksum that matches
+    char msg[TELEMETRY_SUMMARY_MSG_LEN];
+    UNIT_TEST(create_telemetry_summary_message(TELEM_INJ_BATT_MV, &summary, msg,
+                                               RADIO_PROTOCOL_V1),
+              "create telemetry summary message");
+    char received_checksum = msg[TELEMETRY_SUMMARY_MSG_BODY_LEN];
+    msg[TELEMETRY_SUMMARY_MSG_BODY_LEN] = '\0';
+    UNIT_TEST(msg[0] == TELEMETRY_REQUEST_HEADER &&
+              base64_to_binary(msg[1]) == TELEM_INJ_BATT_MV &&
+              checksum(msg) == received_checksum,
+              "telemetry summary message has header, quantity and checksum");
+    //latest is the 16 bits right after the quantity
+    uint16_t latest = ((uint16_t) base64_to_binary(msg[2]) << 10) |
+                      ((uint16_t) base64_to_binary(msg[3]) << 4) |
+                      (base64_to_binary(msg[4]) >> 2);
+    UNIT_TEST(latest == 10500, "latest value survives packing");
+
+    printf("%s Test Results: %i tests, %i passed, %i %sfailed%s\n",
+           __FILE__,
+           total_tests,
+           total_tests - failing_tests,
+           failing_tests, failing_tests ? COLOR_RED : COLOR_GREEN, COLOR_NONE);
+}
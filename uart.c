@@ -3,19 +3,18 @@
 #include "uart.h"
 #include "safe_ring_buffer.h"
 #include "error.h"
-#include "message_types.h"
-
-//needed for sending all data out over CAN as well as UART
-#include "can.h"
-#include "can_common.h"
-#include "can_tx_buffer.h"
+#include "radio_mirror.h"
 
 //safe ring buffers for sending and receiving
 static srb_ctx_t rx_buffer;
 static srb_ctx_t tx_buffer;
 
 //memory pools to use for those srbs. 100 is a completely arbitrary number
-uint8_t rx_buffer_pool[100], tx_buffer_pool[100];
+uint8_t rx_buffer_pool[100], tx_buffer_pool[UART_TX_BUFFER_LEN];
+
+//how many bytes are in tx_buffer. A uint8_t, so that the increments and
+//decrements on either side of the interrupt are single instructions
+static volatile uint8_t tx_pending = 0;
 
 void init_uart(void)
 {
@@ -66,31 +65,21 @@ void init_uart(void)
 
 void uart_transmit_byte(uint8_t tx)
 {
+    //everything that goes over the radio goes over CAN too, see radio_mirror.h
+    radio_mirror_append(tx);
+
     //push this byte to ensure ordering
     srb_push(&tx_buffer, &tx);
-    //If the module isn't enabled, give it a byte to send and enable it
+    tx_pending++;
+    //If the module is idle, give it a byte to send. TXEN stays on from
+    //init_uart, so it starts shifting that out straight away
     if (PIE3bits.U1TXIE == 0) {
         srb_pop(&tx_buffer, &tx);
+        tx_pending--;
         U1TXB = tx;
-        U1CON0bits.TXEN = 1;
-        //also enable the interrupt for when it's ready to send more data
+        //enable the interrupt for when it's ready to send more data
         PIE3bits.U1TXIE = 1;
     }
-
-    //we want to send all of the bytes that we're sending over radio over
-    //CAN as well. To do so we buffer these bytes until we have 8 of them,
-    //then we send them all at once. Yes this means that a byte could be
-    //not delivered for a while, but it's fine, since this is only for debug,
-    //and we don't really care about latency
-    static char debug_printf_data[9];
-    static uint8_t debug_printf_data_len = 0;
-    debug_printf_data[debug_printf_data_len++] = (char) tx;
-    if (debug_printf_data_len == 8) {
-        debug_printf_data[8] = '\0';
-        can_msg_t to_send;
-        build_printf_can_message(debug_printf_data, &to_send);
-        txb_enqueue(&to_send);
-    }
 }
 
 void uart_transmit_buffer(uint8_t *tx, uint8_t len)
@@ -100,10 +89,11 @@ void uart_transmit_buffer(uint8_t *tx, uint8_t len)
         uart_transmit_byte(*tx);
         tx++;
     }
-    //for some reason the last byte of uart_transmit_byte isn't being
-    //sent until the next byte is queued. No idea why this happens, but
-    //hacky fix for now is to just transmit a nothing byte after each buffer
-    uart_transmit_byte(' ');
+}
+
+uint8_t uart_transmit_pending(void)
+{
+    return tx_pending;
 }
 
 bool uart_byte_available(void)
@@ -120,20 +110,23 @@ uint8_t uart_read_byte(void)
 
 void uart_interrupt_handler(void)
 {
-    if (PIR3bits.U1TXIF) {
+    //TXIF stays set for as long as the transmit buffer is empty, so it's only
+    //ours to handle while the interrupt is enabled
+    if (PIE3bits.U1TXIE && PIR3bits.U1TXIF) {
         //check if there are any bytes we still want to transmit
         if (!srb_is_empty(&tx_buffer)) {
             //if so, transmit them
             uint8_t tx;
             srb_pop(&tx_buffer, &tx);
+            tx_pending--;
             U1TXB = tx;
         } else {
-            // If we have no data to send, disable this interrupt
+            //If we have no data to send, disable this interrupt so that
+            //the next call to uart_transmit_byte starts things up again.
+            //Leave TXEN alone: clearing it here used to abort the last byte
+            //while it was still in the shift register, so it only went out
+            //once the next byte was queued
             PIE3bits.U1TXIE = 0;
-            //if not, disable the TX part of the uart module so that TXIF
-            //isn't triggered again and so that we reenable the module on
-            //the next call to uart_transmit_byte
-            U1CON0bits.TXEN = 0;
         }
         PIR3bits.U1TXIF = 0;
     } else if (PIR3bits.U1RXIF) {
@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// how many bytes uart_transmit_byte can have waiting to go out
+#define UART_TX_BUFFER_LEN 100
+
 /*
  * Initialize UART module. Set up rx and tx buffers, set up module,
  * and enable the requisite interrupts
@@ -29,6 +32,12 @@ void uart_transmit_byte(uint8_t tx);
  */
 void uart_transmit_buffer(uint8_t *tx, uint8_t len);
 
+/*
+ * returns how many bytes passed to uart_transmit_byte are still waiting to go
+ * out, not counting one that the UART module is in the middle of sending
+ */
+uint8_t uart_transmit_pending(void);
+
 /*
  * returns true if there's a byte waiting to be read from the UART module
  */